@@ -0,0 +1,352 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+/* The 'alsa' audio backend: plays directly to an ALSA PCM device, for
+ * single-client setups where JACK's extra context switch isn't wanted.
+ * The plugins' outputs go to the device's channels in order; audio
+ * inputs are silent, since this backend is playback-only. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <alsa/asoundlib.h>
+
+#include "ghostess.h"
+#include "audio.h"
+
+static char                    *alsa_name = NULL;
+static char                    *alsa_device = NULL;
+static snd_pcm_t               *alsa_pcm = NULL;
+static snd_pcm_format_t         alsa_format;
+static unsigned int             alsa_rate;
+static unsigned int             alsa_channels;
+static void                    *alsa_buffer = NULL;   /* interleaved, in alsa_format */
+static audio_process_callback_t alsa_callback = NULL;
+static void                    *alsa_callback_arg = NULL;
+static audio_clock_t            alsa_clock;
+static jack_nframes_t           alsa_frame = 0;
+static pthread_t                alsa_thread;
+static volatile int             alsa_running = 0;
+static audio_port_t           **alsa_ports = NULL;
+static int                      alsa_port_count = 0;
+static unsigned long            alsa_xruns = 0;
+
+static int
+alsa_pcm_open(const char *client_name, const char *device, const char *session_uuid)
+{
+    snd_pcm_hw_params_t *hw_params;
+    int rc;
+
+    alsa_device = strdup(device ? device : "default");
+    if ((rc = snd_pcm_open(&alsa_pcm, alsa_device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+        ghss_debug(GDB_ERROR, ": could not open ALSA PCM device '%s': %s",
+                   alsa_device, snd_strerror(rc));
+        return 0;
+    }
+
+    /* The rate has to be known before the plugins are instantiated, but
+     * the channel count isn't known until their ports are registered, so
+     * just find the rate now, and set everything up in activate(). */
+    snd_pcm_hw_params_alloca(&hw_params);
+    snd_pcm_hw_params_any(alsa_pcm, hw_params);
+    alsa_rate = audio_sample_rate;
+    if ((rc = snd_pcm_hw_params_set_rate_near(alsa_pcm, hw_params, &alsa_rate, NULL)) < 0) {
+        ghss_debug(GDB_ERROR, ": could not set ALSA PCM sample rate: %s", snd_strerror(rc));
+        snd_pcm_close(alsa_pcm);
+        alsa_pcm = NULL;
+        return 0;
+    }
+
+    alsa_name = strdup(client_name);
+    ghss_debug(GDB_MAIN, ": ALSA PCM audio backend, device '%s', %u Hz, %u frames per period",
+               alsa_device, alsa_rate, audio_period_size);
+    return 1;
+}
+
+static const char *
+alsa_client_name(void)
+{
+    return alsa_name;
+}
+
+static float
+alsa_sample_rate(void)
+{
+    return (float)alsa_rate;
+}
+
+static jack_nframes_t
+alsa_buffer_size(void)
+{
+    return audio_period_size;
+}
+
+static audio_port_t *
+alsa_port_register(const char *name, int is_output)
+{
+    audio_port_t *port, **ports;
+
+    ports = (audio_port_t **)realloc(alsa_ports, (alsa_port_count + 1) * sizeof(audio_port_t *));
+    if (!ports)
+        return NULL;
+    alsa_ports = ports;
+    port = audio_buffer_port_new(audio_period_size, is_output);
+    if (port)
+        alsa_ports[alsa_port_count++] = port;
+    return port;
+}
+
+static float *
+alsa_port_get_buffer(audio_port_t *port, jack_nframes_t nframes)
+{
+    return port->buffer;
+}
+
+static void
+alsa_set_process_callback(audio_process_callback_t callback, void *arg)
+{
+    alsa_callback = callback;
+    alsa_callback_arg = arg;
+}
+
+static inline float
+alsa_clip(float sample)
+{
+    return sample > 1.0f ? 1.0f : (sample < -1.0f ? -1.0f : sample);
+}
+
+/* interleave the output ports into alsa_buffer, converting the format */
+static void
+alsa_interleave(jack_nframes_t nframes)
+{
+    unsigned int channel = 0;
+    jack_nframes_t n;
+    float *in;
+    int i;
+
+    memset(alsa_buffer, 0, nframes * alsa_channels * snd_pcm_format_physical_width(alsa_format) / 8);
+
+    for (i = 0; i < alsa_port_count && channel < alsa_channels; i++) {
+        if (!alsa_ports[i]->is_output)
+            continue;
+        in = alsa_ports[i]->buffer;
+        if (alsa_format == SND_PCM_FORMAT_FLOAT) {
+            float *out = (float *)alsa_buffer + channel;
+            for (n = 0; n < nframes; n++, out += alsa_channels)
+                *out = in[n];
+        } else if (alsa_format == SND_PCM_FORMAT_S32) {
+            int32_t *out = (int32_t *)alsa_buffer + channel;
+            for (n = 0; n < nframes; n++, out += alsa_channels)
+                *out = (int32_t)(alsa_clip(in[n]) * 2147483647.0);
+        } else {
+            int16_t *out = (int16_t *)alsa_buffer + channel;
+            for (n = 0; n < nframes; n++, out += alsa_channels)
+                *out = (int16_t)(alsa_clip(in[n]) * 32767.0f);
+        }
+        channel++;
+    }
+}
+
+static void *
+alsa_process_thread(void *arg)
+{
+    int frame_bytes = alsa_channels * snd_pcm_format_physical_width(alsa_format) / 8;
+    snd_pcm_sframes_t written;
+    jack_nframes_t done;
+
+    while (alsa_running) {
+
+        audio_clock_start_cycle(&alsa_clock, alsa_frame);
+        if (alsa_callback)
+            alsa_callback(audio_period_size, alsa_callback_arg);
+        alsa_interleave(audio_period_size);
+
+        /* snd_pcm_writei() blocks until there's room, which paces us */
+        for (done = 0; done < audio_period_size && alsa_running; ) {
+            written = snd_pcm_writei(alsa_pcm, (char *)alsa_buffer + done * frame_bytes,
+                                     audio_period_size - done);
+            if (written < 0) {
+                alsa_xruns++;
+                ghss_debug_rt(GDB_MAIN, " alsa_process_thread: %s", snd_strerror(written));
+                if (snd_pcm_recover(alsa_pcm, written, 1) < 0) {
+                    ghss_debug(GDB_ERROR, " alsa_process_thread: could not recover, stopping");
+                    alsa_running = 0;
+                }
+                continue;
+            }
+            done += written;
+        }
+        alsa_frame += audio_period_size;
+    }
+
+    return NULL;
+}
+
+static int
+alsa_activate(void)
+{
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_uframes_t period = audio_period_size;
+    unsigned int rate = alsa_rate, periods = 2;
+    int i, rc;
+
+    for (i = 0, alsa_channels = 0; i < alsa_port_count; i++)
+        if (alsa_ports[i]->is_output)
+            alsa_channels++;
+    if (alsa_channels == 0)
+        alsa_channels = 1;
+
+    snd_pcm_hw_params_alloca(&hw_params);
+    snd_pcm_hw_params_any(alsa_pcm, hw_params);
+    if ((rc = snd_pcm_hw_params_set_access(alsa_pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+        goto error;
+    alsa_format = SND_PCM_FORMAT_FLOAT;
+    if (snd_pcm_hw_params_set_format(alsa_pcm, hw_params, alsa_format) < 0) {
+        alsa_format = SND_PCM_FORMAT_S32;
+        if (snd_pcm_hw_params_set_format(alsa_pcm, hw_params, alsa_format) < 0) {
+            alsa_format = SND_PCM_FORMAT_S16;
+            if ((rc = snd_pcm_hw_params_set_format(alsa_pcm, hw_params, alsa_format)) < 0)
+                goto error;
+        }
+    }
+    if ((rc = snd_pcm_hw_params_set_channels_near(alsa_pcm, hw_params, &alsa_channels)) < 0 ||
+        (rc = snd_pcm_hw_params_set_rate_near(alsa_pcm, hw_params, &rate, NULL)) < 0 ||
+        (rc = snd_pcm_hw_params_set_period_size_near(alsa_pcm, hw_params, &period, NULL)) < 0 ||
+        (rc = snd_pcm_hw_params_set_periods_near(alsa_pcm, hw_params, &periods, NULL)) < 0 ||
+        (rc = snd_pcm_hw_params(alsa_pcm, hw_params)) < 0)
+        goto error;
+    if (rate != alsa_rate) {
+        ghss_debug(GDB_ERROR, ": ALSA PCM device '%s' changed its rate from %u to %u Hz",
+                   alsa_device, alsa_rate, rate);
+        return 0;
+    }
+    if (period != audio_period_size)
+        ghss_debug(GDB_MAIN, ": ALSA PCM device period is %lu frames, ghostess's is %u",
+                   (unsigned long)period, audio_period_size);
+
+    snd_pcm_sw_params_alloca(&sw_params);
+    snd_pcm_sw_params_current(alsa_pcm, sw_params);
+    snd_pcm_sw_params_set_start_threshold(alsa_pcm, sw_params, period * periods);
+    snd_pcm_sw_params_set_avail_min(alsa_pcm, sw_params, period);
+    if ((rc = snd_pcm_sw_params(alsa_pcm, sw_params)) < 0 ||
+        (rc = snd_pcm_prepare(alsa_pcm)) < 0)
+        goto error;
+
+    alsa_buffer = malloc(audio_period_size * alsa_channels *
+                         snd_pcm_format_physical_width(alsa_format) / 8);
+    if (!alsa_buffer)
+        return 0;
+
+    ghss_debug(GDB_MAIN, ": ALSA PCM device '%s' running %u channels of %s",
+               alsa_device, alsa_channels, snd_pcm_format_name(alsa_format));
+
+    audio_clock_start_cycle(&alsa_clock, alsa_frame);
+    alsa_running = 1;
+    if (audio_create_rt_thread(&alsa_thread, alsa_process_thread, NULL)) {
+        ghss_debug(GDB_ERROR, ": could not create ALSA PCM audio thread");
+        alsa_running = 0;
+        return 0;
+    }
+    return 1;
+
+  error:
+    ghss_debug(GDB_ERROR, ": could not configure ALSA PCM device '%s': %s",
+               alsa_device, snd_strerror(rc));
+    return 0;
+}
+
+static void
+alsa_autoconnect(audio_port_t **ports, int count)
+{
+    /* outputs are always 'connected', to the device's channels in order */
+}
+
+static jack_nframes_t
+alsa_frame_time(void)
+{
+    return audio_clock_frame_time(&alsa_clock, (float)alsa_rate, audio_period_size);
+}
+
+static jack_nframes_t
+alsa_last_frame_time(void)
+{
+    return alsa_clock.frame;
+}
+
+static int
+alsa_create_thread(pthread_t *thread, void *(*function)(void *), void *arg)
+{
+    return audio_create_rt_thread(thread, function, arg);
+}
+
+static void
+alsa_close(void)
+{
+    int i;
+
+    if (alsa_running) {
+        alsa_running = 0;
+        pthread_join(alsa_thread, NULL);
+    }
+    if (alsa_pcm) {
+        snd_pcm_drop(alsa_pcm);
+        snd_pcm_close(alsa_pcm);
+        alsa_pcm = NULL;
+    }
+    if (alsa_xruns)
+        ghss_debug(GDB_MAIN, ": ALSA PCM device had %lu xruns", alsa_xruns);
+    for (i = 0; i < alsa_port_count; i++) {
+        free(alsa_ports[i]->buffer);
+        free(alsa_ports[i]);
+    }
+    free(alsa_ports);
+    alsa_ports = NULL;
+    alsa_port_count = 0;
+    free(alsa_buffer);
+    alsa_buffer = NULL;
+    free(alsa_name);
+    alsa_name = NULL;
+    free(alsa_device);
+    alsa_device = NULL;
+}
+
+audio_backend_t audio_alsa_backend = {
+    "alsa",
+    alsa_pcm_open,
+    alsa_client_name,
+    alsa_sample_rate,
+    alsa_buffer_size,
+    alsa_port_register,
+    alsa_port_get_buffer,
+    alsa_set_process_callback,
+    alsa_activate,
+    alsa_autoconnect,
+    alsa_frame_time,
+    alsa_last_frame_time,
+    alsa_create_thread,
+    alsa_close
+};
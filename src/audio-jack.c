@@ -0,0 +1,175 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <jack/jack.h>
+#ifdef JACK_SESSION
+#include <jack/session.h>
+#endif
+
+#include "ghostess.h"
+#include "audio.h"
+
+/* The JACK backend's audio_port_t pointers are really jack_port_t
+ * pointers. */
+
+static int
+jack_backend_open(const char *client_name, const char *device,
+                  const char *session_uuid)
+{
+    jack_status_t status;
+
+#ifdef JACK_SESSION
+    if (session_uuid)
+        jackClient = jack_client_open(client_name, JackSessionID, &status, session_uuid);
+    else
+#endif
+        jackClient = jack_client_open(client_name, 0, &status);
+    if (jackClient == 0) {
+        ghss_debug(GDB_ERROR, ": failed to connect to JACK server");
+        return 0;
+    }
+    return 1;
+}
+
+static const char *
+jack_backend_client_name(void)
+{
+    return jack_get_client_name(jackClient);
+}
+
+static float
+jack_backend_sample_rate(void)
+{
+    return (float)jack_get_sample_rate(jackClient);
+}
+
+static jack_nframes_t
+jack_backend_buffer_size(void)
+{
+    return jack_get_buffer_size(jackClient);
+}
+
+static audio_port_t *
+jack_backend_port_register(const char *name, int is_output)
+{
+    return (audio_port_t *)jack_port_register(jackClient, name,
+                                              JACK_DEFAULT_AUDIO_TYPE,
+                                              is_output ? JackPortIsOutput :
+                                                          JackPortIsInput,
+                                              0);
+}
+
+static float *
+jack_backend_port_get_buffer(audio_port_t *port, jack_nframes_t nframes)
+{
+    return (float *)jack_port_get_buffer((jack_port_t *)port, nframes);
+}
+
+static void
+jack_backend_set_process_callback(audio_process_callback_t callback, void *arg)
+{
+    jack_set_process_callback(jackClient, callback, arg);
+}
+
+static int
+jack_backend_activate(void)
+{
+    if (jack_activate(jackClient)) {
+        ghss_debug(GDB_ERROR, ": cannot activate JACK client");
+        return 0;
+    }
+    return 1;
+}
+
+static void
+jack_backend_autoconnect(audio_port_t **ports, int count)
+{
+    const char **physical;
+    int i, j;
+
+    /* !FIX! this to more intelligently connect ports: */
+    physical = jack_get_ports(jackClient, NULL, "^" JACK_DEFAULT_AUDIO_TYPE "$",
+                              JackPortIsPhysical|JackPortIsInput);
+    if (physical && physical[0]) {
+        for (i = 0, j = 0; i < count; ++i) {
+            if (!ports[i])
+                continue;  /* voice farm member */
+            if (jack_connect(jackClient, jack_port_name((jack_port_t *)ports[i]),
+                             physical[j])) {
+                ghss_debug(GDB_ERROR, ": cannot connect output port %d", i);
+            }
+            if (!physical[++j]) j = 0;
+        }
+    }
+    if (physical)
+        free(physical);
+}
+
+static jack_nframes_t
+jack_backend_frame_time(void)
+{
+    return jack_frame_time(jackClient);
+}
+
+static jack_nframes_t
+jack_backend_last_frame_time(void)
+{
+    return jack_last_frame_time(jackClient);
+}
+
+static int
+jack_backend_create_thread(pthread_t *thread, void *(*function)(void *), void *arg)
+{
+    return jack_client_create_thread(jackClient, thread,
+                                     jack_client_real_time_priority(jackClient),
+                                     jack_is_realtime(jackClient),
+                                     function, arg);
+}
+
+static void
+jack_backend_close(void)
+{
+    jack_client_close(jackClient);
+    jackClient = NULL;
+}
+
+audio_backend_t audio_jack_backend = {
+    "jack",
+    jack_backend_open,
+    jack_backend_client_name,
+    jack_backend_sample_rate,
+    jack_backend_buffer_size,
+    jack_backend_port_register,
+    jack_backend_port_get_buffer,
+    jack_backend_set_process_callback,
+    jack_backend_activate,
+    jack_backend_autoconnect,
+    jack_backend_frame_time,
+    jack_backend_last_frame_time,
+    jack_backend_create_thread,
+    jack_backend_close
+};
@@ -0,0 +1,205 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+/* The 'null' audio backend: no audio I/O at all, just a real-time thread
+ * that runs the processing cycle every period, from a timer.  Useful on
+ * headless machines without jackd, and for repeatable testing. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ghostess.h"
+#include "audio.h"
+
+static char                    *null_name = NULL;
+static audio_process_callback_t null_callback = NULL;
+static void                    *null_callback_arg = NULL;
+static audio_clock_t            null_clock;
+static jack_nframes_t           null_frame = 0;
+static pthread_t                null_thread;
+static volatile int             null_running = 0;
+static audio_port_t           **null_ports = NULL;
+static int                      null_port_count = 0;
+
+static int
+null_open(const char *client_name, const char *device, const char *session_uuid)
+{
+    null_name = strdup(client_name);
+    ghss_debug(GDB_MAIN, ": null audio backend, %lu Hz, %u frames per period",
+               audio_sample_rate, audio_period_size);
+    return 1;
+}
+
+static const char *
+null_client_name(void)
+{
+    return null_name;
+}
+
+static float
+null_sample_rate(void)
+{
+    return (float)audio_sample_rate;
+}
+
+static jack_nframes_t
+null_buffer_size(void)
+{
+    return audio_period_size;
+}
+
+static audio_port_t *
+null_port_register(const char *name, int is_output)
+{
+    audio_port_t *port, **ports;
+
+    ports = (audio_port_t **)realloc(null_ports, (null_port_count + 1) * sizeof(audio_port_t *));
+    if (!ports)
+        return NULL;
+    null_ports = ports;
+    port = audio_buffer_port_new(audio_period_size, is_output);
+    if (port)
+        null_ports[null_port_count++] = port;
+    return port;
+}
+
+static float *
+null_port_get_buffer(audio_port_t *port, jack_nframes_t nframes)
+{
+    return port->buffer;
+}
+
+static void
+null_set_process_callback(audio_process_callback_t callback, void *arg)
+{
+    null_callback = callback;
+    null_callback_arg = arg;
+}
+
+static void *
+null_process_thread(void *arg)
+{
+    struct timespec next, now;
+    long period_ns = (long)((double)audio_period_size * 1e9 / audio_sample_rate);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (null_running) {
+
+        audio_clock_start_cycle(&null_clock, null_frame);
+        if (null_callback)
+            null_callback(audio_period_size, null_callback_arg);
+        null_frame += audio_period_size;
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec + 1) {
+            next = now;  /* fell far behind, don't try to catch up */
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    return NULL;
+}
+
+static int
+null_activate(void)
+{
+    audio_clock_start_cycle(&null_clock, null_frame);
+    null_running = 1;
+    if (audio_create_rt_thread(&null_thread, null_process_thread, NULL)) {
+        ghss_debug(GDB_ERROR, ": could not create null audio thread");
+        null_running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static void
+null_autoconnect(audio_port_t **ports, int count)
+{
+    /* nothing to connect to */
+}
+
+static jack_nframes_t
+null_frame_time(void)
+{
+    return audio_clock_frame_time(&null_clock, (float)audio_sample_rate,
+                                  audio_period_size);
+}
+
+static jack_nframes_t
+null_last_frame_time(void)
+{
+    return null_clock.frame;
+}
+
+static int
+null_create_thread(pthread_t *thread, void *(*function)(void *), void *arg)
+{
+    return audio_create_rt_thread(thread, function, arg);
+}
+
+static void
+null_close(void)
+{
+    int i;
+
+    if (null_running) {
+        null_running = 0;
+        pthread_join(null_thread, NULL);
+    }
+    for (i = 0; i < null_port_count; i++) {
+        free(null_ports[i]->buffer);
+        free(null_ports[i]);
+    }
+    free(null_ports);
+    null_ports = NULL;
+    null_port_count = 0;
+    free(null_name);
+    null_name = NULL;
+}
+
+audio_backend_t audio_null_backend = {
+    "null",
+    null_open,
+    null_client_name,
+    null_sample_rate,
+    null_buffer_size,
+    null_port_register,
+    null_port_get_buffer,
+    null_set_process_callback,
+    null_activate,
+    null_autoconnect,
+    null_frame_time,
+    null_last_frame_time,
+    null_create_thread,
+    null_close
+};
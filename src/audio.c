@@ -0,0 +1,154 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "ghostess.h"
+#include "audio.h"
+
+unsigned long  audio_sample_rate = 44100;
+jack_nframes_t audio_period_size = 256;
+
+static audio_backend_t *audio_backends[] = {
+    &audio_jack_backend,
+    &audio_null_backend,
+#ifdef AUDIO_ALSA
+    &audio_alsa_backend,
+#endif
+    NULL
+};
+
+audio_backend_t *
+audio_backend_find(const char *name)
+{
+    int i;
+
+    for (i = 0; audio_backends[i]; i++) {
+        if (!strcmp(name, audio_backends[i]->name))
+            return audio_backends[i];
+    }
+    return NULL;
+}
+
+void
+audio_backend_list(FILE *fp)
+{
+    int i;
+
+    for (i = 0; audio_backends[i]; i++)
+        fprintf(fp, "%s%s", i ? ", " : "", audio_backends[i]->name);
+}
+
+/* Create a SCHED_FIFO thread if we're allowed to, or an ordinary one if
+ * not. */
+int
+audio_create_rt_thread(pthread_t *thread, void *(*function)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+    int rc;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = AUDIO_RT_PRIORITY;
+    pthread_attr_setschedparam(&attr, &param);
+    rc = pthread_create(thread, &attr, function, arg);
+    pthread_attr_destroy(&attr);
+    if (rc == 0)
+        return 0;
+
+    ghss_debug(GDB_MAIN, " audio_create_rt_thread: could not get real-time scheduling, continuing without");
+    return pthread_create(thread, NULL, function, arg);
+}
+
+/* a port which is just a buffer, silent unless written */
+audio_port_t *
+audio_buffer_port_new(jack_nframes_t nframes, int is_output)
+{
+    audio_port_t *port = (audio_port_t *)malloc(sizeof(audio_port_t));
+
+    if (!port)
+        return NULL;
+    port->buffer = (float *)calloc(nframes, sizeof(float));
+    if (!port->buffer) {
+        free(port);
+        return NULL;
+    }
+    port->is_output = is_output;
+    return port;
+}
+
+double
+audio_clock_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Called by the process thread at the start of each cycle.  The frame
+ * time and wall clock are published together with a sequence lock, so
+ * other threads can extrapolate from them. */
+void
+audio_clock_start_cycle(audio_clock_t *clock, jack_nframes_t frame)
+{
+    clock->sequence++;
+    __sync_synchronize();
+    clock->frame = frame;
+    clock->when = audio_clock_now();
+    __sync_synchronize();
+    clock->sequence++;
+}
+
+/* Estimate the current frame time from the start of the current cycle,
+ * never running more than a period ahead of it. */
+jack_nframes_t
+audio_clock_frame_time(audio_clock_t *clock, float sample_rate,
+                       jack_nframes_t nframes)
+{
+    unsigned int sequence;
+    jack_nframes_t frame;
+    double elapsed;
+
+    do {
+        sequence = clock->sequence;
+        __sync_synchronize();
+        frame = clock->frame;
+        elapsed = audio_clock_now() - clock->when;
+        __sync_synchronize();
+    } while ((sequence & 1) || sequence != clock->sequence);
+
+    if (elapsed < 0.0)
+        elapsed = 0.0;
+    else if (elapsed * sample_rate > nframes)
+        elapsed = (double)nframes / sample_rate;
+
+    return frame + (jack_nframes_t)(elapsed * sample_rate);
+}
@@ -0,0 +1,113 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _AUDIO_H
+#define _AUDIO_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <pthread.h>
+#include <jack/jack.h>  /* for jack_nframes_t, which the host uses throughout */
+
+/* An audio backend drives ghostess's processing cycle, and owns the audio
+ * ports and the frame clock.  'jack' is the default; 'null' runs the cycle
+ * from a timer with no audio I/O; 'alsa' plays directly to an ALSA PCM
+ * device.  Everything except open() is only valid after a successful
+ * open(). */
+
+typedef struct _audio_port_t audio_port_t;  /* opaque, backend specific */
+
+typedef int (*audio_process_callback_t)(jack_nframes_t nframes, void *arg);
+
+typedef struct _audio_backend_t {
+    const char     *name;
+
+    /* Connect to the server or open the device; 'device' is whatever
+     * followed the ':' in '-audio <backend>:<device>', or NULL, and
+     * 'session_uuid' is the JACK session UUID, or NULL. */
+    int            (*open)(const char *client_name, const char *device,
+                           const char *session_uuid);
+    /* The client name actually in use, which may differ from the one
+     * asked for. */
+    const char    *(*client_name)(void);
+    float          (*sample_rate)(void);
+    jack_nframes_t (*buffer_size)(void);
+
+    audio_port_t  *(*port_register)(const char *name, int is_output);
+    float         *(*port_get_buffer)(audio_port_t *port, jack_nframes_t nframes);
+
+    void           (*set_process_callback)(audio_process_callback_t callback,
+                                           void *arg);
+    int            (*activate)(void);
+    /* Connect the given output ports (NULL entries are skipped) to the
+     * system's playback ports, if that means anything to the backend. */
+    void           (*autoconnect)(audio_port_t **ports, int count);
+
+    /* estimated current frame time, for timestamping from other threads */
+    jack_nframes_t (*frame_time)(void);
+    /* frame time at the start of the current cycle (process thread only) */
+    jack_nframes_t (*last_frame_time)(void);
+
+    /* Create a thread with the same scheduling as the process thread. */
+    int            (*create_thread)(pthread_t *thread,
+                                    void *(*function)(void *), void *arg);
+
+    void           (*close)(void);
+} audio_backend_t;
+
+/* audio.c */
+extern unsigned long audio_sample_rate;   /* for the 'null' and 'alsa' backends */
+extern jack_nframes_t audio_period_size;
+
+audio_backend_t *audio_backend_find(const char *name);
+void             audio_backend_list(FILE *fp);
+
+/* helpers for backends that run their own process thread */
+#define AUDIO_RT_PRIORITY  60
+
+struct _audio_port_t {
+    float *buffer;
+    int    is_output;
+};
+
+typedef struct _audio_clock_t {
+    volatile unsigned int    sequence;  /* odd while being updated */
+    volatile jack_nframes_t  frame;     /* frame time at start of cycle */
+    volatile double          when;      /* CLOCK_MONOTONIC seconds at the same */
+} audio_clock_t;
+
+int            audio_create_rt_thread(pthread_t *thread, void *(*function)(void *),
+                                      void *arg);
+audio_port_t  *audio_buffer_port_new(jack_nframes_t nframes, int is_output);
+void           audio_clock_start_cycle(audio_clock_t *clock, jack_nframes_t frame);
+jack_nframes_t audio_clock_frame_time(audio_clock_t *clock, float sample_rate,
+                                      jack_nframes_t nframes);
+double         audio_clock_now(void);
+
+extern audio_backend_t audio_jack_backend;
+extern audio_backend_t audio_null_backend;
+#ifdef AUDIO_ALSA
+extern audio_backend_t audio_alsa_backend;
+#endif
+
+#endif /* _AUDIO_H */
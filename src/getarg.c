@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "ghostess.h"
 #include "getarg.h"
@@ -62,7 +63,10 @@ getarg_pop_state(void)
     if (state_list) {
         state = state_list;
         state_list = state->up;
-        if (state->is_file) {
+        if (state->is_snapshot) {
+            free(state->state.snapshot.filename);
+            free(state->state.snapshot.data);
+        } else if (state->is_file) {
             free(state->state.file.filename);
             fclose(state->state.file.fh);
         }
@@ -112,6 +116,63 @@ getarg_init_with_command_line(int argc, char **argv)
     getarg_error = NULL;
 }
 
+/*
+ * getarg_push_snapshot
+ *
+ * Read the whole of a binary snapshot file into memory, to be decoded a
+ * record at a time by getarg_read_snapshot_args().
+ */
+static int
+getarg_push_snapshot(char *fn, FILE *fh)
+{
+    getarg_state *state;
+    struct stat st;
+    unsigned char *data;
+    uint32_t version;
+
+    if (fstat(fileno(fh), &st) || st.st_size < GHSNAP_HEADER_LENGTH) {
+        snprintf(argbuf, 2048, "could not read snapshot file '%s'", fn);
+        goto error;
+    }
+    data = (unsigned char *)malloc(st.st_size);
+    if (fseek(fh, 0, SEEK_SET) < 0 ||
+        fread(data, 1, st.st_size, fh) != (size_t)st.st_size) {
+        snprintf(argbuf, 2048, "error reading snapshot file '%s': %s",
+                 fn, strerror(errno));
+        free(data);
+        goto error;
+    }
+    fclose(fh);
+    version = ghsnap_get_u32(data + GHSNAP_MAGIC_LENGTH);
+    if (version > GHSNAP_VERSION) {
+        snprintf(argbuf, 2048, "snapshot file '%s' is version %u, this ghostess only reads up to version %d",
+                 fn, version, GHSNAP_VERSION);
+        getarg_error = argbuf;
+        free(data);
+        free(fn);
+        return 0;
+    }
+
+    state = (getarg_state *)calloc(1, sizeof(getarg_state));
+    state->up = state_list;
+    state->is_file = 1;
+    state->is_snapshot = 1;
+    state->state.snapshot.filename = fn;
+    state->state.snapshot.data = data;
+    state->state.snapshot.length = st.st_size;
+    state->state.snapshot.next = GHSNAP_HEADER_LENGTH;
+
+    state_list = state;
+
+    return 1;
+
+  error:
+    getarg_error = argbuf;
+    fclose(fh);
+    free(fn);
+    return 0;
+}
+
 /*
  * getarg_push_file
  */
@@ -121,6 +182,10 @@ getarg_push_file(char *filename)
     getarg_state *state;
     char *fn = strdup(filename);
     FILE *fh = fopen(filename, "r");
+    char magic[GHSNAP_MAGIC_LENGTH];
+
+    if (!argbuf)
+        argbuf = (char *)malloc(GETARG_MAX_LENGTH + 1);
 
     if (!fh) {
         snprintf(argbuf, 2048, "could not open configuration file '%s': %s",
@@ -130,6 +195,10 @@ getarg_push_file(char *filename)
         return 0;
     }
 
+    if (fread(magic, 1, GHSNAP_MAGIC_LENGTH, fh) == GHSNAP_MAGIC_LENGTH &&
+        !memcmp(magic, GHSNAP_MAGIC, GHSNAP_MAGIC_LENGTH))
+        return getarg_push_snapshot(fn, fh);
+
     state = (getarg_state *)calloc(1, sizeof(getarg_state));
     state->up = state_list;
     state->is_file = 1;
@@ -139,9 +208,6 @@ getarg_push_file(char *filename)
 
     state_list = state;
 
-    if (!argbuf)
-        argbuf = (char *)malloc(GETARG_MAX_LENGTH + 1);
-
     return 1;
 }
 
@@ -261,6 +327,165 @@ getarg_read_file_arg(getarg_state *state)
     return 1;
 }
 
+/*
+ * getarg_read_snapshot_args
+ *
+ * Decode the next record of a snapshot into the equivalent command line
+ * arguments.  Returns 0 at the end of the snapshot or on error.
+ */
+static int
+getarg_read_snapshot_args(getarg_state *state)
+{
+    struct _snapshot_state *ss = &state->state.snapshot;
+    const unsigned char *p;
+    unsigned int type;
+    uint32_t length;
+    char *s, *end;
+    int i;
+
+  again:
+    ss->argc = ss->next_arg = 0;
+    ss->ports = NULL;
+
+    if (ss->next + 5 > ss->length)
+        goto truncated;
+    type = ss->data[ss->next];
+    length = ghsnap_get_u32(ss->data + ss->next + 1);
+    if (length > ss->length - ss->next - 5)
+        goto truncated;
+    p = ss->data + ss->next + 5;
+    ss->next += 5 + length;
+
+    /* records holding strings must end with a NUL, so they can be used in place */
+    if (type == GHSNAP_OPTION || type == GHSNAP_INSTANCE ||
+        type == GHSNAP_CONFIGURE || type == GHSNAP_PLUGIN) {
+        if (length ? p[length - 1] != '\0' : type != GHSNAP_OPTION)
+            goto corrupt;
+        s = (char *)p;
+        end = s + length;
+    } else {
+        s = end = NULL;
+    }
+
+    switch (type) {
+      case GHSNAP_END:
+        return 0;
+
+      case GHSNAP_OPTION:
+        while (s < end) {
+            if (ss->argc == GHSNAP_MAX_ARGS)
+                goto corrupt;
+            ss->args[ss->argc++] = s;
+            s += strlen(s) + 1;
+        }
+        break;
+
+      case GHSNAP_INSTANCE:
+        ss->args[ss->argc++] = "-comment";
+        ss->args[ss->argc++] = s;
+        break;
+
+      case GHSNAP_CHANNEL:
+        if (length != 8)
+            goto corrupt;
+        snprintf(ss->numbuf[0], sizeof(ss->numbuf[0]), "%u:%u",
+                 ghsnap_get_u32(p), ghsnap_get_u32(p + 4));
+        ss->args[ss->argc++] = "-chan";
+        ss->args[ss->argc++] = ss->numbuf[0];
+        break;
+
+      case GHSNAP_ZONE:
+        if (length != 16)
+            goto corrupt;
+        for (i = 0; i < 4; i++)
+            snprintf(ss->numbuf[i], sizeof(ss->numbuf[i]), "%u", ghsnap_get_u32(p + i * 4));
+        ss->args[ss->argc++] = "-keys";
+        ss->args[ss->argc++] = ss->numbuf[0];
+        ss->args[ss->argc++] = ss->numbuf[1];
+        ss->args[ss->argc++] = "-vel";
+        ss->args[ss->argc++] = ss->numbuf[2];
+        ss->args[ss->argc++] = ss->numbuf[3];
+        break;
+
+      case GHSNAP_CONFIGURE:
+        ss->args[ss->argc++] = "-conf";
+        ss->args[ss->argc++] = s;
+        s += strlen(s) + 1;
+        if (s >= end)
+            goto corrupt;
+        ss->args[ss->argc++] = s;
+        break;
+
+      case GHSNAP_PROGRAM:
+        if (length != 8)
+            goto corrupt;
+        snprintf(ss->numbuf[0], sizeof(ss->numbuf[0]), "%u", ghsnap_get_u32(p));
+        snprintf(ss->numbuf[1], sizeof(ss->numbuf[1]), "%u", ghsnap_get_u32(p + 4));
+        ss->args[ss->argc++] = "-prog";
+        ss->args[ss->argc++] = ss->numbuf[0];
+        ss->args[ss->argc++] = ss->numbuf[1];
+        break;
+
+      case GHSNAP_PORTS:
+        if (length < 4 || (length - 4) / 8 != ghsnap_get_u32(p) || (length - 4) % 8)
+            goto corrupt;
+        ss->port_count = ghsnap_get_u32(p);
+        ss->ports = p + 4;
+        ss->args[ss->argc++] = "-ports";  /* see getarg_port_block() */
+        break;
+
+      case GHSNAP_FARM:
+        if (length != 4)
+            goto corrupt;
+        snprintf(ss->numbuf[0], sizeof(ss->numbuf[0]), "%u", ghsnap_get_u32(p));
+        ss->args[ss->argc++] = "-farm";
+        ss->args[ss->argc++] = ss->numbuf[0];
+        break;
+
+      case GHSNAP_PLUGIN:
+        ss->args[ss->argc++] = s;
+        break;
+
+      default:
+        /* a record type from a newer version 1 writer: skip it */
+        ghss_debug(GDB_MAIN, ": skipping unknown record type %u in snapshot file '%s'",
+                   type, ss->filename);
+        goto again;
+    }
+    if (ss->argc == 0)
+        goto again;
+
+    return 1;
+
+  truncated:
+    snprintf(argbuf, 2048, "snapshot file '%s' is truncated", ss->filename);
+    getarg_error = argbuf;
+    return 0;
+
+  corrupt:
+    snprintf(argbuf, 2048, "bad record (type %u) in snapshot file '%s'", type, ss->filename);
+    getarg_error = argbuf;
+    return 0;
+}
+
+/*
+ * getarg_port_block
+ *
+ * After getarg() has returned '-ports' from a snapshot, fetch the block
+ * of port numbers and values that goes with it: 'count' pairs of u32
+ * port number and f32 value, for ghsnap_get_u32() and ghsnap_get_float().
+ */
+int
+getarg_port_block(const unsigned char **block, unsigned long *count)
+{
+    if (!state_list || !state_list->is_snapshot || !state_list->state.snapshot.ports)
+        return 0;
+
+    *block = state_list->state.snapshot.ports;
+    *count = state_list->state.snapshot.port_count;
+    return 1;
+}
+
 /*
  * getarg_internal
  */
@@ -275,7 +500,21 @@ getarg_internal(void)
     if (state == NULL)
         return NULL;
 
-    if (state->is_file) {
+    if (state->is_snapshot) {
+
+        if (state->state.snapshot.next_arg < state->state.snapshot.argc ||
+            getarg_read_snapshot_args(state)) {
+            return state->state.snapshot.args[state->state.snapshot.next_arg++];
+        } else {
+            if (getarg_error) {
+                return NULL;
+            } else { /* end of snapshot */
+                getarg_pop_state();
+                goto again;
+            }
+        }
+
+    } else if (state->is_file) {
 
         if (getarg_read_file_arg(state)) {
             return argbuf;
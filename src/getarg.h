@@ -20,6 +20,8 @@
 
 #include <stdio.h>
 
+#include "snapshot.h"
+
 #define GETARG_MAX_LENGTH  32767  /* approximate limit of OSC over UDP */
 
 extern char *getarg_error;
@@ -29,6 +31,7 @@ void  getarg_cleanup(void);
 void  getarg_init_with_command_line(int argc, char **argv);
 int   getarg_init_with_file(char *filename);
 char *getarg(void);
+int   getarg_port_block(const unsigned char **block, unsigned long *count);
 
 typedef struct _getarg_state getarg_state;
 
@@ -44,12 +47,27 @@ struct _file_state {
     long   next;
 };
 
+struct _snapshot_state {
+    char          *filename;
+    unsigned char *data;       /* the whole file */
+    size_t         length;
+    size_t         next;       /* offset of next record */
+    char          *args[GHSNAP_MAX_ARGS];  /* args decoded from current record */
+    int            argc;
+    int            next_arg;
+    char           numbuf[4][24];
+    const unsigned char *ports;  /* GHSNAP_PORTS payload, after the count */
+    unsigned long  port_count;
+};
+
 struct _getarg_state {
     getarg_state *up;
     int           is_file;
+    int           is_snapshot;
     union {
-        struct _argc_state argv;
-        struct _file_state file;
+        struct _argc_state     argv;
+        struct _file_state     file;
+        struct _snapshot_state snapshot;
     } state;
 };
 
@@ -56,7 +56,14 @@
 #include <signal.h>
 #include <dirent.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -76,15 +83,24 @@
 
 #include "ghostess.h"
 #include "getarg.h"
+#include "snapshot.h"
 #include "gui_interface.h"
 #include "gui_callbacks.h"
 #include "midi.h"
-
-       jack_client_t *jackClient;
-static jack_port_t  **inputPorts, **outputPorts;
+#include "midi_decoder.h"
+#include "smf.h"
+#include "wav.h"
+
+       audio_backend_t *audio_backend = NULL;
+static int              audio_backend_opened = 0;
+static char          *audio_backend_name = "jack";
+static char          *audio_device = NULL;
+       jack_client_t *jackClient = NULL;  /* if using the JACK audio backend */
+static audio_port_t **inputPorts, **outputPorts;
 #ifdef MIDI_JACK
-       jack_port_t   *jack_midi_input_port;
-       snd_midi_event_t *jack_alsa_encoder;
+       jack_port_t   *jack_midi_input_ports[GHSS_MAX_MIDI_PORTS];
+static snd_seq_event_t jackMidiEvents[EVENT_BUFFER_SIZE]; /* decoded JACK MIDI input */
+static snd_seq_event_t jackMidiMerged[EVENT_BUFFER_SIZE]; /* ... with several ports' merged */
 #endif /* MIDI_JACK */
 char  *jack_session_uuid = NULL;
 static float          sample_rate;
@@ -106,14 +122,188 @@ static float **pluginInputBuffers, **pluginOutputBuffers;
 
 static int controlInsTotal, controlOutsTotal;
 static float *pluginControlIns, *pluginControlOuts;
-static d3h_instance_t *channel2instances[GHSS_MAX_CHANNELS]; /* maps MIDI channel to instances */
+       int             midi_port_count = 1;
+static d3h_instance_t *channel2instances[GHSS_MAX_MIDI_PORTS * GHSS_MAX_CHANNELS]; /* maps MIDI port and channel to instances */
+
+/* channel-addressed events carry their MIDI input port number in dest.port */
+#define EVENT_ROUTE(ev)  ((ev)->dest.port * GHSS_MAX_CHANNELS + (ev)->data.note.channel)
 static d3h_instance_t **pluginAudioInInstances;              /* maps global audio in # to instance */
 static unsigned long *pluginAudioInPortNumbers;              /* maps global audio in # to instance LADSPA port # */
+static d3h_instance_t **pluginAudioOutInstances;             /* maps global audio out # to instance */
+static unsigned long *pluginAudioOutPortNumbers;             /* maps global audio out # to instance LADSPA port # */
 static d3h_instance_t **pluginControlInInstances;            /* maps global control in # to instance */
 static unsigned long *pluginControlInPortNumbers;            /* maps global control in # to instance LADSPA port # */
 static int *pluginPortUpdated;                               /* indexed by global control in # */
 
+/* Control changes from OSC are queued here for the audio thread, which
+ * applies them at their frame offset within the cycle.  If sub-block
+ * splitting is enabled, the cycle is split at each change, so plugins see
+ * it at (nearly) the right sample. */
+static control_event_t controlEventBuffer[CONTROL_EVENT_BUFFER_SIZE]; /* ring buffer */
+static volatile int    controlEventReadIndex = 0, controlEventWriteIndex = 0;
+int                    control_subblock_min = 0;      /* shortest sub-block in frames, 0 = no splitting */
+static control_event_t pendingControls[CONTROL_EVENT_BUFFER_SIZE];  /* audio thread only, sorted by time */
+static int             pendingControlCount = 0, pendingControlIndex = 0;
+static snd_seq_event_t **segmentEventBuffers;         /* per-instance events for the current sub-block */
+static unsigned long    *segmentEventCounts;
+static unsigned long    *segmentEventIndex;           /* per-instance index of next event not yet run */
+
+/* Plugin run jobs: each is either one instance, or all the instances of a
+ * plugin with run_multiple_synths().  With '-threads <n>', n - 1 worker
+ * threads help the audio thread work through them in each sub-block. */
+typedef struct _run_job_t {
+    int first;                  /* instance number */
+    int count;
+} run_job_t;
+
+static run_job_t     *runJobs;
+static int            runJobCount;
+int                   run_thread_count = 1;
+static pthread_t     *runWorkers;
+static int            runWorkerCount = 0;
+static sem_t          runStartSem, runDoneSem;
+static volatile int   runJobNext;
+static volatile int   runWorkersExiting = 0;
+static jack_nframes_t runNframes;
+
+/* voice farms */
+#define FARM_NO_OWNER  0xff
+static unsigned int dispatch_serial = 0;
+
+#define is_farm_member(instance)  ((instance)->farm_leader && (instance)->farm_leader != (instance))
+
+/* offline rendering */
+#define RENDER_BLOCK_SIZE    256
+#define RENDER_TAIL_SECONDS  2  /* rendered after the last event, for releases */
+static char          *render_midi_file = NULL;
+static char          *render_wav_file = NULL;
+
+#ifdef GHSS_BENCH
+/* ghostess-bench: time the host cycle under synthetic load, without JACK */
+#define BENCH_WARMUP_CYCLES  100
+#define BENCH_MAX_SIZES      16
+#define BENCH_MAX_FRAMES     8192
+#define BENCH_POLYPHONY      8     /* notes held per instance before releasing */
+#define BENCH_LOAD_NOTES     1     /* note on/off, via MIDI */
+#define BENCH_LOAD_CC        2     /* mod wheel and pitch bend, via MIDI */
+#define BENCH_LOAD_OSC       4     /* notes and control port changes, via OSC */
+#define BENCH_LOAD_PROGRAM   8     /* program changes, via MIDI */
+static int            offline = 1;  /* never JACK */
+static int            bench_cycles = 10000;
+static jack_nframes_t bench_sizes[BENCH_MAX_SIZES] = { 64, 256, 1024 };
+static int            bench_size_count = 3;
+static int            bench_load = BENCH_LOAD_NOTES;
+static char          *bench_load_name = "notes";
+static unsigned long  bench_event_rate = 1000;  /* events per second */
+#else
+static int            offline = 0;  /* no JACK, GUI, OSC or MIDI input */
+#endif /* GHSS_BENCH */
+
+/* Controller coalescing: if enabled, a controller, pitch bend, or channel
+ * pressure event delivered to an instance within 'coalesce_frames' of an
+ * earlier one of the same kind in this cycle just replaces the earlier
+ * one's value.  Each instance has a slot per (channel, controller) noting
+ * where in its event buffer the last such event went, valid only if
+ * stamped with the current cycle number. */
+#define COALESCE_KEYS_PER_CHANNEL  (MIDI_CONTROLLER_COUNT + 2)  /* controllers, pitch bend, channel pressure */
+
+typedef struct _coalesce_slot_t {
+    unsigned int  cycle;
+    unsigned long index;
+} coalesce_slot_t;
+
+int                     coalesce_frames = 0;          /* 0 = no coalescing */
+static coalesce_slot_t **instanceCoalesceSlots = NULL;
+static unsigned int      coalesce_cycle = 0;
+
+/* Key and velocity zones: for each (port, channel) route and key, a bitmask
+ * of the instances (by number) on that route whose key zone includes the
+ * key.  Compiled by the audio thread whenever zone_generation changes. */
+static unsigned int zoneKeyMasks[GHSS_MAX_MIDI_PORTS * GHSS_MAX_CHANNELS][128];
+static volatile int zone_generation = 1;
+static int          zone_compiled_generation = 0;
+
+/* MIDI events from timetagged OSC bundles, held by the audio thread until
+ * due, sorted by JACK frame time */
+static snd_seq_event_t scheduledEvents[EVENT_BUFFER_SIZE];
+static int             scheduledEventCount = 0;
+
+/* Mapping between the wall clock (for OSC timetags) and JACK frame time,
+ * recalibrated every cycle.  Written only by the audio thread, under a
+ * sequence lock. */
+static volatile unsigned int clock_map_seq = 0;
+static lo_timetag            clock_map_wall;
+static double                clock_map_frame;
+
 lo_server_thread serverThread;
+lo_server_thread serverThreadTCP = NULL;
+lo_server_thread serverThreadUnix = NULL;
+int   osc_serve_tcp = 0;
+char *osc_unix_socket = NULL;
+static pthread_mutex_t osc_handler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* OSC dispatch: the full '/dssi/<friendly name>/<method>' path of every
+ * method we handle is entered into a hash table once all instances are
+ * created, so the OSC thread can find the instance and method with a
+ * single lookup, rather than comparing against every friendly name. */
+enum osc_method {
+    OSC_METHOD_CONFIGURE,
+    OSC_METHOD_CONTROL,
+    OSC_METHOD_EXITING,
+    OSC_METHOD_MIDI,
+    OSC_METHOD_MIDI_BULK,
+    OSC_METHOD_PROGRAM,
+    OSC_METHOD_UPDATE,
+    OSC_METHOD_ZONE,
+    OSC_METHOD_COUNT,
+    /* host methods, at '/ghostess/<method>', with no instance: */
+    OSC_HOST_METHOD_SLOT_STORE = OSC_METHOD_COUNT,
+    OSC_HOST_METHOD_SLOT_RECALL,
+    OSC_HOST_METHOD_SLOT_LIST,
+    OSC_HOST_METHOD_PROGRAMS,
+    OSC_HOST_METHOD_GUI_HELLO,
+    OSC_HOST_METHOD_GUI_BYE,
+    OSC_HOST_METHOD_END
+};
+
+static const char *osc_method_names[OSC_HOST_METHOD_END] = {
+    "configure", "control", "exiting", "midi", "midi-bulk", "program",
+    "update", "zone",
+    "slot/store", "slot/recall", "slot/list", "programs",
+    "gui/hello", "gui/bye"
+};
+
+typedef struct _osc_dispatch_entry_t {
+    d3h_instance_t *instance;
+    enum osc_method method;
+} osc_dispatch_entry_t;
+
+static GHashTable           *osc_dispatch_table = NULL; /* path -> osc_dispatch_entry_t */
+static osc_dispatch_entry_t *osc_dispatch_entries = NULL;
+static osc_dispatch_entry_t  osc_host_dispatch_entries[OSC_HOST_METHOD_END - OSC_METHOD_COUNT];
+
+/* State slots: '/ghostess/slot/store' captures every instance's control
+ * values, bank and program, and configure items into memory, and
+ * '/ghostess/slot/recall' restores them, the controls and programs all
+ * within one audio cycle, for switching between songs in a live set. */
+#define GHSS_STATE_SLOTS  32
+
+typedef struct _state_slot_t {
+    char              *name;             /* NULL if the slot is empty */
+    LADSPA_Data       *controls;         /* controlInsTotal values */
+    unsigned long     *bank;             /* per instance */
+    unsigned long     *program;          /* per instance */
+    configure_item_t **configure_items;  /* per instance */
+} state_slot_t;
+
+static state_slot_t          stateSlots[GHSS_STATE_SLOTS];
+static state_slot_t * volatile pendingSlotRecall = NULL;  /* cleared by the audio thread */
+
+/* for copying the control vector between cycles, see capture_controls() */
+static LADSPA_Data * volatile pendingControlCapture = NULL;  /* cleared by the audio thread */
+static pthread_mutex_t controlCaptureMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  controlCaptureOnce = PTHREAD_ONCE_INIT;
+static sem_t           controlCaptureSem;  /* posted by the audio thread once it has copied */
 
 static sigset_t _signals;
 
@@ -122,10 +312,35 @@ int   host_exiting = 0;
 char *host_name_default = "ghostess";
 char *host_name;
 char *host_osc_url = NULL;
+char *host_osc_local_url = NULL;  /* UNIX socket or TCP server URL, for locally spawned UIs */
 char *host_argv0;
 
 int   debug_flags = GDB_ERROR;  /* default is errors only */
 int   autoconnect = 1;
+static int nogui = 0;            /* headless: no GTK+ at all, control by OSC only */
+static char *autosave_file = NULL;  /* autosave journal, or NULL for none */
+
+/* With '-sharedgui', instances using the universal GUI share a single GUI
+ * process: the first start_ui() launches it with '-shared', and once it
+ * says '/ghostess/gui/hello' with its URL, windows for the others are
+ * opened with '/ghostess/gui/open'. */
+enum shared_gui_state {
+    SHARED_GUI_NONE,
+    SHARED_GUI_STARTING,
+    SHARED_GUI_RUNNING
+};
+#define SHARED_GUI_START_TIMEOUT 10  /* seconds to wait for hello before trying again */
+
+static int                   shared_gui = 0;
+static pthread_mutex_t       sharedGuiMutex = PTHREAD_MUTEX_INITIALIZER;
+static enum shared_gui_state sharedGuiState = SHARED_GUI_NONE;
+static time_t                sharedGuiStartTime;
+static lo_address            sharedGuiAddress = NULL;
+static pid_t                 sharedGuiPid = 0;  /* reaped in housekeeping */
+#define ACTIVITY_INTERVAL  100  /* milliseconds, MIDI activity LED decay tick */
+#ifdef JACK_SESSION
+static jack_session_event_t * volatile pendingSessionEvent = NULL;  /* for -nogui */
+#endif
 
 char *dssi_path = NULL;
 char *ladspa_path = NULL;
@@ -133,6 +348,13 @@ char *project_directory = NULL;
 
 int   main_timeout_tick = 0;
 
+/* The audio thread wakes the GUI thread through this pipe when there is
+ * something for it to do, instead of the GUI polling: */
+static int hostWakeupPipe[2] = { -1, -1 };
+static volatile int hostWakeupPending = 0;  /* a byte is (about to be) in the pipe */
+static int uiUpdateWanted = 0;               /* audio thread only: wake at end of cycle */
+static guint activity_timeout_tag = 0;
+
 snd_seq_event_t midiEventBuffer[EVENT_BUFFER_SIZE]; /* ring buffer */
 int midiEventReadIndex = 0, midiEventWriteIndex = 0;
 
@@ -146,6 +368,21 @@ LADSPA_Data get_port_default(const LADSPA_Descriptor *plugin, int port);
 
 void osc_error(int num, const char *m, const char *path);
 
+void osc_dispatch_table_build(void);
+jack_nframes_t osc_timetag_to_frame(lo_timetag tt);
+void osc_source_key_from_address(lo_address address, osc_source_key_t *key);
+void osc_queue_midi_events(d3h_instance_t *instance, snd_seq_event_t *events,
+                           int count);
+int  osc_control_handler(d3h_instance_t *instance, lo_arg **argv, int echo,
+                         int scheduled, jack_nframes_t when);
+int  osc_dispatch(osc_dispatch_entry_t *entry, const char *path, const char *types,
+                  lo_arg **argv, int argc, void *data, void *user_data);
+static void free_state_slot(state_slot_t *slot, int all);
+static void slot_configure(d3h_instance_t *instance, const char *key, const char *value);
+static int  query_cached_programs(d3h_instance_t *instance);
+static void free_configure_item_list(configure_item_t *item);
+static configure_item_t *copy_configure_item_list(configure_item_t *item);
+
 int osc_message_handler(const char *path, const char *types, lo_arg **argv, int
 		      argc, void *data, void *user_data) ;
 int osc_debug_handler(const char *path, const char *types, lo_arg **argv, int
@@ -165,12 +402,42 @@ ghss_debug(int type, const char *format, ...)
     va_end(args);
 }
 
+/* Wake the GUI thread (or the -nogui loop) to do its housekeeping.  This
+ * is called from the audio thread, at most once per cycle, and from the
+ * signal handler, so it must neither block nor allocate: if a wakeup is
+ * already pending, the housekeeping it triggers will see our changes too. */
+static void
+host_wakeup(void)
+{
+    char c = 0;
+
+    if (hostWakeupPipe[1] < 0 || hostWakeupPending)
+        return;
+    hostWakeupPending = 1;
+    if (write(hostWakeupPipe[1], &c, 1) < 0) {
+        /* pipe full: the GUI thread has plenty to wake it already */
+    }
+}
+
+/* Called by the GUI thread upon waking: empty the pipe, before looking at
+ * what changed. */
+static void
+host_wakeup_drain(void)
+{
+    char buf[64];
+
+    hostWakeupPending = 0;
+    while (read(hostWakeupPipe[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
 void
 signalHandler(int sig)
 
 {
     ghss_debug(GDB_MAIN, ": signal caught, trying to clean up and exit");
     host_exiting = 1;
+    host_wakeup();
 }
 
 void
@@ -227,310 +494,671 @@ setControl(d3h_instance_t *instance, long controlIn, snd_seq_event_t *event)
 
     pluginControlIns[controlIn] = value;
     pluginPortUpdated[controlIn] = 1;
+    uiUpdateWanted = 1;
 }
 
-int
-audio_callback(jack_nframes_t nframes, void *arg)
+/* Convert an OSC timetag to the JACK frame time at which it falls, using
+ * the clock mapping calibrated by the audio thread. */
+jack_nframes_t
+osc_timetag_to_frame(lo_timetag tt)
 {
-    int i;
-    jack_nframes_t last_frame_time = jack_last_frame_time(jackClient);
-    unsigned int last_tick_offset = 0;
-#ifdef MIDI_JACK
-    void* midi_port_buf = jack_port_get_buffer(jack_midi_input_port, nframes);
-    jack_midi_event_t jack_midi_event;
-    jack_nframes_t jack_midi_event_index = 0;
-    jack_nframes_t jack_midi_event_count = jack_midi_get_event_count(midi_port_buf);
-    static snd_seq_event_t jack_seq_event_holder[3];
-    snd_seq_event_t *jack_seq_event = NULL, *osc_seq_event = NULL;
-    int had_midi_overflow = 0;
-#else /* MIDI_JACK */
-    int have_full_midi_buffer = 0;
-#endif /* MIDI_JACK */
-    d3h_instance_t *instance;
+    unsigned int seq;
+    lo_timetag wall;
+    double frame;
 
-    /* Not especially pretty or efficient */
+    do {
+        seq = clock_map_seq;
+        __sync_synchronize();
+        wall = clock_map_wall;
+        frame = clock_map_frame;
+        __sync_synchronize();
+    } while ((seq & 1) || seq != clock_map_seq);
+
+    return (jack_nframes_t)lrint(frame + lo_timetag_diff(tt, wall) * sample_rate);
+}
 
-    for (i = 0; i < instance_count; i++) {
-        instanceEventCounts[i] = 0;
+/* Once per cycle, compare the wall clock against JACK's frame time and
+ * nudge the mapping between them, which is published with a sequence
+ * lock for osc_timetag_to_frame(). */
+static void
+update_clock_map(jack_nframes_t nframes)
+{
+    static int calibrated = 0;
+    lo_timetag now;
+    jack_nframes_t now_frame;
+    double predicted, error;
+
+    lo_timetag_now(&now);
+    now_frame = audio_backend->frame_time();
+
+    if (calibrated) {
+        predicted = clock_map_frame + lo_timetag_diff(now, clock_map_wall) * sample_rate;
+        error = (double)(int32_t)(now_frame - (jack_nframes_t)lrint(predicted));
+        if (fabs(error) > nframes * 2)
+            predicted = now_frame;  /* xrun or clock step, start over */
+        else
+            predicted += error * 0.05;
+    } else {
+        predicted = now_frame;
+        calibrated = 1;
     }
+    /* keep the reference frame within range of a jack_nframes_t */
+    predicted = fmod(predicted, 4294967296.0);
+
+    clock_map_seq++;
+    __sync_synchronize();
+    clock_map_wall = now;
+    clock_map_frame = predicted;
+    __sync_synchronize();
+    clock_map_seq++;
+}
 
-#ifdef MIDI_JACK
+/* Move queued control changes from the OSC thread's ring into the
+ * audio thread's pending list, which is sorted by the frame time at
+ * which each change should be rendered. */
+static void
+collect_control_events(jack_nframes_t nframes)
+{
+    control_event_t cev;
+    int i;
 
-    /* Merge MIDI events arriving via JACK and OSC */
-    while (1) {
-	snd_seq_event_t *ev;
+    if (pendingControlIndex) {
+        pendingControlCount -= pendingControlIndex;
+        memmove(pendingControls, pendingControls + pendingControlIndex,
+                pendingControlCount * sizeof(control_event_t));
+        pendingControlIndex = 0;
+    }
 
-        /* MIDI events from JACK */
-        if (jack_seq_event == NULL && (jack_midi_event_index < jack_midi_event_count)) {
+    while (controlEventReadIndex != controlEventWriteIndex &&
+           pendingControlCount < CONTROL_EVENT_BUFFER_SIZE) {
+
+        __sync_synchronize();  /* read the event only after seeing the index */
+        cev = controlEventBuffer[controlEventReadIndex];
+        __sync_synchronize();  /* finish with the event before releasing it */
+        controlEventReadIndex = (controlEventReadIndex + 1) % CONTROL_EVENT_BUFFER_SIZE;
+
+        /* Unscheduled changes are stamped with their arrival time, and are
+         * rendered one period later, same as MIDI events; scheduled ones
+         * already carry the frame time at which they should be heard. */
+        if (!cev.scheduled)
+            cev.time += nframes;
+
+        for (i = pendingControlCount;
+             i > 0 && (int32_t)(pendingControls[i - 1].time - cev.time) > 0;
+             i--)
+            pendingControls[i] = pendingControls[i - 1];
+        pendingControls[i] = cev;
+        pendingControlCount++;
+    }
+}
+
+/* Apply pending control changes due at or before frame 'start' of this
+ * cycle, and return the frame at which the next sub-block should end. */
+static jack_nframes_t
+apply_control_events(jack_nframes_t start, jack_nframes_t nframes,
+                     jack_nframes_t cycle_frame_time)
+{
+    control_event_t *cev;
+    int32_t delta;
+    jack_nframes_t offset;
 
-            int count;
+    while (pendingControlIndex < pendingControlCount) {
 
-            jack_midi_event_get(&jack_midi_event, midi_port_buf, jack_midi_event_index);
-            jack_midi_event_index++;
-
-            jack_seq_event = jack_seq_event_holder;
-            count = snd_midi_event_encode(jack_alsa_encoder, jack_midi_event.buffer,
-                                          jack_midi_event.size, jack_seq_event);
-            if (count) {
-                jack_seq_event->time.tick = jack_midi_event.time;
-                jack_seq_event->dest.client = 0;  /* flag as from MIDI thread */
-            } else
-                jack_seq_event = NULL;
+        cev = &pendingControls[pendingControlIndex];
 
+        delta = (int32_t)(cev->time - cycle_frame_time);
+        if (delta >= (int32_t)nframes) {
+            if (delta < (int32_t)sample_rate * 60)
+                return nframes;  /* leave this and following changes for a later cycle */
+            offset = start;      /* so we don't block if things get weird */
+        } else if (delta < (int32_t)start) {
+            offset = start;
         } else {
-            jack_seq_event = NULL;
+            offset = delta;
         }
 
-        /* MIDI events from OSC */
-        if (osc_seq_event == NULL && (midiEventReadIndex != midiEventWriteIndex)) {
+        if (control_subblock_min && offset >= start + control_subblock_min)
+            return offset;       /* end the sub-block here */
 
-            osc_seq_event = &midiEventBuffer[midiEventReadIndex];
+        pluginControlIns[cev->controlIn] = cev->value;
+        if (cev->echo) {
+            pluginPortUpdated[cev->controlIn] = 1;
+            uiUpdateWanted = 1;
+        }
 
-            /* de-jitter */
-            if (osc_seq_event->time.tick < last_frame_time) {
-                osc_seq_event->time.tick = 0;
-            } else {
-                osc_seq_event->time.tick -= last_frame_time;
-                if (osc_seq_event->time.tick > nframes - 1) {
-                    if (osc_seq_event->time.tick < nframes * 2) {
-                        osc_seq_event->time.tick += last_frame_time;
-                        /* !FIX! this is horribly inefficient: */
-                        osc_seq_event = NULL;  /* leave this and following events for the next process cycle */
-                    } else {
-                        osc_seq_event->time.tick = nframes - 1;  /* so we don't block if things get weird */
-                    }
-                }
-            }
-            if (osc_seq_event) {
-                midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE;
-                if (osc_seq_event->time.tick < last_tick_offset) {
-                    osc_seq_event->time.tick = last_tick_offset; /* assure monotonicity */
-                } else {
-                    last_tick_offset = osc_seq_event->time.tick;
-                }
-            }
+        pendingControlIndex++;
+    }
 
-        } else {
-            osc_seq_event = NULL;
-        }
+    return nframes;
+}
 
-        if (jack_seq_event && osc_seq_event) {
-            if (jack_seq_event->time.tick < osc_seq_event->time.tick) {
-                ev = jack_seq_event;
-                jack_seq_event = NULL;
-            } else {
-                ev = osc_seq_event;
-                osc_seq_event = NULL;
-            }
-        } else if (jack_seq_event) {
-            ev = jack_seq_event;
-            jack_seq_event = NULL;
-        } else if (osc_seq_event) {
-            ev = osc_seq_event;
-            osc_seq_event = NULL;
-        } else {
-            break;  /* no more events to process */
-        }
+/* connect_port() all audio ports to their buffers, plus 'offset' frames */
+static void
+connect_audio_ports(jack_nframes_t offset)
+{
+    int i;
+    d3h_instance_t *instance;
 
-        if (!snd_seq_ev_is_channel_type(ev)) {
-            /* discard non-channel oriented messages */
-            continue;
-        }
+    for (i = 0; i < insTotal; i++) {
+        instance = pluginAudioInInstances[i];
+        instance->plugin->descriptor->LADSPA_Plugin->connect_port
+            (instanceHandles[instance->number], pluginAudioInPortNumbers[i],
+             pluginInputBuffers[i] + offset);
+    }
+    for (i = 0; i < outsTotal; i++) {
+        instance = pluginAudioOutInstances[i];
+        instance->plugin->descriptor->LADSPA_Plugin->connect_port
+            (instanceHandles[instance->number], pluginAudioOutPortNumbers[i],
+             pluginOutputBuffers[i] + offset);
+    }
+}
 
-        if (ev->dest.client == 0 &&
-            channel2instances[ev->data.note.channel] == NULL) {
-            /* discard messages intended for channels we aren't using */
-            continue;
-        }
+static void
+run_job(run_job_t *job, jack_nframes_t nframes)
+{
+    int i = job->first;
+    d3h_instance_t *instance = &instances[i];
+
+    if (instance->plugin->descriptor->run_multiple_synths) {
+        instance->plugin->descriptor->run_multiple_synths
+            (job->count,
+             instanceHandles + i,
+             nframes,
+             segmentEventBuffers + i,
+             segmentEventCounts + i);
+    } else if (instance->plugin->descriptor->run_synth) {
+        instance->plugin->descriptor->run_synth(instanceHandles[i],
+                                                nframes,
+                                                segmentEventBuffers[i],
+                                                segmentEventCounts[i]);
+    } else if (instance->plugin->descriptor->LADSPA_Plugin->run) {
+        instance->plugin->descriptor->LADSPA_Plugin->run(instanceHandles[i],
+                                                         nframes);
+    } /* -FIX- else silence buffer? */
+}
 
-        if (ev->dest.client) {
-            /* instance-addressed event from OSC message */
-            instance = &instances[ev->dest.port];
-        } else {
-            /* channel-addressed event from MIDI thread */
-            instance = channel2instances[ev->data.note.channel];
-        }
-        while (instance) {
-            i = instance->number;
+/* claim and run jobs until there are none left this sub-block */
+static void
+run_jobs(jack_nframes_t nframes)
+{
+    int j;
+
+    while ((j = __sync_fetch_and_add(&runJobNext, 1)) < runJobCount)
+        run_job(&runJobs[j], nframes);
+}
+
+static void *
+run_worker_function(void *arg)
+{
+    while (1) {
+        sem_wait(&runStartSem);
+        if (runWorkersExiting)
+            break;
+        run_jobs(runNframes);
+        sem_post(&runDoneSem);
+    }
+    return NULL;
+}
 
-            if (ev->type == SND_SEQ_EVENT_CONTROLLER) {
+/* build the job list, and start any worker threads */
+static int
+run_jobs_init(void)
+{
+    int i;
+    d3h_instance_t *instance;
 
-                int controller = ev->data.control.param;
+    runJobs = (run_job_t *)malloc(instance_count * sizeof(run_job_t));
+    runJobCount = 0;
+    i = 0;
+    while (i < instance_count) {
+        instance = &instances[i];
+        runJobs[runJobCount].first = i;
+        if (instance->plugin->descriptor->run_multiple_synths)
+            runJobs[runJobCount].count = instance->plugin->instances;
+        else
+            runJobs[runJobCount].count = 1;
+        i += runJobs[runJobCount].count;
+        runJobCount++;
+    }
 
-                ghss_debug_rt(GDB_MIDI_CC, ": %s MIDI CC %d(0x%02x) = %d",
-                              instance->friendly_name, controller, controller,
-                              ev->data.control.value);
+    if (run_thread_count > runJobCount)
+        run_thread_count = runJobCount;
+    if (run_thread_count < 2)
+        return 1;
 
-                if (controller == 0) { // bank select MSB
+    sem_init(&runStartSem, 0, 0);
+    sem_init(&runDoneSem, 0, 0);
+    runWorkers = (pthread_t *)malloc((run_thread_count - 1) * sizeof(pthread_t));
+    for (i = 0; i < run_thread_count - 1; i++) {
+        if (audio_backend ?
+                audio_backend->create_thread(&runWorkers[i], run_worker_function, NULL) :
+                pthread_create(&runWorkers[i], NULL, run_worker_function, NULL)) {
+            ghss_debug(GDB_ERROR, ": could not create plugin worker thread");
+            break;
+        }
+        runWorkerCount++;
+    }
+    ghss_debug(GDB_MAIN, ": running plugins on %d threads", runWorkerCount + 1);
 
-                    instance->pendingBankMSB = ev->data.control.value;
+    return 1;
+}
 
-                } else if (controller == 32) { // bank select LSB
+static void
+run_jobs_cleanup(void)
+{
+    int i;
 
-                    instance->pendingBankLSB = ev->data.control.value;
+    if (!runWorkerCount)
+        return;
+    runWorkersExiting = 1;
+    for (i = 0; i < runWorkerCount; i++)
+        sem_post(&runStartSem);
+    for (i = 0; i < runWorkerCount; i++)
+        pthread_join(runWorkers[i], NULL);
+    runWorkerCount = 0;
+}
 
-                } else if (controller > 0 && controller < MIDI_CONTROLLER_COUNT) {
+/* run all instances for the 'nframes' frames starting at 'offset' */
+static void
+run_plugins(jack_nframes_t offset, jack_nframes_t nframes)
+{
+    int i;
+    unsigned long first, count;
+    snd_seq_event_t *ev;
+    d3h_instance_t *instance;
+    jack_nframes_t end = offset + nframes;
 
-                    long controlIn = instance->controllerMap[controller];
-                    if (controlIn >= 0) {
+    /* gather each instance's events for this sub-block, rebased to its start */
+    for (i = 0; i < instance_count; i++) {
+        first = segmentEventIndex[i];
+        ev = instanceEventBuffers[i] + first;
+        for (count = 0;
+             first + count < instanceEventCounts[i] && ev[count].time.tick < end;
+             count++)
+            ev[count].time.tick -= offset;
+        segmentEventBuffers[i] = ev;
+        segmentEventCounts[i] = count;
+        segmentEventIndex[i] = first + count;
+    }
 
-                        /* controller is mapped to LADSPA port, update the port */
-                        setControl(instance, controlIn, ev);
+    /* call run_multiple_synths(), run_synth() or run() for all instances */
+    if (runWorkerCount) {
+        runNframes = nframes;
+        runJobNext = 0;
+        __sync_synchronize();
+        for (i = 0; i < runWorkerCount; i++)
+            sem_post(&runStartSem);
+        run_jobs(nframes);
+        for (i = 0; i < runWorkerCount; i++)
+            sem_wait(&runDoneSem);
+    } else {
+        for (i = 0; i < runJobCount; i++)
+            run_job(&runJobs[i], nframes);
+    }
+}
 
-                    } else {
+/* Data entry, switches, (N)RPN and channel mode controllers carry meaning in
+ * every value, so are never coalesced. */
+static inline int
+controller_is_coalescible(int controller)
+{
+    return !(controller == 6 || controller == 38 ||
+             (controller >= 64 && controller <= 69) ||
+             (controller >= 96 && controller <= 101) ||
+             controller >= 120);
+}
 
-                        /* controller is not mapped, so pass the event through to plugin */
-                        if (instanceEventCounts[i] < EVENT_BUFFER_SIZE) {
-                            instanceEventBuffers[i][instanceEventCounts[i]] = *ev;
-                            instanceEventCounts[i]++;
-                        } else
-                            had_midi_overflow = 1;
-                    }
+/* Append an event to instance i's event buffer, or, if coalescing is
+ * enabled and this is a recent repeat of a continuous controller, pitch
+ * bend, or channel pressure, update the earlier event in place. */
+static void
+append_instance_event(int i, snd_seq_event_t *ev)
+{
+    snd_seq_event_t *prev;
+    coalesce_slot_t *slot;
+    int key;
+
+    if (coalesce_frames) {
+        switch (ev->type) {
+          case SND_SEQ_EVENT_CONTROLLER:
+            key = ev->data.control.param;
+            if (key >= MIDI_CONTROLLER_COUNT || !controller_is_coalescible(key))
+                key = -1;
+            break;
+          case SND_SEQ_EVENT_PITCHBEND:
+            key = MIDI_CONTROLLER_COUNT;
+            break;
+          case SND_SEQ_EVENT_CHANPRESS:
+            key = MIDI_CONTROLLER_COUNT + 1;
+            break;
+          default:
+            key = -1;
+            break;
+        }
+        if (key >= 0) {
+            slot = &instanceCoalesceSlots[i][(ev->data.control.channel & 15) *
+                                             COALESCE_KEYS_PER_CHANNEL + key];
+            if (slot->cycle == coalesce_cycle) {
+                prev = &instanceEventBuffers[i][slot->index];
+                if (ev->time.tick >= prev->time.tick &&
+                    ev->time.tick - prev->time.tick < (unsigned int)coalesce_frames) {
+                    prev->data.control.value = ev->data.control.value;
+                    return;
                 }
+            }
+            if (instanceEventCounts[i] < EVENT_BUFFER_SIZE) {
+                slot->cycle = coalesce_cycle;
+                slot->index = instanceEventCounts[i];
+            }
+        }
+    }
 
-            } else if (ev->type == SND_SEQ_EVENT_PGMCHANGE) {
-            
-                instance->pendingProgramChange = ev->data.control.value;
-                instance->uiNeedsProgramUpdate = 1;
+    if (instanceEventCounts[i] < EVENT_BUFFER_SIZE) {
+        instanceEventBuffers[i][instanceEventCounts[i]] = *ev;
+        instanceEventCounts[i]++;
+    }
+}
 
-            } else {
+/* Rebuild zoneKeyMasks[] from the instances' key zones. */
+static void
+compile_zones(void)
+{
+    int i, route, key;
+    d3h_instance_t *instance;
 
-                if (instanceEventCounts[i] < EVENT_BUFFER_SIZE) {
-                    instanceEventBuffers[i][instanceEventCounts[i]] = *ev;
-                    instanceEventCounts[i]++;
-                } else
-                    had_midi_overflow = 1;
-            }
+    for (i = 0; i < instance_count; i++) {
+        instance = &instances[i];
+        route = instance->midi_port * GHSS_MAX_CHANNELS + instance->channel;
+        for (key = 0; key < 128; key++)
+            zoneKeyMasks[route][key] &= ~(1u << i);
+        for (key = instance->key_lo; key <= instance->key_hi; key++)
+            zoneKeyMasks[route][key] |= (1u << i);
+    }
+    zone_compiled_generation = zone_generation;
+}
 
-            instance->midi_activity_tick = main_timeout_tick;
+/* Returns true if a channel-addressed note event should not be delivered
+ * to 'instance' because it lies outside the instance's zone.  Note-offs
+ * (including velocity-zero note-ons, which dispatch_midi_event() turns
+ * into note-offs first) are only filtered by key, so a change of velocity
+ * zone can't leave a note hanging. */
+static inline int
+outside_zone(d3h_instance_t *instance, snd_seq_event_t *ev)
+{
+    switch (ev->type) {
+      case SND_SEQ_EVENT_NOTEON:
+        if (ev->data.note.velocity < instance->vel_lo ||
+            ev->data.note.velocity > instance->vel_hi)
+            return 1;
+        /* fall through */
+      case SND_SEQ_EVENT_NOTEOFF:
+      case SND_SEQ_EVENT_KEYPRESS:
+        return !(zoneKeyMasks[EVENT_ROUTE(ev)][ev->data.note.note & 127] &
+                 (1u << instance->number));
+      default:
+        return 0;
+    }
+}
 
-            if (!ev->dest.client)
-                instance = instance->channel_next_instance; /* repeat for next instance on this channel, if any */
-            else
-                break;  /* event is just for this instance */
+/* Choose which member of a voice farm a note event goes to:  a note-on goes
+ * to the member with the fewest notes playing (round-robin among equals),
+ * and its note-off and key pressure follow it.  Returns the member's index
+ * within the farm, or -1 to send the event to all members.  A velocity-zero
+ * note-on is a note-off here, whether or not the caller has converted it,
+ * since treating it as a retrigger would leave the member's voice count
+ * too high for good. */
+static int
+farm_note_target(d3h_instance_t *leader, snd_seq_event_t *ev)
+{
+    int key = (ev->data.note.channel & 15) * 128 + (ev->data.note.note & 127);
+    int owner = leader->farm_note_owner[key];
+    int i, m, best;
+    int type = ev->type;
+
+    if (type == SND_SEQ_EVENT_NOTEON && ev->data.note.velocity == 0)
+        type = SND_SEQ_EVENT_NOTEOFF;
+
+    switch (type) {
+      case SND_SEQ_EVENT_NOTEON:
+        if (owner != FARM_NO_OWNER)
+            return owner;  /* retrigger on the same member */
+        best = leader->farm_next;
+        for (i = 1; i < leader->farm_size; i++) {
+            m = (leader->farm_next + i) % leader->farm_size;
+            if (leader[m].farm_voices < leader[best].farm_voices)
+                best = m;
         }
+        leader->farm_next = (best + 1) % leader->farm_size;
+        leader->farm_note_owner[key] = best;
+        leader[best].farm_voices++;
+        return best;
+
+      case SND_SEQ_EVENT_NOTEOFF:
+        if (owner == FARM_NO_OWNER)
+            return -1;
+        leader->farm_note_owner[key] = FARM_NO_OWNER;
+        leader[owner].farm_voices--;
+        return owner;
+
+      case SND_SEQ_EVENT_KEYPRESS:
+        return (owner == FARM_NO_OWNER ? -1 : owner);
+
+      default:
+        return -1;
     }
+}
 
-    if (had_midi_overflow) {
-        ghss_debug_rt(GDB_MIDI, " audio_callback: MIDI overflow");
+/* forget all of a farm's notes on a channel, after all notes/sound off */
+static void
+farm_reset_channel(d3h_instance_t *leader, int channel)
+{
+    unsigned char *owner = leader->farm_note_owner + (channel & 15) * 128;
+    int key;
+
+    for (key = 0; key < 128; key++) {
+        if (owner[key] != FARM_NO_OWNER) {
+            leader[owner[key]].farm_voices--;
+            owner[key] = FARM_NO_OWNER;
+        }
     }
-#else /* MIDI_JACK */
-    for ( ; midiEventReadIndex != midiEventWriteIndex;
-         midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE) {
+}
 
-	snd_seq_event_t *ev = &midiEventBuffer[midiEventReadIndex];
-        jack_nframes_t previous_frame_time;
+/* Deliver a channel event to the instance(s) it is addressed to:  bank
+ * selects and program changes become pending program changes, mapped
+ * controllers update their ports, and everything else is appended to
+ * the instances' event buffers.  Returns non-zero if an instance's event
+ * buffer is full. */
+static int
+dispatch_midi_event(snd_seq_event_t *ev)
+{
+    int i, full = 0;
+    d3h_instance_t *instance, *leader;
 
-        if (!snd_seq_ev_is_channel_type(ev)) {
-            /* discard non-channel oriented messages */
-            continue;
-        }
+    dispatch_serial++;
 
-        if (ev->dest.client == 0 &&
-            channel2instances[ev->data.note.channel] == NULL) {
-            /* discard messages intended for channels we aren't using */
+    /* JACK MIDI input isn't normalized the way ALSA, OSC and MIDI file
+     * input is, so do it here, before zones and voice farms see it */
+    if (ev->type == SND_SEQ_EVENT_NOTEON && ev->data.note.velocity == 0)
+        ev->type = SND_SEQ_EVENT_NOTEOFF;
+
+    if (ev->dest.client) {
+        /* instance-addressed event from OSC message */
+        instance = &instances[ev->dest.port];
+    } else {
+        /* channel-addressed event from MIDI thread */
+        instance = channel2instances[EVENT_ROUTE(ev)];
+    }
+    while (instance) {
+        i = instance->number;
+
+        if (!ev->dest.client && outside_zone(instance, ev)) {
+            instance = instance->channel_next_instance;
             continue;
         }
 
-        /* MIDI event de-jittering:
-         * The MIDI thread sets ev->time.tick to the JACK rolling frame time
-         * of the event's arrival, and subtracting (jack_last_frame_time() -
-         * nframes) from that gives an approximate frame offset relative to
-         * the current cycle.  With some clipping, we use that as this cycle's
-         * frame offset. */
-        /* !FIX! test this with recent JACK SVN! */
-        previous_frame_time = last_frame_time - nframes;
-        if (ev->time.tick < previous_frame_time) {
-            ev->time.tick = 0;
-        } else {
-            ev->time.tick -= previous_frame_time;
-            if (ev->time.tick > nframes - 1) {
-                if (ev->time.tick < nframes * 2) {
-                    ev->time.tick += previous_frame_time;
-                    break;  /* leave this and following events for the next process cycle */
-                } else {
-                    ev->time.tick = nframes - 1;  /* so we don't block if things get weird */
-                }
+        if (!ev->dest.client && instance->farm_leader &&
+            (ev->type == SND_SEQ_EVENT_NOTEON || ev->type == SND_SEQ_EVENT_NOTEOFF ||
+             ev->type == SND_SEQ_EVENT_KEYPRESS)) {
+            /* voice farm: note goes to just one member */
+            leader = instance->farm_leader;
+            if (leader->farm_event_serial != dispatch_serial) {
+                leader->farm_event_serial = dispatch_serial;
+                leader->farm_event_target = farm_note_target(leader, ev);
+            }
+            if (leader->farm_event_target >= 0 &&
+                instance != leader + leader->farm_event_target) {
+                instance = instance->channel_next_instance;
+                continue;
             }
-        }
-        if (ev->time.tick < last_tick_offset) {
-            ev->time.tick = last_tick_offset; /* assure monotonicity */
-        } else {
-            last_tick_offset = ev->time.tick;
         }
 
-        if (ev->dest.client) {
-            /* instance-addressed event from OSC message */
-            instance = &instances[ev->dest.port];
-        } else {
-            /* channel-addressed event from MIDI thread */
-            instance = channel2instances[ev->data.note.channel];
-        }
-        while (instance) {
-            i = instance->number;
+        if (ev->type == SND_SEQ_EVENT_CONTROLLER) {
 
-            if (ev->type == SND_SEQ_EVENT_CONTROLLER) {
+            int controller = ev->data.control.param;
 
-                int controller = ev->data.control.param;
+            ghss_debug_rt(GDB_MIDI_CC, ": %s MIDI CC %d(0x%02x) = %d",
+                          instance->friendly_name, controller, controller,
+                          ev->data.control.value);
 
-                ghss_debug_rt(GDB_MIDI_CC, ": %s MIDI CC %d(0x%02x) = %d",
-                              instance->friendly_name, controller, controller,
-                              ev->data.control.value);
+            if ((controller == 120 || controller == 123) &&
+                instance->farm_leader == instance)
+                farm_reset_channel(instance, ev->data.control.channel);
 
-                if (controller == 0) { // bank select MSB
+            if (controller == 0) { // bank select MSB
 
-                    instance->pendingBankMSB = ev->data.control.value;
+                instance->pendingBankMSB = ev->data.control.value;
 
-                } else if (controller == 32) { // bank select LSB
+            } else if (controller == 32) { // bank select LSB
 
-                    instance->pendingBankLSB = ev->data.control.value;
+                instance->pendingBankLSB = ev->data.control.value;
 
-                } else if (controller > 0 && controller < MIDI_CONTROLLER_COUNT) {
+            } else if (controller > 0 && controller < MIDI_CONTROLLER_COUNT) {
 
-                    long controlIn = instance->controllerMap[controller];
-                    if (controlIn >= 0) {
+                long controlIn = instance->controllerMap[controller];
+                if (controlIn >= 0) {
 
-                        /* controller is mapped to LADSPA port, update the port */
-                        setControl(instance, controlIn, ev);
+                    /* controller is mapped to LADSPA port, update the port */
+                    setControl(instance, controlIn, ev);
 
-                    } else {
+                } else {
 
-                        /* controller is not mapped, so pass the event through to plugin */
-                        instanceEventBuffers[i][instanceEventCounts[i]] = *ev;
-                        instanceEventCounts[i]++;
-                    }
+                    /* controller is not mapped, so pass the event through to plugin */
+                    append_instance_event(i, ev);
                 }
+            }
 
-            } else if (ev->type == SND_SEQ_EVENT_PGMCHANGE) {
+        } else if (ev->type == SND_SEQ_EVENT_PGMCHANGE) {
             
-                instance->pendingProgramChange = ev->data.control.value;
-                instance->uiNeedsProgramUpdate = 1;
+            instance->pendingProgramChange = ev->data.control.value;
+            instance->uiNeedsProgramUpdate = 1;
+            uiUpdateWanted = 1;
 
-            } else {
+        } else {
 
-                instanceEventBuffers[i][instanceEventCounts[i]] = *ev;
-                instanceEventCounts[i]++;
-            }
+            append_instance_event(i, ev);
+        }
 
-            if (instanceEventCounts[i] == EVENT_BUFFER_SIZE)
-                have_full_midi_buffer = 1;
+        if (instanceEventCounts[i] == EVENT_BUFFER_SIZE)
+            full = 1;
 
+        if (instance->midi_activity_tick != main_timeout_tick) {
+            /* only the first event per activity tick need light the LED */
             instance->midi_activity_tick = main_timeout_tick;
-
-            if (!ev->dest.client)
-                instance = instance->channel_next_instance; /* repeat for next instance on this channel, if any */
-            else
-                break;  /* event is just for this instance */
+            uiUpdateWanted = 1;
         }
 
-        /* stop processing incoming MIDI if an instance's event buffer
-         * became full. */
-        if (have_full_midi_buffer)
+        if (!ev->dest.client)
+            instance = instance->channel_next_instance; /* repeat for next instance on this channel, if any */
+        else
+            break;  /* event is just for this instance */
+    }
+
+    return full;
+}
+
+/* Add a timetagged OSC event to the list of scheduled events, which is
+ * kept sorted by (absolute JACK frame) time. */
+static void
+schedule_midi_event(snd_seq_event_t *ev)
+{
+    int i;
+
+    if (scheduledEventCount == EVENT_BUFFER_SIZE) {
+        ghss_debug_rt(GDB_OSC, " audio_callback: scheduled MIDI event buffer overflow");
+        return;
+    }
+    for (i = scheduledEventCount;
+         i > 0 && (int32_t)(scheduledEvents[i - 1].time.tick - ev->time.tick) > 0;
+         i--)
+        scheduledEvents[i] = scheduledEvents[i - 1];
+    scheduledEvents[i] = *ev;
+    scheduledEvents[i].tag = 0;
+    scheduledEventCount++;
+}
+
+/* Dispatch those scheduled events which fall within this cycle, then
+ * restore the time order of any instance event buffers they went into. */
+static void
+dispatch_scheduled_midi_events(jack_nframes_t last_frame_time, jack_nframes_t nframes)
+{
+    int i, n;
+    int32_t delta;
+    unsigned long j, k;
+    snd_seq_event_t *buffer, tmp;
+
+    for (n = 0; n < scheduledEventCount; n++) {
+        snd_seq_event_t *ev = &scheduledEvents[n];
+
+        delta = (int32_t)(ev->time.tick - last_frame_time);
+        if (delta >= (int32_t)nframes)
             break;
+        ev->time.tick = (delta < 0 ? 0 : delta);
+        if (dispatch_midi_event(ev))
+            ghss_debug_rt(GDB_MIDI, " audio_callback: MIDI overflow");
     }
-#endif /* MIDI_JACK */
+    if (n == 0)
+        return;
+    scheduledEventCount -= n;
+    memmove(scheduledEvents, scheduledEvents + n,
+            scheduledEventCount * sizeof(snd_seq_event_t));
+
+    /* insertion sort, which is cheap on nearly-sorted buffers */
+    for (i = 0; i < instance_count; i++) {
+        buffer = instanceEventBuffers[i];
+        for (j = 1; j < instanceEventCounts[i]; j++) {
+            if (buffer[j].time.tick >= buffer[j - 1].time.tick)
+                continue;
+            tmp = buffer[j];
+            for (k = j; k > 0 && buffer[k - 1].time.tick > tmp.time.tick; k--)
+                buffer[k] = buffer[k - 1];
+            buffer[k] = tmp;
+        }
+    }
+}
+
+/* start of a cycle: clear the instances' event buffers */
+static void
+begin_cycle(void)
+{
+    int i;
+
+    for (i = 0; i < instance_count; i++) {
+        instanceEventCounts[i] = 0;
+    }
+    if (++coalesce_cycle == 0)  /* invalidates all coalescing slots */
+        coalesce_cycle = 1;
+
+    if (zone_compiled_generation != zone_generation)
+        compile_zones();
+}
+
+/* process pending program changes */
+static void
+apply_program_changes(void)
+{
+    int i;
+    d3h_instance_t *instance;
 
-    /* process pending program changes */
     for (i = 0; i < instance_count; i++) {
         instance = &instances[i];
 
@@ -569,447 +1197,1992 @@ audio_callback(jack_nframes_t nframes, void *arg)
             }
         }
     }
+}
 
-    /* connect input port buffers */
-    for (i = 0; i < insTotal; i++) {
-
-	jack_default_audio_sample_t *buffer =
-	    jack_port_get_buffer(inputPorts[i], nframes);
+/* Recall a state slot, if one has been requested: select each instance's
+ * saved program, then copy in the whole saved control vector, so the
+ * plugins switch over between one cycle and the next.  The slot's
+ * configure items were already applied by the OSC thread. */
+static void
+apply_slot_recall(void)
+{
+    state_slot_t *slot = pendingSlotRecall;
+    d3h_instance_t *instance;
+    int i;
 
-        if (buffer != pluginInputBuffers[i]) {
-            pluginInputBuffers[i] = buffer;
-            instance = pluginAudioInInstances[i];
-            instance->plugin->descriptor->LADSPA_Plugin->connect_port
-                (instanceHandles[instance->number], pluginAudioInPortNumbers[i],
-                 buffer);
-        }
-    }
+    if (!slot)
+        return;
 
-    /* call run_multiple_synths(), run_synth() or run() for all instances */
-    i = 0;
-    while (i < instance_count) {
+    for (i = 0; i < instance_count; i++) {
         instance = &instances[i];
-        if (instance->plugin->descriptor->run_multiple_synths) {
-            instance->plugin->descriptor->run_multiple_synths
-                (instance->plugin->instances,
-                 instanceHandles + i,
-                 nframes,
-                 instanceEventBuffers + i,
-                 instanceEventCounts + i);
-            i += instance->plugin->instances;
-        } else if (instance->plugin->descriptor->run_synth) {
-            instance->plugin->descriptor->run_synth(instanceHandles[i],
-                                                    nframes,
-                                                    instanceEventBuffers[i],
-                                                    instanceEventCounts[i]);
-            i++;
-        } else if (instance->plugin->descriptor->LADSPA_Plugin->run) {
-            instance->plugin->descriptor->LADSPA_Plugin->run(instanceHandles[i],
-                                                             nframes);
-            i++;
-        } /* -FIX- else silence buffer? */
+
+        if (instance->plugin->descriptor->select_program) {
+            instance->currentBank = slot->bank[i];
+            instance->currentProgram = slot->program[i];
+            instance->plugin->descriptor->
+                select_program(instanceHandles[instance->number],
+                               instance->currentBank,
+                               instance->currentProgram);
+            instance->uiNeedsProgramUpdate = 1;
+        }
     }
+    memcpy(pluginControlIns, slot->controls, controlInsTotal * sizeof(LADSPA_Data));
+    for (i = 0; i < controlInsTotal; i++)
+        pluginPortUpdated[i] = 1;
+    uiUpdateWanted = 1;
 
-    for (i = 0; i < outsTotal; ++i) {
+    /* done with the slot, unless the OSC thread has since asked for another */
+    __sync_bool_compare_and_swap(&pendingSlotRecall, slot, NULL);
+}
 
-	jack_default_audio_sample_t *buffer =
-	    jack_port_get_buffer(outputPorts[i], nframes);
+/* Copy the control vector for a save or slot store, if one is waiting. */
+static void
+apply_control_capture(void)
+{
+    LADSPA_Data *copy = pendingControlCapture;
 
-	/* -FIX- this memcpy could be avoided for anything this host is not
-         * doing post-plugin processing on */
-	memcpy(buffer, pluginOutputBuffers[i], nframes * sizeof(LADSPA_Data));
+    if (copy) {
+        memcpy(copy, pluginControlIns, controlInsTotal * sizeof(LADSPA_Data));
+        __sync_synchronize();
+        if (__sync_bool_compare_and_swap(&pendingControlCapture, copy, NULL))
+            sem_post(&controlCaptureSem);
     }
-
-    return 0;
 }
 
-#ifdef JACK_SESSION
-int 
-session_gui_idle_callback( void *arg )
+/* Apply queued control changes and run the plugins for a cycle, in
+ * sub-blocks if splitting is enabled, then mix any voice farm members'
+ * output into their leaders'. */
+static void
+run_cycle(jack_nframes_t nframes, jack_nframes_t last_frame_time)
 {
-    char *filename;
-    char *command;
-    jack_session_event_t *session_event = (jack_session_event_t *) arg;
+    int i;
+    jack_nframes_t offset, end;
+    int split = 0;
+    d3h_instance_t *instance;
 
-    filename = g_strdup_printf( "%sghostess.cfg", session_event->session_dir );
-    command = "/bin/sh ${SESSION_DIR}ghostess.cfg";
+    for (i = 0; i < instance_count; i++) {
+        segmentEventIndex[i] = 0;
+    }
+    collect_control_events(nframes);
+    offset = 0;
+    do {
+        end = apply_control_events(offset, nframes, last_frame_time);
+        if (offset) {
+            connect_audio_ports(offset);
+            split = 1;
+        }
+        run_plugins(offset, end - offset);
+        offset = end;
+    } while (offset < nframes);
+    if (split)
+        connect_audio_ports(0);
 
-    ghss_debug(GDB_MAIN | GDB_GUI, " session_gui_idle_callback: %s to '%s'",
-               (session_event->type == JackSessionSaveAndQuit ? "save-and-quit" : "save"),
-               filename);
+    /* mix voice farm members' output into their leaders' */
+    for (i = 0; i < outsTotal; ++i) {
+        instance = pluginAudioOutInstances[i];
+        if (is_farm_member(instance)) {
+            LADSPA_Data *in, *out;
+            jack_nframes_t n;
+
+            in = pluginOutputBuffers[i];
+            out = pluginOutputBuffers[instance->farm_leader->firstAudioOut +
+                                      i - instance->firstAudioOut];
+            for (n = 0; n < nframes; n++)
+                out[n] += in[n];
+        }
+    }
+}
 
-    /* -FIX- is there no way for a client to report a save failure back to JACK? */
-    /* int rc = */ write_configuration( filename, session_event->client_uuid );
+/* Merge the cycle's MIDI events with those from OSC, and fan them out to
+ * the instances' event buffers.  With JACK MIDI, 'midi_events' holds the
+ * cycle's decoded JACK MIDI input; otherwise MIDI events arrive with those
+ * from OSC in the ring buffer, and 'midi_events' is unused. */
+static void
+merge_midi_events(snd_seq_event_t *midi_events, int midi_event_count,
+                  jack_nframes_t nframes, jack_nframes_t last_frame_time)
+{
+    unsigned int last_tick_offset = 0;
+#ifdef MIDI_JACK
+    int midi_event_index = 0;
+    snd_seq_event_t *jack_seq_event = NULL, *osc_seq_event = NULL;
+    int had_midi_overflow = 0;
 
-    g_free(filename);
+    /* Merge MIDI events arriving via JACK and OSC */
+    while (1) {
+	snd_seq_event_t *ev;
 
-    session_event->command_line = g_strdup( command );
+        /* MIDI events from JACK */
+        if (jack_seq_event == NULL && midi_event_index < midi_event_count) {
+            jack_seq_event = &midi_events[midi_event_index++];
+        }
 
-    jack_session_reply( jackClient, session_event );
+        /* MIDI events from OSC */
+        while (osc_seq_event == NULL && (midiEventReadIndex != midiEventWriteIndex)) {
 
-    if (session_event->type == JackSessionSaveAndQuit)
-	host_exiting = TRUE;
+            osc_seq_event = &midiEventBuffer[midiEventReadIndex];
 
-    jack_session_event_free (session_event);
+            if (osc_seq_event->tag == GHSS_EVENT_SCHEDULED) {
+                /* timetagged, hold until its time comes */
+                schedule_midi_event(osc_seq_event);
+                midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE;
+                osc_seq_event = NULL;
+                continue;
+            }
 
-    return 0; /* remove this source */
-}
+            /* de-jitter */
+            if (osc_seq_event->time.tick < last_frame_time) {
+                osc_seq_event->time.tick = 0;
+            } else {
+                osc_seq_event->time.tick -= last_frame_time;
+                if (osc_seq_event->time.tick > nframes - 1) {
+                    if (osc_seq_event->time.tick < nframes * 2) {
+                        osc_seq_event->time.tick += last_frame_time;
+                        /* !FIX! this is horribly inefficient: */
+                        osc_seq_event = NULL;  /* leave this and following events for the next process cycle */
+                        break;
+                    } else {
+                        osc_seq_event->time.tick = nframes - 1;  /* so we don't block if things get weird */
+                    }
+                }
+            }
+            if (osc_seq_event) {
+                midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE;
+                if (osc_seq_event->time.tick < last_tick_offset) {
+                    osc_seq_event->time.tick = last_tick_offset; /* assure monotonicity */
+                } else {
+                    last_tick_offset = osc_seq_event->time.tick;
+                }
+            }
+        }
 
-void session_callback( jack_session_event_t *event, void *arg )
-{
-    g_idle_add( session_gui_idle_callback, event );
-}
-#endif
+        if (jack_seq_event && osc_seq_event) {
+            if (jack_seq_event->time.tick < osc_seq_event->time.tick) {
+                ev = jack_seq_event;
+                jack_seq_event = NULL;
+            } else {
+                ev = osc_seq_event;
+                osc_seq_event = NULL;
+            }
+        } else if (jack_seq_event) {
+            ev = jack_seq_event;
+            jack_seq_event = NULL;
+        } else if (osc_seq_event) {
+            ev = osc_seq_event;
+            osc_seq_event = NULL;
+        } else {
+            break;  /* no more events to process */
+        }
 
-#ifndef RTLD_LOCAL
-#define RTLD_LOCAL  (0)
-#endif
+        if (!snd_seq_ev_is_channel_type(ev)) {
+            /* discard non-channel oriented messages */
+            continue;
+        }
 
-static char *
-search_path(const char *paths, const char *name, void **dll)
-{
-    gchar **elem;
-    int i;
-    char *path, *file;
-    void *handle;
-    const char *message;
+        if (ev->dest.client == 0 &&
+            channel2instances[EVENT_ROUTE(ev)] == NULL) {
+            /* discard messages intended for channels we aren't using */
+            continue;
+        }
 
-    elem = g_strsplit(paths, ":", 0);
+        if (dispatch_midi_event(ev))
+            had_midi_overflow = 1;
+    }
 
-    for (i = 0; elem[i]; i++) {
-        path = elem[i];
+    if (had_midi_overflow) {
+        ghss_debug_rt(GDB_MIDI, " audio_callback: MIDI overflow");
+    }
+#else /* MIDI_JACK */
+    for ( ; midiEventReadIndex != midiEventWriteIndex;
+         midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE) {
 
-        if (strlen(path) == 0)
+	snd_seq_event_t *ev = &midiEventBuffer[midiEventReadIndex];
+        jack_nframes_t previous_frame_time;
+
+        if (!snd_seq_ev_is_channel_type(ev)) {
+            /* discard non-channel oriented messages */
             continue;
-        if (!g_path_is_absolute(path)) {
-            ghss_debug(GDB_DSSI, ": ignoring plugin search path relative element '%s'", path);
+        }
+
+        if (ev->dest.client == 0 &&
+            channel2instances[EVENT_ROUTE(ev)] == NULL) {
+            /* discard messages intended for channels we aren't using */
             continue;
         }
 
-        file = g_build_filename(path, name, NULL);
+        if (ev->dest.client && ev->tag == GHSS_EVENT_SCHEDULED) {
+            /* timetagged OSC event, hold until its time comes */
+            schedule_midi_event(ev);
+            continue;
+        }
 
-        handle = dlopen(file, RTLD_NOW |    /* real-time programs should not use RTLD_LAZY */
-                              RTLD_LOCAL);  /* do not share symbols across plugins */
-        if (handle) {
-            ghss_debug(GDB_DSSI, ": '%s' found at '%s'", name, file);
-            *dll = handle;
-            path = g_strdup(path);
-            g_free(file);
-            g_strfreev(elem);
-            return path;
+        /* MIDI event de-jittering:
+         * The MIDI thread sets ev->time.tick to the audio backend's rolling frame time
+         * of the event's arrival, and subtracting (last_frame_time -
+         * nframes) from that gives an approximate frame offset relative to
+         * the current cycle.  With some clipping, we use that as this cycle's
+         * frame offset. */
+        /* !FIX! test this with recent JACK SVN! */
+        previous_frame_time = last_frame_time - nframes;
+        if (ev->time.tick < previous_frame_time) {
+            ev->time.tick = 0;
+        } else {
+            ev->time.tick -= previous_frame_time;
+            if (ev->time.tick > nframes - 1) {
+                if (ev->time.tick < nframes * 2) {
+                    ev->time.tick += previous_frame_time;
+                    break;  /* leave this and following events for the next process cycle */
+                } else {
+                    ev->time.tick = nframes - 1;  /* so we don't block if things get weird */
+                }
+            }
         }
-        
-        message = dlerror();
-        if (message) {
-            ghss_debug(GDB_DSSI, ": dlopen of '%s' failed: %s", file, message);
+        if (ev->time.tick < last_tick_offset) {
+            ev->time.tick = last_tick_offset; /* assure monotonicity */
         } else {
-            ghss_debug(GDB_DSSI, ": dlopen of '%s' failed", file);
+            last_tick_offset = ev->time.tick;
         }
-        
-        g_free(file);
-    }
-    
-    g_strfreev(elem);
-    return NULL;
-}
 
-char *
-load(const char *dllName, void **dll) /* returns directory where dll found */
+        /* stop processing incoming MIDI if an instance's event buffer
+         * became full. */
+        if (dispatch_midi_event(ev)) {
+            midiEventReadIndex = (midiEventReadIndex + 1) % EVENT_BUFFER_SIZE;
+            break;
+        }
+    }
+#endif /* MIDI_JACK */
+
+    /* timetagged OSC events due this cycle */
+    if (scheduledEventCount)
+        dispatch_scheduled_midi_events(last_frame_time, nframes);
+}
+
+int
+audio_callback(jack_nframes_t nframes, void *arg)
+{
+    int i;
+    jack_nframes_t last_frame_time = audio_backend->last_frame_time();
+#ifdef MIDI_JACK
+    void* midi_port_buf;
+    jack_midi_event_t jack_midi_event;
+    jack_nframes_t jack_midi_event_index;
+    jack_nframes_t jack_midi_event_count;
+    midi_decoder_t decoder;
+    int jack_event_count = 0, j, n, port, best;
+    int run_next[GHSS_MAX_MIDI_PORTS], run_end[GHSS_MAX_MIDI_PORTS];
+    snd_seq_event_t *events = jackMidiEvents;
+#endif /* MIDI_JACK */
+    d3h_instance_t *instance;
+
+    begin_cycle();
+
+    update_clock_map(nframes);
+
+#ifdef MIDI_JACK
+
+    /* Decode the whole JACK MIDI buffer of each port up front.  Each JACK
+     * MIDI event should be a complete message, so the decoder is reset for
+     * each, but any extra messages (e.g. via running status) in one are
+     * kept. */
+    for (port = 0; port < midi_port_count; port++) {
+
+        run_next[port] = run_end[port] = jack_event_count;
+        if (!jack_midi_input_ports[port])
+            continue;  /* no JACK client, so MIDI input is by OSC only */
+        midi_port_buf = jack_port_get_buffer(jack_midi_input_ports[port], nframes);
+        jack_midi_event_count = jack_midi_get_event_count(midi_port_buf);
+
+        for (jack_midi_event_index = 0;
+             jack_midi_event_index < jack_midi_event_count &&
+                 jack_event_count < EVENT_BUFFER_SIZE;
+             jack_midi_event_index++) {
+
+            jack_midi_event_get(&jack_midi_event, midi_port_buf, jack_midi_event_index);
+
+            midi_decoder_reset(&decoder);
+            n = midi_decoder_decode(&decoder, jack_midi_event.buffer, jack_midi_event.size,
+                                    &jackMidiEvents[jack_event_count],
+                                    EVENT_BUFFER_SIZE - jack_event_count);
+            for (j = jack_event_count; j < jack_event_count + n; j++) {
+                jackMidiEvents[j].time.tick = jack_midi_event.time;
+                jackMidiEvents[j].dest.client = 0;  /* flag as from MIDI thread */
+                jackMidiEvents[j].dest.port = port;
+            }
+            jack_event_count += n;
+        }
+        run_end[port] = jack_event_count;
+    }
+    if (midi_port_count > 1) {
+        /* each port's events are already in order, so merge the runs,
+         * taking the lowest port's event first among equal times */
+        for (j = 0; j < jack_event_count; j++) {
+            best = -1;
+            for (port = 0; port < midi_port_count; port++) {
+                if (run_next[port] < run_end[port] &&
+                    (best < 0 ||
+                     jackMidiEvents[run_next[port]].time.tick <
+                         jackMidiEvents[run_next[best]].time.tick))
+                    best = port;
+            }
+            jackMidiMerged[j] = jackMidiEvents[run_next[best]++];
+        }
+        events = jackMidiMerged;
+    }
+
+    merge_midi_events(events, jack_event_count, nframes, last_frame_time);
+#else /* MIDI_JACK */
+    merge_midi_events(NULL, 0, nframes, last_frame_time);
+#endif /* MIDI_JACK */
+
+    apply_program_changes();
+    apply_slot_recall();
+    apply_control_capture();
+
+    /* connect input port buffers */
+    for (i = 0; i < insTotal; i++) {
+
+	jack_default_audio_sample_t *buffer;
+
+        instance = pluginAudioInInstances[i];
+        if (inputPorts[i]) {
+            buffer = audio_backend->port_get_buffer(inputPorts[i], nframes);
+        } else {
+            /* voice farm member, shares its leader's input */
+            buffer = pluginInputBuffers[instance->farm_leader->firstAudioIn +
+                                        i - instance->firstAudioIn];
+        }
+
+        if (buffer != pluginInputBuffers[i]) {
+            pluginInputBuffers[i] = buffer;
+            instance->plugin->descriptor->LADSPA_Plugin->connect_port
+                (instanceHandles[instance->number], pluginAudioInPortNumbers[i],
+                 buffer);
+        }
+    }
+
+    run_cycle(nframes, last_frame_time);
+
+    for (i = 0; i < outsTotal; ++i) {
+
+	jack_default_audio_sample_t *buffer;
+
+        if (!outputPorts[i])
+            continue;
+        buffer = audio_backend->port_get_buffer(outputPorts[i], nframes);
+
+	/* -FIX- this memcpy could be avoided for anything this host is not
+         * doing post-plugin processing on */
+	memcpy(buffer, pluginOutputBuffers[i], nframes * sizeof(LADSPA_Data));
+    }
+
+    if (uiUpdateWanted) {
+        uiUpdateWanted = 0;
+        host_wakeup();
+    }
+
+    return 0;
+}
+
+/* Render a MIDI file offline, as fast as the plugins will go, without JACK:
+ * events are dispatched and the plugins run in fixed-size blocks, just as
+ * by audio_callback(), and the outputs (except those of voice farm members,
+ * which are mixed into their leaders') are written to a WAV file. */
+static int
+render_offline(const char *midi_file, const char *wav_file)
+{
+    snd_seq_event_t *events, ev;
+    int event_count, next = 0;
+    int i, channels, rc = 1, max_port = 0, dropped = 0;
+    float **buffers, *silence;
+    wav_writer_t *wav;
+    jack_nframes_t frame = 0, end_frame, nframes, last_tick;
+
+    if (outsTotal == 0) {
+        ghss_debug(GDB_ERROR, ": can't render '%s', the plugins have no audio outputs", midi_file);
+        return 0;
+    }
+
+    if (!smf_read(midi_file, sample_rate, &events, &event_count))
+        return 0;
+
+    /* the file's MIDI port prefixes select among the '-midiports' ports */
+    for (i = 0; i < event_count; i++) {
+        if (events[i].dest.port >= midi_port_count) {
+            dropped++;
+            events[i].dest.port = GHSS_MAX_MIDI_PORTS;  /* marks it for discarding */
+        } else if (events[i].dest.port > max_port) {
+            max_port = events[i].dest.port;
+        }
+    }
+    if (dropped)
+        ghss_debug(GDB_ERROR, ": %d events in '%s' are for MIDI ports beyond the %d requested with '-midiports', and will be ignored",
+                   dropped, midi_file, midi_port_count);
+    else if (midi_port_count > 1 && max_port == 0)
+        ghss_debug(GDB_ERROR, ": '%s' has no MIDI port prefix events, so all of it will be played on MIDI port 0",
+                   midi_file);
+
+    /* audio inputs get silence */
+    silence = (float *)calloc(RENDER_BLOCK_SIZE, sizeof(float));
+    for (i = 0; i < insTotal; i++)
+        pluginInputBuffers[i] = silence;
+    connect_audio_ports(0);
+
+    buffers = (float **)malloc((outsTotal ? outsTotal : 1) * sizeof(float *));
+    for (i = 0, channels = 0; i < outsTotal; i++) {
+        if (!is_farm_member(pluginAudioOutInstances[i]))
+            buffers[channels++] = pluginOutputBuffers[i];
+    }
+    wav = wav_writer_open(wav_file, channels, audio_sample_rate);
+    if (!wav) {
+        ghss_debug(GDB_ERROR, ": could not open WAV file '%s' for writing", wav_file);
+        free(events);
+        free(silence);
+        free(buffers);
+        return 0;
+    }
+
+    end_frame = (event_count ? events[event_count - 1].time.tick : 0) +
+                    RENDER_TAIL_SECONDS * audio_sample_rate;
+    ghss_debug(GDB_MAIN, ": rendering %d events, %u frames, from '%s' to '%s'",
+               event_count, end_frame, midi_file, wav_file);
+
+    while (frame < end_frame) {
+
+        nframes = RENDER_BLOCK_SIZE;
+        last_tick = 0;
+
+        begin_cycle();
+
+        while (next < event_count &&
+               events[next].time.tick < frame + nframes) {
+            ev = events[next++];
+            ev.time.tick = (ev.time.tick > frame ? ev.time.tick - frame : 0);
+            if (ev.dest.port >= midi_port_count ||
+                channel2instances[EVENT_ROUTE(&ev)] == NULL)
+                continue;  /* discard messages for channels we aren't using */
+            last_tick = ev.time.tick;
+            if (dispatch_midi_event(&ev)) {
+                /* An event buffer is full, so end the block where the next
+                 * event is due, and it will start the next block on time.
+                 * (Only if more events than fit share one frame must some
+                 * be a frame late.) */
+                if (next < event_count &&
+                    events[next].time.tick < frame + nframes) {
+                    if (events[next].time.tick > frame + last_tick)
+                        nframes = events[next].time.tick - frame;
+                    else
+                        nframes = last_tick + 1;
+                }
+                break;
+            }
+        }
+
+        apply_program_changes();
+
+        run_cycle(nframes, frame);
+
+        if (!wav_writer_write(wav, buffers, nframes)) {
+            ghss_debug(GDB_ERROR, ": error writing WAV file '%s'", wav_file);
+            rc = 0;
+            break;
+        }
+        frame += nframes;
+    }
+
+    if (!wav_writer_close(wav)) {
+        ghss_debug(GDB_ERROR, ": error closing WAV file '%s'", wav_file);
+        rc = 0;
+    }
+    free(events);
+    free(silence);
+    free(buffers);
+
+    return rc;
+}
+
+#ifdef GHSS_BENCH
+typedef struct {
+    int           held[BENCH_POLYPHONY];  /* FIFO of sounding keys */
+    int           held_count, held_head;
+    int           control_port;           /* first control input, or -1 */
+    unsigned int  value;
+} bench_target_t;
+
+static bench_target_t *benchTargets;
+static int             benchTargetIndex = 0;
+static int             benchKindIndex = 0;
+static unsigned int    benchRandom = 1;
+
+static inline uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+bench_compare_times(const void *a, const void *b)
+{
+    uint64_t ta = *(const uint64_t *)a, tb = *(const uint64_t *)b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+static int
+bench_parse_load(const char *s)
+{
+    char *copy = strdup(s), *name, *save;
+    int load = 0;
+
+    for (name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (!strcmp(name, "idle"))
+            ;
+        else if (!strcmp(name, "notes"))
+            load |= BENCH_LOAD_NOTES;
+        else if (!strcmp(name, "cc"))
+            load |= BENCH_LOAD_CC;
+        else if (!strcmp(name, "osc"))
+            load |= BENCH_LOAD_OSC;
+        else if (!strcmp(name, "program"))
+            load |= BENCH_LOAD_PROGRAM;
+        else {
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+    return load;
+}
+
+static int
+bench_parse_sizes(const char *s)
+{
+    const char *p = s;
+    char *end;
+    long size;
+
+    bench_size_count = 0;
+    while (*p) {
+        size = strtol(p, &end, 10);
+        if (end == p || size < 1 || size > BENCH_MAX_FRAMES ||
+            bench_size_count == BENCH_MAX_SIZES)
+            return 0;
+        bench_sizes[bench_size_count++] = size;
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return 0;
+    }
+    return bench_size_count > 0;
+}
+
+/* Generate one synthetic event for the next instance, at frame 'offset'
+ * of the cycle, cycling through the enabled kinds of load.  MIDI events
+ * go where the MIDI input would put them (into 'midi' with JACK MIDI,
+ * otherwise into the ring buffer, stamped 'base' + offset), OSC events
+ * are queued through the same functions the OSC handlers use. */
+static int
+bench_generate_event(jack_nframes_t offset, jack_nframes_t base,
+                     jack_nframes_t last_frame_time,
+                     snd_seq_event_t *midi, int *midi_count)
+{
+    d3h_instance_t *instance;
+    bench_target_t *target;
+    snd_seq_event_t ev;
+    int kind, key, via_osc = 0;
+
+    if (!bench_load)
+        return 0;
+
+    do {
+        benchTargetIndex = (benchTargetIndex + 1) % instance_count;
+        instance = &instances[benchTargetIndex];
+    } while (is_farm_member(instance));  /* farms are fed through their leaders */
+    target = &benchTargets[benchTargetIndex];
+
+    do {
+        kind = 1 << (benchKindIndex++ & 3);
+    } while (!(bench_load & kind));
+
+    memset(&ev, 0, sizeof(ev));
+    ev.dest.client = 0;
+    ev.dest.port = instance->midi_port;
+    benchRandom = benchRandom * 1103515245 + 12345;
+
+    switch (kind) {
+      case BENCH_LOAD_OSC:
+        if (target->control_port >= 0 && (benchRandom & 0x10000)) {
+            lo_arg a0, a1, *argv[2];
+
+            a0.i = target->control_port;
+            a1.f = (float)(benchRandom >> 16 & 0x7fff) / 32768.0f;
+            argv[0] = &a0;
+            argv[1] = &a1;
+            osc_control_handler(instance, argv, 0, 1, last_frame_time + offset);
+            return 1;
+        }
+        via_osc = 1;
+        /* fall through */
+      case BENCH_LOAD_NOTES:
+        if (target->held_count == BENCH_POLYPHONY) {
+            key = target->held[target->held_head];
+            target->held_head = (target->held_head + 1) % BENCH_POLYPHONY;
+            target->held_count--;
+            ev.type = SND_SEQ_EVENT_NOTEOFF;
+            ev.data.note.note = key;
+            ev.data.note.velocity = 64;
+        } else {
+            key = 36 + (benchRandom >> 16) % 61;
+            target->held[(target->held_head + target->held_count++) % BENCH_POLYPHONY] = key;
+            ev.type = SND_SEQ_EVENT_NOTEON;
+            ev.data.note.note = key;
+            ev.data.note.velocity = 1 + (benchRandom >> 8 & 0x7f) % 127;
+        }
+        break;
+
+      case BENCH_LOAD_CC:
+        if (target->value++ & 1) {
+            ev.type = SND_SEQ_EVENT_CONTROLLER;
+            ev.data.control.param = 1;  /* mod wheel */
+            ev.data.control.value = target->value & 0x7f;
+        } else {
+            ev.type = SND_SEQ_EVENT_PITCHBEND;
+            ev.data.control.value = (int)(target->value * 37 % 16384) - 8192;
+        }
+        break;
+
+      case BENCH_LOAD_PROGRAM:
+        ev.type = SND_SEQ_EVENT_PGMCHANGE;
+        ev.data.control.value = target->value++ & 1;
+        break;
+    }
+    ev.data.control.channel = instance->channel;  /* same offset as data.note.channel */
+
+    if (via_osc) {
+        ev.time.tick = base + offset;
+        osc_queue_midi_events(instance, &ev, 1);
+        return 1;
+    }
+#ifdef MIDI_JACK
+    ev.time.tick = offset;
+    midi[(*midi_count)++] = ev;
+#else /* MIDI_JACK */
+    ev.time.tick = base + offset;
+    midiEventBuffer[midiEventWriteIndex] = ev;
+    midiEventWriteIndex = (midiEventWriteIndex + 1) % EVENT_BUFFER_SIZE;
+#endif /* MIDI_JACK */
+    return 1;
+}
+
+/* Run the host cycle -- event merge and fan-out, program changes, running
+ * the plugins, and copying their output -- for each buffer size in turn,
+ * with no JACK server, and report how long it took. */
+static int
+bench_run(jack_nframes_t max_frames)
+{
+    static snd_seq_event_t midi[EVENT_BUFFER_SIZE];
+    int s, c, i, port, midi_count, count, total_events, cycle_events;
+    jack_nframes_t nframes, frame, base, offset;
+    double accumulator, mean;
+    uint64_t *times, start, elapsed, total;
+    float *silence, *output;
+    d3h_instance_t *instance;
+
+    times = (uint64_t *)malloc(bench_cycles * sizeof(uint64_t));
+    silence = (float *)calloc(max_frames, sizeof(float));
+    output = (float *)calloc(max_frames, sizeof(float));  /* stands in for the JACK port buffers */
+    benchTargets = (bench_target_t *)calloc(instance_count, sizeof(bench_target_t));
+    if (!times || !silence || !output || !benchTargets) {
+        ghss_debug(GDB_ERROR, ": out of memory");
+        return 0;
+    }
+    for (i = 0; i < instance_count; i++) {
+        instance = &instances[i];
+        benchTargets[i].control_port = -1;
+        for (port = 0; port < instance->plugin->descriptor->LADSPA_Plugin->PortCount; port++) {
+            if (instance->pluginPortControlInNumbers[port] != -1) {
+                benchTargets[i].control_port = port;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < insTotal; i++)
+        pluginInputBuffers[i] = silence;
+    connect_audio_ports(0);
+
+    printf("ghostess-bench: %d instances, %d outputs, %.0f Hz, load '%s' at %lu events/s, %d cycles\n",
+           instance_count, outsTotal, sample_rate, bench_load_name, bench_event_rate,
+           bench_cycles);
+    printf("%6s %11s %9s %10s %10s %10s %10s %7s %11s\n", "frames", "mean ns",
+           "ns/frame", "p50 ns", "p90 ns", "p99 ns", "max ns", "DSP %", "events/s");
+
+    for (s = 0; s < bench_size_count; s++) {
+        nframes = bench_sizes[s];
+        frame = sample_rate;  /* keep the de-jittering away from wraparound */
+        accumulator = 0.0;
+        total = 0;
+        total_events = 0;
+
+        for (c = -BENCH_WARMUP_CYCLES; c < bench_cycles; c++) {
+
+            /* the load arriving during the previous period */
+#ifdef MIDI_JACK
+            base = frame;           /* OSC events are de-jittered against this cycle */
+#else
+            base = frame - nframes; /* ring events against the previous one */
+#endif
+            accumulator += (double)bench_event_rate * nframes / sample_rate;
+            count = (int)accumulator;
+            accumulator -= count;
+            if (count > CONTROL_EVENT_BUFFER_SIZE / 2)  /* don't overrun the rings */
+                count = CONTROL_EVENT_BUFFER_SIZE / 2;
+            if (count > EVENT_BUFFER_SIZE / 2)
+                count = EVENT_BUFFER_SIZE / 2;
+            midi_count = 0;
+            cycle_events = 0;
+            for (i = 0; i < count; i++) {
+                offset = (jack_nframes_t)((uint64_t)i * nframes / count);
+                cycle_events += bench_generate_event(offset, base, frame,
+                                                     midi, &midi_count);
+            }
+
+            start = bench_now();
+
+            begin_cycle();
+            merge_midi_events(midi, midi_count, nframes, frame);
+            apply_program_changes();
+            run_cycle(nframes, frame);
+            for (i = 0; i < outsTotal; i++) {
+                if (!is_farm_member(pluginAudioOutInstances[i]))
+                    memcpy(output, pluginOutputBuffers[i], nframes * sizeof(LADSPA_Data));
+            }
+
+            elapsed = bench_now() - start;
+
+            if (c >= 0) {
+                times[c] = elapsed;
+                total += elapsed;
+                total_events += cycle_events;
+            }
+            frame += nframes;
+        }
+
+        qsort(times, bench_cycles, sizeof(uint64_t), bench_compare_times);
+        mean = (double)total / bench_cycles;
+        printf("%6u %11.0f %9.1f %10llu %10llu %10llu %10llu %7.2f %11.0f\n",
+               nframes, mean, mean / nframes,
+               (unsigned long long)times[(bench_cycles - 1) / 2],
+               (unsigned long long)times[(bench_cycles - 1) * 90 / 100],
+               (unsigned long long)times[(bench_cycles - 1) * 99 / 100],
+               (unsigned long long)times[bench_cycles - 1],
+               mean * sample_rate / nframes / 1e7,
+               total ? (double)total_events * 1e9 / total : 0.0);
+    }
+
+    free(times);
+    free(silence);
+    free(output);
+    free(benchTargets);
+
+    return 1;
+}
+#endif /* GHSS_BENCH */
+
+#ifdef JACK_SESSION
+/* called from the save thread once the session files are written */
+static void
+session_save_done(int error, void *arg)
+{
+    jack_session_event_t *session_event = (jack_session_event_t *) arg;
+
+    if (error)
+        session_event->flags |= JackSessionSaveError;
+
+    jack_session_reply( jackClient, session_event );
+
+    if (session_event->type == JackSessionSaveAndQuit) {
+	host_exiting = TRUE;
+        host_wakeup();
+    }
+
+    jack_session_event_free (session_event);
+}
+
+int 
+session_gui_idle_callback( void *arg )
+{
+    char *filename;
+    char *snapshot;
+    char *command;
+    jack_session_event_t *session_event = (jack_session_event_t *) arg;
+
+    /* the configuration is saved as a snapshot, which is quick to write
+     * and to load, with a small script to start ghostess on it */
+    filename = g_strdup_printf( "%sghostess.cfg", session_event->session_dir );
+    snapshot = g_strdup_printf( "%sghostess" GHSNAP_SUFFIX, session_event->session_dir );
+    command = "/bin/sh ${SESSION_DIR}ghostess.cfg";
+
+    ghss_debug(GDB_MAIN | GDB_GUI, " session_gui_idle_callback: %s to '%s'",
+               (session_event->type == JackSessionSaveAndQuit ? "save-and-quit" : "save"),
+               snapshot);
+
+    session_event->command_line = g_strdup( command );
+
+    /* the reply to JACK is sent when the files have been written */
+    save_configuration_async( snapshot, session_event->client_uuid, filename,
+                              session_save_done, session_event );
+
+    g_free(filename);
+    g_free(snapshot);
+
+    return 0; /* remove this source */
+}
+
+void session_callback( jack_session_event_t *event, void *arg )
+{
+    if (nogui) {
+        pendingSessionEvent = event;  /* picked up by nogui_main_loop() */
+        host_wakeup();
+    } else
+        g_idle_add( session_gui_idle_callback, event );
+}
+#endif
+
+#ifndef RTLD_LOCAL
+#define RTLD_LOCAL  (0)
+#endif
+
+static char *
+search_path(const char *paths, const char *name, void **dll)
+{
+    gchar **elem;
+    int i;
+    char *path, *file;
+    void *handle;
+    const char *message;
+
+    elem = g_strsplit(paths, ":", 0);
+
+    for (i = 0; elem[i]; i++) {
+        path = elem[i];
+
+        if (strlen(path) == 0)
+            continue;
+        if (!g_path_is_absolute(path)) {
+            ghss_debug(GDB_DSSI, ": ignoring plugin search path relative element '%s'", path);
+            continue;
+        }
+
+        file = g_build_filename(path, name, NULL);
+
+        handle = dlopen(file, RTLD_NOW |    /* real-time programs should not use RTLD_LAZY */
+                              RTLD_LOCAL);  /* do not share symbols across plugins */
+        if (handle) {
+            ghss_debug(GDB_DSSI, ": '%s' found at '%s'", name, file);
+            *dll = handle;
+            path = g_strdup(path);
+            g_free(file);
+            g_strfreev(elem);
+            return path;
+        }
+        
+        message = dlerror();
+        if (message) {
+            ghss_debug(GDB_DSSI, ": dlopen of '%s' failed: %s", file, message);
+        } else {
+            ghss_debug(GDB_DSSI, ": dlopen of '%s' failed", file);
+        }
+        
+        g_free(file);
+    }
+    
+    g_strfreev(elem);
+    return NULL;
+}
+
+char *
+load(const char *dllName, void **dll) /* returns directory where dll found */
+{
+    char *path;
+    const char *message;
+
+    if (g_path_is_absolute(dllName)) {
+	if ((*dll = dlopen(dllName, RTLD_NOW |       /* real-time programs should not use RTLD_LAZY */
+                                    RTLD_LOCAL))) {  /* incredibly, some systems default to RTLD_GLOBAL **cough**Apple** */
+	    return g_path_get_dirname(dllName);
+	} else {
+            message = dlerror();
+            if (message) {
+                ghss_debug(GDB_DSSI, ": dlopen of '%s' failed: %s", dllName, message);
+            } else {
+                ghss_debug(GDB_DSSI, ": dlopen of '%s' failed", dllName);
+            }
+	    return NULL;
+	}
+    }
+
+    if (!dssi_path && !(dssi_path = getenv("DSSI_PATH"))) {
+        dssi_path = "/usr/local/lib/dssi:/usr/lib/dssi";
+        ghss_debug(GDB_DSSI, " warning: DSSI_PATH not set, defaulting to '%s'", dssi_path);
+    }
+    if ((path = search_path(dssi_path, dllName, dll)) != NULL)
+        return path;
+
+    if (!ladspa_path && !(ladspa_path = getenv("LADSPA_PATH"))) {
+        ladspa_path = "/usr/local/lib/ladspa:/usr/lib/ladspa";
+        ghss_debug(GDB_DSSI, " warning: LADSPA_PATH not set, defaulting to '%s'", ladspa_path);
+    }
+    return search_path(ladspa_path, dllName, dll);
+}
+
+static void
+copy_initial_port_set(instance_template_t *temp, d3h_instance_t *inst)
+{
+    unsigned long port_count = inst->plugin->descriptor->LADSPA_Plugin->PortCount;
+    unsigned long number_set = temp->ports.highest_set + 1;
+
+    inst->have_initial_values = 1;
+    inst->initial_value_set = (int *)calloc(sizeof(int), port_count);
+    inst->initial_value = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * port_count);
+    memcpy(inst->initial_value_set, temp->ports.set, sizeof(int) * number_set);
+    memcpy(inst->initial_value, temp->ports.value, sizeof(LADSPA_Data) * number_set);
+}
+
+static instance_template_t *
+new_instance_template(void)
+{
+    instance_template_t *t = (instance_template_t *)calloc(1, sizeof(instance_template_t));
+    t->key_hi = 127;
+    t->vel_hi = 127;
+    return t;
+}
+
+static void
+reset_instance_template(instance_template_t *t)
+{
+    configure_item_t *c;
+    int i;
+
+    /* leave t->channel alone */
+    while((c = t->configure_items)) {
+        t->configure_items = c->next;
+        free(c->key);
+        free(c->value);
+        free(c);
+    }
+    t->program_set = 0;
+    t->bank = 0;
+    t->program = 0;
+    t->key_lo = 0;
+    t->key_hi = 127;
+    t->vel_lo = 0;
+    t->vel_hi = 127;
+    t->farm = 0;
+    t->ports.have_settings = 0;
+    t->ports.highest_set = 0;
+    for (i = 0; i < t->ports.allocated; i++)
+        t->ports.set[i] = 0;
+}
+
+static void
+free_instance_template(instance_template_t *t)
+{
+    reset_instance_template(t); /* free configure items */
+    if (t->ports.allocated) {
+        free(t->ports.set);
+        free(t->ports.value);
+    }
+    free(t);
+}
+
+static void
+instance_template_set_port(instance_template_t *t, unsigned long port,
+                           LADSPA_Data value)
 {
-    char *path;
-    const char *message;
+    unsigned long n;
 
-    if (g_path_is_absolute(dllName)) {
-	if ((*dll = dlopen(dllName, RTLD_NOW |       /* real-time programs should not use RTLD_LAZY */
-                                    RTLD_LOCAL))) {  /* incredibly, some systems default to RTLD_GLOBAL **cough**Apple** */
-	    return g_path_get_dirname(dllName);
-	} else {
-            message = dlerror();
-            if (message) {
-                ghss_debug(GDB_DSSI, ": dlopen of '%s' failed: %s", dllName, message);
-            } else {
-                ghss_debug(GDB_DSSI, ": dlopen of '%s' failed", dllName);
+    if (port >= t->ports.allocated) {
+        n = 256;
+        while (n <= port) n <<= 1;
+        if (t->ports.allocated) {
+            t->ports.set = (int *)realloc(t->ports.set, sizeof(int) * n);
+            memset(&t->ports.set[t->ports.allocated], 0, sizeof(int) * (n - t->ports.allocated));
+            t->ports.value = (LADSPA_Data *)realloc(t->ports.value, sizeof(LADSPA_Data) * n);
+        } else {
+            t->ports.set = (int *)calloc(sizeof(int), n);
+            t->ports.value = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * n);
+        }
+        t->ports.allocated = n;
+    }
+
+    t->ports.have_settings = 1;
+    if (t->ports.highest_set < port)
+        t->ports.highest_set = port;
+    t->ports.set[port] = 1;
+    t->ports.value[port] = value;
+}
+
+void
+set_initial_port_settings(d3h_instance_t *instance)
+{
+    int i, in;
+
+    for (i = 0; i < instance->plugin->descriptor->LADSPA_Plugin->PortCount; i++) {
+        if (instance->initial_value_set[i]) {
+            in = instance->pluginPortControlInNumbers[i];
+            /* ghss_debug_rt(GDB_MAIN, ": %s setting control %lu (in %d) to %f", instance->friendly_name, i, in, instance->initial_value[i]); */
+            pluginControlIns[in] = instance->initial_value[i];
+            pluginPortUpdated[in] = 1;
+        }
+    }
+}
+
+void
+add_configure_item(configure_item_t **head, char *key, char *value)
+{
+    configure_item_t *item = *head;
+
+    while(item) {
+        if (!strcmp(key, item->key))
+            break;
+        item = item->next;
+    }
+    if (item) {
+        free(item->value);
+    } else {
+        item = (configure_item_t *)malloc(sizeof(configure_item_t));
+        item->next = *head;
+        *head = item;
+        item->key = strdup(key);
+    }
+    item->value = strdup(value);
+}
+
+void
+copy_configure_items(instance_template_t *temp, d3h_instance_t *inst)
+{
+    configure_item_t *item = temp->configure_items,
+                     *newitem;
+
+    while(item) {
+        newitem = (configure_item_t *)malloc(sizeof(configure_item_t));
+        newitem->next = inst->configure_items;
+        inst->configure_items = newitem;
+        newitem->key = strdup(item->key);
+        newitem->value = strdup(item->value);
+        item = item->next;
+    }
+}
+
+void
+escape_for_shell(char **p, const char *text)
+{
+    int len, i, c;
+
+    if (*p) free(*p);
+
+    if (!text || (len = strlen(text)) == 0) {
+        *p = strdup("''");
+        return;
+    }
+
+    for (i = 0, c = 0; i < len; i++)
+        if (text[i] == '\'') c++;
+
+    if (c == 0) {
+        *p = (char *)malloc(len + 3);
+        sprintf(*p, "'%s'", text);
+        return;
+    }
+
+    *p = (char *)malloc(len + c * 3 + 3);
+    c = 0;
+    if (text[0] != '\'') {
+        (*p)[c++] = '\'';
+    }
+    for (i = 0; i < len; i++) {
+        if (text[i] == '\'') {
+            if (i != 0) (*p)[c++] = '\'';
+            (*p)[c++] = '\\';
+            (*p)[c++] = '\'';
+            if (i != len - 1) (*p)[c++] = '\'';
+        } else {
+            (*p)[c++] = text[i];
+        }
+    }
+    if (text[len - 1] != '\'') {
+        (*p)[c++] = '\'';
+    }
+    (*p)[c++] = '\0';
+}
+
+/* Collect the host-wide options for a saved configuration, as argument
+ * strings (to be g_free()d), each option followed by a NULL. */
+static void
+host_options(GPtrArray *options, const char *uuid)
+{
+#define OPTION(...)  do { \
+        const char *args[] = { __VA_ARGS__ }; \
+        unsigned int n; \
+        for (n = 0; n < sizeof(args) / sizeof(args[0]); n++) \
+            g_ptr_array_add(options, g_strdup(args[n])); \
+        g_ptr_array_add(options, NULL); \
+    } while (0)
+    char a[32], b[32];
+
+    if (strcmp(host_name, host_name_default))
+        OPTION("-hostname", host_name);
+    if (project_directory)
+        OPTION("-projdir", project_directory);
+    if (uuid)
+        OPTION("-uuid", uuid);
+    if (nogui)
+        OPTION("-nogui");
+    if (shared_gui)
+        OPTION("-sharedgui");
+    if (!autoconnect || uuid)
+        OPTION("-noauto");
+    if (osc_serve_tcp)
+        OPTION("-osctcp");
+    if (coalesce_frames) {
+        snprintf(a, sizeof(a), "%d", coalesce_frames);
+        OPTION("-coalesce", a);
+    }
+    if (midi_port_count > 1) {
+        snprintf(a, sizeof(a), "%d", midi_port_count);
+        OPTION("-midiports", a);
+    }
+    if (control_subblock_min) {
+        snprintf(a, sizeof(a), "%d", control_subblock_min);
+        OPTION("-subblock", a);
+    }
+    if (osc_unix_socket)
+        OPTION("-oscunix", osc_unix_socket);
+    if (run_thread_count > 1) {
+        snprintf(a, sizeof(a), "%d", run_thread_count);
+        OPTION("-threads", a);
+    }
+    if (strcmp(audio_backend_name, "jack")) {
+        if (audio_device) {
+            char *backend = g_strdup_printf("%s:%s", audio_backend_name, audio_device);
+            OPTION("-audio", backend);
+            g_free(backend);
+        } else {
+            OPTION("-audio", audio_backend_name);
+        }
+        snprintf(a, sizeof(a), "%lu", audio_sample_rate);
+        snprintf(b, sizeof(b), "%u", audio_period_size);
+        OPTION("-rate", a, "-period", b);
+    }
+#undef OPTION
+}
+
+static void
+free_host_options(GPtrArray *options)
+{
+    g_ptr_array_foreach(options, (GFunc)g_free, NULL);
+    g_ptr_array_free(options, TRUE);
+}
+
+/* Does 'text' need quoting for the shell? */
+static int
+needs_shell_escape(const char *text)
+{
+    if (!*text)
+        return 1;
+    for (; *text; text++) {
+        if (!g_ascii_isalnum(*text) && !strchr("-_.,/:=+@%", *text))
+            return 1;
+    }
+    return 0;
+}
+
+static void
+control_capture_init(void)
+{
+    sem_init(&controlCaptureSem, 0, 0);
+}
+
+/* Copy the control vector without tearing: the audio thread makes the
+ * copy between cycles.  If it doesn't within a second (e.g. JACK has
+ * stopped), copy it here instead. */
+static void
+capture_controls(LADSPA_Data *copy)
+{
+    struct timespec deadline;
+    int rc;
+
+    pthread_once(&controlCaptureOnce, control_capture_init);
+    pthread_mutex_lock(&controlCaptureMutex);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 1;
+    __sync_synchronize();
+    pendingControlCapture = copy;
+    while ((rc = sem_timedwait(&controlCaptureSem, &deadline)) && errno == EINTR);
+    if (rc) {
+        if (__sync_bool_compare_and_swap(&pendingControlCapture, copy, NULL))
+            memcpy(copy, pluginControlIns, controlInsTotal * sizeof(LADSPA_Data));
+        else
+            sem_wait(&controlCaptureSem);  /* copied just now, the post is on its way */
+    }
+    pthread_mutex_unlock(&controlCaptureMutex);
+}
+
+/* Build the start of a configuration script, up to the 'exec ghostess'. */
+static void
+build_script_header(GString *out)
+{
+    char *arg1 = NULL;
+
+    g_string_append(out, "#!/bin/sh\n");
+    /* -FIX- this shouldn't really be saved in the .ghss: */
+    if (dssi_path) {
+        escape_for_shell(&arg1, dssi_path);
+        g_string_append_printf(out, "DSSI_PATH=%s\nexport DSSI_PATH\n", arg1);
+    }
+    if (ladspa_path) {
+        escape_for_shell(&arg1, ladspa_path);
+        g_string_append_printf(out, "LADSPA_PATH=%s\nexport LADSPA_PATH\n", arg1);
+    }
+    g_string_append_printf(out, "exec %s \\\n", host_argv0);
+
+    if (arg1) free(arg1);
+}
+
+/* Build the configuration as a shell script, using the control values
+ * in 'controls'. */
+static void
+build_configuration(GString *out, const char *uuid, LADSPA_Data *controls)
+{
+    int id, instno, i, in, port;
+    d3h_instance_t *instance;
+    char *arg1 = NULL,
+         *arg2 = NULL;
+    configure_item_t *item;
+    GPtrArray *options = g_ptr_array_new();
+
+    build_script_header(out);
+    host_options(options, uuid);
+    for (i = 0; i < options->len; i++) {
+        char *arg = (char *)g_ptr_array_index(options, i);
+
+        if (!arg) {
+            g_string_append(out, " \\\n");
+        } else if (needs_shell_escape(arg)) {
+            escape_for_shell(&arg1, arg);
+            g_string_append_printf(out, " %s", arg1);
+        } else {
+            g_string_append_printf(out, " %s", arg);
+        }
+    }
+    free_host_options(options);
+
+    for (id = 0; id < instance_count; id++) {
+        for (instno = 0; instances[instno].id != id; instno++);
+        instance = &instances[instno];
+
+        if (instance->farm_leader && instance->farm_leader != instance)
+            continue;  /* farm members are recreated by their leader's '-farm' */
+
+        escape_for_shell(&arg1, instance->friendly_name);
+        g_string_append_printf(out, "-comment %s \\\n", arg1);
+
+        /* chan */
+        if (instance->midi_port) {
+            g_string_append_printf(out, " -chan %d:%d \\\n", instance->midi_port, instance->channel);
+        } else {
+            g_string_append_printf(out, " -chan %d \\\n", instance->channel);
+        }
+
+        /* zones */
+        if (instance->key_lo != 0 || instance->key_hi != 127) {
+            g_string_append_printf(out, " -keys %d %d \\\n", instance->key_lo, instance->key_hi);
+        }
+        if (instance->vel_lo != 0 || instance->vel_hi != 127) {
+            g_string_append_printf(out, " -vel %d %d \\\n", instance->vel_lo, instance->vel_hi);
+        }
+
+        /* conf */
+        for (item = instance->configure_items; item; item = item->next) {
+            if (strcmp(item->key, DSSI_PROJECT_DIRECTORY_KEY)) {  /* skip project directory */
+                escape_for_shell(&arg1, item->key);
+                escape_for_shell(&arg2, item->value);
+                g_string_append_printf(out, " -conf %s %s \\\n", arg1, arg2);
             }
-	    return NULL;
-	}
+        }
+
+        /* prog */
+        if (instance->plugin->descriptor->select_program) {
+            g_string_append_printf(out, " -prog %lu %lu \\\n", instance->currentBank, instance->currentProgram);
+        }
+
+        /* port */
+        for (i = 0; i < instance->plugin->controlIns; i++) {
+            char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+            in = i + instance->firstControlIn;
+	    port = pluginControlInPortNumbers[in];
+
+            /* always use "." as decimal point */
+            g_ascii_formatd(buf, sizeof(buf), "%.6g", controls[in]);
+            g_string_append_printf(out, " -port %d %s \\\n", port, buf);
+        }
+
+        /* farm */
+        if (instance->farm_leader) {
+            g_string_append_printf(out, " -farm %d \\\n", instance->farm_size);
+        }
+
+        /* soname:label */
+        escape_for_shell(&arg1, instance->plugin->dll->name);
+        escape_for_shell(&arg2, instance->plugin->label);
+        g_string_append_printf(out, " %s:%s \\\n", arg1, arg2);
+    }
+    g_string_append(out, "\n");
+
+    if (arg1) free(arg1);
+    if (arg2) free(arg2);
+}
+
+/* Build the configuration as a binary snapshot (see snapshot.h), which
+ * holds the same information as build_configuration()'s script, but is
+ * much quicker to write and to read back for large racks. */
+static void
+build_snapshot(ghsnap_buffer_t *buf, const char *uuid, LADSPA_Data *controls)
+{
+    int id, instno, i, in;
+    d3h_instance_t *instance;
+    configure_item_t *item;
+    GPtrArray *options = g_ptr_array_new();
+    char *arg;
+
+    ghsnap_init(buf);
+
+    host_options(options, uuid);
+    for (i = 0; i < options->len; i++) {
+        if (i == 0 || !g_ptr_array_index(options, i - 1))
+            ghsnap_begin_record(buf, GHSNAP_OPTION);
+        if ((arg = (char *)g_ptr_array_index(options, i)))
+            ghsnap_put_string(buf, arg);
+        else
+            ghsnap_end_record(buf);
     }
+    free_host_options(options);
+
+    for (id = 0; id < instance_count; id++) {
+        for (instno = 0; instances[instno].id != id; instno++);
+        instance = &instances[instno];
+
+        if (instance->farm_leader && instance->farm_leader != instance)
+            continue;  /* farm members are recreated by their leader's '-farm' */
+
+        ghsnap_begin_record(buf, GHSNAP_INSTANCE);
+        ghsnap_put_string(buf, instance->friendly_name);
+        ghsnap_end_record(buf);
+
+        ghsnap_begin_record(buf, GHSNAP_CHANNEL);
+        ghsnap_put_u32(buf, instance->midi_port);
+        ghsnap_put_u32(buf, instance->channel);
+        ghsnap_end_record(buf);
+
+        if (instance->key_lo != 0 || instance->key_hi != 127 ||
+            instance->vel_lo != 0 || instance->vel_hi != 127) {
+            ghsnap_begin_record(buf, GHSNAP_ZONE);
+            ghsnap_put_u32(buf, instance->key_lo);
+            ghsnap_put_u32(buf, instance->key_hi);
+            ghsnap_put_u32(buf, instance->vel_lo);
+            ghsnap_put_u32(buf, instance->vel_hi);
+            ghsnap_end_record(buf);
+        }
+
+        for (item = instance->configure_items; item; item = item->next) {
+            if (strcmp(item->key, DSSI_PROJECT_DIRECTORY_KEY)) {  /* skip project directory */
+                ghsnap_begin_record(buf, GHSNAP_CONFIGURE);
+                ghsnap_put_string(buf, item->key);
+                ghsnap_put_string(buf, item->value);
+                ghsnap_end_record(buf);
+            }
+        }
 
-    if (!dssi_path && !(dssi_path = getenv("DSSI_PATH"))) {
-        dssi_path = "/usr/local/lib/dssi:/usr/lib/dssi";
-        ghss_debug(GDB_DSSI, " warning: DSSI_PATH not set, defaulting to '%s'", dssi_path);
-    }
-    if ((path = search_path(dssi_path, dllName, dll)) != NULL)
-        return path;
+        if (instance->plugin->descriptor->select_program) {
+            ghsnap_begin_record(buf, GHSNAP_PROGRAM);
+            ghsnap_put_u32(buf, instance->currentBank);
+            ghsnap_put_u32(buf, instance->currentProgram);
+            ghsnap_end_record(buf);
+        }
 
-    if (!ladspa_path && !(ladspa_path = getenv("LADSPA_PATH"))) {
-        ladspa_path = "/usr/local/lib/ladspa:/usr/lib/ladspa";
-        ghss_debug(GDB_DSSI, " warning: LADSPA_PATH not set, defaulting to '%s'", ladspa_path);
+        ghsnap_begin_record(buf, GHSNAP_PORTS);
+        ghsnap_put_u32(buf, instance->plugin->controlIns);
+        for (i = 0; i < instance->plugin->controlIns; i++) {
+            in = i + instance->firstControlIn;
+            ghsnap_put_u32(buf, pluginControlInPortNumbers[in]);
+            ghsnap_put_float(buf, controls[in]);
+        }
+        ghsnap_end_record(buf);
+
+        if (instance->farm_leader) {
+            ghsnap_begin_record(buf, GHSNAP_FARM);
+            ghsnap_put_u32(buf, instance->farm_size);
+            ghsnap_end_record(buf);
+        }
+
+        arg = g_strdup_printf("%s:%s", instance->plugin->dll->name, instance->plugin->label);
+        ghsnap_begin_record(buf, GHSNAP_PLUGIN);
+        ghsnap_put_string(buf, arg);
+        ghsnap_end_record(buf);
+        g_free(arg);
     }
-    return search_path(ladspa_path, dllName, dll);
+
+    ghsnap_finish(buf);
 }
 
+/* A save is done in two steps:  the files' contents are built in memory
+ * from the host state, which is quick, on the thread asking for the save,
+ * then they are written out, which may be slow, on a writer thread, so
+ * the GUI and OSC threads aren't held up by the disk. */
+#define SAVE_JOB_MAX_FILES  2
+
+typedef struct _save_job_t {
+    int                  file_count;
+    char                *filename[SAVE_JOB_MAX_FILES];
+    char                *data[SAVE_JOB_MAX_FILES];  /* g_free()able */
+    size_t               length[SAVE_JOB_MAX_FILES];
+    save_done_callback_t done;
+    void                *arg;
+} save_job_t;
+
+static pthread_mutex_t savesMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  savesDone = PTHREAD_COND_INITIALIZER;
+static int             saves_in_progress = 0;  /* under savesMutex */
+
 static void
-copy_initial_port_set(instance_template_t *temp, d3h_instance_t *inst)
+save_job_add(save_job_t *job, const char *filename, char *data, size_t length)
 {
-    unsigned long port_count = inst->plugin->descriptor->LADSPA_Plugin->PortCount;
-    unsigned long number_set = temp->ports.highest_set + 1;
-
-    inst->have_initial_values = 1;
-    inst->initial_value_set = (int *)calloc(sizeof(int), port_count);
-    inst->initial_value = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * port_count);
-    memcpy(inst->initial_value_set, temp->ports.set, sizeof(int) * number_set);
-    memcpy(inst->initial_value, temp->ports.value, sizeof(LADSPA_Data) * number_set);
+    job->filename[job->file_count] = g_strdup(filename);
+    job->data[job->file_count] = data;
+    job->length[job->file_count] = length;
+    job->file_count++;
 }
 
-static instance_template_t *
-new_instance_template(void)
+/* Build a save job for the configuration, as a snapshot if 'filename'
+ * ends in '.ghsnap', otherwise as a script.  If 'launcher' is given, also
+ * write a script by that name that starts ghostess on the snapshot, for
+ * JACK session saves, which must give a shell command. */
+static save_job_t *
+prepare_save(const char *filename, const char *uuid, const char *launcher)
 {
-    instance_template_t *t = (instance_template_t *)calloc(1, sizeof(instance_template_t));
-    return t;
+    save_job_t *job = (save_job_t *)calloc(1, sizeof(save_job_t));
+    LADSPA_Data *controls = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * (controlInsTotal + 1));
+    ghsnap_buffer_t buf;
+    GString *out;
+    char *name;
+
+    capture_controls(controls);
+
+    if (g_str_has_suffix(filename, GHSNAP_SUFFIX)) {
+        build_snapshot(&buf, uuid, controls);
+        /* copied into GLib's heap, so every file's data is freed alike */
+        save_job_add(job, filename, g_memdup(buf.data, buf.length), buf.length);
+        ghsnap_free(&buf);
+    } else {
+        out = g_string_new(NULL);
+        build_configuration(out, uuid, controls);
+        save_job_add(job, filename, out->str, out->len);
+        g_string_free(out, FALSE);
+    }
+    free(controls);
+
+    if (launcher) {
+        out = g_string_new(NULL);
+        name = g_path_get_basename(filename);
+        build_script_header(out);
+        g_string_append_printf(out, " -f \"`dirname \"$0\"`/%s\"\n", name);
+        g_free(name);
+        save_job_add(job, launcher, out->str, out->len);
+        g_string_free(out, FALSE);
+    }
+
+    return job;
 }
 
-static void
-reset_instance_template(instance_template_t *t)
+/* Write out a save job's files.  Returns 0 on success, or an errno value. */
+static int
+run_save_job(save_job_t *job)
 {
-    configure_item_t *c;
     int i;
 
-    /* leave t->channel alone */
-    while((c = t->configure_items)) {
-        t->configure_items = c->next;
-        free(c->key);
-        free(c->value);
-        free(c);
+    for (i = 0; i < job->file_count; i++) {
+        if (!atomic_write_file(job->filename[i], job->data[i], job->length[i])) {
+            ghss_debug(GDB_ERROR, ": saving '%s' failed: %s", job->filename[i],
+                       strerror(errno));
+            return errno;
+        }
     }
-    t->program_set = 0;
-    t->bank = 0;
-    t->program = 0;
-    t->ports.have_settings = 0;
-    t->ports.highest_set = 0;
-    for (i = 0; i < t->ports.allocated; i++)
-        t->ports.set[i] = 0;
+    return 0;
 }
 
 static void
-free_instance_template(instance_template_t *t)
+free_save_job(save_job_t *job)
 {
-    reset_instance_template(t); /* free configure items */
-    if (t->ports.allocated) {
-        free(t->ports.set);
-        free(t->ports.value);
+    int i;
+
+    for (i = 0; i < job->file_count; i++) {
+        g_free(job->filename[i]);
+        g_free(job->data[i]);
     }
-    free(t);
+    free(job);
 }
 
-static void
-instance_template_set_port(instance_template_t *t, unsigned long port,
-                           LADSPA_Data value)
+static void *
+save_thread_function(void *arg)
 {
-    unsigned long n;
+    save_job_t *job = (save_job_t *)arg;
+    int error = run_save_job(job);
 
-    if (port >= t->ports.allocated) {
-        n = 256;
-        while (n <= port) n <<= 1;
-        if (t->ports.allocated) {
-            t->ports.set = (int *)realloc(t->ports.set, sizeof(int) * n);
-            memset(&t->ports.set[t->ports.allocated], 0, sizeof(int) * (n - t->ports.allocated));
-            t->ports.value = (LADSPA_Data *)realloc(t->ports.value, sizeof(LADSPA_Data) * n);
-        } else {
-            t->ports.set = (int *)calloc(sizeof(int), n);
-            t->ports.value = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * n);
-        }
-        t->ports.allocated = n;
-    }
+    if (job->done)
+        job->done(error, job->arg);
+    free_save_job(job);
+    pthread_mutex_lock(&savesMutex);
+    if (--saves_in_progress == 0)
+        pthread_cond_broadcast(&savesDone);
+    pthread_mutex_unlock(&savesMutex);
 
-    t->ports.have_settings = 1;
-    if (t->ports.highest_set < port)
-        t->ports.highest_set = port;
-    t->ports.set[port] = 1;
-    t->ports.value[port] = value;
+    return NULL;
 }
 
+/* Save the configuration in the background:  the host state is captured
+ * before this returns, and 'done' is later called, from the writer
+ * thread, with 0 or an errno value. */
 void
-set_initial_port_settings(d3h_instance_t *instance)
+save_configuration_async(const char *filename, const char *uuid, const char *launcher,
+                         save_done_callback_t done, void *arg)
 {
-    int i, in;
-
-    for (i = 0; i < instance->plugin->descriptor->LADSPA_Plugin->PortCount; i++) {
-        if (instance->initial_value_set[i]) {
-            in = instance->pluginPortControlInNumbers[i];
-            /* ghss_debug_rt(GDB_MAIN, ": %s setting control %lu (in %d) to %f", instance->friendly_name, i, in, instance->initial_value[i]); */
-            pluginControlIns[in] = instance->initial_value[i];
-            pluginPortUpdated[in] = 1;
-        }
+    save_job_t *job = prepare_save(filename, uuid, launcher);
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    job->done = done;
+    job->arg = arg;
+    pthread_mutex_lock(&savesMutex);
+    saves_in_progress++;
+    pthread_mutex_unlock(&savesMutex);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, save_thread_function, job)) {
+        ghss_debug(GDB_ERROR, ": could not create save thread, saving in the foreground");
+        save_thread_function(job);
     }
+    pthread_attr_destroy(&attr);
 }
 
-void
-add_configure_item(configure_item_t **head, char *key, char *value)
+/* Save the configuration, waiting for it to be written.  Returns 0 on
+ * failure, with errno set. */
+int
+write_configuration(char *filename, const char *uuid)
 {
-    configure_item_t *item = *head;
+    save_job_t *job = prepare_save(filename, uuid, NULL);
+    int error = run_save_job(job);
 
-    while(item) {
-        if (!strcmp(key, item->key))
-            break;
-        item = item->next;
-    }
-    if (item) {
-        free(item->value);
-    } else {
-        item = (configure_item_t *)malloc(sizeof(configure_item_t));
-        item->next = *head;
-        *head = item;
-        item->key = strdup(key);
-    }
-    item->value = strdup(value);
+    free_save_job(job);
+    errno = error;
+    return !error;
 }
 
-void
-copy_configure_items(instance_template_t *temp, d3h_instance_t *inst)
+/* let any background saves finish before we exit */
+static void
+wait_for_saves(void)
 {
-    configure_item_t *item = temp->configure_items,
-                     *newitem;
+    pthread_mutex_lock(&savesMutex);
+    while (saves_in_progress)
+        pthread_cond_wait(&savesDone, &savesMutex);
+    pthread_mutex_unlock(&savesMutex);
+}
 
-    while(item) {
-        newitem = (configure_item_t *)malloc(sizeof(configure_item_t));
-        newitem->next = inst->configure_items;
-        inst->configure_items = newitem;
-        newitem->key = strdup(item->key);
-        newitem->value = strdup(item->value);
-        item = item->next;
-    }
+/* ==== autosave ==== */
+
+/* With '-autosave <file>', a journal of state changes is kept in <file>,
+ * so that after a crash the rack can be restored just as it was.  The
+ * journal begins with the full state (every control value, program, and
+ * configure item), and every AUTOSAVE_INTERVAL the autosave thread
+ * appends records for whatever has changed since.  When the journal
+ * grows too long it is compacted, by atomically replacing it with a new
+ * one holding just the full state.  Replaying the journal only ever sets
+ * absolute values, so a record that ends up both in a compacted state
+ * and after it does no harm, and a record cut short by a crash is simply
+ * ignored. */
+#define AUTOSAVE_INTERVAL      1000    /* milliseconds */
+#define AUTOSAVE_COMPACT_SLACK 65536   /* bytes of changes allowed beyond 4x the full state */
+
+static pthread_t          autosave_thread;
+static volatile int       autosave_running = 0;
+static int                autosave_fd = -1;
+static size_t             autosave_length = 0;    /* of the journal so far */
+static size_t             autosave_compact_length = 0;  /* of the last full state */
+static pthread_mutex_t    autosaveMutex = PTHREAD_MUTEX_INITIALIZER;
+static ghsnap_buffer_t    autosaveRecords;        /* records waiting to be written */
+static configure_item_t **autosaveConfigure;      /* per instance number, our own copy */
+static LADSPA_Data       *autosaveControls;       /* as last journaled */
+static LADSPA_Data       *autosaveCapture;        /* latest from the audio thread */
+static unsigned long     *autosaveBank, *autosaveProgram;  /* as last journaled */
+
+static void
+autosave_put_configure(ghsnap_buffer_t *buf, d3h_instance_t *instance,
+                       const char *key, const char *value)
+{
+    ghsnap_begin_record(buf, GHSNAP_JOURNAL_CONFIGURE);
+    ghsnap_put_u32(buf, instance->id);
+    ghsnap_put_string(buf, key);
+    ghsnap_put_string(buf, value);
+    ghsnap_end_record(buf);
 }
 
-void
-escape_for_shell(char **p, const char *text)
+static void
+autosave_put_program(ghsnap_buffer_t *buf, d3h_instance_t *instance)
 {
-    int len, i, c;
+    ghsnap_begin_record(buf, GHSNAP_JOURNAL_PROGRAM);
+    ghsnap_put_u32(buf, instance->id);
+    ghsnap_put_u32(buf, instance->currentBank);
+    ghsnap_put_u32(buf, instance->currentProgram);
+    ghsnap_end_record(buf);
+}
 
-    if (*p) free(*p);
+static void
+autosave_put_control(ghsnap_buffer_t *buf, int in, LADSPA_Data value)
+{
+    ghsnap_begin_record(buf, GHSNAP_JOURNAL_CONTROL);
+    ghsnap_put_u32(buf, pluginControlInInstances[in]->id);
+    ghsnap_put_u32(buf, pluginControlInPortNumbers[in]);
+    ghsnap_put_float(buf, value);
+    ghsnap_end_record(buf);
+}
 
-    if (!text || (len = strlen(text)) == 0) {
-        *p = strdup("''");
+/* Note a configure call, from the OSC thread, for the next journal write. */
+static void
+autosave_note_configure(d3h_instance_t *instance, const char *key, const char *value)
+{
+    if (!autosave_running)
         return;
-    }
 
-    for (i = 0, c = 0; i < len; i++)
-        if (text[i] == '\'') c++;
+    pthread_mutex_lock(&autosaveMutex);
+    add_configure_item(&autosaveConfigure[instance->number], (char *)key, (char *)value);
+    autosave_put_configure(&autosaveRecords, instance, key, value);
+    pthread_mutex_unlock(&autosaveMutex);
+}
 
-    if (c == 0) {
-        *p = (char *)malloc(len + 3);
-        sprintf(*p, "'%s'", text);
-        return;
-    }
+/* Replace the journal with one holding the full state. */
+static int
+autosave_compact(void)
+{
+    ghsnap_buffer_t buf;
+    configure_item_t *item;
+    int i, ok;
 
-    *p = (char *)malloc(len + c * 3 + 3);
-    c = 0;
-    if (text[0] != '\'') {
-        (*p)[c++] = '\'';
+    ghsnap_init_journal(&buf);
+    ghsnap_begin_record(&buf, GHSNAP_JOURNAL_RACK);
+    ghsnap_put_u32(&buf, instance_count);
+    ghsnap_put_u32(&buf, controlInsTotal);
+    ghsnap_end_record(&buf);
+
+    pthread_mutex_lock(&autosaveMutex);
+    for (i = 0; i < instance_count; i++) {
+        for (item = autosaveConfigure[i]; item; item = item->next) {
+            if (strcmp(item->key, DSSI_PROJECT_DIRECTORY_KEY))
+                autosave_put_configure(&buf, &instances[i], item->key, item->value);
+        }
     }
-    for (i = 0; i < len; i++) {
-        if (text[i] == '\'') {
-            if (i != 0) (*p)[c++] = '\'';
-            (*p)[c++] = '\\';
-            (*p)[c++] = '\'';
-            if (i != len - 1) (*p)[c++] = '\'';
-        } else {
-            (*p)[c++] = text[i];
+    ghsnap_clear(&autosaveRecords);  /* all included above */
+    pthread_mutex_unlock(&autosaveMutex);
+
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].plugin->descriptor->select_program) {
+            autosaveBank[i] = instances[i].currentBank;
+            autosaveProgram[i] = instances[i].currentProgram;
+            autosave_put_program(&buf, &instances[i]);
         }
     }
-    if (text[len - 1] != '\'') {
-        (*p)[c++] = '\'';
+    for (i = 0; i < controlInsTotal; i++) {
+        autosaveControls[i] = autosaveCapture[i];
+        autosave_put_control(&buf, i, autosaveControls[i]);
     }
-    (*p)[c++] = '\0';
+
+    ok = atomic_write_file(autosave_file, buf.data, buf.length);
+    if (ok) {
+        if (autosave_fd >= 0)
+            close(autosave_fd);
+        autosave_fd = open(autosave_file, O_WRONLY | O_APPEND);
+        autosave_length = autosave_compact_length = buf.length;
+    } else {
+        ghss_debug(GDB_ERROR, ": autosave to '%s' failed: %s", autosave_file,
+                   strerror(errno));
+        autosave_length = (size_t)-1;  /* try again next time */
+    }
+    ghsnap_free(&buf);
+
+    return ok;
 }
 
-int
-write_configuration(char *filename, const char *uuid)
+/* Append whatever has changed since the last write to the journal. */
+static void
+autosave_update(void)
 {
-    FILE *fp = NULL;
-    int rc = 0;
-    int id, instno, i, in, port;
-    d3h_instance_t *instance;
-    char *arg1 = NULL,
-         *arg2 = NULL;
-    configure_item_t *item;
+    int i;
 
-    if ((fp = fopen(filename, "w")) == NULL) goto error;
-    if (fprintf(fp, "#!/bin/sh\n") < 0) goto error;
-    /* -FIX- this shouldn't really be saved in the .ghss: */
-    if (dssi_path) {
-        escape_for_shell(&arg1, dssi_path);
-        if (fprintf(fp, "DSSI_PATH=%s\nexport DSSI_PATH\n", arg1) < 0) goto error;
+    pthread_mutex_lock(&autosaveMutex);
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].plugin->descriptor->select_program &&
+            (autosaveBank[i] != instances[i].currentBank ||
+             autosaveProgram[i] != instances[i].currentProgram)) {
+            autosaveBank[i] = instances[i].currentBank;
+            autosaveProgram[i] = instances[i].currentProgram;
+            autosave_put_program(&autosaveRecords, &instances[i]);
+        }
     }
-    if (ladspa_path) {
-        escape_for_shell(&arg1, ladspa_path);
-        if (fprintf(fp, "LADSPA_PATH=%s\nexport LADSPA_PATH\n", arg1) < 0) goto error;
+    for (i = 0; i < controlInsTotal; i++) {
+        if (autosaveControls[i] != autosaveCapture[i]) {
+            autosaveControls[i] = autosaveCapture[i];
+            autosave_put_control(&autosaveRecords, i, autosaveControls[i]);
+        }
     }
-    if (fprintf(fp, "exec %s \\\n", host_argv0) < 0) goto error;
-    if (strcmp(host_name, host_name_default)) {
-        escape_for_shell(&arg1, host_name);
-        if (fprintf(fp, " -hostname %s \\\n", arg1) < 0) goto error;
+
+    if (autosaveRecords.length && autosave_fd >= 0) {
+        if (write(autosave_fd, autosaveRecords.data, autosaveRecords.length) !=
+                autosaveRecords.length ||
+            fdatasync(autosave_fd)) {
+            ghss_debug(GDB_ERROR, ": autosave to '%s' failed: %s", autosave_file,
+                       strerror(errno));
+            /* the journal may now end with a partial record, which would hide
+             * anything after it, so start over with a fresh one */
+            autosave_length = (size_t)-1;
+        } else {
+            autosave_length += autosaveRecords.length;
+        }
     }
-    if (project_directory) {
-        escape_for_shell(&arg1, project_directory);
-        if (fprintf(fp, " -projdir %s \\\n", arg1) < 0) goto error;
+    ghsnap_clear(&autosaveRecords);
+    pthread_mutex_unlock(&autosaveMutex);
+}
+
+static void *
+autosave_thread_function(void *arg)
+{
+    int compact = 1;  /* start with the full state as restored */
+
+    while (autosave_running) {
+        capture_controls(autosaveCapture);
+        if (compact) {
+            autosave_compact();
+        } else {
+            autosave_update();
+        }
+        compact = (autosave_length > 4 * autosave_compact_length + AUTOSAVE_COMPACT_SLACK);
+
+        usleep(AUTOSAVE_INTERVAL * 1000);
     }
-    if (uuid) {
-        escape_for_shell(&arg1, uuid);
-        if (fprintf(fp, " -uuid %s \\\n", arg1) < 0) goto error;
+    /* one last update on the way out */
+    capture_controls(autosaveCapture);
+    autosave_update();
+
+    return NULL;
+}
+
+/* Apply the state saved in the autosave journal, if there is one, to the
+ * newly created instances.  Called before the audio thread starts. */
+static void
+autosave_restore(void)
+{
+    FILE *fp;
+    struct stat st;
+    unsigned char *data, *p, *end;
+    unsigned int type, id;
+    uint32_t length;
+    d3h_instance_t *instance;
+    char *key;
+    long in;
+    int i, records = 0;
+
+    if ((fp = fopen(autosave_file, "r")) == NULL)
+        return;  /* nothing to restore */
+    if (fstat(fileno(fp), &st) || st.st_size < GHSNAP_HEADER_LENGTH) {
+        fclose(fp);
+        return;
     }
-    if (!autoconnect || uuid) {
-        if (fprintf(fp, " -noauto \\\n") < 0) goto error;
+    data = (unsigned char *)malloc(st.st_size);
+    if (fread(data, 1, st.st_size, fp) != (size_t)st.st_size ||
+        memcmp(data, GHSNAP_JOURNAL_MAGIC, GHSNAP_MAGIC_LENGTH) ||
+        ghsnap_get_u32(data + GHSNAP_MAGIC_LENGTH) > GHSNAP_VERSION) {
+        ghss_debug(GDB_ERROR, ": '%s' is not an autosave journal, not restoring it",
+                   autosave_file);
+        goto done;
     }
-    for (id = 0; id < instance_count; id++) {
-        for (instno = 0; instances[instno].id != id; instno++);
-        instance = &instances[instno];
 
-        escape_for_shell(&arg1, instance->friendly_name);
-        if (fprintf(fp, "-comment %s \\\n", arg1) < 0) goto error;
+    p = data + GHSNAP_HEADER_LENGTH;
+    end = data + st.st_size;
+    while (p + 5 <= end) {
+        type = p[0];
+        length = ghsnap_get_u32(p + 1);
+        if (length > end - p - 5)
+            break;  /* cut short by a crash */
+        p += 5;
+        id = length >= 4 ? ghsnap_get_u32(p) : 0;
+        instance = NULL;
+        for (i = 0; i < instance_count; i++) {
+            if (instances[i].id == id) {
+                instance = &instances[i];
+                break;
+            }
+        }
+
+        switch (type) {
+          case GHSNAP_JOURNAL_RACK:
+            if (length != 8 || ghsnap_get_u32(p) != instance_count ||
+                ghsnap_get_u32(p + 4) != controlInsTotal) {
+                ghss_debug(GDB_ERROR, ": autosave journal '%s' is for a different set of plugins, not restoring it",
+                           autosave_file);
+                goto done;
+            }
+            break;
+
+          case GHSNAP_JOURNAL_CONTROL:
+            if (length != 12 || !instance ||
+                ghsnap_get_u32(p + 4) >= instance->plugin->descriptor->LADSPA_Plugin->PortCount)
+                break;
+            in = instance->pluginPortControlInNumbers[ghsnap_get_u32(p + 4)];
+            if (in >= 0) {
+                pluginControlIns[in] = ghsnap_get_float(p + 8);
+                pluginPortUpdated[in] = 1;
+            }
+            records++;
+            break;
+
+          case GHSNAP_JOURNAL_PROGRAM:
+            if (length != 12 || !instance || !instance->plugin->descriptor->select_program)
+                break;
+            instance->currentBank = ghsnap_get_u32(p + 4);
+            instance->currentProgram = ghsnap_get_u32(p + 8);
+            instance->plugin->descriptor->select_program(instanceHandles[instance->number],
+                                                         instance->currentBank,
+                                                         instance->currentProgram);
+            instance->uiNeedsProgramUpdate = 1;
+            records++;
+            break;
+
+          case GHSNAP_JOURNAL_CONFIGURE:
+            key = (char *)p + 4;
+            if (length < 6 || !instance || p[length - 1] != '\0' ||
+                key + strlen(key) + 1 >= (char *)p + length)
+                break;
+            slot_configure(instance, key, key + strlen(key) + 1);
+            records++;
+            break;
+
+          default:
+            break;
+        }
+        p += length;
+    }
+    ghss_debug(GDB_MAIN, ": restored %d settings from autosave journal '%s'",
+               records, autosave_file);
+
+  done:
+    free(data);
+    fclose(fp);
+}
+
+/* Start the autosave thread, once the audio thread is running. */
+static void
+autosave_start(void)
+{
+    int i;
+
+    autosaveConfigure = (configure_item_t **)calloc(instance_count, sizeof(configure_item_t *));
+    for (i = 0; i < instance_count; i++)
+        autosaveConfigure[i] = copy_configure_item_list(instances[i].configure_items);
+    autosaveControls = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * (controlInsTotal + 1));
+    autosaveCapture = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * (controlInsTotal + 1));
+    autosaveBank = (unsigned long *)calloc(instance_count, sizeof(unsigned long));
+    autosaveProgram = (unsigned long *)calloc(instance_count, sizeof(unsigned long));
+    ghsnap_init(&autosaveRecords);
+    ghsnap_clear(&autosaveRecords);
+
+    autosave_running = 1;
+    if (pthread_create(&autosave_thread, NULL, autosave_thread_function, NULL)) {
+        ghss_debug(GDB_ERROR, ": could not create autosave thread, autosave is off");
+        autosave_running = 0;
+    }
+}
 
-        /* chan */
-        if (fprintf(fp, " -chan %d \\\n", instance->channel) < 0) goto error;
+static void
+autosave_stop(void)
+{
+    int i;
 
-        /* conf */
-        for (item = instance->configure_items; item; item = item->next) {
-            if (strcmp(item->key, DSSI_PROJECT_DIRECTORY_KEY)) {  /* skip project directory */
-                escape_for_shell(&arg1, item->key);
-                escape_for_shell(&arg2, item->value);
-                if (fprintf(fp, " -conf %s %s \\\n", arg1, arg2) < 0) goto error;
-            }
-        }
+    if (!autosave_running)
+        return;
+    autosave_running = 0;
+    pthread_join(autosave_thread, NULL);
 
-        /* prog */
-        if (instance->plugin->descriptor->select_program) {
-            if (fprintf(fp, " -prog %lu %lu \\\n", instance->currentBank, instance->currentProgram) < 0) goto error;
-        }
+    if (autosave_fd >= 0)
+        close(autosave_fd);
+    for (i = 0; i < instance_count; i++)
+        free_configure_item_list(autosaveConfigure[i]);
+    free(autosaveConfigure);
+    free(autosaveControls);
+    free(autosaveCapture);
+    free(autosaveBank);
+    free(autosaveProgram);
+    ghsnap_free(&autosaveRecords);
+}
 
-        /* port */
-        for (i = 0; i < instance->plugin->controlIns; i++) {
-            char buf[G_ASCII_DTOSTR_BUF_SIZE];
+/* Querying programs for the patchlist: instances whose programs aren't
+ * cached are queried on worker threads, one per plugin DLL, so that slow
+ * plugins are queried concurrently, but instances sharing a DLL (which
+ * may have global state shared between its labels) never are. */
+typedef struct _program_query_job_t {
+    pthread_t        thread;
+    int              running;
+    int              count;
+    d3h_instance_t **instances;
+} program_query_job_t;
+
+static void *
+program_query_thread_function(void *arg)
+{
+    program_query_job_t *job = (program_query_job_t *)arg;
+    int i;
 
-            in = i + instance->firstControlIn;
-	    port = pluginControlInPortNumbers[in];
+    for (i = 0; i < job->count; i++)
+        query_programs(job->instances[i]);
 
-            /* always use "." as decimal point */
-            g_ascii_formatd(buf, sizeof(buf), "%.6g", pluginControlIns[in]);
-            if (fprintf(fp, " -port %d %s \\\n", port, buf) < 0) goto error;
-        }
+    return NULL;
+}
 
-        /* soname:label */
-        escape_for_shell(&arg1, instance->plugin->dll->name);
-        escape_for_shell(&arg2, instance->plugin->label);
-        if (fprintf(fp, " %s:%s \\\n", arg1, arg2) < 0) goto error;
-    }
-    if (fprintf(fp, "\n") < 0) goto error;
-    rc = 1;
+/* Instances' jobs are indexed by the number of the first instance's
+ * plugin from the same DLL. */
+static int
+program_query_job_index(d3h_instance_t *instance)
+{
+    int i;
 
-  error:
-    if (arg1) free(arg1);
-    if (arg2) free(arg2);
-    if (fp)   fclose(fp);
+    for (i = 0; instances[i].plugin->dll != instance->plugin->dll; i++);
+    return instances[i].plugin->number;
+}
 
-    return rc;
+/* Write one program name, as an XML attribute value. */
+static void
+write_patch_name(FILE *fp, const char *name)
+{
+    for ( ; *name; name++) {
+        /* Replace <, >, and " characters in name (bad XML) */
+        if (*name == '<' || *name == '>')
+            putc(' ', fp);
+        else if (*name == '"')
+            putc('\'', fp);
+        else
+            putc(*name, fp);
+    }
 }
 
 int
@@ -1017,43 +3190,64 @@ write_patchlist(char *filename)
 {
     FILE *fp = NULL;
     int rc = 0;
-    int id, instno, i, j;
+    int id, instno, i;
     d3h_instance_t *instance;
-    char tmp[255];
+    program_list_t *list;
+    program_query_job_t *jobs, *job;
 
-    if ((fp = fopen(filename, "w")) == NULL) goto error;
-    fprintf(fp, "<patchlist>\n");
+    if ((fp = fopen(filename, "w")) == NULL) return 0;
+    setvbuf(fp, NULL, _IOFBF, 65536);
+
+    /* start querying the instances that need it */
+    jobs = (program_query_job_t *)calloc(plugin_count, sizeof(program_query_job_t));
+    for (i = 0; i < instance_count; i++) {
+        instance = &instances[i];
+        if (query_cached_programs(instance))
+            continue;
+        job = &jobs[program_query_job_index(instance)];
+        if (!job->instances)
+            job->instances = (d3h_instance_t **)malloc(instance_count *
+                                                       sizeof(d3h_instance_t *));
+        job->instances[job->count++] = instance;
+    }
+    for (i = 0; i < plugin_count; i++) {
+        if (jobs[i].count &&
+            !pthread_create(&jobs[i].thread, NULL, program_query_thread_function, &jobs[i]))
+            jobs[i].running = 1;
+    }
 
+    /* write out each instance's programs as soon as we have them */
+    fprintf(fp, "<patchlist>\n");
     for (id = 0; id < instance_count; id++) {
         for (instno = 0; instances[instno].id != id; instno++);
         instance = &instances[instno];
 
-        if (!instance->pluginProgramsValid)
-            query_programs(instance);
-
-        for (i = 0; i < instance->pluginProgramCount; i++) {
-            /* Replace <, >, and " characters in name (bad XML) */
-            strncpy(tmp, instance->pluginPrograms[i].Name, 254);
-            tmp[254] = '\0';
-            for (j = 0; tmp[j]; j++) 
-                if (tmp[j] == '<' || tmp[j] == '>')
-                    tmp[j] = ' ';
-                else if (tmp[j] =='"')
-                    tmp[j] = '\'';
- 
-            fprintf(fp, "<patch channel=\"%d\" "
-                    "name=\"%s\" bank=\"%d\" program=\"%d\"/>\n",
-                    instance->channel,
-                    tmp,
-                    (int)instance->pluginPrograms[i].Bank,
-                    (int)instance->pluginPrograms[i].Program);
+        job = &jobs[program_query_job_index(instance)];
+        if (job->running) {
+            pthread_join(job->thread, NULL);
+            job->running = 0;
+        }
+        query_programs(instance);  /* if the thread couldn't be started */
+
+        if (!(list = hold_program_list(instance)))
+            continue;
+        for (i = 0; i < list->count; i++) {
+            fprintf(fp, "<patch channel=\"%d\" name=\"", instance->channel);
+            write_patch_name(fp, list->programs[i].Name);
+            fprintf(fp, "\" bank=\"%d\" program=\"%d\"/>\n",
+                    (int)list->programs[i].Bank,
+                    (int)list->programs[i].Program);
         }
+        release_program_list(list);
     }
-    if (fprintf(fp, "</patchlist>\n") < 0) goto error;
-    rc = 1;
+    if (fprintf(fp, "</patchlist>\n") >= 0)
+        rc = 1;
+    if (fclose(fp))
+        rc = 0;
 
-  error:
-    if (fp)   fclose(fp);
+    for (i = 0; i < plugin_count; i++)
+        free(jobs[i].instances);
+    free(jobs);
 
     return rc;
 }
@@ -1095,6 +3289,158 @@ ui_osc_free(d3h_instance_t *instance)
     instance->ui_osc_show_path = NULL;
 }
 
+/* Ask the shared universal GUI for a window for an instance. */
+static void
+shared_gui_send_open(d3h_instance_t *instance)
+{
+    char *osc_url;
+    char tag[12];
+
+    osc_url = (char *)malloc(strlen(host_osc_url) +
+                             strlen(instance->friendly_name) + 7);
+    sprintf(osc_url, "%sdssi/%s", host_osc_url, instance->friendly_name);
+    snprintf(tag, 12, "Inst %d", instance->id);
+
+    ghss_debug(GDB_UI, ": asking shared universal GUI for a window for '%s'", osc_url);
+    lo_send(sharedGuiAddress, "/ghostess/gui/open", "ssss", osc_url,
+            instance->plugin->dll->name,
+            instance->plugin->descriptor->LADSPA_Plugin->Label, tag);
+
+    free(osc_url);
+}
+
+/* With '-sharedgui', get an instance a window in the shared universal GUI,
+ * returning true if that's in hand, or false if the GUI needs launching,
+ * in which case the caller launches it and it is marked as starting. */
+static int
+shared_gui_open(d3h_instance_t *instance)
+{
+    int rc = 1;
+
+    pthread_mutex_lock(&sharedGuiMutex);
+    instance->ui_in_shared_gui = 1;
+    if (sharedGuiState == SHARED_GUI_STARTING &&
+        time(NULL) - sharedGuiStartTime > SHARED_GUI_START_TIMEOUT) {
+        ghss_debug(GDB_UI, ": shared universal GUI never said hello, trying again");
+        sharedGuiState = SHARED_GUI_NONE;
+    }
+    switch (sharedGuiState) {
+      case SHARED_GUI_RUNNING:
+        shared_gui_send_open(instance);
+        break;
+      case SHARED_GUI_STARTING:
+        instance->ui_shared_pending = 1;
+        break;
+      case SHARED_GUI_NONE:
+        sharedGuiState = SHARED_GUI_STARTING;
+        sharedGuiStartTime = time(NULL);
+        rc = 0;
+        break;
+    }
+    if (rc) {
+        instance->ui_running = 1;
+        instance->ui_initial_show_sent = 0;
+    }
+    pthread_mutex_unlock(&sharedGuiMutex);
+
+    return rc;
+}
+
+/* Note the pid of a just-launched shared universal GUI, or give up on it
+ * if the fork failed. */
+static void
+shared_gui_launched(pid_t pid)
+{
+    pthread_mutex_lock(&sharedGuiMutex);
+    if (pid > 0)
+        sharedGuiPid = pid;
+    else
+        sharedGuiState = SHARED_GUI_NONE;
+    pthread_mutex_unlock(&sharedGuiMutex);
+}
+
+/* Called from housekeeping: if the shared universal GUI has exited
+ * without saying bye (say it crashed), forget it and the UIs that were
+ * in it, so their editors can be opened again. */
+static void
+shared_gui_reap(void)
+{
+    d3h_instance_t *instance;
+    int i;
+
+    pthread_mutex_lock(&sharedGuiMutex);
+    if (sharedGuiPid > 0 && waitpid(sharedGuiPid, NULL, WNOHANG) == sharedGuiPid) {
+        ghss_debug(GDB_UI, ": shared universal GUI (pid %d) has exited", (int)sharedGuiPid);
+        sharedGuiPid = 0;
+        if (sharedGuiAddress)
+            lo_address_free(sharedGuiAddress);
+        sharedGuiAddress = NULL;
+        sharedGuiState = SHARED_GUI_NONE;
+        for (i = 0; i < instance_count; i++) {
+            instance = &instances[i];
+            if (!instance->ui_in_shared_gui)
+                continue;
+            instance->ui_in_shared_gui = 0;
+            instance->ui_shared_pending = 0;
+            instance->ui_running = 0;
+            if (instance->ui_osc_address)
+                ui_osc_free(instance);
+            if (instance->strip)
+                update_from_exiting(instance);
+        }
+    }
+    pthread_mutex_unlock(&sharedGuiMutex);
+}
+
+/* '/ghostess/gui/hello <url>': the shared universal GUI is ready */
+int
+osc_shared_gui_hello_handler(const char *url)
+{
+    int i;
+
+    ghss_debug(GDB_OSC, " OSC: shared universal GUI is at %s", url);
+
+    pthread_mutex_lock(&sharedGuiMutex);
+    if (sharedGuiAddress)
+        lo_address_free(sharedGuiAddress);
+    sharedGuiAddress = lo_address_new_from_url(url);
+    sharedGuiState = SHARED_GUI_RUNNING;
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].ui_shared_pending) {
+            instances[i].ui_shared_pending = 0;
+            shared_gui_send_open(&instances[i]);
+        }
+    }
+    pthread_mutex_unlock(&sharedGuiMutex);
+
+    return 0;
+}
+
+/* '/ghostess/gui/bye': the shared universal GUI has exited */
+int
+osc_shared_gui_bye_handler(void)
+{
+    int i;
+
+    ghss_debug(GDB_OSC, " OSC: shared universal GUI exited");
+
+    pthread_mutex_lock(&sharedGuiMutex);
+    if (sharedGuiAddress)
+        lo_address_free(sharedGuiAddress);
+    sharedGuiAddress = NULL;
+    sharedGuiState = SHARED_GUI_NONE;
+    for (i = 0; i < instance_count; i++) {
+        instances[i].ui_in_shared_gui = 0;
+        if (instances[i].ui_shared_pending) {
+            instances[i].ui_shared_pending = 0;
+            instances[i].ui_running = 0;
+        }
+    }
+    pthread_mutex_unlock(&sharedGuiMutex);
+
+    return 0;
+}
+
 void
 start_ui(d3h_instance_t *instance)
 {
@@ -1110,9 +3456,7 @@ start_ui(d3h_instance_t *instance)
     char *osc_url;
     char tag[12];
     int fuzzy;
-#if !(defined(__MACH__) && defined(__APPLE__))
     pid_t pid;
-#endif
 
     if (strlen(dllBase) > 3 &&
         !strcasecmp(dllBase + strlen(dllBase) - 3, ".so")) {
@@ -1237,7 +3581,13 @@ start_ui(d3h_instance_t *instance)
             
             if ((S_ISREG(buf.st_mode) || S_ISLNK(buf.st_mode)) &&
                 (buf.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
-                
+
+                if (shared_gui && shared_gui_open(instance)) {
+                    free(filename);
+                    free(origPath);
+                    return;
+                }
+
                 osc_url = (char *)malloc(strlen(host_osc_url) +
                                          strlen(instance->friendly_name) + 7);
                 sprintf(osc_url, "%sdssi/%s", host_osc_url, instance->friendly_name);
@@ -1249,8 +3599,20 @@ start_ui(d3h_instance_t *instance)
 #if !(defined(__MACH__) && defined(__APPLE__))
                 /* !FIX! On Darwin, this results in ghostess dying with a SIGPIPE.  Need to
                  * figure out which fds to close before the exec.... */
-                if ((pid = fork()) == 0) {
+                if (shared_gui) {
+                    /* forked just once, so housekeeping can tell if it dies */
+                    if ((pid = fork()) == 0) {
+                        if (host_osc_local_url)
+                            setenv("GHOSTESS_OSC_LOCAL_URL", host_osc_local_url, 1);
+                        execlp(filename, filename, "-shared", osc_url, dllName, label, tag, NULL);
+                        ghss_debug(GDB_ERROR, ": exec of universal GUI failed: %s", strerror(errno));
+                        _exit(1);
+                    }
+                    shared_gui_launched(pid);
+                } else if ((pid = fork()) == 0) {
                     if (fork() == 0) {
+                        if (host_osc_local_url)
+                            setenv("GHOSTESS_OSC_LOCAL_URL", host_osc_local_url, 1);
                         execlp(filename, filename, osc_url, dllName, label, tag, NULL);
                         ghss_debug(GDB_ERROR, ": exec of universal GUI failed: %s", strerror(errno));
                     }
@@ -1259,11 +3621,18 @@ start_ui(d3h_instance_t *instance)
                     waitpid(pid, NULL, 0);
                 }
 #else
-		if (fork() == 0) {
-		    execlp(filename, filename, osc_url, dllName, label, tag, NULL);
+		if ((pid = fork()) == 0) {
+                    if (host_osc_local_url)
+                        setenv("GHOSTESS_OSC_LOCAL_URL", host_osc_local_url, 1);
+                    if (shared_gui)
+                        execlp(filename, filename, "-shared", osc_url, dllName, label, tag, NULL);
+                    else
+                        execlp(filename, filename, osc_url, dllName, label, tag, NULL);
                     ghss_debug(GDB_ERROR, ": exec of universal GUI failed: %s", strerror(errno));
 		    exit(1);
 		}
+                if (shared_gui)
+                    shared_gui_launched(pid);
 #endif
 
                 instance->ui_running = 1;
@@ -1271,85 +3640,518 @@ start_ui(d3h_instance_t *instance)
                 
                 free(osc_url);
                 free(filename);
+                free(origPath);
                 return;
             }
 
             free(filename);
         }
-
-        free(origPath);
+
+        free(origPath);
+    }
+
+    ghss_debug(GDB_UI, ": no UI found for plugin '%s'", label);
+}
+
+/* ==== program lists ==== */
+
+/* Some plugins have thousands of programs, and calling get_program() for
+ * each can take a while, so program lists are cached, in memory and on
+ * disk, keyed by plugin and a hash of the instance's configure items
+ * (configure can change a plugin's programs).  Instances with the same
+ * plugin and configuration share one list.  On disk, the key also holds
+ * the plugin DLL's modification time and size, so a rebuilt plugin gets
+ * queried afresh. */
+#define PROGRAM_CACHE_MAX  64   /* lists kept in memory, beyond those in use */
+
+static pthread_mutex_t programCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static program_list_t *programCache = NULL;  /* most recently used first */
+static int             programCacheCount = 0;
+
+static uint32_t
+fnv_hash(uint32_t hash, const char *s)
+{
+    do {
+        hash ^= (unsigned char)*s;
+        hash *= 16777619;
+    } while (*s++);
+
+    return hash;
+}
+
+/* Hash an instance's configure items.  The order of the list depends on
+ * the order the keys were first set in, so the items are combined in a
+ * way that doesn't depend on it. */
+static uint32_t
+configure_hash(configure_item_t *item)
+{
+    uint32_t hash = 0;
+
+    for ( ; item; item = item->next)
+        hash += fnv_hash(fnv_hash(2166136261u, item->key), item->value);
+
+    return hash;
+}
+
+static void
+free_program_list(program_list_t *list)
+{
+    free(list->programs);
+    free(list->names);
+    free(list->index);
+    free(list);
+}
+
+static inline unsigned int
+program_index_hash(unsigned long bank, unsigned long program)
+{
+    return (unsigned int)((bank << 7) ^ program) * 2654435761u;
+}
+
+/* Build a list's (bank, program) index, an open-addressed hash table at
+ * most half full.  If a plugin lists the same bank and program twice, the
+ * first is the one found. */
+static void
+program_list_build_index(program_list_t *list)
+{
+    unsigned int size = 16, slot;
+    int i;
+
+    while (size < list->count * 2)
+        size *= 2;
+    list->index = (int *)calloc(size, sizeof(int));
+    list->index_mask = size - 1;
+
+    for (i = 0; i < list->count; i++) {
+        slot = program_index_hash(list->programs[i].Bank, list->programs[i].Program);
+        for (;; slot++) {
+            slot &= list->index_mask;
+            if (!list->index[slot]) {
+                list->index[slot] = i + 1;
+                break;
+            }
+            if (list->programs[list->index[slot] - 1].Bank == list->programs[i].Bank &&
+                list->programs[list->index[slot] - 1].Program == list->programs[i].Program)
+                break;  /* duplicate */
+        }
+    }
+}
+
+/* Return the programs[] number of a bank and program, or -1. */
+static int
+program_list_find(program_list_t *list, unsigned long bank, unsigned long program)
+{
+    unsigned int slot = program_index_hash(bank, program);
+    int i;
+
+    if (!list)
+        return -1;
+    for (;; slot++) {
+        slot &= list->index_mask;
+        if (!(i = list->index[slot]))
+            return -1;
+        if (list->programs[i - 1].Bank == bank && list->programs[i - 1].Program == program)
+            return i - 1;
+    }
+}
+
+/* Find the file a plugin's DLL was loaded from. */
+static char *
+plugin_dll_path(d3h_plugin_t *plugin)
+{
+    if (g_path_is_absolute(plugin->dll->name))
+        return g_strdup(plugin->dll->name);
+    return g_build_filename(plugin->dll->directory, plugin->dll->name, NULL);
+}
+
+/* Build the on-disk cache key record for a plugin and configure hash, and
+ * return the name of the cache file, or NULL if the DLL can't be found. */
+static char *
+program_cache_key(d3h_plugin_t *plugin, uint32_t hash, ghsnap_buffer_t *buf)
+{
+    char *path, *key, *filename, name[32];
+    struct stat st;
+
+    path = plugin_dll_path(plugin);
+    if (stat(path, &st)) {
+        g_free(path);
+        return NULL;
+    }
+    key = g_strdup_printf("%s:%s", path, plugin->label);
+    g_free(path);
+
+    ghsnap_begin_record(buf, GHSNAP_PROGRAMS_KEY);
+    ghsnap_put_string(buf, key);
+    ghsnap_put_u32(buf, st.st_mtime);
+    ghsnap_put_u32(buf, st.st_size);
+    ghsnap_put_u32(buf, hash);
+    ghsnap_end_record(buf);
+
+    snprintf(name, sizeof(name), "%08x%08x.ghprog", fnv_hash(2166136261u, key), hash);
+    filename = g_build_filename(g_get_user_cache_dir(), "ghostess", name, NULL);
+    g_free(key);
+
+    return filename;
+}
+
+/* Look for a program list in the on-disk cache. */
+static program_list_t *
+program_cache_load(d3h_plugin_t *plugin, uint32_t hash)
+{
+    ghsnap_buffer_t key;
+    char *filename, *names;
+    FILE *fp;
+    struct stat st;
+    unsigned char *data = NULL, *p, *end;
+    uint32_t length, count, i;
+    program_list_t *list = NULL;
+
+    ghsnap_init_programs(&key);
+    if (!(filename = program_cache_key(plugin, hash, &key)))
+        goto out;
+    if ((fp = fopen(filename, "r")) == NULL)
+        goto out;
+    if (!fstat(fileno(fp), &st) &&
+        st.st_size > key.length + 9) {
+        data = (unsigned char *)malloc(st.st_size);
+        if (fread(data, 1, st.st_size, fp) != (size_t)st.st_size)
+            st.st_size = 0;
+    }
+    fclose(fp);
+    if (!data || st.st_size == 0 ||
+        memcmp(data, key.data, key.length))  /* header and key must match exactly */
+        goto out;
+
+    p = data + key.length;
+    end = data + st.st_size;
+    length = ghsnap_get_u32(p + 1);
+    if (p[0] != GHSNAP_PROGRAMS_LIST || length < 4 || length > end - p - 5)
+        goto out;
+    p += 5;
+    end = p + length;
+    count = ghsnap_get_u32(p);
+    p += 4;
+    if (count > length / 9)  /* each at least 9 bytes */
+        goto out;
+
+    list = (program_list_t *)calloc(1, sizeof(program_list_t));
+    list->plugin = plugin;
+    list->configure_hash = hash;
+    list->programs = (DSSI_Program_Descriptor *)malloc((count ? count : 1) * sizeof(DSSI_Program_Descriptor));
+    /* the names take up no more than the record does */
+    list->names = names = (char *)malloc(length);
+    for (i = 0; i < count; i++) {
+        if (end - p < 9 || !memchr(p + 8, 0, end - p - 8)) {
+            free_program_list(list);
+            list = NULL;
+            goto out;
+        }
+        list->programs[i].Bank = ghsnap_get_u32(p);
+        list->programs[i].Program = ghsnap_get_u32(p + 4);
+        strcpy(names, (char *)p + 8);
+        list->programs[i].Name = names;
+        names += strlen(names) + 1;
+        p += 8 + strlen((char *)p + 8) + 1;
+    }
+    list->count = count;
+    program_list_build_index(list);
+    ghss_debug(GDB_PROGRAM, ": loaded %d programs for plugin '%s' from cache file '%s'",
+               count, plugin->label, filename);
+
+  out:
+    free(data);
+    ghsnap_free(&key);
+    g_free(filename);
+    return list;
+}
+
+/* Save a program list to the on-disk cache. */
+static void
+program_cache_store(program_list_t *list)
+{
+    ghsnap_buffer_t buf;
+    char *filename, *directory;
+    int i;
+
+    ghsnap_init_programs(&buf);
+    if ((filename = program_cache_key(list->plugin, list->configure_hash, &buf))) {
+        ghsnap_begin_record(&buf, GHSNAP_PROGRAMS_LIST);
+        ghsnap_put_u32(&buf, list->count);
+        for (i = 0; i < list->count; i++) {
+            ghsnap_put_u32(&buf, list->programs[i].Bank);
+            ghsnap_put_u32(&buf, list->programs[i].Program);
+            ghsnap_put_string(&buf, list->programs[i].Name);
+        }
+        ghsnap_end_record(&buf);
+        ghsnap_finish(&buf);
+
+        directory = g_path_get_dirname(filename);
+        if (g_mkdir_with_parents(directory, 0755) ||
+            !atomic_write_file(filename, buf.data, buf.length)) {
+            ghss_debug(GDB_PROGRAM, ": could not write program cache file '%s': %s",
+                       filename, strerror(errno));
+        }
+        g_free(directory);
+        g_free(filename);
+    }
+    ghsnap_free(&buf);
+}
+
+/* Ask a plugin for its programs. */
+static program_list_t *
+program_list_from_plugin(d3h_instance_t *instance, uint32_t hash)
+{
+    const DSSI_Program_Descriptor *descriptor;
+    program_list_t *list;
+    int allocated = 128;
+    size_t names_length = 0, names_allocated = 4096, length;
+    int i;
+
+    list = (program_list_t *)calloc(1, sizeof(program_list_t));
+    list->plugin = instance->plugin;
+    list->configure_hash = hash;
+    list->programs = (DSSI_Program_Descriptor *)malloc(allocated * sizeof(DSSI_Program_Descriptor));
+    list->names = (char *)malloc(names_allocated);
+
+    i = 0;
+    while ((descriptor = instance->plugin->descriptor->
+                get_program(instanceHandles[instance->number], i)) != NULL) {
+
+        if (i == allocated) {
+            allocated *= 2;
+            list->programs = (DSSI_Program_Descriptor *)
+                realloc(list->programs, allocated * sizeof(DSSI_Program_Descriptor));
+        }
+        length = strlen(descriptor->Name) + 1;
+        if (names_length + length > names_allocated) {
+            while (names_length + length > names_allocated)
+                names_allocated *= 2;
+            list->names = (char *)realloc(list->names, names_allocated);
+        }
+        memcpy(list->names + names_length, descriptor->Name, length);
+
+        list->programs[i].Bank = descriptor->Bank;
+        list->programs[i].Program = descriptor->Program;
+        list->programs[i].Name = (char *)names_length;  /* offset until the arena stops moving */
+        names_length += length;
+        ghss_debug(GDB_PROGRAM, " %s: program %d is MIDI bank %lu program %lu, named '%s'",
+                   instance->friendly_name, i,
+                   descriptor->Bank, descriptor->Program, descriptor->Name);
+        i++;
+    }
+    list->count = i;
+    for (i = 0; i < list->count; i++)
+        list->programs[i].Name = list->names + (size_t)list->programs[i].Name;
+    program_list_build_index(list);
+
+    return list;
+}
+
+/* Find a list in the in-memory cache, moving it to the front.  Called with
+ * programCacheMutex held. */
+static program_list_t *
+program_cache_find(d3h_plugin_t *plugin, uint32_t hash)
+{
+    program_list_t *list, **prev;
+
+    for (prev = &programCache; (list = *prev); prev = &list->next) {
+        if (list->plugin == plugin && list->configure_hash == hash) {
+            *prev = list->next;
+            list->next = programCache;
+            programCache = list;
+            return list;
+        }
+    }
+    return NULL;
+}
+
+/* Add a list to the in-memory cache, dropping the least recently used
+ * lists no instance is using if there are too many.  Called with
+ * programCacheMutex held. */
+static void
+program_cache_add(program_list_t *list)
+{
+    program_list_t *old, **prev;
+    int kept = 0;
+
+    list->next = programCache;
+    programCache = list;
+    programCacheCount++;
+
+    prev = &programCache;
+    while ((old = *prev)) {
+        if (old->references == 0 && ++kept > PROGRAM_CACHE_MAX) {
+            *prev = old->next;
+            free_program_list(old);
+            programCacheCount--;
+        } else {
+            prev = &old->next;
+        }
+    }
+}
+
+/* Point an instance at a program list (or none), with programCacheMutex
+ * held. */
+static void
+set_program_list(d3h_instance_t *instance, program_list_t *list)
+{
+    if (instance->programList)
+        instance->programList->references--;
+    instance->programList = list;
+    if (list)
+        list->references++;
+}
+
+/* Take a reference to an instance's program list, so it can be read
+ * without programCacheMutex held, even if the instance moves to another
+ * list and the cache evicts this one meanwhile.  Returns NULL if the
+ * instance has no programs; otherwise release_program_list() it when
+ * done. */
+program_list_t *
+hold_program_list(d3h_instance_t *instance)
+{
+    program_list_t *list;
+
+    pthread_mutex_lock(&programCacheMutex);
+    list = instance->programList;
+    if (list)
+        list->references++;
+    pthread_mutex_unlock(&programCacheMutex);
+
+    return list;
+}
+
+void
+release_program_list(program_list_t *list)
+{
+    if (!list)
+        return;
+    pthread_mutex_lock(&programCacheMutex);
+    list->references--;
+    pthread_mutex_unlock(&programCacheMutex);
+}
+
+/* Try the caches for an instance's programs, returning true if they were
+ * found there (or the plugin has none).  Called with the instance's DLL's
+ * programQueryMutex held. */
+static int
+programs_from_cache(d3h_instance_t *instance)
+{
+    uint32_t hash;
+    program_list_t *list, *loaded;
+
+    if (instance->pluginProgramsValid)
+        return 1;
+
+    if (!instance->plugin->descriptor->get_program) {
+        pthread_mutex_lock(&programCacheMutex);
+        set_program_list(instance, NULL);
+        pthread_mutex_unlock(&programCacheMutex);
+        instance->pluginProgramsValid = 1;
+        return 1;
+    }
+
+    hash = configure_hash(instance->configure_items);
+    pthread_mutex_lock(&programCacheMutex);
+    list = program_cache_find(instance->plugin, hash);
+    if (!list) {
+        /* read the disk cache unlocked, then look again before adding,
+         * in case the list went in meanwhile */
+        pthread_mutex_unlock(&programCacheMutex);
+        /* -FIX- this assumes a plugin's programs depend only on its DLL
+         * and configure items.  A plugin that loads its programs from
+         * files will be served a stale list after those files change,
+         * until its DLL changes or the cache file is removed. */
+        loaded = program_cache_load(instance->plugin, hash);
+        if (!loaded)
+            return 0;
+        pthread_mutex_lock(&programCacheMutex);
+        list = program_cache_find(instance->plugin, hash);
+        if (list) {
+            free_program_list(loaded);
+        } else {
+            list = loaded;
+            program_cache_add(list);
+        }
     }
+    set_program_list(instance, list);
+    pthread_mutex_unlock(&programCacheMutex);
 
-    ghss_debug(GDB_UI, ": no UI found for plugin '%s'", label);
+    instance->pluginProgramsValid = 1;
+    return 1;
+}
+
+static int
+query_cached_programs(d3h_instance_t *instance)
+{
+    pthread_mutex_t *mutex = &instance->plugin->dll->programQueryMutex;
+    int rc;
+
+    pthread_mutex_lock(mutex);
+    rc = programs_from_cache(instance);
+    pthread_mutex_unlock(mutex);
+
+    return rc;
 }
 
+/* Make sure an instance's programList is up to date, querying the plugin
+ * if it isn't cached.  Plugins from one DLL are never queried at once,
+ * whichever thread does the querying, since they may share global
+ * state. */
 void
 query_programs(d3h_instance_t *instance)
 {
-    int i;
-    const DSSI_Program_Descriptor *descriptor;
-
-    if (instance->pluginProgramsValid)
-        return;
+    pthread_mutex_t *mutex = &instance->plugin->dll->programQueryMutex;
+    program_list_t *list, *found;
+    uint32_t hash;
 
-    if (!instance->plugin->descriptor->get_program) {
-        instance->pluginProgramsValid = 1;
-        instance->pluginProgramCount = 0;
+    pthread_mutex_lock(mutex);
+    if (programs_from_cache(instance)) {
+        pthread_mutex_unlock(mutex);
         return;
     }
 
-    /* free old lot */
-    for (i = 0; i < instance->pluginProgramCount; i++)
-        free((void *)instance->pluginPrograms[i].Name);
-    instance->pluginProgramCount = 0;
-
-    /* get new */
-    i = 0;
-    while ((descriptor = instance->plugin->descriptor->
-                get_program(instanceHandles[instance->number], i)) != NULL) {
-
-        if (instance->pluginProgramsAlloc <= i) {
-            instance->pluginProgramsAlloc += 128;
-            instance->pluginPrograms = (DSSI_Program_Descriptor *)
-                realloc(instance->pluginPrograms,
-                        instance->pluginProgramsAlloc * sizeof(DSSI_Program_Descriptor));
-        }
+    hash = configure_hash(instance->configure_items);
+    list = program_list_from_plugin(instance, hash);
+    program_cache_store(list);
 
-        instance->pluginPrograms[i].Bank = descriptor->Bank;
-        instance->pluginPrograms[i].Program = descriptor->Program;
-        instance->pluginPrograms[i].Name = strdup(descriptor->Name);
-        ghss_debug(GDB_PROGRAM, " %s: program %d is MIDI bank %lu program %lu, named '%s'",
-                   instance->friendly_name, i,
-                   instance->pluginPrograms[i].Bank,
-                   instance->pluginPrograms[i].Program,
-                   instance->pluginPrograms[i].Name);
-        instance->pluginProgramCount++;
-        i++;
+    pthread_mutex_lock(&programCacheMutex);
+    if ((found = program_cache_find(instance->plugin, hash))) {
+        free_program_list(list);
+        list = found;
+    } else {
+        program_cache_add(list);
     }
+    set_program_list(instance, list);
+    pthread_mutex_unlock(&programCacheMutex);
     instance->pluginProgramsValid = 1;
+    pthread_mutex_unlock(mutex);
 }
 
 void free_programs(d3h_instance_t *instance)
 {
-    int i;
+    pthread_mutex_t *mutex = &instance->plugin->dll->programQueryMutex;
 
-    if (instance->pluginPrograms) {
-        for (i = 0; i < instance->pluginProgramCount; i++)
-            free((void *)instance->pluginPrograms[i].Name);
-        free((char *)instance->pluginPrograms);
-    }
+    pthread_mutex_lock(mutex);
+    pthread_mutex_lock(&programCacheMutex);
+    set_program_list(instance, NULL);
+    pthread_mutex_unlock(&programCacheMutex);
     instance->pluginProgramsValid = 0;
-    instance->pluginProgramsAlloc = 0;
-    instance->pluginProgramCount = 0;
-    instance->pluginPrograms = NULL;
+    pthread_mutex_unlock(mutex);
 }
 
-gint
-gtk_timeout_callback(gpointer data)
+/* Periodic host housekeeping, run from the GTK+ main loop or, with
+ * -nogui, from nogui_main_loop(): send program and control changes made
+ * by the audio thread out to the UIs, and update the GUI's eyecandy. */
+static void
+host_housekeeping(void)
 {
     int i;
     d3h_instance_t *instance;
 
+    if (shared_gui)
+        shared_gui_reap();
+
     /* Race conditions here, because the programs and ports are
        updated from the audio thread.  We at least try to minimise
        trouble by copying out before the expensive OSC call */
@@ -1378,23 +4180,163 @@ gtk_timeout_callback(gpointer data)
         }
     }
 
-    for (i = 0; i < instance_count; i++)
-        update_eyecandy(&instances[i]);
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].strip)
+            update_eyecandy(&instances[i]);
+    }
+}
+
+/* Is any instance's MIDI activity LED lit? */
+static int
+host_activity_lit(void)
+{
+    int i;
+
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].strip && instances[i].strip->previous_midi_state)
+            return 1;
+    }
+    return 0;
+}
+
+/* The MIDI activity LEDs are the only thing that changes without the audio
+ * thread telling us, as they decay, so this timer only runs while one is
+ * lit. */
+static gint
+activity_timeout_callback(gpointer data)
+{
+    int i;
 
     main_timeout_tick++;
 
-    if (host_exiting) {
-        gtk_main_quit();
-        return FALSE;
-    } else {
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].strip)
+            update_eyecandy(&instances[i]);
+    }
+
+    if (host_activity_lit()) {
         return TRUE;
+    } else {
+        activity_timeout_tag = 0;
+        return FALSE;
+    }
+}
+
+static gboolean
+host_wakeup_callback(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    host_wakeup_drain();
+    host_housekeeping();
+
+    if (!activity_timeout_tag && host_activity_lit())
+        activity_timeout_tag = gtk_timeout_add(ACTIVITY_INTERVAL,
+                                               activity_timeout_callback, NULL);
+
+    if (host_exiting)
+        gtk_main_quit();
+
+    return TRUE;
+}
+
+/* The -nogui replacement for gtk_main(): sleep until the audio thread, a
+ * JACK session event or a signal wakes us, do the housekeeping, and repeat
+ * until we're told to exit. */
+static void
+nogui_main_loop(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = hostWakeupPipe[0];
+    pfd.events = POLLIN;
+
+    while (!host_exiting) {
+        if (poll(&pfd, 1, -1) > 0 && (pfd.revents & POLLIN))
+            host_wakeup_drain();
+#ifdef JACK_SESSION
+        if (pendingSessionEvent) {
+            jack_session_event_t *event = pendingSessionEvent;
+
+            pendingSessionEvent = NULL;
+            session_gui_idle_callback(event);
+        }
+#endif
+        host_housekeeping();
+    }
+}
+
+/* Remove a UNIX socket, but only if that's what 'path' is -- '-oscunix'
+ * given a mistyped path shouldn't delete some other file. */
+static void
+unlink_socket(const char *path)
+{
+    struct stat st;
+
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+}
+
+/* Create the OSC server thread(s) */
+static void
+osc_servers_start(void)
+{
+    osc_dispatch_table_build();
+    serverThread = lo_server_thread_new(NULL, osc_error);
+    host_osc_url = lo_server_thread_get_url(serverThread);
+    ghss_debug(GDB_OSC, ": host OSC URL is %s", host_osc_url);
+    lo_server_enable_queue(lo_server_thread_get_server(serverThread), 0, 1);
+    lo_server_thread_add_method(serverThread, NULL, NULL, osc_message_handler,
+				NULL);
+    lo_server_thread_start(serverThread);
+
+    /* Serve the same namespace over TCP and/or a UNIX domain socket, if
+     * requested.  These are lossless and (for UNIX sockets) skip the
+     * network stack, so the universal GUI is pointed at one of them. */
+    if (osc_serve_tcp) {
+        serverThreadTCP = lo_server_thread_new_with_proto(NULL, LO_TCP, osc_error);
+        if (serverThreadTCP) {
+            host_osc_local_url = lo_server_thread_get_url(serverThreadTCP);
+            ghss_debug(GDB_OSC, ": host OSC TCP URL is %s", host_osc_local_url);
+            lo_server_enable_queue(lo_server_thread_get_server(serverThreadTCP), 0, 1);
+            lo_server_thread_add_method(serverThreadTCP, NULL, NULL, osc_message_handler,
+                                        NULL);
+            lo_server_thread_start(serverThreadTCP);
+        } else {
+            ghss_debug(GDB_ERROR, ": could not create OSC TCP server");
+        }
+    }
+    if (osc_unix_socket) {
+        unlink_socket(osc_unix_socket);  /* remove any stale socket */
+        serverThreadUnix = lo_server_thread_new_with_proto(osc_unix_socket, LO_UNIX, osc_error);
+        if (serverThreadUnix) {
+            if (host_osc_local_url) free(host_osc_local_url);
+            host_osc_local_url = lo_server_thread_get_url(serverThreadUnix);
+            ghss_debug(GDB_OSC, ": host OSC UNIX socket URL is %s", host_osc_local_url);
+            lo_server_enable_queue(lo_server_thread_get_server(serverThreadUnix), 0, 1);
+            lo_server_thread_add_method(serverThreadUnix, NULL, NULL, osc_message_handler,
+                                        NULL);
+            lo_server_thread_start(serverThreadUnix);
+        } else {
+            ghss_debug(GDB_ERROR, ": could not create OSC server on UNIX socket '%s'",
+                       osc_unix_socket);
+        }
+    }
+}
+
+/* Close the audio backend if main() returned early, without closing it. */
+static void
+audio_backend_close_at_exit(void)
+{
+    if (audio_backend_opened) {
+        audio_backend_opened = 0;
+        audio_backend->close();
     }
 }
 
 int
 main(int argc, char **argv)
 {
-    gint gtk_timeout_tag;
+    GIOChannel *wakeup_channel;
+    guint wakeup_tag;
 
     d3h_dll_t *dll;
     d3h_plugin_t *plugin;
@@ -1403,13 +4345,20 @@ main(int argc, char **argv)
     void *pluginObject;
     char *dllName;
     char *label;
-    const char **ports;
     char *tmp, *arg0, *arg1;
     int i, reps, j;
     int in, out, controlIn, controlOut;
-    jack_status_t status;
-
-    gtk_init(&argc, &argv);
+    jack_nframes_t buffer_size;
+    gboolean have_display;
+    int exit_status = 0;
+
+    /* A display isn't needed for offline rendering, and -nogui skips
+     * GTK+ entirely, so it has to be noticed before anything else. */
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-nogui"))
+            nogui = 1;
+    }
+    have_display = nogui ? FALSE : gtk_init_check(&argc, &argv);
 
     setsid();
     sigemptyset (&_signals);
@@ -1426,101 +4375,353 @@ main(int argc, char **argv)
 
     insTotal = outsTotal = controlInsTotal = controlOutsTotal = 0;
 
-    /* Parse args and report usage */
+    /* Parse args and report usage */
+
+    if (argc < 2) {
+#ifdef HAVE_CONFIG_H
+	fprintf(stderr, "%s %s\n", host_name, VERSION);
+#else
+	fprintf(stderr, "%s\n", host_name);
+#endif
+	fprintf(stderr, "Copyright (C) 2006-2012 Sean Bolton and others.\n");
+	fprintf(stderr, "%s comes with ABSOLUTELY NO WARRANTY. This is free software, and you are\n", host_name);
+        fprintf(stderr, "welcome to redistribute it under certain conditions; see the file COPYING for details.\n");
+#ifdef JACK_SESSION
+	fprintf(stderr, "Usage: %s [-debug <level>] [-hostname <hostname>] [-projdir <projdir>] [-uuid <uuid>] [-noauto] [-nogui] [-sharedgui] [-f <cfgfile>]\n", argv[0]);
+#else
+	fprintf(stderr, "Usage: %s [-debug <level>] [-hostname <hostname>] [-projdir <projdir>] [-noauto] [-nogui] [-sharedgui] [-f <cfgfile>]\n", argv[0]);
+#endif
+        fprintf(stderr, "       [-osctcp] [-oscunix <socket>] [-subblock <frames>] [-autosave <file>]\n");
+        fprintf(stderr, "       [-midiports <n>] [-coalesce <frames>] [-threads <n>]\n");
+        fprintf(stderr, "       [-audio <backend>[:<device>]] [-rate <hz>] [-period <frames>]\n");
+        fprintf(stderr, "       [-render <midifile> <wavfile>]\n");
+#ifdef GHSS_BENCH
+        fprintf(stderr, "       [-cycles <count>] [-sizes <sizes>] [-load <pattern>] [-eventrate <rate>]\n");
+#endif /* GHSS_BENCH */
+        fprintf(stderr, "       [-<n> | -farm <n>] [-chan [<p>:]<c>] [-keys <lo> <hi>] [-vel <lo> <hi>] [-conf <k> <v>] [-prog <b> <p>] [-port <p> <f>] <soname>[:<label>] [...]\n\n");
+        fprintf(stderr, "  <level>    Debug information flags, bitfield, 1 = errors only, -1 = all\n");
+        fprintf(stderr, "  <hostname> JACK and ALSA client name to use, default \"ghostess\"\n");
+        fprintf(stderr, "  <projdir>  DSSI project directory, default none\n");
+#ifdef JACK_SESSION
+        fprintf(stderr, "  <uuid>     JACK session management UUID, default none\n");
+#endif
+        fprintf(stderr, "  <cfgfile>  File containing more configuration; same format as command line,\n"
+                        "             or a binary snapshot saved with a name ending in '.ghsnap'\n");
+        fprintf(stderr, "  <socket>   Path of UNIX domain socket on which to also serve OSC\n");
+        fprintf(stderr, "  <file>     Journal in which to keep plugin state as it changes, and from which\n"
+                        "             to restore it at startup\n");
+        fprintf(stderr, "  <frames>   For -subblock, shortest sub-block when splitting cycles at OSC control changes;\n"
+                        "             for -coalesce, window in which repeated controller values are merged; default 0 (off);\n"
+                        "             for -period, period size for the null and alsa backends, default 256\n");
+        fprintf(stderr, "  <backend>  Audio backend: ");
+        audio_backend_list(stderr);
+        fprintf(stderr, "; default jack\n");
+        fprintf(stderr, "  <device>   Device for the backend, e.g. ALSA PCM device name, default \"default\"\n");
+        fprintf(stderr, "  <hz>       Sample rate for the null and alsa backends and offline rendering, default 44100\n");
+        fprintf(stderr, "  <midifile> <wavfile>  Render a Standard MIDI File to a WAV file offline, without JACK\n");
+#ifdef GHSS_BENCH
+        fprintf(stderr, "  <count>    Cycles to time at each buffer size, default 10000\n");
+        fprintf(stderr, "  <sizes>    Comma-separated buffer sizes to time, in frames, default 64,256,1024\n");
+        fprintf(stderr, "  <pattern>  Synthetic load, comma-separated from: idle, notes, cc, osc, program; default notes\n");
+        fprintf(stderr, "  <rate>     Synthetic events per second, default 1000\n");
+#endif /* GHSS_BENCH */
+        fprintf(stderr, "  <n>        Number of MIDI input ports (-midiports), threads to run plugins on (-threads),\n"
+                        "             or number of instances of the following plugin to create (-<n>), or\n"
+                        "             to create as a voice farm sharing one channel (-farm), default 1\n");
+        fprintf(stderr, "  <p>:<c>    MIDI input port (default 0) and channel for following instance, numbered from 0\n");
+        fprintf(stderr, "  <lo> <hi>  Key or note-on velocity zone for following instance, default 0 127\n");
+        fprintf(stderr, "  <k> <v>    Configure item key and value for following instance (repeatable for different keys)\n");
+        fprintf(stderr, "  <b> <p>    Bank and program number for following instance\n");
+        fprintf(stderr, "  <p> <f>    Port number and value for following instance (repeatable for different ports)\n");
+        fprintf(stderr, "  <soname>   Name of DSSI plugin library (*.so) to load\n");
+        fprintf(stderr, "  <label>    Name of DSSI plugin within library to instantiate, default first\n");
+        /* -FIX- add example? */
+	return 2;
+    }
+
+    host_argv0 = argv[0];
+
+    ghss_debug(GDB_ALWAYS, ": ghostess starting...");
+    
+    getarg_init_with_command_line(argc - 1, &argv[1]);
+    itemplate = new_instance_template();
+    reps = 1;
+    while ((arg0 = getarg())) {
+
+        if (!strcmp(arg0, "-debug")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": debug level expected after '-debug'");
+                return 2;
+            }
+            debug_flags = atoi(arg0);
+            ghss_debug(GDB_MAIN, ": debug level now %08x", debug_flags);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-hostname")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": host name base expected after '-hostname'");
+                return 2;
+            }
+            /* -FIX- check new host name for length, valid characters? */
+            if (host_name != host_name_default) free(host_name);
+            host_name = strdup(arg0);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-projdir") || !strcmp(arg0, "-p")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": project directory expected after '-projdir'");
+                return 2;
+            }
+            if (project_directory) free(project_directory);
+            project_directory = strdup(arg0);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-uuid")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": uuid expected after '-uuid'");
+                return 2;
+            }
+            if (jack_session_uuid) free(jack_session_uuid);
+            jack_session_uuid = strdup(arg0);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-noauto") || !strcmp(arg0, "-c")) {
+            autoconnect = 0;
+            continue;
+        }
+
+        if (!strcmp(arg0, "-nogui")) {
+            nogui = 1;  /* if from a config file, GTK+ was initialized, but goes unused */
+            continue;
+        }
+
+        if (!strcmp(arg0, "-sharedgui")) {
+            shared_gui = 1;
+            continue;
+        }
+
+        if (!strcmp(arg0, "-autosave")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": file name expected after '-autosave'");
+                return 2;
+            }
+            free(autosave_file);
+            autosave_file = strdup(arg0);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-midiports")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": port count expected after '-midiports'");
+                return 2;
+            }
+            midi_port_count = strtol(arg0, &tmp, 10);
+            if (*tmp != '\0' || midi_port_count < 1 || midi_port_count > GHSS_MAX_MIDI_PORTS) {
+                ghss_debug(GDB_ERROR, ": bad MIDI port count '%s'", arg0);
+                return 2;
+            }
+            continue;
+        }
+
+        if (!strcmp(arg0, "-render")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": MIDI and WAV file names expected after '-render'");
+                return 2;
+            }
+            if (render_midi_file) free(render_midi_file);
+            render_midi_file = strdup(arg0);
+            offline = 1;
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": MIDI and WAV file names expected after '-render'");
+                return 2;
+            }
+            if (render_wav_file) free(render_wav_file);
+            render_wav_file = strdup(arg0);
+            continue;
+        }
+
+        if (!strcmp(arg0, "-rate")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": sample rate expected after '-rate'");
+                return 2;
+            }
+            audio_sample_rate = strtoul(arg0, &tmp, 10);
+            if (*tmp != '\0' || audio_sample_rate < 1000) {
+                ghss_debug(GDB_ERROR, ": bad sample rate '%s'", arg0);
+                return 2;
+            }
+            continue;
+        }
+
+        if (!strcmp(arg0, "-audio")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": audio backend name expected after '-audio'");
+                return 2;
+            }
+            audio_backend_name = strdup(arg0);
+            if ((tmp = strchr(audio_backend_name, ':'))) {
+                *tmp = '\0';
+                audio_device = tmp + 1;
+            } else {
+                audio_device = NULL;
+            }
+            if (!audio_backend_find(audio_backend_name)) {
+                ghss_debug(GDB_ERROR, ": unknown audio backend '%s'", audio_backend_name);
+                return 2;
+            }
+            continue;
+        }
+
+        if (!strcmp(arg0, "-period")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": period size expected after '-period'");
+                return 2;
+            }
+            audio_period_size = strtoul(arg0, &tmp, 10);
+            if (*tmp != '\0' || audio_period_size < 16 || audio_period_size > 8192) {
+                ghss_debug(GDB_ERROR, ": bad period size '%s'", arg0);
+                return 2;
+            }
+            continue;
+        }
 
-    if (argc < 2) {
-#ifdef HAVE_CONFIG_H
-	fprintf(stderr, "%s %s\n", host_name, VERSION);
-#else
-	fprintf(stderr, "%s\n", host_name);
-#endif
-	fprintf(stderr, "Copyright (C) 2006-2012 Sean Bolton and others.\n");
-	fprintf(stderr, "%s comes with ABSOLUTELY NO WARRANTY. This is free software, and you are\n", host_name);
-        fprintf(stderr, "welcome to redistribute it under certain conditions; see the file COPYING for details.\n");
-#ifdef JACK_SESSION
-	fprintf(stderr, "Usage: %s [-debug <level>] [-hostname <hostname>] [-projdir <projdir>] [-uuid <uuid>] [-noauto] [-f <cfgfile>]\n", argv[0]);
-#else
-	fprintf(stderr, "Usage: %s [-debug <level>] [-hostname <hostname>] [-projdir <projdir>] [-noauto] [-f <cfgfile>]\n", argv[0]);
-#endif
-        fprintf(stderr, "       [-<n>] [-chan <c>] [-conf <k> <v>] [-prog <b> <p>] [-port <p> <f>] <soname>[:<label>] [...]\n\n");
-        fprintf(stderr, "  <level>    Debug information flags, bitfield, 1 = errors only, -1 = all\n");
-        fprintf(stderr, "  <hostname> JACK and ALSA client name to use, default \"ghostess\"\n");
-        fprintf(stderr, "  <projdir>  DSSI project directory, default none\n");
-#ifdef JACK_SESSION
-        fprintf(stderr, "  <uuid>     JACK session management UUID, default none\n");
-#endif
-        fprintf(stderr, "  <cfgfile>  File containing more configuration; same format as command line\n");
-        fprintf(stderr, "  <n>        Number of instances of the following plugin to create, default 1\n");
-        fprintf(stderr, "  <c>        MIDI channel for following instance, numbered from 0\n");
-        fprintf(stderr, "  <k> <v>    Configure item key and value for following instance (repeatable for different keys)\n");
-        fprintf(stderr, "  <b> <p>    Bank and program number for following instance\n");
-        fprintf(stderr, "  <p> <f>    Port number and value for following instance (repeatable for different ports)\n");
-        fprintf(stderr, "  <soname>   Name of DSSI plugin library (*.so) to load\n");
-        fprintf(stderr, "  <label>    Name of DSSI plugin within library to instantiate, default first\n");
-        /* -FIX- add example? */
-	return 2;
-    }
+#ifdef GHSS_BENCH
+        if (!strcmp(arg0, "-cycles")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": cycle count expected after '-cycles'");
+                return 2;
+            }
+            bench_cycles = atoi(arg0);
+            if (bench_cycles < 1) {
+                ghss_debug(GDB_ERROR, ": bad cycle count '%s'", arg0);
+                return 2;
+            }
+            continue;
+        }
 
-    host_argv0 = argv[0];
+        if (!strcmp(arg0, "-sizes")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": buffer sizes expected after '-sizes'");
+                return 2;
+            }
+            if (!bench_parse_sizes(arg0)) {
+                ghss_debug(GDB_ERROR, ": bad buffer size list '%s'", arg0);
+                return 2;
+            }
+            continue;
+        }
 
-    ghss_debug(GDB_ALWAYS, ": ghostess starting...");
-    
-    getarg_init_with_command_line(argc - 1, &argv[1]);
-    itemplate = new_instance_template();
-    reps = 1;
-    while ((arg0 = getarg())) {
+        if (!strcmp(arg0, "-load")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": load pattern expected after '-load'");
+                return 2;
+            }
+            bench_load = bench_parse_load(arg0);
+            if (bench_load < 0) {
+                ghss_debug(GDB_ERROR, ": bad load pattern '%s'", arg0);
+                return 2;
+            }
+            bench_load_name = strdup(arg0);
+            continue;
+        }
 
-        if (!strcmp(arg0, "-debug")) {
+        if (!strcmp(arg0, "-eventrate")) {
             arg0 = getarg();
             if (!arg0 || !strlen(arg0)) {
                 getarg_print_possible_error();
-                ghss_debug(GDB_ERROR, ": debug level expected after '-debug'");
+                ghss_debug(GDB_ERROR, ": event rate expected after '-eventrate'");
                 return 2;
             }
-            debug_flags = atoi(arg0);
-            ghss_debug(GDB_MAIN, ": debug level now %08x", debug_flags);
+            bench_event_rate = strtoul(arg0, NULL, 10);
             continue;
         }
+#endif /* GHSS_BENCH */
 
-        if (!strcmp(arg0, "-hostname")) {
+        if (!strcmp(arg0, "-threads")) {
             arg0 = getarg();
             if (!arg0 || !strlen(arg0)) {
                 getarg_print_possible_error();
-                ghss_debug(GDB_ERROR, ": host name base expected after '-hostname'");
+                ghss_debug(GDB_ERROR, ": thread count expected after '-threads'");
                 return 2;
             }
-            /* -FIX- check new host name for length, valid characters? */
-            if (host_name != host_name_default) free(host_name);
-            host_name = strdup(arg0);
+            run_thread_count = atoi(arg0);
+            if (run_thread_count < 1)
+                run_thread_count = 1;
             continue;
         }
 
-        if (!strcmp(arg0, "-projdir") || !strcmp(arg0, "-p")) {
+        if (!strcmp(arg0, "-coalesce")) {
             arg0 = getarg();
             if (!arg0 || !strlen(arg0)) {
                 getarg_print_possible_error();
-                ghss_debug(GDB_ERROR, ": project directory expected after '-projdir'");
+                ghss_debug(GDB_ERROR, ": frame count expected after '-coalesce'");
                 return 2;
             }
-            if (project_directory) free(project_directory);
-            project_directory = strdup(arg0);
+            coalesce_frames = atoi(arg0);
+            if (coalesce_frames < 0)
+                coalesce_frames = 0;
             continue;
         }
 
-        if (!strcmp(arg0, "-uuid")) {
+        if (!strcmp(arg0, "-subblock")) {
             arg0 = getarg();
             if (!arg0 || !strlen(arg0)) {
                 getarg_print_possible_error();
-                ghss_debug(GDB_ERROR, ": uuid expected after '-uuid'");
+                ghss_debug(GDB_ERROR, ": frame count expected after '-subblock'");
                 return 2;
             }
-            if (jack_session_uuid) free(jack_session_uuid);
-            jack_session_uuid = strdup(arg0);
+            control_subblock_min = atoi(arg0);
+            if (control_subblock_min < 0)
+                control_subblock_min = 0;
             continue;
         }
 
-        if (!strcmp(arg0, "-noauto") || !strcmp(arg0, "-c")) {
-            autoconnect = 0;
+        if (!strcmp(arg0, "-osctcp")) {
+            osc_serve_tcp = 1;
+            continue;
+        }
+
+        if (!strcmp(arg0, "-oscunix")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": socket path expected after '-oscunix'");
+                return 2;
+            }
+            if (osc_unix_socket) free(osc_unix_socket);
+            osc_unix_socket = strdup(arg0);
             continue;
         }
 
@@ -1546,7 +4747,17 @@ main(int argc, char **argv)
                 ghss_debug(GDB_ERROR, ": MIDI channel expected after '-chan'");
                 return 2;
             }
+            /* either '<channel>' or '<port>:<channel>' */
+            itemplate->midi_port = 0;
             itemplate->channel = strtol(arg0, &tmp, 10);
+            if (*tmp == ':' && tmp > arg0) {
+                itemplate->midi_port = itemplate->channel;
+                itemplate->channel = strtol(tmp + 1, &tmp, 10);
+                if (itemplate->midi_port < 0 || itemplate->midi_port >= GHSS_MAX_MIDI_PORTS) {
+                    ghss_debug(GDB_ERROR, ": bad MIDI port in '%s'", arg0);
+                    return 2;
+                }
+            }
             if (*tmp != '\0' || itemplate->channel < 0 || itemplate->channel > 15) {
                 ghss_debug(GDB_ERROR, ": bad MIDI channel '%s'", arg0);
                 return 2;
@@ -1554,6 +4765,24 @@ main(int argc, char **argv)
             continue;
         }
 
+        /* voice farm */
+        if (!strcmp(arg0, "-farm")) {
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": instance count expected after '-farm'");
+                return 2;
+            }
+            j = strtol(arg0, &tmp, 10);
+            if (*tmp != '\0' || j < 1 || j > GHSS_MAX_INSTANCES) {
+                ghss_debug(GDB_ERROR, ": bad farm instance count '%s'", arg0);
+                return 2;
+            }
+            reps = j;
+            itemplate->farm = (j > 1);
+            continue;
+        }
+
         /* configure item */
         if (!strcmp(arg0, "-conf")) {
             arg0 = getarg();
@@ -1607,6 +4836,60 @@ main(int argc, char **argv)
             continue;
         }
 
+        /* key or velocity zone */
+        if (!strcmp(arg0, "-keys") || !strcmp(arg0, "-vel")) {
+            int is_keys = !strcmp(arg0, "-keys");
+            int lo, hi;
+
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": low and high values expected after '%s'",
+                           is_keys ? "-keys" : "-vel");
+                return 2;
+            }
+            lo = strtol(arg0, &tmp, 10);
+            if (*tmp != '\0' || lo < 0 || lo > 127) {
+                ghss_debug(GDB_ERROR, ": bad zone low value '%s'", arg0);
+                return 2;
+            }
+            arg0 = getarg();
+            if (!arg0 || !strlen(arg0)) {
+                getarg_print_possible_error();
+                ghss_debug(GDB_ERROR, ": low and high values expected after '%s'",
+                           is_keys ? "-keys" : "-vel");
+                return 2;
+            }
+            hi = strtol(arg0, &tmp, 10);
+            if (*tmp != '\0' || hi < lo || hi > 127) {
+                ghss_debug(GDB_ERROR, ": bad zone high value '%s'", arg0);
+                return 2;
+            }
+            if (is_keys) {
+                itemplate->key_lo = lo;
+                itemplate->key_hi = hi;
+            } else {
+                itemplate->vel_lo = lo;
+                itemplate->vel_hi = hi;
+            }
+            continue;
+        }
+
+        /* block of port settings, from a snapshot file */
+        if (!strcmp(arg0, "-ports")) {
+            const unsigned char *block;
+            unsigned long count, n;
+
+            if (!getarg_port_block(&block, &count)) {
+                ghss_debug(GDB_ERROR, ": '-ports' is only valid within a snapshot file");
+                return 2;
+            }
+            for (n = 0; n < count; n++, block += 8)
+                instance_template_set_port(itemplate, ghsnap_get_u32(block),
+                                           ghsnap_get_float(block + 4));
+            continue;
+        }
+
         /* port setting */
         if (!strcmp(arg0, "-port")) {
             unsigned long port;
@@ -1699,6 +4982,7 @@ main(int argc, char **argv)
                 /* this is a new dll */
                 dll = (d3h_dll_t *)calloc(1, sizeof(d3h_dll_t));
                 dll->name = dllName;
+                pthread_mutex_init(&dll->programQueryMutex, NULL);
 
                 dll->directory = load(dllName, &pluginObject);
                 if (!dll->directory || !pluginObject) {
@@ -1828,8 +5112,15 @@ main(int argc, char **argv)
 
                 instance->plugin = plugin;
                 instance->id = instance_count;
+                instance->midi_port = itemplate->midi_port;
                 instance->channel = itemplate->channel;
                 instance->channel_next_instance = NULL;
+                instance->farm_id = (itemplate->farm ? instance_count - j : -1);
+                instance->farm_leader = NULL;
+                instance->key_lo = itemplate->key_lo;
+                instance->key_hi = itemplate->key_hi;
+                instance->vel_lo = itemplate->vel_lo;
+                instance->vel_hi = itemplate->vel_hi;
                 tmp = (char *)malloc(strlen(plugin->dll->name) +
                                      strlen(plugin->label) + 9);
                 instance->friendly_name = tmp;
@@ -1848,9 +5139,7 @@ main(int argc, char **argv)
                 instance->configure_items = NULL;
                 copy_configure_items(itemplate, instance);
                 instance->pluginProgramsValid = 0;
-                instance->pluginProgramsAlloc = 0;
-                instance->pluginProgramCount = 0;
-                instance->pluginPrograms = NULL;
+                instance->programList = NULL;
                 if (itemplate->program_set) {
                     instance->currentBank = itemplate->bank;
                     instance->currentProgram = itemplate->program;
@@ -1893,7 +5182,8 @@ main(int argc, char **argv)
                 controlInsTotal += plugin->controlIns;
                 controlOutsTotal += plugin->controlOuts;
 
-                itemplate->channel = (itemplate->channel + 1) & 15;
+                if (!itemplate->farm || j == reps - 1)  /* farm shares a channel */
+                    itemplate->channel = (itemplate->channel + 1) & 15;
                 plugin->instances++;
                 instance_count++;
             } else {
@@ -1917,47 +5207,96 @@ main(int argc, char **argv)
         return 2;
     }
 
+    if (!offline && !nogui && !have_display) {
+        ghss_debug(GDB_ERROR, ": cannot open display");
+        return 1;
+    }
+
     /* sort array of instances to group them by plugin */
     if (instance_count > 1) {
         qsort(instances, instance_count, sizeof(d3h_instance_t), instance_sort_cmp);
     }
 
     /* build channel2instances[] while showing what our instances are */
-    for (i = 0; i < GHSS_MAX_CHANNELS; i++)
+    for (i = 0; i < GHSS_MAX_MIDI_PORTS * GHSS_MAX_CHANNELS; i++)
         channel2instances[i] = NULL;
     for (i = 0; i < instance_count; i++) {
         instance = &instances[i];
         instance->number = i;
-        if (channel2instances[instance->channel]) {
-            instance->channel_next_instance = channel2instances[instance->channel];
+        if (instance->midi_port >= midi_port_count) {
+            ghss_debug(GDB_ERROR, ": instance '%s' is on MIDI port %d, but only %d port%s requested with '-midiports'",
+                       instance->friendly_name, instance->midi_port, midi_port_count,
+                       midi_port_count == 1 ? " was" : "s were");
+            return 2;
+        }
+        if (instance->farm_id >= 0) {
+            /* farm members follow their leader, the first of the farm */
+            instance->farm_leader = instance - (instance->id - instance->farm_id);
+            instance->farm_leader->farm_size++;
+            instance->farm_voices = 0;
+            if (instance->farm_leader == instance) {
+                instance->farm_next = 0;
+                instance->farm_event_serial = 0;
+                instance->farm_note_owner = (unsigned char *)malloc(GHSS_MAX_CHANNELS * 128);
+                memset(instance->farm_note_owner, FARM_NO_OWNER, GHSS_MAX_CHANNELS * 128);
+            }
+        }
+        j = instance->midi_port * GHSS_MAX_CHANNELS + instance->channel;
+        if (channel2instances[j]) {
+            instance->channel_next_instance = channel2instances[j];
         }
-        channel2instances[instance->channel] = instance;
-        fprintf(stderr, "%s: instance %2d on channel %2d, plugin %2d is '%s'\n",
-                host_name, i, instance->channel, instance->plugin->number,
-                instance->friendly_name);
+        channel2instances[j] = instance;
+        if (midi_port_count > 1)
+            fprintf(stderr, "%s: instance %2d on port %2d channel %2d, plugin %2d is '%s'\n",
+                    host_name, i, instance->midi_port, instance->channel,
+                    instance->plugin->number, instance->friendly_name);
+        else
+            fprintf(stderr, "%s: instance %2d on channel %2d, plugin %2d is '%s'\n",
+                    host_name, i, instance->channel, instance->plugin->number,
+                    instance->friendly_name);
     }
 
     /* Create buffers and JACK client and ports */
 
-#ifdef JACK_SESSION
-    jackClient = jack_client_open(host_name, JackSessionID, &status, jack_session_uuid);
-#else
-    jackClient = jack_client_open(host_name, 0, &status);
-#endif
-    if (jackClient == 0) {
-        fprintf(stderr, "%s: Error: Failed to connect to JACK server\n", host_name);
+    assert(sizeof(jack_default_audio_sample_t) == sizeof(float));
+    assert(sizeof(jack_default_audio_sample_t) == sizeof(LADSPA_Data));
+
+    if (offline) {
+        /* offline rendering doesn't use an audio backend at all */
+        sample_rate = audio_sample_rate;
+        buffer_size = RENDER_BLOCK_SIZE;
+#ifdef GHSS_BENCH
+        for (i = 0; i < bench_size_count; i++) {
+            if (buffer_size < bench_sizes[i])
+                buffer_size = bench_sizes[i];
+        }
+#endif /* GHSS_BENCH */
+    } else {
+
+    audio_backend = audio_backend_find(audio_backend_name);
+    if (!audio_backend) {
+        ghss_debug(GDB_ERROR, ": unknown audio backend '%s'", audio_backend_name);
+        return 2;
+    }
+    if (!audio_backend->open(host_name, audio_device, jack_session_uuid)) {
+        fprintf(stderr, "%s: Error: Failed to open '%s' audio backend\n", host_name,
+                audio_backend->name);
         return 1;
     }
-    if (status & JackNameNotUnique) {
+    if (strcmp(host_name, audio_backend->client_name())) {
         if (host_name != host_name_default) free(host_name);
-        host_name = strdup(jack_get_client_name(jackClient));
+        host_name = strdup(audio_backend->client_name());
     }
-    assert(sizeof(jack_default_audio_sample_t) == sizeof(float));
-    assert(sizeof(jack_default_audio_sample_t) == sizeof(LADSPA_Data));
+    /* make sure an early exit from here on still closes the backend */
+    audio_backend_opened = 1;
+    atexit(audio_backend_close_at_exit);
+
+    sample_rate = audio_backend->sample_rate();
+    buffer_size = audio_backend->buffer_size();
 
-    sample_rate = jack_get_sample_rate(jackClient);
+    } /* !offline */
 
-    inputPorts = (jack_port_t **)malloc(insTotal * sizeof(jack_port_t *));
+    inputPorts = (audio_port_t **)malloc(insTotal * sizeof(audio_port_t *));
     pluginInputBuffers = (float **)calloc(insTotal, sizeof(float *));
     pluginAudioInInstances =
         (d3h_instance_t **)malloc(insTotal * sizeof(d3h_instance_t *));
@@ -1970,8 +5309,12 @@ main(int argc, char **argv)
         (unsigned long *)malloc(controlInsTotal * sizeof(unsigned long));
     pluginPortUpdated = (int *)malloc(controlInsTotal * sizeof(int));
 
-    outputPorts = (jack_port_t **)malloc(outsTotal * sizeof(jack_port_t *));
+    outputPorts = (audio_port_t **)malloc(outsTotal * sizeof(audio_port_t *));
     pluginOutputBuffers = (float **)malloc(outsTotal * sizeof(float *));
+    pluginAudioOutInstances =
+        (d3h_instance_t **)malloc(outsTotal * sizeof(d3h_instance_t *));
+    pluginAudioOutPortNumbers =
+        (unsigned long *)malloc(outsTotal * sizeof(unsigned long));
     pluginControlOuts = (float *)calloc(controlOutsTotal, sizeof(float));
 
     instanceHandles = (LADSPA_Handle *)malloc(instance_count *
@@ -1980,10 +5323,24 @@ main(int argc, char **argv)
                                                       sizeof(snd_seq_event_t *));
     instanceEventCounts = (unsigned long *)malloc(instance_count *
                                                   sizeof(unsigned long));
+    segmentEventBuffers = (snd_seq_event_t **)malloc(instance_count *
+                                                     sizeof(snd_seq_event_t *));
+    segmentEventCounts = (unsigned long *)malloc(instance_count *
+                                                 sizeof(unsigned long));
+    segmentEventIndex = (unsigned long *)malloc(instance_count *
+                                                sizeof(unsigned long));
+
+    if (coalesce_frames)
+        instanceCoalesceSlots = (coalesce_slot_t **)malloc(instance_count *
+                                                           sizeof(coalesce_slot_t *));
 
     for (i = 0; i < instance_count; i++) {
         instanceEventBuffers[i] = (snd_seq_event_t *)malloc(EVENT_BUFFER_SIZE *
                                                             sizeof(snd_seq_event_t));
+        if (coalesce_frames)
+            instanceCoalesceSlots[i] = (coalesce_slot_t *)calloc(GHSS_MAX_CHANNELS *
+                                                                     COALESCE_KEYS_PER_CHANNEL,
+                                                                 sizeof(coalesce_slot_t));
         instances[i].pluginPortControlInNumbers =
             (int *)malloc(instances[i].plugin->descriptor->LADSPA_Plugin->PortCount *
                           sizeof(int));
@@ -1993,9 +5350,13 @@ main(int argc, char **argv)
     out = 0;
     for (i = 0; i < instance_count; i++) {
         int inst_in = 0, inst_out = 0;
+        int farm_member;
 
         instance = &instances[i];
         plugin = instance->plugin;
+        instance->firstAudioIn = in;
+        instance->firstAudioOut = out;
+        farm_member = is_farm_member(instance);
 
         for (j = 0; j < plugin->descriptor->LADSPA_Plugin->PortCount; j++) {
 
@@ -2005,19 +5366,23 @@ main(int argc, char **argv)
             if (LADSPA_IS_PORT_AUDIO(pod) && LADSPA_IS_PORT_INPUT(pod)) {
 
                 char portname[65];
+
+                if (farm_member || offline) {
+                    /* farm members take their leader's input, and there
+                     * are no audio ports when rendering offline */
+                    inputPorts[in] = NULL;
+                    in++;
+                    continue;
+                }
                 snprintf(portname, 65, "inst%02d %s %s",
                          instance->id, plugin->label,
                          plugin->descriptor->LADSPA_Plugin->PortNames[j]);
-                inputPorts[in] = jack_port_register(jackClient, portname,
-                                                    JACK_DEFAULT_AUDIO_TYPE,
-                                                    JackPortIsInput, 0);
+                inputPorts[in] = audio_backend->port_register(portname, 0);
                 if (!inputPorts[in]) {
                     snprintf(portname, 65, "inst%02d %s in %d %s",
                              instance->id, plugin->label, inst_in,
                              plugin->descriptor->LADSPA_Plugin->PortNames[j]);
-                    inputPorts[in] = jack_port_register(jackClient, portname,
-                                                    JACK_DEFAULT_AUDIO_TYPE,
-                                                    JackPortIsInput, 0);
+                    inputPorts[in] = audio_backend->port_register(portname, 0);
                 }
                 if (!inputPorts[in]) {
                     fprintf(stderr, "%s: Error: Could not create instance '%s' input port '%s'\n",
@@ -2026,25 +5391,30 @@ main(int argc, char **argv)
                 }
                 inst_in++;
 
-                /* JACK port buffers are used directly as the audio input buffers */
+                /* backend port buffers are used directly as the audio input buffers */
                 in++;
 
             } else if (LADSPA_IS_PORT_AUDIO(pod) && LADSPA_IS_PORT_OUTPUT(pod)) {
 
                 char portname[65];
+
+                if (farm_member || offline) {
+                    /* farm members are mixed into their leader's outputs */
+                    outputPorts[out] = NULL;
+                    pluginOutputBuffers[out] = 
+                        (float *)calloc(buffer_size, sizeof(float));
+                    out++;
+                    continue;
+                }
                 snprintf(portname, 65, "inst%02d %s %s",
                          instance->id, plugin->label,
                          plugin->descriptor->LADSPA_Plugin->PortNames[j]);
-                outputPorts[out] = jack_port_register(jackClient, portname,
-                                                      JACK_DEFAULT_AUDIO_TYPE,
-                                                      JackPortIsOutput, 0);
+                outputPorts[out] = audio_backend->port_register(portname, 1);
                 if (!outputPorts[out]) {
                     snprintf(portname, 65, "inst%02d %s out %d %s",
                              instance->id, plugin->label, inst_out,
                              plugin->descriptor->LADSPA_Plugin->PortNames[j]);
-                    outputPorts[out] = jack_port_register(jackClient, portname,
-                                                          JACK_DEFAULT_AUDIO_TYPE,
-                                                          JackPortIsOutput, 0);
+                    outputPorts[out] = audio_backend->port_register(portname, 1);
                 }
                 if (!outputPorts[out]) {
                     ghss_debug(GDB_ERROR, " error: Could not create instance '%s' output port '%s'",
@@ -2054,19 +5424,21 @@ main(int argc, char **argv)
                 inst_out++;
 
                 pluginOutputBuffers[out] = 
-                    (float *)calloc(jack_get_buffer_size(jackClient), sizeof(float));
+                    (float *)calloc(buffer_size, sizeof(float));
                 out++;
             }
         }
     }
 
-    jack_set_process_callback(jackClient, audio_callback, 0);
+    if (!offline) {
+        audio_backend->set_process_callback(audio_callback, 0);
 #ifdef JACK_SESSION
-    if (jack_set_session_callback) {
-        ghss_debug(GDB_MAIN, ": setting JACK session callback");
-	jack_set_session_callback(jackClient, session_callback, 0);
-    }
+        if (jackClient && jack_set_session_callback) {
+            ghss_debug(GDB_MAIN, ": setting JACK session callback");
+            jack_set_session_callback(jackClient, session_callback, 0);
+        }
 #endif
+    }
 
     /* Instantiate plugins */
 
@@ -2082,17 +5454,16 @@ main(int argc, char **argv)
         }
     }
 
-    /* Create OSC thread */
+    /* Create OSC thread(s) */
 
-    serverThread = lo_server_thread_new(NULL, osc_error);
-    host_osc_url = lo_server_thread_get_url(serverThread);
-    ghss_debug(GDB_OSC, ": host OSC URL is %s", host_osc_url);
-    lo_server_thread_add_method(serverThread, NULL, NULL, osc_message_handler,
-				NULL);
-    lo_server_thread_start(serverThread);
+    if (!offline) {
+        osc_servers_start();
+    }
 
     /* set up GTK+ */
-    create_windows(host_name, instance_count);
+    if (!offline && !nogui) {
+        create_windows(host_name, instance_count);
+    }
 
     /* Connect plugins, and build a GUI strip for each */
 
@@ -2132,6 +5503,8 @@ main(int argc, char **argv)
                     pluginAudioInInstances[in] = instance;
                     pluginAudioInPortNumbers[in++] = j;
                 } else if (LADSPA_IS_PORT_OUTPUT(pod)) {
+                    pluginAudioOutInstances[out] = instance;
+                    pluginAudioOutPortNumbers[out] = j;
                     plugin->descriptor->LADSPA_Plugin->connect_port
                         (instanceHandles[i], j, pluginOutputBuffers[out++]);
                 }
@@ -2182,8 +5555,10 @@ main(int argc, char **argv)
         }  /* 'for (j...'  LADSPA port number */
 
         /* build GUI strip for plugin */
-        instance->strip = create_plugin_strip(main_window, instance);
-        gtk_box_pack_start (GTK_BOX (plugin_hbox), instance->strip->container, TRUE, TRUE, 0);
+        if (!offline && !nogui) {
+            instance->strip = create_plugin_strip(main_window, instance);
+            gtk_box_pack_start (GTK_BOX (plugin_hbox), instance->strip->container, TRUE, TRUE, 0);
+        }
                   
     } /* 'for (i...' instance number */
     assert(in == insTotal);
@@ -2193,7 +5568,7 @@ main(int argc, char **argv)
 
     /* Create MIDI client and port */
 
-    if (!midi_open()) {
+    if (!offline && !midi_open()) {
         return 1;
     }
 
@@ -2266,27 +5641,41 @@ main(int argc, char **argv)
         }
     }
 
-    /* activate JACK and connect ports */
+    if (!run_jobs_init()) {
+        return 1;
+    }
+
+    if (render_midi_file) {
+        if (!render_offline(render_midi_file, render_wav_file))
+            exit_status = 1;
+        goto cleanup_plugins;
+    }
+#ifdef GHSS_BENCH
+    if (!bench_run(buffer_size))
+        exit_status = 1;
+    goto cleanup_plugins;
+#endif /* GHSS_BENCH */
+
+    /* pick up where we left off, if there's an autosave journal */
+    if (autosave_file)
+        autosave_restore();
+
+    /* create the pipe through which the audio thread wakes the GUI */
+    if (pipe(hostWakeupPipe) ||
+        fcntl(hostWakeupPipe[0], F_SETFL, O_NONBLOCK) ||
+        fcntl(hostWakeupPipe[1], F_SETFL, O_NONBLOCK)) {
+        ghss_debug(GDB_ERROR, ": could not create wakeup pipe: %s", strerror(errno));
+        return 1;
+    }
+
+    /* activate the audio backend and connect ports */
 
-    if (jack_activate(jackClient)) {
-        ghss_debug(GDB_ERROR, ": cannot activate JACK client");
+    if (!audio_backend->activate()) {
         return 1;
     }
 
     if (autoconnect) {
-        /* !FIX! this to more intelligently connect ports: */
-        ports = jack_get_ports(jackClient, NULL, "^" JACK_DEFAULT_AUDIO_TYPE "$",
-                               JackPortIsPhysical|JackPortIsInput);
-        if (ports && ports[0]) {
-            for (i = 0, j = 0; i < outsTotal; ++i) {
-                if (jack_connect(jackClient, jack_port_name(outputPorts[i]),
-                                 ports[j])) {
-                    fprintf (stderr, "cannot connect output port %d\n", i);
-                }
-                if (!ports[++j]) j = 0;
-            }
-            free(ports);
-        }
+        audio_backend->autoconnect(outputPorts, outsTotal);
     }
 
     signal(SIGINT, signalHandler);
@@ -2303,20 +5692,54 @@ main(int argc, char **argv)
     }
 #endif /* MIDI_JACK */
 
-    /* add GTK+ timeout function for GUI updates and OSC output code*/
-    gtk_timeout_tag = gtk_timeout_add(50, gtk_timeout_callback, NULL);
+    host_wakeup();  /* for any initial program updates */
+
+    if (autosave_file)
+        autosave_start();
+
+    if (nogui) {
+
+        fprintf(stderr, "%s ready (no GUI), host OSC URL is %s\n", host_name, host_osc_url);
+
+        host_exiting = 0;
+        nogui_main_loop();
+
+        autosave_stop();
+        wait_for_saves();  /* a session save replies through the JACK client */
+        audio_backend->close();
+        audio_backend_opened = 0;
 
-    fprintf(stderr, "%s ready\n", host_name);
+    } else {
+
+        /* watch the wakeup pipe for GUI updates and OSC output code */
+        wakeup_channel = g_io_channel_unix_new(hostWakeupPipe[0]);
+        wakeup_tag = g_io_add_watch(wakeup_channel, G_IO_IN, host_wakeup_callback, NULL);
+
+        fprintf(stderr, "%s ready\n", host_name);
+
+        /* let GTK+ take it from here */
+        gtk_widget_show(main_window);
+        host_exiting = 0;
+        gtk_main();
 
-    /* let GTK+ take it from here */
-    gtk_widget_show(main_window);
-    host_exiting = 0;
-    gtk_main();
+        autosave_stop();
+        wait_for_saves();  /* a session save replies through the JACK client */
+        audio_backend->close();
+        audio_backend_opened = 0;
 
-    jack_client_close(jackClient);
+        /* GTK+ cleanup */
+        g_source_remove(wakeup_tag);
+        g_io_channel_unref(wakeup_channel);
+        if (activity_timeout_tag)
+            gtk_timeout_remove(activity_timeout_tag);
+    }
+
+  cleanup_plugins:
+    wait_for_saves();
+    run_jobs_cleanup();
 
-    /* GTK+ cleanup */
-    gtk_timeout_remove(gtk_timeout_tag);
+    for (i = 0; i < GHSS_STATE_SLOTS; i++)
+        free_state_slot(&stateSlots[i], 1);
 
     /* cleanup plugins */
     for (i = 0; i < instance_count; i++) {
@@ -2327,6 +5750,8 @@ main(int argc, char **argv)
             lo_send(instance->ui_osc_address, instance->ui_osc_quit_path, "");
             ui_osc_free(instance);
         }
+        instance->ui_shared_pending = 0;
+        instance->ui_in_shared_gui = 0;
 
         if (instance->plugin->descriptor->LADSPA_Plugin->deactivate) {
             instance->plugin->descriptor->LADSPA_Plugin->deactivate
@@ -2341,18 +5766,32 @@ main(int argc, char **argv)
         free_programs(instance);
     }
 
+    /* the shared universal GUI, if any, can go now too */
+    if (sharedGuiAddress) {
+        lo_send(sharedGuiAddress, "/ghostess/gui/quit", "");
+        lo_address_free(sharedGuiAddress);
+        sharedGuiAddress = NULL;
+    }
+
 #ifndef MIDI_JACK
     /* clean up MIDI thread */
     /* !FIX! this should become a midi_cleanup() or something.... */
-    do {
-        sleep(1);  /* this also gives the UIs some time to exit */
-        ghss_debug(GDB_MAIN, ": waiting for midi thread to finish");
-    } while (midi_thread_running);
-    pthread_join(midi_thread, NULL);
+    if (!offline) {
+        do {
+            sleep(1);  /* this also gives the UIs some time to exit */
+            ghss_debug(GDB_MAIN, ": waiting for midi thread to finish");
+        } while (midi_thread_running);
+        pthread_join(midi_thread, NULL);
+    }
 #endif /* MIDI_JACK */
 
     if (host_name != host_name_default) free(host_name);
     if (host_osc_url) free(host_osc_url);
+    if (host_osc_local_url) free(host_osc_local_url);
+    if (osc_unix_socket) {
+        unlink_socket(osc_unix_socket);
+        free(osc_unix_socket);
+    }
 
     /* -FIX- jack-dssi-host sends a SIGHUP here to everything in the process
      * group except the main thread, which is clearly overkill.  If we've
@@ -2360,7 +5799,7 @@ main(int argc, char **argv)
      * I've seen some lingering processes after crashes -- maybe we might
      * want to SIGHUP just the other threads of this process? */
 
-    return 0;
+    return exit_status;
 }
 
 LADSPA_Data get_port_default(const LADSPA_Descriptor *plugin, int port)
@@ -2458,85 +5897,247 @@ osc_exiting_handler(d3h_instance_t *instance, lo_arg **argv)
         ui_osc_free(instance);
     }
 
-    update_from_exiting(instance);
+    if (instance->strip)
+        update_from_exiting(instance);
+
+    return 0;
+}
+
+/* /zone <key lo> <key hi> <velocity lo> <velocity hi>: change the key and
+ * note-on velocity zones of an instance.  The audio thread recompiles its
+ * key masks when it notices the generation change. */
+int
+osc_zone_handler(d3h_instance_t *instance, lo_arg **argv)
+{
+    int key_lo = argv[0]->i, key_hi = argv[1]->i;
+    int vel_lo = argv[2]->i, vel_hi = argv[3]->i;
+
+    ghss_debug(GDB_OSC, " OSC: got zone request for %s: keys %d-%d, velocities %d-%d",
+               instance->friendly_name, key_lo, key_hi, vel_lo, vel_hi);
+
+    if (key_lo < 0 || key_hi > 127 || key_lo > key_hi ||
+        vel_lo < 0 || vel_hi > 127 || vel_lo > vel_hi) {
+        ghss_debug(GDB_OSC, " OSC zone handler: bad zone for %s, ignoring",
+                   instance->friendly_name);
+        return 0;
+    }
+
+    instance->key_lo = key_lo;
+    instance->key_hi = key_hi;
+    instance->vel_lo = vel_lo;
+    instance->vel_hi = vel_hi;
+    __sync_synchronize();
+    zone_generation++;
 
     return 0;
 }
 
+/* Queue a batch of decoded MIDI events from OSC for the audio thread,
+ * with a single update of the ring buffer write index.  Event times must
+ * already be set. */
+void
+osc_queue_midi_events(d3h_instance_t *instance, snd_seq_event_t *events,
+                      int count)
+{
+    int i, space, write;
+    snd_seq_event_t *ev;
+
+#ifndef MIDI_JACK
+    pthread_mutex_lock(&midiEventBufferMutex);
+#endif /* MIDI_JACK */
+
+    write = midiEventWriteIndex;
+    space = (midiEventReadIndex - write - 1 + EVENT_BUFFER_SIZE) % EVENT_BUFFER_SIZE;
+
+    for (i = 0; i < count; i++) {
+        ev = &events[i];
+
+        if (!snd_seq_ev_is_channel_type(ev))
+            continue;
+
+        if (ev->type == SND_SEQ_EVENT_CONTROLLER &&
+            (ev->data.control.param == 0 || ev->data.control.param == 32)) {
+
+            ghss_debug(GDB_OSC, " OSC midi handler warning: %s UI sent bank select controller (should use /program OSC call), ignoring",
+                       instance->friendly_name);
+            continue;
+
+        } else if (ev->type == SND_SEQ_EVENT_PGMCHANGE) {
+
+            ghss_debug(GDB_OSC, " OSC midi handler warning: %s UI sent program change (should use /program OSC call), ignoring",
+                       instance->friendly_name);
+            continue;
+        }
+
+        if (!space) {
+            ghss_debug(GDB_OSC, " OSC midi handler warning: MIDI event buffer overflow!");
+            break;
+        }
+
+        if (ev->type == SND_SEQ_EVENT_NOTEON && ev->data.note.velocity == 0) {
+            ev->type =  SND_SEQ_EVENT_NOTEOFF;
+        }
+
+        /* flag event as for this instance only */
+        ev->dest.client = 1;
+        ev->dest.port = instance->number;
+
+        midiEventBuffer[write] = *ev;
+        write = (write + 1) % EVENT_BUFFER_SIZE;
+        space--;
+    }
+
+    midiEventWriteIndex = write;
+
+#ifndef MIDI_JACK
+    pthread_mutex_unlock(&midiEventBufferMutex);
+#endif /* MIDI_JACK */
+}
+
 int
-osc_midi_handler(d3h_instance_t *instance, lo_arg **argv)
+osc_midi_handler(d3h_instance_t *instance, lo_arg **argv, int scheduled,
+                 jack_nframes_t when)
 {
-    static snd_midi_event_t *alsaCoder = NULL;
-    static snd_seq_event_t alsaEncodeBuffer[10];
-    long count;
-    snd_seq_event_t *ev = &alsaEncodeBuffer[0];
+    midi_decoder_t decoder;
+    snd_seq_event_t ev;
 
     ghss_debug(GDB_OSC, " OSC: got midi request for %s (%02x %02x %02x %02x)",
            instance->friendly_name, argv[0]->m[0], argv[0]->m[1], argv[0]->m[2], argv[0]->m[3]);
 
-    if (!alsaCoder) {
-        if (snd_midi_event_new(10, &alsaCoder)) {
-            ghss_debug(GDB_OSC, " OSC midi handler: Failed to initialise ALSA MIDI coder!");
-            return 0;
-        }
+    midi_decoder_reset(&decoder);
+    if (!midi_decoder_decode(&decoder, (argv[0]->m) + 1, 3, &ev, 1)) /* ignore OSC "port id" in argv[0]->m[0] */
+        return 0;
+
+    if (scheduled) {
+        ev.tag = GHSS_EVENT_SCHEDULED;
+        ev.time.tick = when;
+    } else {
+        ev.tag = 0;
+        ev.time.tick = 0;
     }
 
-    snd_midi_event_reset_encode(alsaCoder);
+    osc_queue_midi_events(instance, &ev, 1);
+
+    return 0;
+}
+
+#define OSC_MIDI_BATCH  256
 
-    count = snd_midi_event_encode
-	(alsaCoder, (argv[0]->m) + 1, 3, alsaEncodeBuffer); /* ignore OSC "port id" in argv[0]->m[0] */
+/* accepts "b", "m+", or "(im)+" */
+static int
+osc_midi_bulk_types_valid(const char *types, int argc)
+{
+    int i;
 
-    if (!count || !snd_seq_ev_is_channel_type(ev)) {
+    if (argc == 1 && types[0] == 'b')
+        return 1;
+    if (argc < 1)
         return 0;
+    if (types[0] == 'm') {
+        for (i = 1; i < argc; i++)
+            if (types[i] != 'm')
+                return 0;
+        return 1;
     }
+    if (argc & 1)
+        return 0;
+    for (i = 0; i < argc; i += 2)
+        if (types[i] != 'i' || types[i + 1] != 'm')
+            return 0;
+    return 1;
+}
 
-    /* flag event as for this instance only */
-    ev->dest.client = 1;
-    ev->dest.port = instance->number;
-    ev->time.tick = 0;
-    
-    if (ev->type == SND_SEQ_EVENT_NOTEON && ev->data.note.velocity == 0) {
-        ev->type =  SND_SEQ_EVENT_NOTEOFF;
-    }
-        
-#ifndef MIDI_JACK
-    pthread_mutex_lock(&midiEventBufferMutex);
-#endif /* MIDI_JACK */
-
-    if (midiEventReadIndex == midiEventWriteIndex + 1) {
+/* /midi-bulk: many MIDI messages in one OSC message, each with a frame
+ * offset from the message's timetag (or, for untagged messages, from one
+ * period after arrival).  The arguments may be either:
+ * - a single blob, containing records of a 16-bit big-endian frame
+ *   offset, an 8-bit length, and that many bytes of raw MIDI, or
+ * - a series of 'm' arguments, all at offset zero, or
+ * - a series of 'i' frame offset and 'm' MIDI message pairs.
+ * Running status may be used within a message. */
+int
+osc_midi_bulk_handler(d3h_instance_t *instance, const char *types, lo_arg **argv,
+                      int argc, int scheduled, jack_nframes_t when)
+{
+    midi_decoder_t decoder;
+    snd_seq_event_t events[OSC_MIDI_BATCH];
+    int count = 0, i;
+    unsigned long pos, size, length;
+    const unsigned char *data;
+    jack_nframes_t offset;
 
-        ghss_debug(GDB_OSC, " OSC midi handler warning: MIDI event buffer overflow!");
+    if (!scheduled)
+        when = audio_backend->frame_time() + audio_backend->buffer_size();
 
-    } else if (ev->type == SND_SEQ_EVENT_CONTROLLER &&
-               (ev->data.control.param == 0 || ev->data.control.param == 32)) {
+    midi_decoder_reset(&decoder);
 
-        ghss_debug(GDB_OSC, " OSC midi handler warning: %s UI sent bank select controller (should use /program OSC call), ignoring",
-                   instance->friendly_name);
+    if (argc == 1 && types[0] == 'b') {
 
-    } else if (ev->type == SND_SEQ_EVENT_PGMCHANGE) {
+        size = lo_blob_datasize((lo_blob)argv[0]);
+        data = (const unsigned char *)lo_blob_dataptr((lo_blob)argv[0]);
 
-        ghss_debug(GDB_OSC, " OSC midi handler warning: %s UI sent program change (should use /program OSC call), ignoring",
-                   instance->friendly_name);
+        for (pos = 0; pos + 3 <= size; pos += length) {
+            offset = (data[pos] << 8) | data[pos + 1];
+            length = data[pos + 2];
+            pos += 3;
+            if (pos + length > size) {
+                ghss_debug(GDB_OSC, " OSC midi-bulk handler: %s sent truncated blob",
+                           instance->friendly_name);
+                break;
+            }
+            /* a record may hold more (running status) messages than the
+             * batch has room for, so flush as often as it fills */
+            for (i = 0; i < length; i++) {
+                if (!midi_decoder_byte(&decoder, data[pos + i], &events[count]))
+                    continue;
+                events[count].tag = GHSS_EVENT_SCHEDULED;
+                events[count].time.tick = when + offset;
+                if (++count == OSC_MIDI_BATCH) {
+                    osc_queue_midi_events(instance, events, count);
+                    count = 0;
+                }
+            }
+        }
 
     } else {
 
-        midiEventBuffer[midiEventWriteIndex] = *ev;
-        midiEventWriteIndex = (midiEventWriteIndex + 1) % EVENT_BUFFER_SIZE;
-
+        offset = 0;
+        for (i = 0; i < argc; i++) {
+            if (types[i] == 'i') {
+                offset = argv[i]->i;
+                continue;
+            }
+            /* ignore OSC "port id" in m[0] */
+            if (midi_decoder_decode(&decoder, (argv[i]->m) + 1, 3, events + count, 1)) {
+                events[count].tag = GHSS_EVENT_SCHEDULED;
+                events[count].time.tick = when + offset;
+                if (++count == OSC_MIDI_BATCH) {
+                    osc_queue_midi_events(instance, events, count);
+                    count = 0;
+                }
+            }
+            /* a 'm' argument holds at most one message, so don't let a
+             * partial one carry over as running status */
+            decoder.have = 0;
+        }
     }
 
-#ifndef MIDI_JACK
-    pthread_mutex_unlock(&midiEventBufferMutex);
-#endif /* MIDI_JACK */
+    ghss_debug(GDB_OSC, " OSC: got midi-bulk request for %s", instance->friendly_name);
+
+    if (count)
+        osc_queue_midi_events(instance, events, count);
 
     return 0;
 }
 
 int
-osc_control_handler(d3h_instance_t *instance, lo_arg **argv)
+osc_control_handler(d3h_instance_t *instance, lo_arg **argv, int echo,
+                    int scheduled, jack_nframes_t when)
 {
     int port = argv[0]->i;
     LADSPA_Data value = argv[1]->f;
+    control_event_t *cev;
+    int next;
 
     if (port < 0 || port > instance->plugin->descriptor->LADSPA_Plugin->PortCount) {
 	ghss_debug(GDB_OSC, " OSC control handler: %s port number (%d) is out of range",
@@ -2548,7 +6149,23 @@ osc_control_handler(d3h_instance_t *instance, lo_arg **argv)
                    instance->friendly_name, port);
 	return 0;
     }
-    pluginControlIns[instance->pluginPortControlInNumbers[port]] = value;
+
+    /* queue the change for the audio thread, which will apply it and, if
+     * 'echo' is set, flag it for sending to the UI */
+    next = (controlEventWriteIndex + 1) % CONTROL_EVENT_BUFFER_SIZE;
+    if (next == controlEventReadIndex) {
+        ghss_debug(GDB_OSC, " OSC control handler warning: control event buffer overflow!");
+        return 0;
+    }
+    cev = &controlEventBuffer[controlEventWriteIndex];
+    cev->controlIn = instance->pluginPortControlInNumbers[port];
+    cev->value = value;
+    cev->time = scheduled ? when : audio_backend->frame_time();
+    cev->echo = echo;
+    cev->scheduled = scheduled;
+    __sync_synchronize();  /* complete the event before publishing it */
+    controlEventWriteIndex = next;
+
     ghss_debug(GDB_OSC, " OSC control handler: %s port %d = %f",
                instance->friendly_name, port, value);
     
@@ -2560,28 +6177,23 @@ osc_program_handler(d3h_instance_t *instance, lo_arg **argv)
 {
     int bank = argv[0]->i;
     int program = argv[1]->i;
+    program_list_t *list;
     int i;
-    int found = 0;
 
     if (debug_flags & GDB_OSC) {
-        if (!instance->pluginProgramsValid)
-            query_programs(instance);
-
-        for (i = 0; i < instance->pluginProgramCount; ++i) {
-            if (instance->pluginPrograms[i].Bank == bank &&
-                instance->pluginPrograms[i].Program == program) {
-                ghss_debug(GDB_OSC, " OSC program handler: %s setting bank %d, program %d, name %s",
-                       instance->friendly_name, bank, program,
-                       instance->pluginPrograms[i].Name);
-                found = 1;
-                break;
-            }
-        }
-
-        if (!found) {
+        query_programs(instance);
+
+        list = hold_program_list(instance);
+        i = program_list_find(list, bank, program);
+        if (i >= 0) {
+            ghss_debug(GDB_OSC, " OSC program handler: %s setting bank %d, program %d, name %s",
+                   instance->friendly_name, bank, program,
+                   list->programs[i].Name);
+        } else {
             ghss_debug(GDB_OSC, " OSC program handler: %s UI requested unknown program: bank %d, program %d: sending to plugin anyway (plugin should ignore it)",
                     instance->friendly_name, bank, program);
         }
+        release_program_list(list);
     }
 
     instance->pendingBankMSB = bank / 128;
@@ -2610,6 +6222,7 @@ osc_configure_handler(d3h_instance_t *instance, lo_arg **argv)
         if (instance->plugin->descriptor->configure) {
 
             add_configure_item(&instance->configure_items, (char *)key, (char *)value);
+            autosave_note_configure(instance, key, value);
 
             message = instance->plugin->descriptor->configure
                           (instanceHandles[instance->number], key, value);
@@ -2636,6 +6249,7 @@ osc_configure_handler(d3h_instance_t *instance, lo_arg **argv)
         if (inst->plugin->descriptor->configure) {
 
             add_configure_item(&inst->configure_items, (char *)key, (char *)value);
+            autosave_note_configure(inst, key, value);
 
             message = inst->plugin->descriptor->configure(instanceHandles[i],
                                                           key, value);
@@ -2647,7 +6261,7 @@ osc_configure_handler(d3h_instance_t *instance, lo_arg **argv)
         }
 
         /* configure invalidates bank and program information */
-        instance->pluginProgramsValid = 0;
+        inst->pluginProgramsValid = 0;
 
         /* also send to UIs of other instances of this plugin */
         if (i != instance->number && inst->ui_osc_address) {
@@ -2659,6 +6273,233 @@ osc_configure_handler(d3h_instance_t *instance, lo_arg **argv)
     return 0;
 }
 
+/* Apply one configure item to one instance, as part of a slot recall. */
+static void
+slot_configure(d3h_instance_t *instance, const char *key, const char *value)
+{
+    char *message;
+
+    if (!instance->plugin->descriptor->configure)
+        return;
+
+    add_configure_item(&instance->configure_items, (char *)key, (char *)value);
+    autosave_note_configure(instance, key, value);
+    message = instance->plugin->descriptor->configure
+                  (instanceHandles[instance->number], key, value);
+    if (message) {
+        ghss_debug(GDB_DSSI, ": on configure '%s' '%s', plugin '%s' returned '%s'",
+               key, value, instance->friendly_name, message);
+        free(message);
+    }
+    instance->pluginProgramsValid = 0;
+
+    if (instance->ui_osc_address) {
+        lo_send(instance->ui_osc_address, instance->ui_osc_configure_path, "ss",
+                key, value);
+    }
+}
+
+static void
+free_configure_item_list(configure_item_t *item)
+{
+    configure_item_t *next;
+
+    for (; item; item = next) {
+        next = item->next;
+        free(item->key);
+        free(item->value);
+        free(item);
+    }
+}
+
+/* copy a list of configure items, keeping their order */
+static configure_item_t *
+copy_configure_item_list(configure_item_t *item)
+{
+    configure_item_t *head = NULL, **tail = &head;
+
+    for (; item; item = item->next) {
+        *tail = (configure_item_t *)malloc(sizeof(configure_item_t));
+        (*tail)->key = strdup(item->key);
+        (*tail)->value = strdup(item->value);
+        tail = &(*tail)->next;
+    }
+    *tail = NULL;
+    return head;
+}
+
+static void
+free_state_slot(state_slot_t *slot, int all)
+{
+    int i;
+
+    if (!slot->name)
+        return;
+    free(slot->name);
+    slot->name = NULL;
+    for (i = 0; i < instance_count; i++) {
+        free_configure_item_list(slot->configure_items[i]);
+        slot->configure_items[i] = NULL;
+    }
+    if (all) {
+        free(slot->controls);
+        free(slot->bank);
+        free(slot->program);
+        free(slot->configure_items);
+        memset(slot, 0, sizeof(state_slot_t));
+    }
+}
+
+int
+osc_slot_store_handler(int n, const char *name)
+{
+    state_slot_t *slot;
+    int i, tries;
+
+    if (n < 0 || n >= GHSS_STATE_SLOTS) {
+	ghss_debug(GDB_OSC, " OSC slot store handler: slot number (%d) is out of range", n);
+	return 0;
+    }
+    slot = &stateSlots[n];
+
+    /* the audio thread reads slots without locking, so wait until it has
+     * finished any recall before overwriting one */
+    for (tries = 0; pendingSlotRecall && tries < 1000; tries++)
+        usleep(1000);
+    if (pendingSlotRecall) {
+	ghss_debug(GDB_ERROR, ": slot store failed: audio thread isn't running");
+	return 0;
+    }
+
+    if (slot->controls) {
+        free_state_slot(slot, 0);
+    } else {
+        slot->controls = (LADSPA_Data *)malloc(sizeof(LADSPA_Data) * (controlInsTotal + 1));
+        slot->bank = (unsigned long *)calloc(instance_count, sizeof(unsigned long));
+        slot->program = (unsigned long *)calloc(instance_count, sizeof(unsigned long));
+        slot->configure_items = (configure_item_t **)calloc(instance_count,
+                                                            sizeof(configure_item_t *));
+    }
+
+    capture_controls(slot->controls);
+    for (i = 0; i < instance_count; i++) {
+        slot->bank[i] = instances[i].currentBank;
+        slot->program[i] = instances[i].currentProgram;
+        slot->configure_items[i] = copy_configure_item_list(instances[i].configure_items);
+    }
+    if (name && strlen(name)) {
+        slot->name = strdup(name);
+    } else {
+        slot->name = g_strdup_printf("slot %d", n);
+    }
+
+    ghss_debug(GDB_OSC, " OSC slot store handler: stored slot %d '%s'", n, slot->name);
+
+    return 0;
+}
+
+int
+osc_slot_recall_handler(int n)
+{
+    state_slot_t *slot;
+    d3h_instance_t *instance;
+    configure_item_t *item, *current;
+    int i;
+
+    if (n < 0 || n >= GHSS_STATE_SLOTS || !stateSlots[n].name) {
+	ghss_debug(GDB_OSC, " OSC slot recall handler: slot %d is out of range or empty", n);
+	return 0;
+    }
+    slot = &stateSlots[n];
+
+    /* configure calls aren't real-time safe, so they're made here, and
+     * only for the items that differ from the instances' current ones */
+    for (i = 0; i < instance_count; i++) {
+        instance = &instances[i];
+        for (item = slot->configure_items[i]; item; item = item->next) {
+            for (current = instance->configure_items; current; current = current->next) {
+                if (!strcmp(current->key, item->key))
+                    break;
+            }
+            if (!current || strcmp(current->value, item->value))
+                slot_configure(instance, item->key, item->value);
+        }
+    }
+
+    /* hand the programs and controls to the audio thread */
+    __sync_synchronize();
+    pendingSlotRecall = slot;
+
+    ghss_debug(GDB_OSC, " OSC slot recall handler: recalling slot %d '%s'", n, slot->name);
+
+    return 0;
+}
+
+/* Reply to the sender with the names of up to 128 programs of an
+ * instance, from 'first' on in 'bank', skipping program numbers the
+ * plugin doesn't have.  The reply is the instance id and bank, followed
+ * by a program number and name for each. */
+int
+osc_programs_handler(int id, int bank, int first, int count, lo_address source)
+{
+    d3h_instance_t *instance = NULL;
+    program_list_t *list;
+    lo_message reply;
+    int i, n;
+
+    for (i = 0; i < instance_count; i++) {
+        if (instances[i].id == id) {
+            instance = &instances[i];
+            break;
+        }
+    }
+    if (!instance || bank < 0 || first < 0 || count < 0) {
+        ghss_debug(GDB_OSC, " OSC programs handler: bad request for instance %d, bank %d, program %d, count %d",
+                   id, bank, first, count);
+        return 0;
+    }
+    if (count > 128)
+        count = 128;
+
+    query_programs(instance);
+
+    list = hold_program_list(instance);
+    reply = lo_message_new();
+    lo_message_add_int32(reply, id);
+    lo_message_add_int32(reply, bank);
+    for (n = first; n < first + count; n++) {
+        i = program_list_find(list, bank, n);
+        if (i >= 0) {
+            lo_message_add_int32(reply, n);
+            lo_message_add_string(reply, list->programs[i].Name);
+        }
+    }
+    release_program_list(list);
+    lo_send_message(source, "/ghostess/programs/reply", reply);
+    lo_message_free(reply);
+
+    return 0;
+}
+
+/* reply to the sender with the number and name of each stored slot */
+int
+osc_slot_list_handler(lo_address source)
+{
+    lo_message reply = lo_message_new();
+    int i;
+
+    for (i = 0; i < GHSS_STATE_SLOTS; i++) {
+        if (stateSlots[i].name) {
+            lo_message_add_int32(reply, i);
+            lo_message_add_string(reply, stateSlots[i].name);
+        }
+    }
+    lo_send_message(source, "/ghostess/slot/list/reply", reply);
+    lo_message_free(reply);
+
+    return 0;
+}
+
 int
 osc_update_handler(d3h_instance_t *instance, lo_arg **argv, lo_address source)
 {
@@ -2671,18 +6512,30 @@ osc_update_handler(d3h_instance_t *instance, lo_arg **argv, lo_address source)
     printf("%s: OSC: got update request from <%s>\n", host_name, url);
 
     if (instance->ui_osc_address) lo_address_free(instance->ui_osc_address);
-    host = lo_url_get_hostname(url);
-    port = lo_url_get_port(url);
-    instance->ui_osc_address = lo_address_new(host, port);
-    free(host);
-    free(port);
+    if (lo_url_get_protocol_id(url) == LO_UNIX) {
+        /* liblo can't tell where a UNIX socket path ends and the OSC path
+         * begins, so split at the DSSI namespace ourselves */
+        path = strstr(url + 11, "/dssi/");  /* skip "osc.unix://" */
+        if (!path) {
+            ghss_debug(GDB_OSC, " OSC: can't find OSC path in UNIX socket URL <%s>", url);
+            instance->ui_osc_address = NULL;
+            return 0;
+        }
+        host = strndup(url, path - url);
+        instance->ui_osc_address = lo_address_new_from_url(host);
+        free(host);
+        path = strdup(path);
+    } else {
+        instance->ui_osc_address = lo_address_new_from_url(url);
+        path = lo_url_get_path(url);
+    }
 
     if (instance->ui_osc_source) lo_address_free(instance->ui_osc_source);
     host = (char *)lo_address_get_hostname(source);
     port = (char *)lo_address_get_port(source);
-    instance->ui_osc_source = lo_address_new(host, port);
-
-    path = lo_url_get_path(url);
+    instance->ui_osc_source = lo_address_new_with_proto(lo_address_get_protocol(source),
+                                                        host, port);
+    osc_source_key_from_address(source, &instance->ui_osc_source_key);
 
     if (instance->ui_osc_configure_path) free(instance->ui_osc_configure_path);
     instance->ui_osc_configure_path = (char *)malloc(strlen(path) + 11);
@@ -2770,88 +6623,307 @@ int osc_debug_handler(const char *path, const char *types, lo_arg **argv,
     return 1;
 }
 
+/* Parse a port string as liblo gives it, which is always decimal digits. */
+static inline int
+osc_source_port(const char *port)
+{
+    int value = 0;
+
+    if (!port)
+        return 0;
+    while (*port >= '0' && *port <= '9')
+        value = value * 10 + (*port++ - '0');
+    return value;
+}
+
+/* Reduce the known UI's source address to a numeric key, once, when its
+ * '/update' arrives. */
+void
+osc_source_key_from_address(lo_address address, osc_source_key_t *key)
+{
+    const char *host = lo_address_get_hostname(address);
+
+    memset(key, 0, sizeof(osc_source_key_t));
+    if (host && inet_pton(AF_INET, host, key->addr) == 1) {
+        key->family = AF_INET;
+    } else if (host && inet_pton(AF_INET6, host, key->addr) == 1) {
+        key->family = AF_INET6;
+    } else {
+        key->family = AF_UNSPEC;  /* compared by name, in osc_source_is_known_ui() */
+    }
+    key->port = osc_source_port(lo_address_get_port(address));
+}
+
+/* Return true if 'source' is the known UI of 'instance'.  The port is
+ * compared first, as an integer, which settles it for most other senders;
+ * only then are the address bytes compared. */
+static int
+osc_source_is_known_ui(d3h_instance_t *instance, lo_address source)
+{
+    osc_source_key_t *key = &instance->ui_osc_source_key;
+    const char *host, *ui_host;
+    unsigned char addr[16];
+
+    if (osc_source_port(lo_address_get_port(source)) != key->port)
+        return 0;
+
+    host = lo_address_get_hostname(source);
+    if (!host)
+        return 0;
+    switch (key->family) {
+      case AF_INET:
+        return inet_pton(AF_INET, host, addr) == 1 && !memcmp(addr, key->addr, 4);
+      case AF_INET6:
+        return inet_pton(AF_INET6, host, addr) == 1 && !memcmp(addr, key->addr, 16);
+      default:
+        /* not an IP address (e.g. a UNIX socket), so compare host names */
+        ui_host = lo_address_get_hostname(instance->ui_osc_source);
+        return ui_host && !strcmp(host, ui_host);
+    }
+}
+
+void
+osc_dispatch_table_build(void)
+{
+    int i, m;
+    osc_dispatch_entry_t *entry;
+
+    osc_dispatch_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               g_free, NULL);
+    osc_dispatch_entries = (osc_dispatch_entry_t *)calloc(instance_count * OSC_METHOD_COUNT,
+                                                          sizeof(osc_dispatch_entry_t));
+
+    for (i = 0; i < instance_count; i++) {
+        for (m = 0; m < OSC_METHOD_COUNT; m++) {
+            entry = &osc_dispatch_entries[i * OSC_METHOD_COUNT + m];
+            entry->instance = &instances[i];
+            entry->method = m;
+            g_hash_table_insert(osc_dispatch_table,
+                                g_strdup_printf("/dssi/%s/%s",
+                                                instances[i].friendly_name,
+                                                osc_method_names[m]),
+                                entry);
+        }
+    }
+
+    for (m = OSC_METHOD_COUNT; m < OSC_HOST_METHOD_END; m++) {
+        entry = &osc_host_dispatch_entries[m - OSC_METHOD_COUNT];
+        entry->instance = NULL;
+        entry->method = m;
+        g_hash_table_insert(osc_dispatch_table,
+                            g_strdup_printf("/ghostess/%s", osc_method_names[m]),
+                            entry);
+    }
+}
+
 int osc_message_handler(const char *path, const char *types, lo_arg **argv,
                         int argc, void *data, void *user_data)
 {
-    int i;
-    d3h_instance_t *instance = NULL;
-    const char *method;
-    unsigned int flen = 0;
-    lo_address source;
-    int send_to_ui = 0;
+    osc_dispatch_entry_t *entry;
+    int rc;
 
-    if (strncmp(path, "/dssi/", 6))
+    entry = (osc_dispatch_entry_t *)g_hash_table_lookup(osc_dispatch_table, path);
+    if (!entry)
         return osc_debug_handler(path, types, argv, argc, data, user_data);
 
-    for (i = 0; i < instance_count; i++) {
-        flen = strlen(instances[i].friendly_name);
-        if (!strncmp(path + 6, instances[i].friendly_name, flen) &&
-            *(path + 6 + flen) == '/') { /* avoid matching prefix only */
-            instance = &instances[i];
+    /* with more than one OSC transport, handlers may be called from
+     * several server threads */
+    if (serverThreadTCP || serverThreadUnix) {
+        pthread_mutex_lock(&osc_handler_mutex);
+        rc = osc_dispatch(entry, path, types, argv, argc, data, user_data);
+        pthread_mutex_unlock(&osc_handler_mutex);
+        return rc;
+    }
+    return osc_dispatch(entry, path, types, argv, argc, data, user_data);
+}
+
+/* The members of a voice farm are kept identical:  configure, control and
+ * program changes for one are applied to the others as well. */
+static void
+osc_farm_broadcast(d3h_instance_t *instance, enum osc_method method,
+                   lo_arg **argv, int scheduled, jack_nframes_t when)
+{
+    d3h_instance_t *leader = instance->farm_leader;
+    int i;
+
+    if (method == OSC_METHOD_CONFIGURE && instance->plugin->instances > 1 &&
+        !strncmp(&argv[0]->s, DSSI_GLOBAL_CONFIGURE_PREFIX,
+                 strlen(DSSI_GLOBAL_CONFIGURE_PREFIX)))
+        return;  /* global keys already go to every instance of the plugin */
+
+    for (i = 0; i < leader->farm_size; i++) {
+        if (&leader[i] == instance)
+            continue;
+        switch (method) {
+          case OSC_METHOD_CONFIGURE:
+            osc_configure_handler(&leader[i], argv);
+            break;
+          case OSC_METHOD_CONTROL:
+            osc_control_handler(&leader[i], argv, 0, scheduled, when);
+            break;
+          case OSC_METHOD_PROGRAM:
+            osc_program_handler(&leader[i], argv);
+            break;
+          default:
             break;
         }
     }
-    if (!instance)
-        return osc_debug_handler(path, types, argv, argc, data, user_data);
+}
 
-    method = path + 6 + flen;
-    if (*method != '/' || *(method + 1) == 0)
-        return osc_debug_handler(path, types, argv, argc, data, user_data);
-    method++;
+int
+osc_dispatch(osc_dispatch_entry_t *entry, const char *path, const char *types,
+             lo_arg **argv, int argc, void *data, void *user_data)
+{
+    d3h_instance_t *instance = entry->instance;
+    lo_address source;
+    int send_to_ui = 0;
+    lo_timetag tt;
+    int scheduled = 0;
+    jack_nframes_t when = 0;
 
     source = lo_message_get_source((lo_message)data);
 
-    if (instance->ui_osc_source && instance->ui_osc_address) {
-        if (strcmp(lo_address_get_hostname(source),
-                   lo_address_get_hostname(instance->ui_osc_source)) ||
-            strcmp(lo_address_get_port(source),
-                   lo_address_get_port(instance->ui_osc_source))) {
-            /* This didn't come from our known UI for this plugin,
-               so send an update to that as well */
-            send_to_ui = 1;
+    switch (entry->method) {
+
+      case OSC_METHOD_CONFIGURE:
+      case OSC_METHOD_CONTROL:
+      case OSC_METHOD_PROGRAM:
+        if (instance->ui_osc_source && instance->ui_osc_address) {
+            if (!osc_source_is_known_ui(instance, source)) {
+                /* This didn't come from our known UI for this plugin,
+                   so send an update to that as well */
+                send_to_ui = 1;
+            }
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    /* MIDI and control messages from timetagged bundles are scheduled for
+     * the frame corresponding to the timetag (liblo's own queueing is
+     * disabled, so they arrive here as soon as received) */
+    if (entry->method == OSC_METHOD_MIDI || entry->method == OSC_METHOD_MIDI_BULK ||
+        entry->method == OSC_METHOD_CONTROL) {
+        tt = lo_message_get_timestamp((lo_message)data);
+        if (!(tt.sec == 0 && tt.frac <= 1) &&  /* not 'immediate' */
+            clock_map_seq != 0) {              /* audio thread has calibrated the clock map */
+            scheduled = 1;
+            when = osc_timetag_to_frame(tt);
         }
     }
 
-    if (!strcmp(method, "configure") && argc == 2 && !strcmp(types, "ss")) {
+    switch (entry->method) {
+
+      case OSC_METHOD_CONFIGURE:
+        if (argc != 2 || strcmp(types, "ss"))
+            break;
 
         if (send_to_ui) {
             lo_send(instance->ui_osc_address, instance->ui_osc_configure_path, "ss",
                     &argv[0]->s, &argv[1]->s);
         }
 
+        if (instance->farm_leader)
+            osc_farm_broadcast(instance, entry->method, argv, scheduled, when);
+
         return osc_configure_handler(instance, argv);
 
-    } else if (!strcmp(method, "control") && argc == 2 && !strcmp(types, "if")) {
+      case OSC_METHOD_CONTROL:
+        if (argc != 2 || strcmp(types, "if"))
+            break;
 
-        if (send_to_ui) {
-            lo_send(instance->ui_osc_address, instance->ui_osc_control_path, "if",
-                    argv[0]->i, argv[1]->f);
-        }
+        if (instance->farm_leader)
+            osc_farm_broadcast(instance, entry->method, argv, scheduled, when);
 
-        return osc_control_handler(instance, argv);
+        /* any echo to the UI is sent after the audio thread applies it */
+        return osc_control_handler(instance, argv, send_to_ui, scheduled, when);
 
-    } else if (!strcmp(method, "exiting") && argc == 0) {
+      case OSC_METHOD_EXITING:
+        if (argc != 0)
+            break;
 
         return osc_exiting_handler(instance, argv);
 
-    } else if (!strcmp(method, "midi") && argc == 1 && !strcmp(types, "m")) {
+      case OSC_METHOD_MIDI:
+        if (argc != 1 || strcmp(types, "m"))
+            break;
+
+        return osc_midi_handler(instance, argv, scheduled, when);
+
+      case OSC_METHOD_MIDI_BULK:
+        if (!osc_midi_bulk_types_valid(types, argc))
+            break;
 
-        return osc_midi_handler(instance, argv);
+        return osc_midi_bulk_handler(instance, types, argv, argc, scheduled, when);
 
-    } else if (!strcmp(method, "program") && argc == 2 && !strcmp(types, "ii")) {
+      case OSC_METHOD_PROGRAM:
+        if (argc != 2 || strcmp(types, "ii"))
+            break;
 
         if (send_to_ui) {
             lo_send(instance->ui_osc_address, instance->ui_osc_program_path, "ii",
                     argv[0]->i, argv[1]->i);
         }
+
+        if (instance->farm_leader)
+            osc_farm_broadcast(instance, entry->method, argv, scheduled, when);
         
         return osc_program_handler(instance, argv);
 
-    } else if (!strcmp(method, "update") && argc == 1 && !strcmp(types, "s")) {
+      case OSC_METHOD_UPDATE:
+        if (argc != 1 || strcmp(types, "s"))
+            break;
 
         return osc_update_handler(instance, argv, source);
 
+      case OSC_METHOD_ZONE:
+        if (argc != 4 || strcmp(types, "iiii"))
+            break;
+
+        return osc_zone_handler(instance, argv);
+
+      case OSC_HOST_METHOD_SLOT_STORE:
+        if (argc == 1 && !strcmp(types, "i"))
+            return osc_slot_store_handler(argv[0]->i, NULL);
+        if (argc != 2 || strcmp(types, "is"))
+            break;
+
+        return osc_slot_store_handler(argv[0]->i, &argv[1]->s);
+
+      case OSC_HOST_METHOD_SLOT_RECALL:
+        if (argc != 1 || strcmp(types, "i"))
+            break;
+
+        return osc_slot_recall_handler(argv[0]->i);
+
+      case OSC_HOST_METHOD_SLOT_LIST:
+        if (argc != 0)
+            break;
+
+        return osc_slot_list_handler(source);
+
+      case OSC_HOST_METHOD_PROGRAMS:
+        if (argc != 4 || strcmp(types, "iiii"))
+            break;
+
+        return osc_programs_handler(argv[0]->i, argv[1]->i, argv[2]->i, argv[3]->i, source);
+
+      case OSC_HOST_METHOD_GUI_HELLO:
+        if (argc != 1 || strcmp(types, "s"))
+            break;
+
+        return osc_shared_gui_hello_handler(&argv[0]->s);
+
+      case OSC_HOST_METHOD_GUI_BYE:
+        if (argc != 0)
+            break;
+
+        return osc_shared_gui_bye_handler();
+
+      default:
+        break;
     }
     return osc_debug_handler(path, types, argv, argc, data, user_data);
 }
-
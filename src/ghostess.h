@@ -26,6 +26,7 @@
 #define _GHOSTESS_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <jack/jack.h>
 #ifdef MIDI_JACK
@@ -36,6 +37,8 @@
 #include <dssi.h>
 #include <lo/lo.h>
 
+#include "audio.h"
+
 /* ==== debugging ==== */
 
 #define GDB_ERROR     1  /* error messages */
@@ -57,6 +60,7 @@ void ghss_debug(int type, const char *format, ...);
 /* ==== end of debugging ==== */
 
 #define GHSS_MAX_CHANNELS   16  /* MIDI limit */
+#define GHSS_MAX_MIDI_PORTS 16  /* MIDI input ports, each with GHSS_MAX_CHANNELS channels */
 
 #define GHSS_MAX_INSTANCES  32  /* arbitrary */
 
@@ -70,6 +74,7 @@ struct _d3h_dll_t {
     char                    *directory;
     int                      is_DSSI_dll;
     DSSI_Descriptor_Function descfn;      /* if is_DSSI_dll is false, this is a LADSPA_Descriptor_Function */
+    pthread_mutex_t          programQueryMutex;  /* held while its plugins' programs are queried */
 };
 
 typedef struct _d3h_plugin_t d3h_plugin_t;
@@ -96,6 +101,23 @@ struct _configure_item_t {
     char *value;
 };
 
+typedef struct _program_list_t program_list_t;
+
+/* A plugin's programs, as returned by get_program() for some set of
+ * configure items.  Lists are cached and shared between instances, and
+ * must not be changed once made. */
+struct _program_list_t {
+    program_list_t          *next;
+    d3h_plugin_t            *plugin;
+    uint32_t                 configure_hash;
+    int                      references;   /* instances using this list */
+    int                      count;
+    DSSI_Program_Descriptor *programs;
+    char                    *names;        /* arena holding all the program names */
+    int                     *index;        /* hashed (bank, program) -> programs[] # + 1, or 0 */
+    unsigned int             index_mask;   /* index size - 1 */
+};
+
 typedef struct _initial_port_set_t initial_port_set_t;
 
 struct _initial_port_set_t {
@@ -109,7 +131,11 @@ struct _initial_port_set_t {
 typedef struct _instance_template_t instance_template_t;
 
 struct _instance_template_t {
+    int                midi_port;
     int                channel;
+    int                key_lo, key_hi;     /* key zone */
+    int                vel_lo, vel_hi;     /* note-on velocity zone */
+    int                farm;               /* true if repetitions form a voice farm */
     configure_item_t  *configure_items;
     int                program_set;
     unsigned long      bank;
@@ -117,6 +143,14 @@ struct _instance_template_t {
     initial_port_set_t ports;
 };
 
+typedef struct _osc_source_key_t osc_source_key_t;
+
+struct _osc_source_key_t {     /* numeric form of an OSC source address */
+    int                family;   /* AF_INET, AF_INET6, or AF_UNSPEC if the host isn't an IP address */
+    unsigned char      addr[16];
+    int                port;
+};
+
 typedef struct _d3h_instance_t d3h_instance_t;
 
 #define MIDI_CONTROLLER_COUNT 128
@@ -125,19 +159,29 @@ struct _d3h_instance_t {
     int                number;
     d3h_plugin_t      *plugin;
     int                id;
+    int                midi_port;
     int                channel;
     d3h_instance_t    *channel_next_instance;
+    int                key_lo, key_hi;     /* key zone, notes outside which are not delivered */
+    int                vel_lo, vel_hi;     /* note-on velocity zone */
     char              *friendly_name;
 
+    /* voice farm: identical instances on one channel, sharing out notes */
+    int                farm_id;            /* id of first instance of farm, or -1 if not farmed */
+    d3h_instance_t    *farm_leader;        /* first instance of farm, or NULL */
+    int                farm_size;          /* in leader: number of instances in farm */
+    int                farm_voices;        /* notes currently assigned to this instance */
+    int                farm_next;          /* in leader: where to start looking for the least loaded */
+    unsigned char     *farm_note_owner;    /* in leader: member playing each channel * 128 + key */
+    unsigned int       farm_event_serial;  /* in leader: dispatch of the event farm_event_target is for */
+    int                farm_event_target;  /* in leader: member the current note event goes to, or -1 for all */
+
     /* configure items */
     configure_item_t  *configure_items;
 
     /* programs */
     int                pluginProgramsValid;
-    int                pluginProgramsAlloc;
-    int                pluginProgramCount;
-    DSSI_Program_Descriptor
-                      *pluginPrograms;
+    program_list_t    *programList;        /* change under programCacheMutex, read via hold_program_list() */
     long               currentBank;
     long               currentProgram;
     int                pendingBankLSB;
@@ -145,6 +189,8 @@ struct _d3h_instance_t {
     int                pendingProgramChange;
 
     /* ports */
+    int                firstAudioIn;                         /* global audio in # of this instance's first */
+    int                firstAudioOut;                        /* global audio out # of this instance's first */
     int                firstControlIn;                       /* the offset to translate instance control in # to global control in # */
     int               *pluginPortControlInNumbers;           /* maps instance LADSPA port # to global control in # */
     long               controllerMap[MIDI_CONTROLLER_COUNT]; /* maps MIDI controller to global control in # */
@@ -161,9 +207,12 @@ struct _d3h_instance_t {
     int                ui_running;               /* true if UI launched and 'exiting' not received */
     int                ui_visible;               /* true if 'show' sent */
     int                ui_initial_show_sent;
+    int                ui_shared_pending;        /* waiting for the shared universal GUI to start */
+    int                ui_in_shared_gui;         /* UI is a window in the shared universal GUI */
     int                uiNeedsProgramUpdate;
     lo_address         ui_osc_address;           /* non-NULL if 'update' received */
     lo_address         ui_osc_source;            /* address of 'known UI' for this instance */
+    osc_source_key_t   ui_osc_source_key;        /* ui_osc_source, for fast comparison */
     char              *ui_osc_control_path;
     char              *ui_osc_configure_path;
     char              *ui_osc_hide_path;
@@ -174,10 +223,10 @@ struct _d3h_instance_t {
 };
 
 /* in ghostess.c: */
+extern audio_backend_t *audio_backend;
 extern jack_client_t  *jackClient;
 #ifdef MIDI_JACK
-extern jack_port_t    *jack_midi_input_port;
-extern snd_midi_event_t *jack_alsa_encoder;
+extern jack_port_t    *jack_midi_input_ports[GHSS_MAX_MIDI_PORTS];
 #endif /* MIDI_JACK */
 
 extern char           *host_name_default;
@@ -189,15 +238,39 @@ extern char           *project_directory;
 extern int             main_timeout_tick;
 
 #define EVENT_BUFFER_SIZE 1024
+
+/* snd_seq_event_t.tag value marking an OSC event from a timetagged bundle,
+ * whose time.tick is the JACK frame time at which it should be played */
+#define GHSS_EVENT_SCHEDULED  1
 extern snd_seq_event_t midiEventBuffer[EVENT_BUFFER_SIZE]; /* ring buffer */
 extern int             midiEventReadIndex;
 extern int             midiEventWriteIndex;
 extern int             midi_thread_running;
+extern int             midi_port_count;
 extern pthread_mutex_t midiEventBufferMutex;
 
+/* control port changes queued from the OSC thread to the audio thread */
+typedef struct _control_event_t control_event_t;
+
+struct _control_event_t {
+    long           controlIn;   /* global control in # */
+    LADSPA_Data    value;
+    jack_nframes_t time;        /* JACK frame time of arrival */
+    int            echo;        /* true if UI should be sent the new value */
+    int            scheduled;   /* true if 'time' is when to apply the change, rather than arrival */
+};
+
+#define CONTROL_EVENT_BUFFER_SIZE 1024
+
+typedef void (*save_done_callback_t)(int error, void *arg);
+
 int  write_configuration(char *filename, const char *uuid);
+void save_configuration_async(const char *filename, const char *uuid, const char *launcher,
+                              save_done_callback_t done, void *arg);
 int  write_patchlist(char *filename);
 void query_programs(d3h_instance_t *instance);
+program_list_t *hold_program_list(d3h_instance_t *instance);
+void release_program_list(program_list_t *list);
 void free_programs(d3h_instance_t *instance);
 void ui_osc_free(d3h_instance_t *instance);
 void start_ui(d3h_instance_t *instance);
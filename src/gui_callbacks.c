@@ -167,6 +167,27 @@ on_file_selection_cancel( GtkWidget *widget, gpointer data )
     gtk_widget_hide(file_selection);
 }
 
+static gint
+save_done_idle_callback(gpointer data)
+{
+    int error = GPOINTER_TO_INT(data);
+
+    if (error) {
+        display_notice("Save Configuration failed:", strerror(error));
+    } else {
+        display_notice("Configuration Saved.", "");
+    }
+
+    return FALSE; /* remove this source */
+}
+
+/* called from the save thread, so pass the result back to the GUI thread */
+static void
+save_done(int error, void *arg)
+{
+    g_idle_add(save_done_idle_callback, GINT_TO_POINTER(error));
+}
+
 void
 on_save_file_ok( GtkWidget *widget, gpointer data )
 {
@@ -177,11 +198,7 @@ on_save_file_ok( GtkWidget *widget, gpointer data )
     ghss_debug(GDB_GUI, " on_save_file_ok: file '%s' selected",
                last_save_filename);
 
-    if (!write_configuration(last_save_filename, NULL)) {
-        display_notice("Save Configuration failed:", strerror(errno));
-    } else {
-        display_notice("Configuration Saved.", "");
-    }
+    save_configuration_async(last_save_filename, NULL, NULL, save_done, NULL);
 }
 
 void
@@ -45,10 +45,28 @@ struct pollfd    *alsaClient_pfd;
 
 int alsa_client_id;
 int alsa_port_id;
+static int alsa_port_ids[GHSS_MAX_MIDI_PORTS];
+
+/* Incoming events are timestamped by ALSA in real time on our own
+ * queue.  Each time the MIDI thread wakes, it samples the queue time and
+ * the JACK frame time together, and uses that pair to convert event
+ * timestamps to JACK frames, so that scheduling latency of the MIDI
+ * thread doesn't show up as timing jitter. */
+static int    alsa_queue = -1;
+static double alsa_frames_per_nsec;
+
+/* how late, in frames, the MIDI thread picked up events: bin n counts
+ * delays of less than 2^n frames (the last bin, anything longer) */
+#define MIDI_LATENESS_BINS  16
+static unsigned long midi_lateness_histogram[MIDI_LATENESS_BINS];
 
 int
 midi_open(void)
 {
+    snd_seq_port_info_t *pinfo;
+    int i;
+    char name[16];
+
     if (snd_seq_open(&alsaClient, "hw", SND_SEQ_OPEN_DUPLEX, 0) < 0) {
         ghss_debug(GDB_ERROR, ": failed to open ALSA sequencer interface");
 	return 0;
@@ -58,11 +76,40 @@ midi_open(void)
 
     alsa_client_id = snd_seq_client_id(alsaClient);
 
-    if ((alsa_port_id = snd_seq_create_simple_port
-	 (alsaClient, "input",
-	  SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, SND_SEQ_PORT_TYPE_APPLICATION)) < 0) {
-        ghss_debug(GDB_ERROR, ": failed to create ALSA sequencer port");
-	return 0;
+    /* set up an input queue, so events are timestamped on arrival */
+    alsa_queue = snd_seq_alloc_named_queue(alsaClient, host_name);
+    if (alsa_queue < 0) {
+        ghss_debug(GDB_MIDI, " midi_open: failed to allocate ALSA queue, events will be timestamped on pickup");
+        alsa_queue = -1;
+    }
+    alsa_frames_per_nsec = (double)audio_backend->sample_rate() / 1e9;
+
+    snd_seq_port_info_alloca(&pinfo);
+    for (i = 0; i < midi_port_count; i++) {
+        if (i == 0)
+            strcpy(name, "input");
+        else
+            snprintf(name, sizeof(name), "input %d", i);
+        snd_seq_port_info_set_name(pinfo, name);
+        snd_seq_port_info_set_capability(pinfo, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+        snd_seq_port_info_set_type(pinfo, SND_SEQ_PORT_TYPE_APPLICATION);
+        snd_seq_port_info_set_midi_channels(pinfo, 16);
+        if (alsa_queue >= 0) {
+            snd_seq_port_info_set_timestamping(pinfo, 1);
+            snd_seq_port_info_set_timestamp_real(pinfo, 1);
+            snd_seq_port_info_set_timestamp_queue(pinfo, alsa_queue);
+        }
+        if (snd_seq_create_port(alsaClient, pinfo) < 0) {
+            ghss_debug(GDB_ERROR, ": failed to create ALSA sequencer port");
+            return 0;
+        }
+        alsa_port_ids[i] = snd_seq_port_info_get_port(pinfo);
+    }
+    alsa_port_id = alsa_port_ids[0];
+
+    if (alsa_queue >= 0) {
+        snd_seq_start_queue(alsaClient, alsa_queue, NULL);
+        snd_seq_drain_output(alsaClient);
     }
 
     alsaClient_npfd = snd_seq_poll_descriptors_count(alsaClient, POLLIN);
@@ -74,12 +121,82 @@ midi_open(void)
     return 1;
 }
 
+/* Sample the ALSA queue's real time and the JACK frame time as close
+ * together as we can.  Returns 0 if the queue time isn't available. */
+static int
+midi_calibrate(snd_seq_queue_status_t *status, double *queue_nsec,
+               jack_nframes_t *frame)
+{
+    const snd_seq_real_time_t *rt;
+
+    if (alsa_queue < 0 ||
+        snd_seq_get_queue_status(alsaClient, alsa_queue, status) < 0)
+        return 0;
+    *frame = audio_backend->frame_time();
+    rt = snd_seq_queue_status_get_real_time(status);
+    *queue_nsec = (double)rt->tv_sec * 1e9 + (double)rt->tv_nsec;
+    return 1;
+}
+
+/* Convert an event's real-time queue timestamp to JACK frame time, given
+ * a calibration pair. */
+static jack_nframes_t
+midi_event_frame(snd_seq_event_t *ev, double queue_nsec, jack_nframes_t frame)
+{
+    double age;
+    jack_nframes_t late;
+    int bin;
+
+    age = queue_nsec - ((double)ev->time.time.tv_sec * 1e9 + (double)ev->time.time.tv_nsec);
+    if (age < 0.0)
+        age = 0.0;
+    late = (jack_nframes_t)(age * alsa_frames_per_nsec + 0.5);
+    if (late > (jack_nframes_t)(alsa_frames_per_nsec * 1e9)) {
+        /* more than a second ago: something odd, treat as just arrived */
+        late = 0;
+    }
+
+    for (bin = 0; bin < MIDI_LATENESS_BINS - 1 && late >= (1u << bin); bin++);
+    midi_lateness_histogram[bin]++;
+
+    return frame - late;
+}
+
+static void
+midi_print_lateness_histogram(void)
+{
+    int bin;
+
+    if (alsa_queue < 0)
+        return;
+
+    ghss_debug(GDB_MIDI, " midi thread: event pickup lateness (frames):");
+    for (bin = 0; bin < MIDI_LATENESS_BINS; bin++) {
+        if (!midi_lateness_histogram[bin])
+            continue;
+        if (bin == 0)
+            ghss_debug(GDB_MIDI, "         0: %lu", midi_lateness_histogram[bin]);
+        else if (bin == MIDI_LATENESS_BINS - 1)
+            ghss_debug(GDB_MIDI, " %5u and up: %lu", 1u << (bin - 1), midi_lateness_histogram[bin]);
+        else
+            ghss_debug(GDB_MIDI, " %5u-%5u: %lu", 1u << (bin - 1), (1u << bin) - 1,
+                       midi_lateness_histogram[bin]);
+    }
+}
+
 void *
 midi_thread_function(void *arg)
 {
     int rc;
     struct sched_param rtparam;
     snd_seq_event_t *ev = 0;
+    snd_seq_queue_status_t *status;
+    double queue_nsec = 0.0;
+    jack_nframes_t calibration_frame = 0;
+    int calibrated;
+    int port;
+
+    snd_seq_queue_status_alloca(&status);
 
     /* try to get low-priority real-time scheduling */
     memset (&rtparam, 0, sizeof (rtparam));
@@ -105,6 +222,8 @@ midi_thread_function(void *arg)
             continue;
         }
 
+        calibrated = midi_calibrate(status, &queue_nsec, &calibration_frame);
+
         pthread_mutex_lock(&midiEventBufferMutex);
 
         do {
@@ -116,6 +235,11 @@ midi_thread_function(void *arg)
                     continue;
                 }
 
+                /* find which of our ports this arrived on */
+                for (port = midi_port_count - 1;
+                     port > 0 && alsa_port_ids[port] != ev->dest.port;
+                     port--);
+
                 midiEventBuffer[midiEventWriteIndex] = *ev;
 
                 ev = &midiEventBuffer[midiEventWriteIndex];
@@ -134,21 +258,21 @@ midi_thread_function(void *arg)
                  *         ev->flags, ev->time.tick, ev->time.time.tv_sec, ev->time.time.tv_nsec);
                  * fflush(stderr); */
 
-                /* -FIX- Ideally, we would use ev->time to figure out how long ago
-                 * this event was generated, and adjust accordingly. Instead, we
-                 * take the easy-and-fast route of just restamping the event with
-                 * the JACK rolling frame time at its arrival, which seems to work
-                 * pretty well.... */
-                /* -FIX- Rosegarden has example of setting up input queue, see
-                 * /t/src/example/rosegarden-CVS-20050109/sound/AlsaDriver.cpp */
-                /* -FIX- snd_seq_ioctl_get_queue_status, aka snd_seq_MUMBLE_get_queue_status()
-                 * should return current queue time, subtract event time from that to get offset
-                 * into past that event arrived? */
-                ev->time.tick = jack_frame_time(jackClient);
+                /* Use the real-time stamp ALSA gave the event on arrival
+                 * at our queue to figure out how long ago it arrived.  If
+                 * it isn't stamped (or we have no queue), fall back to
+                 * restamping it with the JACK frame time now. */
+                if (calibrated && ev->queue == alsa_queue &&
+                    (ev->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL) {
+                    ev->time.tick = midi_event_frame(ev, queue_nsec, calibration_frame);
+                } else {
+                    ev->time.tick = audio_backend->frame_time();
+                }
 
                 /* fprintf(stderr, "midi: %u\n", ev->time.tick); fflush(stderr); */
 
                 ev->dest.client = 0;  /* flag as from MIDI thread */
+                ev->dest.port = port; /* ... and which input port */
 
                 midiEventWriteIndex = (midiEventWriteIndex + 1) % EVENT_BUFFER_SIZE;
             }
@@ -159,6 +283,8 @@ midi_thread_function(void *arg)
 
     } while(!host_exiting);
 
+    midi_print_lateness_histogram();
+
     midi_thread_running = 0;
 
     return NULL;
@@ -104,9 +104,10 @@ static void midi_read_proc(const MIDIPacketList *pktlist, void *refCon, void *co
              * Instead, we take the easy-and-fast route of just restamping the
              * event with the JACK rolling frame time at its arrival, which seems
              * to work pretty well.... */
-            ev->time.tick = jack_frame_time(jackClient);
+            ev->time.tick = audio_backend->frame_time();
 
             ev->dest.client = 0;  /* flag as from MIDI thread */
+            ev->dest.port = 0;    /* CoreMIDI input is always port 0 */
 
             if (midiEventReadIndex == midiEventWriteIndex + 1) {
                 ghss_debug_rt(GDB_MIDI, " midi_read_proc warning: MIDI event buffer overflow!");
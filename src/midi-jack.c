@@ -22,6 +22,9 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
+#include <string.h>
+
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
@@ -30,24 +33,29 @@
 int
 midi_open(void)
 {
-    jack_midi_input_port = jack_port_register (jackClient, "midi_in",
-                                               JACK_DEFAULT_MIDI_TYPE,
-                                               JackPortIsInput, 0);
-    if (!jack_midi_input_port) {
-        ghss_debug(GDB_ERROR, " midi_open: Failed to create JACK MIDI port!");
-	return 0;
+    int i;
+    char name[16];
+
+    if (!jackClient) {
+        /* e.g. the 'null' or 'alsa' audio backend on a headless node */
+        ghss_debug(GDB_ALWAYS, ": not using JACK, so MIDI input is by OSC only");
+        return 1;
     }
 
-    /* Set up ALSA snd_seq_event_t encoder */
-    if (!jack_alsa_encoder) {
-        if (snd_midi_event_new(3, &jack_alsa_encoder)) {
-            ghss_debug(GDB_ERROR, " midi_open: Failed to initialize ALSA MIDI encoder!");
+    for (i = 0; i < midi_port_count; i++) {
+        if (i == 0)
+            strcpy(name, "midi_in");
+        else
+            snprintf(name, sizeof(name), "midi_in_%d", i);
+        jack_midi_input_ports[i] = jack_port_register (jackClient, name,
+                                                       JACK_DEFAULT_MIDI_TYPE,
+                                                       JackPortIsInput, 0);
+        if (!jack_midi_input_ports[i]) {
+            ghss_debug(GDB_ERROR, " midi_open: Failed to create JACK MIDI port!");
             return 0;
         }
     }
 
-    snd_midi_event_reset_encode(jack_alsa_encoder);
-
     ghss_debug(GDB_ALWAYS, ": listening using JACK MIDI");
 
     return 1;
@@ -0,0 +1,161 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <alsa/seq_event.h>
+
+#include "midi_decoder.h"
+
+/* indexed by (status >> 4) - 8, i.e. 0x8n note off through 0xEn pitch bend */
+static const unsigned char channel_data_length[7] = {
+    2, 2, 2, 2, 1, 1, 2
+};
+
+static const snd_seq_event_type_t channel_event_type[7] = {
+    SND_SEQ_EVENT_NOTEOFF,
+    SND_SEQ_EVENT_NOTEON,
+    SND_SEQ_EVENT_KEYPRESS,
+    SND_SEQ_EVENT_CONTROLLER,
+    SND_SEQ_EVENT_PGMCHANGE,
+    SND_SEQ_EVENT_CHANPRESS,
+    SND_SEQ_EVENT_PITCHBEND
+};
+
+/* indexed by status & 0x0f, for 0xF0 through 0xF7: number of data bytes
+ * following system common messages (sysex, 0xF0, is handled separately) */
+static const unsigned char system_data_length[8] = {
+    0, 1, 2, 1, 0, 0, 0, 0
+};
+
+void
+midi_decoder_reset(midi_decoder_t *decoder)
+{
+    decoder->status = 0;
+    decoder->have = 0;
+    decoder->need = 0;
+    decoder->skip = 0;
+}
+
+static void
+build_event(midi_decoder_t *decoder, snd_seq_event_t *ev)
+{
+    int index = (decoder->status >> 4) - 8;
+    unsigned char channel = decoder->status & 0x0f;
+
+    ev->type = channel_event_type[index];
+    ev->flags = 0;
+    ev->tag = 0;
+
+    switch (ev->type) {
+      case SND_SEQ_EVENT_NOTEOFF:
+      case SND_SEQ_EVENT_NOTEON:
+      case SND_SEQ_EVENT_KEYPRESS:
+        ev->data.note.channel = channel;
+        ev->data.note.note = decoder->data[0];
+        ev->data.note.velocity = decoder->data[1];
+        ev->data.note.off_velocity = 0;
+        ev->data.note.duration = 0;
+        break;
+
+      case SND_SEQ_EVENT_CONTROLLER:
+        ev->data.control.channel = channel;
+        ev->data.control.param = decoder->data[0];
+        ev->data.control.value = decoder->data[1];
+        break;
+
+      case SND_SEQ_EVENT_PGMCHANGE:
+      case SND_SEQ_EVENT_CHANPRESS:
+        ev->data.control.channel = channel;
+        ev->data.control.param = 0;
+        ev->data.control.value = decoder->data[0];
+        break;
+
+      case SND_SEQ_EVENT_PITCHBEND:
+        ev->data.control.channel = channel;
+        ev->data.control.param = 0;
+        ev->data.control.value = ((decoder->data[1] << 7) | decoder->data[0]) - 8192;
+        break;
+    }
+}
+
+int
+midi_decoder_byte(midi_decoder_t *decoder, unsigned char byte,
+                  snd_seq_event_t *ev)
+{
+    if (byte >= 0xf8) {            /* system real-time: ignore */
+        return 0;
+
+    } else if (byte >= 0xf0) {     /* system common: cancels running status */
+        decoder->status = 0;
+        decoder->have = 0;
+        if (byte == 0xf0) {        /* sysex: skip until next status byte */
+            decoder->skip = 1;
+            decoder->need = -1;
+        } else {
+            decoder->need = system_data_length[byte & 0x07];
+            decoder->skip = (decoder->need > 0);
+        }
+        return 0;
+
+    } else if (byte & 0x80) {      /* channel status */
+        decoder->status = byte;
+        decoder->have = 0;
+        decoder->need = channel_data_length[(byte >> 4) - 8];
+        decoder->skip = 0;
+        return 0;
+
+    } else if (decoder->skip) {    /* data of sysex or system common */
+        if (decoder->need > 0 && ++decoder->have == decoder->need) {
+            decoder->skip = 0;
+            decoder->have = 0;
+            decoder->need = 0;
+        }
+        return 0;
+
+    } else if (!decoder->status) { /* data without status: ignore */
+        return 0;
+    }
+
+    decoder->data[decoder->have++] = byte;
+    if (decoder->have < decoder->need)
+        return 0;
+
+    build_event(decoder, ev);
+    decoder->have = 0;             /* keep running status */
+    return 1;
+}
+
+int
+midi_decoder_decode(midi_decoder_t *decoder, const unsigned char *buffer,
+                    unsigned long size, snd_seq_event_t *events,
+                    int max_events)
+{
+    unsigned long i;
+    int count = 0;
+
+    for (i = 0; i < size && count < max_events; i++) {
+        if (midi_decoder_byte(decoder, buffer[i], &events[count]))
+            count++;
+    }
+    return count;
+}
@@ -0,0 +1,55 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _MIDI_DECODER_H
+#define _MIDI_DECODER_H
+
+#include <alsa/seq_event.h>
+
+/* A small, allocation-free decoder of raw MIDI bytes into ALSA sequencer
+ * channel events, usable from the audio thread.  It handles running
+ * status, and skips system exclusive and system common messages.
+ * System real-time bytes are ignored wherever they appear. */
+
+typedef struct _midi_decoder_t midi_decoder_t;
+
+struct _midi_decoder_t {
+    unsigned char status;      /* running status, or 0 if none */
+    unsigned char data[2];
+    int           have;        /* data bytes collected so far */
+    int           need;        /* data bytes needed to complete message */
+    int           skip;        /* true while skipping sysex or system common data */
+};
+
+void midi_decoder_reset(midi_decoder_t *decoder);
+
+/* Feed one byte to the decoder.  Returns 1 and fills in the type, flags,
+ * tag and data of 'ev' if a channel message was completed, otherwise 0.
+ * The caller is responsible for the event's time and addressing. */
+int  midi_decoder_byte(midi_decoder_t *decoder, unsigned char byte,
+                       snd_seq_event_t *ev);
+
+/* Decode up to 'max_events' channel messages from 'size' bytes of raw
+ * MIDI.  Returns the number of events written to 'events'. */
+int  midi_decoder_decode(midi_decoder_t *decoder, const unsigned char *buffer,
+                         unsigned long size, snd_seq_event_t *events,
+                         int max_events);
+
+#endif /* _MIDI_DECODER_H */
@@ -0,0 +1,268 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <alsa/seq_event.h>
+
+#include "ghostess.h"
+#include "midi_decoder.h"
+#include "smf.h"
+
+#define SMF_META_PORT       0x21  /* MIDI port prefix */
+#define SMF_META_TEMPO      0x51
+#define SMF_DEFAULT_TEMPO   500000  /* microseconds per quarter note */
+
+/* An event as read from a track, before conversion to frame time.  Tempo
+ * changes are kept in the same list, so they sort into place. */
+typedef struct _smf_raw_event_t {
+    unsigned long   tick;
+    int             sequence;   /* order read, to keep the sort stable */
+    int             tempo;      /* > 0 for a tempo change */
+    snd_seq_event_t ev;
+} smf_raw_event_t;
+
+typedef struct _smf_reader_t {
+    const unsigned char *data;
+    unsigned long        size;
+    unsigned long        pos;
+} smf_reader_t;
+
+static unsigned long
+read_be(smf_reader_t *r, int bytes)
+{
+    unsigned long value = 0;
+
+    while (bytes-- && r->pos < r->size)
+        value = (value << 8) | r->data[r->pos++];
+    return value;
+}
+
+static unsigned long
+read_varlen(smf_reader_t *r)
+{
+    unsigned long value = 0;
+    unsigned char c;
+    int i;
+
+    for (i = 0; i < 4 && r->pos < r->size; i++) {
+        c = r->data[r->pos++];
+        value = (value << 7) | (c & 0x7f);
+        if (!(c & 0x80))
+            break;
+    }
+    return value;
+}
+
+static int
+raw_event_cmp(const void *a, const void *b)
+{
+    const smf_raw_event_t *ea = (const smf_raw_event_t *)a;
+    const smf_raw_event_t *eb = (const smf_raw_event_t *)b;
+
+    if (ea->tick != eb->tick)
+        return (ea->tick < eb->tick ? -1 : 1);
+    return ea->sequence - eb->sequence;
+}
+
+/* Append a track's events to *list, growing it as needed.  Returns 0 on
+ * allocation failure. */
+static int
+read_track(smf_reader_t *r, smf_raw_event_t **list, int *count, int *alloc)
+{
+    midi_decoder_t decoder;
+    unsigned long tick = 0, length;
+    unsigned char status, type;
+    int port = 0;
+    smf_raw_event_t *raw;
+
+    midi_decoder_reset(&decoder);
+
+    while (r->pos < r->size) {
+        tick += read_varlen(r);
+
+        if (*count == *alloc) {
+            *alloc = (*alloc ? *alloc * 2 : 1024);
+            raw = (smf_raw_event_t *)realloc(*list, *alloc * sizeof(smf_raw_event_t));
+            if (!raw)
+                return 0;
+            *list = raw;
+        }
+        raw = &(*list)[*count];
+        raw->tick = tick;
+        raw->sequence = *count;
+        raw->tempo = 0;
+
+        status = r->data[r->pos];
+        if (status == 0xff) {                          /* meta event */
+            r->pos++;
+            type = read_be(r, 1);
+            length = read_varlen(r);
+            if (type == SMF_META_TEMPO && length == 3) {
+                raw->tempo = read_be(r, 3);
+                (*count)++;
+            } else if (type == SMF_META_PORT && length == 1) {
+                port = read_be(r, 1);  /* for the rest of this track */
+            } else {
+                r->pos += length;
+            }
+            if (type == 0x2f)                          /* end of track */
+                break;
+            continue;
+        }
+        if (status == 0xf0 || status == 0xf7) {        /* system exclusive */
+            r->pos++;
+            length = read_varlen(r);
+            r->pos += length;
+            continue;
+        }
+
+        /* channel message, possibly using running status */
+        while (r->pos < r->size) {
+            if (midi_decoder_byte(&decoder, r->data[r->pos++], &raw->ev))
+                break;
+            if (r->pos < r->size && (r->data[r->pos] & 0x80))
+                break;  /* truncated message */
+        }
+        if (!decoder.status)
+            continue;                                  /* data without status */
+        if (decoder.have)
+            continue;                                  /* incomplete */
+        if (raw->ev.type == SND_SEQ_EVENT_NOTEON && raw->ev.data.note.velocity == 0)
+            raw->ev.type = SND_SEQ_EVENT_NOTEOFF;
+        raw->ev.dest.port = port;
+        (*count)++;
+    }
+    return 1;
+}
+
+int
+smf_read(const char *filename, double sample_rate,
+         snd_seq_event_t **events, int *event_count)
+{
+    FILE *fp;
+    long file_size;
+    unsigned char *data = NULL;
+    smf_reader_t r, track;
+    unsigned long chunk, length;
+    int format, tracks, division, i, n;
+    smf_raw_event_t *list = NULL;
+    int count = 0, alloc = 0;
+    unsigned long last_tick = 0;
+    double seconds = 0.0, seconds_per_tick;
+    snd_seq_event_t *out;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        ghss_debug(GDB_ERROR, ": could not open MIDI file '%s'", filename);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (file_size < 14 || (data = (unsigned char *)malloc(file_size)) == NULL ||
+        fread(data, 1, file_size, fp) != (size_t)file_size) {
+        ghss_debug(GDB_ERROR, ": could not read MIDI file '%s'", filename);
+        fclose(fp);
+        free(data);
+        return 0;
+    }
+    fclose(fp);
+
+    r.data = data;
+    r.size = file_size;
+    r.pos = 0;
+    if (memcmp(data, "MThd", 4)) {
+        ghss_debug(GDB_ERROR, ": '%s' is not a Standard MIDI File", filename);
+        free(data);
+        return 0;
+    }
+    r.pos = 4;
+    length = read_be(&r, 4);
+    format = read_be(&r, 2);
+    tracks = read_be(&r, 2);
+    division = read_be(&r, 2);
+    r.pos = 8 + length;
+    if (format > 1) {
+        ghss_debug(GDB_ERROR, ": MIDI file '%s' is format %d, only formats 0 and 1 are supported",
+                   filename, format);
+        free(data);
+        return 0;
+    }
+
+    /* SMPTE division is frames per second and ticks per frame, else ticks
+     * per quarter note, which the tempo scales */
+    if (division & 0x8000)
+        seconds_per_tick = 1.0 / ((double)(256 - (division >> 8)) * (division & 0xff));
+    else
+        seconds_per_tick = (double)SMF_DEFAULT_TEMPO / 1e6 / division;
+
+    for (i = 0; i < tracks && r.pos + 8 <= r.size; ) {
+        chunk = read_be(&r, 4);
+        length = read_be(&r, 4);
+        if (r.pos + length > r.size)
+            length = r.size - r.pos;
+        if (chunk == 0x4d54726bUL) {  /* "MTrk" */
+            track.data = data + r.pos;
+            track.size = length;
+            track.pos = 0;
+            if (!read_track(&track, &list, &count, &alloc)) {
+                ghss_debug(GDB_ERROR, ": out of memory reading MIDI file '%s'", filename);
+                free(data);
+                free(list);
+                return 0;
+            }
+            i++;
+        }
+        r.pos += length;
+    }
+    free(data);
+
+    qsort(list, count, sizeof(smf_raw_event_t), raw_event_cmp);
+
+    out = (snd_seq_event_t *)malloc((count ? count : 1) * sizeof(snd_seq_event_t));
+    if (!out) {
+        free(list);
+        return 0;
+    }
+    for (i = 0, n = 0; i < count; i++) {
+        seconds += (list[i].tick - last_tick) * seconds_per_tick;
+        last_tick = list[i].tick;
+        if (list[i].tempo) {
+            if (!(division & 0x8000))
+                seconds_per_tick = (double)list[i].tempo / 1e6 / division;
+            continue;
+        }
+        out[n] = list[i].ev;
+        out[n].time.tick = (unsigned int)(seconds * sample_rate + 0.5);
+        out[n].dest.client = 0;
+        n++;
+    }
+    free(list);
+
+    *events = out;
+    *event_count = n;
+    return 1;
+}
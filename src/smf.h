@@ -0,0 +1,37 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _SMF_H
+#define _SMF_H
+
+#include <alsa/seq_event.h>
+
+/* Standard MIDI File reader, for offline rendering.  Reads format 0 or 1
+ * files, merging all tracks and following the tempo map, and returns the
+ * channel events with their absolute time in frames (at 'sample_rate')
+ * in time.tick, and their MIDI port in dest.port:  0, or as set for the
+ * rest of a track by a MIDI port prefix meta event.  Note-ons with
+ * velocity zero become note-offs; other meta, system exclusive, and
+ * system common events are dropped. */
+
+int smf_read(const char *filename, double sample_rate,
+             snd_seq_event_t **events, int *event_count);
+
+#endif /* _SMF_H */
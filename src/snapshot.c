@@ -0,0 +1,247 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+/* ==== snapshot encoding ==== */
+
+static void
+ghsnap_reserve(ghsnap_buffer_t *buf, size_t length)
+{
+    if (buf->length + length > buf->allocated) {
+        while (buf->length + length > buf->allocated)
+            buf->allocated *= 2;
+        buf->data = (unsigned char *)realloc(buf->data, buf->allocated);
+    }
+}
+
+static void
+ghsnap_init_with_magic(ghsnap_buffer_t *buf, const char *magic)
+{
+    buf->allocated = 4096;
+    buf->data = (unsigned char *)malloc(buf->allocated);
+    memcpy(buf->data, magic, GHSNAP_MAGIC_LENGTH);
+    buf->length = GHSNAP_MAGIC_LENGTH;
+    ghsnap_put_u32(buf, GHSNAP_VERSION);
+    buf->record_start = 0;
+}
+
+void
+ghsnap_init(ghsnap_buffer_t *buf)
+{
+    ghsnap_init_with_magic(buf, GHSNAP_MAGIC);
+}
+
+void
+ghsnap_init_journal(ghsnap_buffer_t *buf)
+{
+    ghsnap_init_with_magic(buf, GHSNAP_JOURNAL_MAGIC);
+}
+
+void
+ghsnap_init_programs(ghsnap_buffer_t *buf)
+{
+    ghsnap_init_with_magic(buf, GHSNAP_PROGRAMS_MAGIC);
+}
+
+/* Empty the buffer, with no header, for records to be appended to a
+ * journal.  The buffer must have been initialized. */
+void
+ghsnap_clear(ghsnap_buffer_t *buf)
+{
+    buf->length = 0;
+    buf->record_start = 0;
+}
+
+void
+ghsnap_begin_record(ghsnap_buffer_t *buf, int type)
+{
+    ghsnap_reserve(buf, 5);
+    buf->record_start = buf->length;
+    buf->data[buf->length++] = type;
+    buf->length += 4;  /* length is filled in by ghsnap_end_record() */
+}
+
+void
+ghsnap_put_u32(ghsnap_buffer_t *buf, uint32_t value)
+{
+    unsigned char *p;
+
+    ghsnap_reserve(buf, 4);
+    p = buf->data + buf->length;
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+    buf->length += 4;
+}
+
+void
+ghsnap_put_float(ghsnap_buffer_t *buf, float value)
+{
+    union { float f; uint32_t u; } bits;
+
+    bits.f = value;
+    ghsnap_put_u32(buf, bits.u);
+}
+
+void
+ghsnap_put_string(ghsnap_buffer_t *buf, const char *string)
+{
+    size_t length = strlen(string) + 1;
+
+    ghsnap_reserve(buf, length);
+    memcpy(buf->data + buf->length, string, length);
+    buf->length += length;
+}
+
+void
+ghsnap_end_record(ghsnap_buffer_t *buf)
+{
+    uint32_t length = buf->length - buf->record_start - 5;
+    unsigned char *p = buf->data + buf->record_start + 1;
+
+    p[0] = length & 0xff;
+    p[1] = (length >> 8) & 0xff;
+    p[2] = (length >> 16) & 0xff;
+    p[3] = (length >> 24) & 0xff;
+}
+
+/* Terminate the snapshot, ready for writing out. */
+void
+ghsnap_finish(ghsnap_buffer_t *buf)
+{
+    ghsnap_begin_record(buf, GHSNAP_END);
+    ghsnap_end_record(buf);
+}
+
+void
+ghsnap_free(ghsnap_buffer_t *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->length = buf->allocated = 0;
+}
+
+/* ==== snapshot decoding ==== */
+
+uint32_t
+ghsnap_get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+float
+ghsnap_get_float(const unsigned char *p)
+{
+    union { float f; uint32_t u; } bits;
+
+    bits.u = ghsnap_get_u32(p);
+    return bits.f;
+}
+
+/* ==== atomic file replacement ==== */
+
+static mode_t file_creation_mask;
+static pthread_once_t file_creation_mask_once = PTHREAD_ONCE_INIT;
+
+/* umask() can only be read by setting it, so do that just once */
+static void
+read_file_creation_mask(void)
+{
+    file_creation_mask = umask(022);
+    umask(file_creation_mask);
+}
+
+/* Write 'length' bytes of 'data' to a uniquely-named temporary file in
+ * the same directory as 'filename' (or, if it's a symlink, its target),
+ * give it the old file's permissions (or 0666 less the umask, for a new
+ * file), sync it, then rename it over the file.  Returns 0 on failure,
+ * with errno set. */
+int
+atomic_write_file(const char *filename, const void *data, size_t length)
+{
+    char *target, *tmpname;
+    struct stat st;
+    mode_t mode;
+    const char *p = (const char *)data;
+    ssize_t count;
+    int fd, saved_errno;
+
+    /* replace the file a symlink points to, not the symlink */
+    if (!(target = realpath(filename, NULL)))
+        target = strdup(filename);  /* a new file */
+    if (stat(target, &st) == 0) {
+        mode = st.st_mode & 07777;
+    } else {
+        pthread_once(&file_creation_mask_once, read_file_creation_mask);
+        mode = 0666 & ~file_creation_mask;
+    }
+
+    tmpname = (char *)malloc(strlen(target) + 8);
+    sprintf(tmpname, "%s.XXXXXX", target);
+    if ((fd = mkstemp(tmpname)) < 0) {
+        saved_errno = errno;
+        free(tmpname);
+        free(target);
+        errno = saved_errno;
+        return 0;
+    }
+    while (length) {
+        count = write(fd, p, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        p += count;
+        length -= count;
+    }
+    if (length == 0 && fchmod(fd, mode) == 0 && fsync(fd) == 0) {
+        if (close(fd) == 0 && rename(tmpname, target) == 0) {
+            free(tmpname);
+            free(target);
+            return 1;
+        }
+        saved_errno = errno;
+    } else {
+        saved_errno = (length ? (errno ? errno : EIO) : errno);
+        close(fd);
+    }
+    unlink(tmpname);
+    free(tmpname);
+    free(target);
+    errno = saved_errno;
+    return 0;
+}
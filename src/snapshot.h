@@ -0,0 +1,97 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Binary project snapshot (.ghsnap) format.  The file starts with the
+ * eight-byte magic and a four-byte version number, then a sequence of
+ * records, each a one-byte type, a four-byte payload length, and the
+ * payload, ending with a GHSNAP_END record.  All integers are little-
+ * endian, floats are stored as their IEEE 754 bit patterns, and strings
+ * are NUL-terminated.  Records map one-to-one onto command line options,
+ * so getarg() can read a snapshot wherever a '-f' configuration file is
+ * accepted, except that control port values come as one binary block
+ * instead of a '-port' option per port. */
+
+#define GHSNAP_SUFFIX        ".ghsnap"
+#define GHSNAP_MAGIC         "GHSNAP\r\n"
+#define GHSNAP_JOURNAL_MAGIC "GHJRNL\r\n"  /* autosave journal, same record format */
+#define GHSNAP_PROGRAMS_MAGIC "GHPROG\r\n" /* program list cache, same record format */
+#define GHSNAP_MAGIC_LENGTH  8
+#define GHSNAP_VERSION       1
+#define GHSNAP_HEADER_LENGTH (GHSNAP_MAGIC_LENGTH + 4)
+#define GHSNAP_MAX_ARGS      8   /* most strings in one GHSNAP_OPTION record */
+
+enum ghsnap_record_type {
+    GHSNAP_END = 0,     /* no payload */
+    GHSNAP_OPTION,      /* a host option and its arguments, as strings */
+    GHSNAP_INSTANCE,    /* instance friendly name (a comment) */
+    GHSNAP_CHANNEL,     /* u32 MIDI port, u32 channel */
+    GHSNAP_ZONE,        /* u32 key lo, key hi, velocity lo, velocity hi */
+    GHSNAP_CONFIGURE,   /* configure key and value strings */
+    GHSNAP_PROGRAM,     /* u32 bank, u32 program */
+    GHSNAP_PORTS,       /* u32 count, then count pairs of u32 port, f32 value */
+    GHSNAP_FARM,        /* u32 voice farm size */
+    GHSNAP_PLUGIN,      /* "soname:label" string; instantiates the plugin */
+
+    /* autosave journal records, which refer to instances by id: */
+    GHSNAP_JOURNAL_RACK = 64,   /* u32 instance count, u32 control in count */
+    GHSNAP_JOURNAL_CONTROL,     /* u32 instance id, u32 port, f32 value */
+    GHSNAP_JOURNAL_PROGRAM,     /* u32 instance id, u32 bank, u32 program */
+    GHSNAP_JOURNAL_CONFIGURE,   /* u32 instance id, key and value strings */
+
+    /* program list cache records: */
+    GHSNAP_PROGRAMS_KEY = 96,   /* "path:label" string, u32 DLL mtime, u32 DLL size, u32 configure hash */
+    GHSNAP_PROGRAMS_LIST        /* u32 count, then count sets of u32 bank, u32 program, name string */
+};
+
+typedef struct _ghsnap_buffer_t {
+    unsigned char *data;
+    size_t         length;
+    size_t         allocated;
+    size_t         record_start;
+} ghsnap_buffer_t;
+
+void     ghsnap_init(ghsnap_buffer_t *buf);
+void     ghsnap_init_journal(ghsnap_buffer_t *buf);
+void     ghsnap_init_programs(ghsnap_buffer_t *buf);
+void     ghsnap_clear(ghsnap_buffer_t *buf);
+void     ghsnap_begin_record(ghsnap_buffer_t *buf, int type);
+void     ghsnap_put_u32(ghsnap_buffer_t *buf, uint32_t value);
+void     ghsnap_put_float(ghsnap_buffer_t *buf, float value);
+void     ghsnap_put_string(ghsnap_buffer_t *buf, const char *string);
+void     ghsnap_end_record(ghsnap_buffer_t *buf);
+void     ghsnap_finish(ghsnap_buffer_t *buf);
+void     ghsnap_free(ghsnap_buffer_t *buf);
+
+uint32_t ghsnap_get_u32(const unsigned char *p);
+float    ghsnap_get_float(const unsigned char *p);
+
+/* Files are saved atomically: written to a temporary file in the same
+ * directory, synced, then renamed over the target, so a crash part way
+ * through never leaves a truncated configuration behind.  The file keeps
+ * its permissions, and a symlink keeps pointing at it. */
+int      atomic_write_file(const char *filename, const void *data, size_t length);
+
+#endif /* _SNAPSHOT_H */
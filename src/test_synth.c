@@ -0,0 +1,325 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+/* A trivial DSSI synth, for use with ghostess-bench: 16 voices of a
+ * naive sawtooth with an exponential decay, one output, and a couple of
+ * programs.  It exists to give the host something cheap but realistic to
+ * drive, so that the benchmark measures mostly the host's own work. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <ladspa.h>
+#include <dssi.h>
+
+#define TS_PORT_OUTPUT  0
+#define TS_PORT_VOLUME  1
+#define TS_PORT_DECAY   2
+#define TS_PORT_COUNT   3
+
+#define TS_VOICES       16
+
+typedef struct {
+    int           key;       /* -1 if idle */
+    int           released;
+    float         phase;
+    float         increment;
+    float         level;
+} ts_voice_t;
+
+typedef struct {
+    LADSPA_Data  *output;
+    LADSPA_Data  *volume;
+    LADSPA_Data  *decay;
+    float         sample_rate;
+    unsigned long program;
+    ts_voice_t    voice[TS_VOICES];
+    int           next_voice;
+} test_synth_t;
+
+static const DSSI_Program_Descriptor ts_programs[2] = {
+    { 0, 0, "Short" },
+    { 0, 1, "Long" },
+};
+
+static LADSPA_Descriptor *ts_ladspa_descriptor = NULL;
+static DSSI_Descriptor   *ts_dssi_descriptor = NULL;
+
+static LADSPA_Handle
+ts_instantiate(const LADSPA_Descriptor *descriptor, unsigned long sample_rate)
+{
+    test_synth_t *synth = (test_synth_t *)calloc(1, sizeof(test_synth_t));
+    int i;
+
+    if (!synth)
+        return NULL;
+    synth->sample_rate = (float)sample_rate;
+    for (i = 0; i < TS_VOICES; i++)
+        synth->voice[i].key = -1;
+
+    return (LADSPA_Handle)synth;
+}
+
+static void
+ts_connect_port(LADSPA_Handle instance, unsigned long port, LADSPA_Data *data)
+{
+    test_synth_t *synth = (test_synth_t *)instance;
+
+    switch (port) {
+      case TS_PORT_OUTPUT:  synth->output = data;  break;
+      case TS_PORT_VOLUME:  synth->volume = data;  break;
+      case TS_PORT_DECAY:   synth->decay = data;   break;
+    }
+}
+
+static void
+ts_activate(LADSPA_Handle instance)
+{
+    test_synth_t *synth = (test_synth_t *)instance;
+    int i;
+
+    for (i = 0; i < TS_VOICES; i++)
+        synth->voice[i].key = -1;
+}
+
+static void
+ts_cleanup(LADSPA_Handle instance)
+{
+    free(instance);
+}
+
+static const DSSI_Program_Descriptor *
+ts_get_program(LADSPA_Handle instance, unsigned long index)
+{
+    if (index < 2)
+        return &ts_programs[index];
+    return NULL;
+}
+
+static void
+ts_select_program(LADSPA_Handle instance, unsigned long bank,
+                  unsigned long program)
+{
+    test_synth_t *synth = (test_synth_t *)instance;
+
+    if (bank == 0 && program < 2)
+        synth->program = program;
+}
+
+static int
+ts_get_midi_controller(LADSPA_Handle instance, unsigned long port)
+{
+    if (port == TS_PORT_VOLUME)
+        return DSSI_CC(7);
+    return DSSI_NONE;
+}
+
+static void
+ts_note_on(test_synth_t *synth, int key, int velocity)
+{
+    ts_voice_t *voice = &synth->voice[synth->next_voice];
+
+    synth->next_voice = (synth->next_voice + 1) % TS_VOICES;
+    voice->key = key;
+    voice->released = 0;
+    voice->phase = 0.0f;
+    voice->increment = 440.0f * powf(2.0f, (float)(key - 69) / 12.0f) /
+                           synth->sample_rate;
+    voice->level = (float)velocity / 127.0f;
+}
+
+static void
+ts_note_off(test_synth_t *synth, int key)
+{
+    int i;
+
+    for (i = 0; i < TS_VOICES; i++)
+        if (synth->voice[i].key == key)
+            synth->voice[i].released = 1;
+}
+
+/* render 'count' frames of all active voices, starting at 'pos' */
+static void
+ts_render(test_synth_t *synth, unsigned long pos, unsigned long count)
+{
+    LADSPA_Data *out = synth->output + pos;
+    float volume = *synth->volume;
+    float seconds = *synth->decay * (synth->program ? 4.0f : 1.0f);
+    float decay, release;
+    unsigned long n;
+    int i;
+
+    if (seconds < 0.01f)
+        seconds = 0.01f;
+    /* fall by about 60dB over the decay time, much faster when released */
+    decay = expf(-6.9f / (seconds * synth->sample_rate));
+    release = expf(-6.9f / (0.05f * synth->sample_rate));
+
+    for (i = 0; i < TS_VOICES; i++) {
+        ts_voice_t *voice = &synth->voice[i];
+        float mult;
+
+        if (voice->key < 0)
+            continue;
+        mult = voice->released ? release : decay;
+        for (n = 0; n < count; n++) {
+            out[n] += volume * voice->level * (2.0f * voice->phase - 1.0f);
+            voice->phase += voice->increment;
+            if (voice->phase >= 1.0f)
+                voice->phase -= 1.0f;
+            voice->level *= mult;
+        }
+        if (voice->level < 0.0001f)
+            voice->key = -1;
+    }
+}
+
+static void
+ts_run_synth(LADSPA_Handle instance, unsigned long sample_count,
+             snd_seq_event_t *events, unsigned long event_count)
+{
+    test_synth_t *synth = (test_synth_t *)instance;
+    unsigned long pos = 0, event_index = 0, end;
+    int i;
+
+    memset(synth->output, 0, sample_count * sizeof(LADSPA_Data));
+
+    while (pos < sample_count) {
+
+        while (event_index < event_count &&
+               events[event_index].time.tick <= pos) {
+
+            snd_seq_event_t *ev = &events[event_index++];
+
+            switch (ev->type) {
+              case SND_SEQ_EVENT_NOTEON:
+                if (ev->data.note.velocity > 0)
+                    ts_note_on(synth, ev->data.note.note, ev->data.note.velocity);
+                else
+                    ts_note_off(synth, ev->data.note.note);
+                break;
+              case SND_SEQ_EVENT_NOTEOFF:
+                ts_note_off(synth, ev->data.note.note);
+                break;
+              case SND_SEQ_EVENT_CONTROLLER:
+                if (ev->data.control.param == 120 ||  /* all sound off */
+                    ev->data.control.param == 123) {  /* all notes off */
+                    for (i = 0; i < TS_VOICES; i++)
+                        synth->voice[i].key = -1;
+                }
+                break;
+              default:
+                break;
+            }
+        }
+
+        end = (event_index < event_count &&
+               events[event_index].time.tick < sample_count) ?
+                  events[event_index].time.tick : sample_count;
+        ts_render(synth, pos, end - pos);
+        pos = end;
+    }
+}
+
+static void
+ts_run(LADSPA_Handle instance, unsigned long sample_count)
+{
+    ts_run_synth(instance, sample_count, NULL, 0);
+}
+
+static void
+ts_init(void)
+{
+    LADSPA_PortDescriptor *port_descriptors;
+    LADSPA_PortRangeHint *port_range_hints;
+    char **port_names;
+
+    ts_ladspa_descriptor = (LADSPA_Descriptor *)calloc(1, sizeof(LADSPA_Descriptor));
+    ts_dssi_descriptor = (DSSI_Descriptor *)calloc(1, sizeof(DSSI_Descriptor));
+    if (!ts_ladspa_descriptor || !ts_dssi_descriptor)
+        return;
+
+    ts_ladspa_descriptor->UniqueID = 0;  /* not for general use */
+    ts_ladspa_descriptor->Label = "ghostess_test_synth";
+    ts_ladspa_descriptor->Properties = LADSPA_PROPERTY_HARD_RT_CAPABLE;
+    ts_ladspa_descriptor->Name = "ghostess benchmark test synth";
+    ts_ladspa_descriptor->Maker = "ghostess";
+    ts_ladspa_descriptor->Copyright = "GPL";
+    ts_ladspa_descriptor->PortCount = TS_PORT_COUNT;
+
+    port_descriptors = (LADSPA_PortDescriptor *)calloc(TS_PORT_COUNT, sizeof(LADSPA_PortDescriptor));
+    port_range_hints = (LADSPA_PortRangeHint *)calloc(TS_PORT_COUNT, sizeof(LADSPA_PortRangeHint));
+    port_names = (char **)calloc(TS_PORT_COUNT, sizeof(char *));
+
+    port_descriptors[TS_PORT_OUTPUT] = LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO;
+    port_names[TS_PORT_OUTPUT] = "Output";
+
+    port_descriptors[TS_PORT_VOLUME] = LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL;
+    port_names[TS_PORT_VOLUME] = "Volume";
+    port_range_hints[TS_PORT_VOLUME].HintDescriptor =
+        LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE;
+    port_range_hints[TS_PORT_VOLUME].LowerBound = 0.0f;
+    port_range_hints[TS_PORT_VOLUME].UpperBound = 0.5f;
+
+    port_descriptors[TS_PORT_DECAY] = LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL;
+    port_names[TS_PORT_DECAY] = "Decay";
+    port_range_hints[TS_PORT_DECAY].HintDescriptor =
+        LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_LOW;
+    port_range_hints[TS_PORT_DECAY].LowerBound = 0.01f;
+    port_range_hints[TS_PORT_DECAY].UpperBound = 4.0f;
+
+    ts_ladspa_descriptor->PortDescriptors = (const LADSPA_PortDescriptor *)port_descriptors;
+    ts_ladspa_descriptor->PortRangeHints = (const LADSPA_PortRangeHint *)port_range_hints;
+    ts_ladspa_descriptor->PortNames = (const char * const *)port_names;
+
+    ts_ladspa_descriptor->instantiate = ts_instantiate;
+    ts_ladspa_descriptor->connect_port = ts_connect_port;
+    ts_ladspa_descriptor->activate = ts_activate;
+    ts_ladspa_descriptor->run = ts_run;
+    ts_ladspa_descriptor->cleanup = ts_cleanup;
+
+    ts_dssi_descriptor->DSSI_API_Version = 1;
+    ts_dssi_descriptor->LADSPA_Plugin = ts_ladspa_descriptor;
+    ts_dssi_descriptor->get_program = ts_get_program;
+    ts_dssi_descriptor->select_program = ts_select_program;
+    ts_dssi_descriptor->get_midi_controller_for_port = ts_get_midi_controller;
+    ts_dssi_descriptor->run_synth = ts_run_synth;
+}
+
+const LADSPA_Descriptor *
+ladspa_descriptor(unsigned long index)
+{
+    if (!ts_dssi_descriptor)
+        ts_init();
+    return index == 0 ? ts_ladspa_descriptor : NULL;
+}
+
+const DSSI_Descriptor *
+dssi_descriptor(unsigned long index)
+{
+    if (!ts_dssi_descriptor)
+        ts_init();
+    return index == 0 ? ts_dssi_descriptor : NULL;
+}
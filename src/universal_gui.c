@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
 #include <math.h>
 
 #include <gtk/gtk.h>
@@ -48,52 +49,52 @@
 /* ==== global variables ==== */
 
 char *     osc_host_url;
-char *     osc_self_url;
+char *     osc_host_local_url = NULL;  /* UNIX socket or TCP URL given by ghostess, if any */
+char *     osc_self_socket = NULL;     /* our UNIX socket path, if using one */
+char *     osc_server_url;
+int        osc_proto = LO_UDP;
+lo_server  osc_server;
 lo_address osc_host_address;
-char *     osc_configure_path;
-char *     osc_control_path;
-char *     osc_exiting_path;
-char *     osc_hide_path;
-char *     osc_midi_path;
-char *     osc_program_path;
-char *     osc_quit_path;
-char *     osc_rate_path;
-char *     osc_show_path;
-char *     osc_update_path;
-
-gint update_request_timeout_tag;
-int  update_request_timeout_active = 0;
-int  update_request_awaiting_program_change = 0;
-
-GtkWidget *main_window;
-GtkObject *bank_spin_adj;
-GtkObject *program_spin_adj;
-GtkWidget *test_note_button;
-GtkWidget *test_note_toggle;
-
-unsigned char test_note_noteon_key = 60;
-int           test_note_noteoff_key = -1;
-unsigned char test_note_velocity = 96;
-
-int host_requested_quit = 0;
-
-unsigned long sample_rate;
-
-void *       plugin_dlh;
-char *       plugin_path;
-DSSI_Descriptor_Function
-             plugin_descfn;
-int          plugin_is_DSSI_so;
-const DSSI_Descriptor *
-             plugin_descriptor;
-port_data_t *port_data;
-           
+
+/* With TCP, messages arrive on accepted connections whose sockets liblo
+ * doesn't expose, so GTK+ can't watch them.  Instead a liblo server
+ * thread receives them, and passes each one, serialised, through a pipe
+ * to the GTK+ thread, which dispatches it to osc_server's methods.
+ * osc_server itself is then just a UDP server. */
+lo_server_thread osc_tcp_thread = NULL;
+int        osc_forward_pipe[2] = { -1, -1 };
+
+/* With '-shared', one process serves the universal GUI for every instance
+ * that uses it: the host starts us once, for the first, then asks for
+ * more windows with '/ghostess/gui/open'.  Each window talks to the host
+ * over the usual DSSI paths for its instance, all on our one OSC
+ * server. */
+int        shared = 0;
+int        host_requested_quit = 0;    /* with '-shared', host sent '/ghostess/gui/quit' */
+
+ugui_t *     uguis = NULL;
+plugin_so_t *plugin_sos = NULL;
+
+#define UGUI_OF(object)  ((ugui_t *)g_object_get_data(G_OBJECT(object), "ugui"))
+
+/* Widgets are built for at most this many ports at once; plugins with
+ * more get a page of them at a time, plus a filter by port name. */
+#define PORTS_PER_PAGE  40
+
+/* Incoming '/control' values are only stored as they arrive; the port
+ * widgets are brought up to date at most once per this many ms, so a
+ * burst of updates to a port costs one redraw instead of dozens. */
+#define CONTROL_FLUSH_INTERVAL  20
 
 /* forward: */
-void schedule_update_request(void);
-void update_from_program_select(int bank, int program);
-void update_port_widget(int port, float value);
-void update_for_sample_rate(void);
+void schedule_update_request(ugui_t *ugui);
+void update_from_program_select(ugui_t *ugui, int bank, int program);
+void update_port_widget(ugui_t *ugui, int port, float value);
+void queue_port_update(ugui_t *ugui, int port, float value);
+void update_for_sample_rate(ugui_t *ugui);
+void port_view_filter(ugui_t *ugui);
+void port_view_build_page(ugui_t *ugui);
+void ugui_close(ugui_t *ugui);
 
 /* ==== OSC handling ==== */
 
@@ -138,39 +139,55 @@ fflush(stdout);
 }
 
 int
-osc_action_handler(const char *path, const char *types, lo_arg **argv,
-                  int argc, lo_message msg, void *user_data)
+osc_show_handler(const char *path, const char *types, lo_arg **argv,
+                 int argc, lo_message msg, void *user_data)
 {
-    if (!strcmp(user_data, "show")) {
+    ugui_t *ugui = (ugui_t *)user_data;
 
-        /* GDB_MESSAGE(GDB_OSC, " osc_action_handler: received 'show' message\n"); */
-        if (!GTK_WIDGET_MAPPED(main_window))
-            gtk_widget_show(main_window);
-        else
-            gdk_window_raise(main_window->window);
+    /* GDB_MESSAGE(GDB_OSC, " osc_show_handler: received 'show' message\n"); */
+    if (!GTK_WIDGET_MAPPED(ugui->main_window))
+        gtk_widget_show(ugui->main_window);
+    else
+        gdk_window_raise(ugui->main_window->window);
 
-    } else if (!strcmp(user_data, "hide")) {
+    return 0;
+}
 
-        /* GDB_MESSAGE(GDB_OSC, " osc_action_handler: received 'hide' message\n"); */
-        gtk_widget_hide(main_window);
+int
+osc_hide_handler(const char *path, const char *types, lo_arg **argv,
+                 int argc, lo_message msg, void *user_data)
+{
+    ugui_t *ugui = (ugui_t *)user_data;
 
-    } else if (!strcmp(user_data, "quit")) {
+    /* GDB_MESSAGE(GDB_OSC, " osc_hide_handler: received 'hide' message\n"); */
+    gtk_widget_hide(ugui->main_window);
 
-        /* GDB_MESSAGE(GDB_OSC, " osc_action_handler: received 'quit' message\n"); */
-        host_requested_quit = 1;
-        gtk_main_quit();
+    return 0;
+}
 
-    } else if (!strcmp(user_data, "sample-rate")) {
+int
+osc_quit_handler(const char *path, const char *types, lo_arg **argv,
+                 int argc, lo_message msg, void *user_data)
+{
+    ugui_t *ugui = (ugui_t *)user_data;
 
-        /* GDB_MESSAGE(GDB_OSC, " osc_action_handler: received 'sample-rate' message, rate = %d\n", argv[0]->i); */
-        sample_rate = argv[0]->i;
-        update_for_sample_rate();
+    /* GDB_MESSAGE(GDB_OSC, " osc_quit_handler: received 'quit' message\n"); */
+    ugui->host_requested_quit = 1;
+    ugui_close(ugui);
 
-    } else {
+    return 0;
+}
 
-        return osc_debug_handler(path, types, argv, argc, msg, user_data);
+int
+osc_rate_handler(const char *path, const char *types, lo_arg **argv,
+                 int argc, lo_message msg, void *user_data)
+{
+    ugui_t *ugui = (ugui_t *)user_data;
+
+    /* GDB_MESSAGE(GDB_OSC, " osc_rate_handler: received 'sample-rate' message, rate = %d\n", argv[0]->i); */
+    ugui->sample_rate = argv[0]->i;
+    update_for_sample_rate(ugui);
 
-    }
     return 0;
 }
 
@@ -197,6 +214,7 @@ int
 osc_control_handler(const char *path, const char *types, lo_arg **argv,
                   int argc, lo_message msg, void *user_data)
 {
+    ugui_t *ugui = (ugui_t *)user_data;
     int port;
     float value;
 
@@ -210,7 +228,7 @@ osc_control_handler(const char *path, const char *types, lo_arg **argv,
 
     GDB_MESSAGE(GDB_OSC, " osc_control_handler: control %d now %f\n", port, value);
 
-    update_port_widget(port, value);
+    queue_port_update(ugui, port, value);
 
     return 0;
 }
@@ -219,6 +237,7 @@ int
 osc_program_handler(const char *path, const char *types, lo_arg **argv,
                   int argc, lo_message msg, void *user_data)
 {
+    ugui_t *ugui = (ugui_t *)user_data;
     int bank, program;
 
     if (argc < 2) {
@@ -226,7 +245,7 @@ osc_program_handler(const char *path, const char *types, lo_arg **argv,
         return 1;
     }
 
-    if (!plugin_descriptor->select_program) {
+    if (!ugui->descriptor->select_program) {
         GDB_MESSAGE(GDB_OSC, " osc_program_handler: received program change; plugin has no select_program()!\n");
         return 0;
     }
@@ -236,14 +255,14 @@ osc_program_handler(const char *path, const char *types, lo_arg **argv,
 
     GDB_MESSAGE(GDB_OSC, " osc_program_handler: received program change, bank %d, program %d\n", bank, program);
 
-    update_from_program_select(bank, program);
+    update_from_program_select(ugui, bank, program);
 
-    if (update_request_awaiting_program_change) {
-        update_request_awaiting_program_change = 0;
+    if (ugui->update_request_awaiting_program_change) {
+        ugui->update_request_awaiting_program_change = 0;
     } else {
         /* assume this isn't part of an update response, so request another
          * update to get current port values */
-        schedule_update_request();
+        schedule_update_request(ugui);
     }
 
     return 0;
@@ -258,38 +277,155 @@ osc_data_on_socket_callback(gpointer data, gint source,
     lo_server_recv_noblock(server, 0);
 }
 
+static int
+write_all(int fd, const void *buffer, size_t length)
+{
+    const char *p = (const char *)buffer;
+    ssize_t count;
+
+    while (length) {
+        count = write(fd, p, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return 0;
+        p += count;
+        length -= count;
+    }
+    return 1;
+}
+
+static int
+read_all(int fd, void *buffer, size_t length)
+{
+    char *p = (char *)buffer;
+    ssize_t count;
+
+    while (length) {
+        count = read(fd, p, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return 0;
+        p += count;
+        length -= count;
+    }
+    return 1;
+}
+
+/* Called in the TCP server thread: pass a message on to the GTK+ thread. */
+int
+osc_forward_handler(const char *path, const char *types, lo_arg **argv,
+                    int argc, lo_message msg, void *user_data)
+{
+    size_t size;
+    uint32_t length;
+    void *data;
+
+    if (!(data = lo_message_serialise(msg, path, NULL, &size)))
+        return 0;
+    length = size;
+    if (!write_all(osc_forward_pipe[1], &length, sizeof(length)) ||
+        !write_all(osc_forward_pipe[1], data, size))
+        GDB_MESSAGE(GDB_OSC, " osc_forward_handler: couldn't forward %s\n", path);
+    free(data);
+
+    return 0;
+}
+
+void
+osc_data_on_pipe_callback(gpointer data, gint source,
+                          GdkInputCondition condition)
+{
+    uint32_t length;
+    void *buffer;
+
+    if (!read_all(source, &length, sizeof(length)))
+        return;
+    buffer = malloc(length);
+    if (read_all(source, buffer, length))
+        lo_server_dispatch_data(osc_server, buffer, length);
+    free(buffer);
+}
+
 gint
 update_request_timeout_callback(gpointer data)
 {
+    ugui_t *ugui = (ugui_t *)data;
+
     /* send our update request */
-    lo_send(osc_host_address, osc_update_path, "s", osc_self_url);
+    lo_send(osc_host_address, ugui->osc_update_path, "s", ugui->osc_self_url);
 
-    update_request_timeout_active = 0;
+    ugui->update_request_timeout_active = 0;
 
     return FALSE;  /* don't need to do this again */
 }
 
 void
-schedule_update_request(void)
+schedule_update_request(ugui_t *ugui)
+{
+    if (!ugui->update_request_timeout_active) {
+        ugui->update_request_timeout_tag = gtk_timeout_add(100,
+                                                           update_request_timeout_callback,
+                                                           ugui);
+        ugui->update_request_timeout_active = 1;
+        ugui->update_request_awaiting_program_change = 1;
+    }
+}
+
+gint
+control_flush_timeout_callback(gpointer data)
+{
+    ugui_t *ugui = (ugui_t *)data;
+    port_data_t *port_data = ugui->port_data;
+    int i, port;
+
+    /* apply the latest value of each port updated since the last flush */
+    for (i = 0; i < ugui->dirty_port_count; i++) {
+        port = ugui->dirty_ports[i];
+        port_data[port].dirty = 0;
+        update_port_widget(ugui, port, port_data[port].value);
+    }
+    ugui->dirty_port_count = 0;
+
+    ugui->control_flush_timeout_active = 0;
+
+    return FALSE;  /* rescheduled by the next update */
+}
+
+/* Store a value received from the host in the model, and schedule its
+ * widget, if the port has one on the current page, to be updated at the
+ * next control flush. */
+void
+queue_port_update(ugui_t *ugui, int port, float value)
 {
-    if (!update_request_timeout_active) {
-        update_request_timeout_tag = gtk_timeout_add(100,
-                                                     update_request_timeout_callback,
-                                                     NULL);
-        update_request_timeout_active = 1;
-        update_request_awaiting_program_change = 1;
+    port_data_t *port_data = ugui->port_data;
+
+    if (port < 0 || port > ugui->descriptor->LADSPA_Plugin->PortCount - 1)
+        return;
+
+    port_data[port].value = value;
+    port_data[port].have_value = 1;
+
+    if (!port_data[port].widget || port_data[port].dirty)
+        return;
+    port_data[port].dirty = 1;
+    ugui->dirty_ports[ugui->dirty_port_count++] = port;
+
+    if (!ugui->control_flush_timeout_active) {
+        ugui->control_flush_timeout_tag = gtk_timeout_add(CONTROL_FLUSH_INTERVAL,
+                                                          control_flush_timeout_callback,
+                                                          ugui);
+        ugui->control_flush_timeout_active = 1;
     }
 }
 
 /* ==== GTK+ widget callbacks ==== */
 
 gint
-on_delete_event_wrapper( GtkWidget *widget, GdkEvent *event, gpointer data )
+on_main_window_delete_event(GtkWidget *widget, GdkEvent *event, gpointer data)
 {
-    void (*handler)(GtkWidget *, gpointer) = (void (*)(GtkWidget *, gpointer))data;
-
-    /* call our 'close', 'dismiss' or 'cancel' callback (which must not need the user data) */
-    (*handler)(widget, NULL);
+    ugui_close((ugui_t *)data);
 
     /* tell GTK+ to NOT emit 'destroy' */
     return TRUE;
@@ -298,51 +434,54 @@ on_delete_event_wrapper( GtkWidget *widget, GdkEvent *event, gpointer data )
 void
 on_program_spin_changed(GtkWidget *widget, gpointer data)
 {
-    unsigned long bank    = lrintf(GTK_ADJUSTMENT(bank_spin_adj)->value);
-    unsigned long program = lrintf(GTK_ADJUSTMENT(program_spin_adj)->value);
+    ugui_t *ugui = UGUI_OF(widget);
+    unsigned long bank    = lrintf(GTK_ADJUSTMENT(ugui->bank_spin_adj)->value);
+    unsigned long program = lrintf(GTK_ADJUSTMENT(ugui->program_spin_adj)->value);
 
     GDB_MESSAGE(GDB_GUI, " on_program_spin_changed: bank %lu program %lu selected\n", bank, program);
 
-    lo_send(osc_host_address, osc_program_path, "ii", bank, program);
+    lo_send(osc_host_address, ugui->osc_program_path, "ii", bank, program);
 
     /* select_program() may change the ports, so we need to request another update */
-    schedule_update_request();
+    schedule_update_request(ugui);
 }
 
 void
 on_test_note_mode_toggled(GtkWidget *widget, gpointer data)
 {
+    ugui_t *ugui = UGUI_OF(widget);
     int state = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget));
 
     if (state) {
-        gtk_widget_hide(test_note_button);
-        gtk_widget_show(test_note_toggle);
+        gtk_widget_hide(ugui->test_note_button);
+        gtk_widget_show(ugui->test_note_toggle);
     } else {
-        gtk_widget_show(test_note_button);
-        gtk_widget_hide(test_note_toggle);
+        gtk_widget_show(ugui->test_note_button);
+        gtk_widget_hide(ugui->test_note_toggle);
     }
 }
 
 void
 on_test_note_slider_change(GtkWidget *widget, gpointer data)
 {
+    ugui_t *ugui = UGUI_OF(widget);
     unsigned char value = lrintf(GTK_ADJUSTMENT(widget)->value);
 
     if ((intptr_t)data == 0) {  /* key */
 
-        test_note_noteon_key = value;
-        GDB_MESSAGE(GDB_GUI, " on_test_note_slider_change: new test note key %d\n", test_note_noteon_key);
+        ugui->test_note_noteon_key = value;
+        GDB_MESSAGE(GDB_GUI, " on_test_note_slider_change: new test note key %d\n", ugui->test_note_noteon_key);
 
     } else {  /* velocity */
 
-        test_note_velocity = value;
-        GDB_MESSAGE(GDB_GUI, " on_test_note_slider_change: new test note velocity %d\n", test_note_velocity);
+        ugui->test_note_velocity = value;
+        GDB_MESSAGE(GDB_GUI, " on_test_note_slider_change: new test note velocity %d\n", ugui->test_note_velocity);
 
     }
 }
 
 static void
-send_midi(unsigned char b0, unsigned char b1, unsigned char b2)
+send_midi(ugui_t *ugui, unsigned char b0, unsigned char b1, unsigned char b2)
 {
     unsigned char midi[4];
 
@@ -350,45 +489,48 @@ send_midi(unsigned char b0, unsigned char b1, unsigned char b2)
     midi[1] = b0;
     midi[2] = b1;
     midi[3] = b2;
-    lo_send(osc_host_address, osc_midi_path, "m", midi);
+    lo_send(osc_host_address, ugui->osc_midi_path, "m", midi);
 }
 
 void
-release_test_note(void)
+release_test_note(ugui_t *ugui)
 {
-    if (test_note_noteoff_key >= 0) {
-        send_midi(0x80, test_note_noteoff_key, 0x40);
-        test_note_noteoff_key = -1;
+    if (ugui->test_note_noteoff_key >= 0) {
+        send_midi(ugui, 0x80, ugui->test_note_noteoff_key, 0x40);
+        ugui->test_note_noteoff_key = -1;
     }
 }
 
 void
 on_test_note_button_press(GtkWidget *widget, gpointer data)
 {
+    ugui_t *ugui = UGUI_OF(widget);
+
     /* here we just set the state of the test note toggle button, which may
      * cause a call to on_test_note_toggle_toggled() below, which will send
      * the actual MIDI message. */
-    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(test_note_toggle), (intptr_t)data != 0);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(ugui->test_note_toggle), (intptr_t)data != 0);
 }
 
 void
 on_test_note_toggle_toggled(GtkWidget *widget, gpointer data)
 {
-    int state = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(test_note_toggle));
+    ugui_t *ugui = UGUI_OF(widget);
+    int state = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ugui->test_note_toggle));
 
     GDB_MESSAGE(GDB_GUI, " on_test_note_toggle_toggled: state is now %s\n",
                 state ? "active" : "inactive");
 
     if (state) {  /* button pressed */
 
-        if (test_note_noteoff_key < 0) {
-            send_midi(0x90, test_note_noteon_key, test_note_velocity);
-            test_note_noteoff_key = test_note_noteon_key;
+        if (ugui->test_note_noteoff_key < 0) {
+            send_midi(ugui, 0x90, ugui->test_note_noteon_key, ugui->test_note_velocity);
+            ugui->test_note_noteoff_key = ugui->test_note_noteon_key;
         }
 
     } else { /* button released */
 
-        release_test_note();
+        release_test_note(ugui);
 
     }
 }
@@ -396,29 +538,39 @@ on_test_note_toggle_toggled(GtkWidget *widget, gpointer data)
 void
 on_port_button_toggled( GtkWidget *widget, gpointer data )
 {
+    ugui_t *ugui = UGUI_OF(widget);
     int port = (intptr_t)data;
     int state = GTK_TOGGLE_BUTTON (widget)->active;
 
     GDB_MESSAGE(GDB_GUI, " on_port_button_toggled: port %d changed to %s\n",
                 port, (state ? "on" : "off"));
 
-    lo_send(osc_host_address, osc_control_path, "if", port, (state ? 1.0f : 0.0f));
+    ugui->port_data[port].value = (state ? 1.0f : 0.0f);
+    ugui->port_data[port].have_value = 1;
+
+    lo_send(osc_host_address, ugui->osc_control_path, "if", port, (state ? 1.0f : 0.0f));
 }
 
 void
 on_port_spin_changed(GtkWidget *widget, gpointer data)
 {
+    ugui_t *ugui = UGUI_OF(widget);
     int port = (intptr_t)data;
     int value = lrintf(GTK_ADJUSTMENT(widget)->value);
 
     GDB_MESSAGE(GDB_GUI, " on_port_spin_changed: port %d changed to %d\n", port, value);
 
-    lo_send(osc_host_address, osc_control_path, "if", port, (float)value);
+    ugui->port_data[port].value = (float)value;
+    ugui->port_data[port].have_value = 1;
+
+    lo_send(osc_host_address, ugui->osc_control_path, "if", port, (float)value);
 }
 
 void
 on_port_knob_changed(GtkWidget *widget, gpointer data)
 {
+    ugui_t *ugui = UGUI_OF(widget);
+    port_data_t *port_data = ugui->port_data;
     int port = (intptr_t)data;
     float lval = GTK_ADJUSTMENT(widget)->value;
     float cval;
@@ -436,49 +588,81 @@ on_port_knob_changed(GtkWidget *widget, gpointer data)
 
     GDB_MESSAGE(GDB_GUI, " on_port_knob_changed: port %d changed to %f => %f\n", port, lval, cval);
 
-    lo_send(osc_host_address, osc_control_path, "if", port, cval);
+    port_data[port].value = cval;
+    port_data[port].have_value = 1;
+
+    lo_send(osc_host_address, ugui->osc_control_path, "if", port, cval);
+}
+
+void
+on_port_page_clicked(GtkWidget *widget, gpointer data)
+{
+    ugui_t *ugui = UGUI_OF(widget);
+    int page = ugui->port_page + (intptr_t)data;
+
+    if (page < 0 || page * PORTS_PER_PAGE >= ugui->port_view_count)
+        return;
+    ugui->port_page = page;
+    port_view_build_page(ugui);
 }
 
 void
-update_from_program_select(int bank, int program)
+on_port_filter_changed(GtkWidget *widget, gpointer data)
+{
+    ugui_t *ugui = UGUI_OF(widget);
+
+    port_view_filter(ugui);
+    ugui->port_page = 0;
+    port_view_build_page(ugui);
+}
+
+void
+update_from_program_select(ugui_t *ugui, int bank, int program)
 {
     /* -FIX- should be g_signal_handlers_block_by_func if we're GTK+ 2.x only */
-    gtk_signal_handler_block_by_func(GTK_OBJECT(bank_spin_adj),
+    gtk_signal_handler_block_by_func(GTK_OBJECT(ugui->bank_spin_adj),
                                      GTK_SIGNAL_FUNC(on_program_spin_changed),
                                      (gpointer)0);
-    gtk_signal_handler_block_by_func(GTK_OBJECT(program_spin_adj),
+    gtk_signal_handler_block_by_func(GTK_OBJECT(ugui->program_spin_adj),
                                      GTK_SIGNAL_FUNC(on_program_spin_changed),
                                      (gpointer)1);
 
-    GTK_ADJUSTMENT(bank_spin_adj)->value = (float)bank;
-    GTK_ADJUSTMENT(program_spin_adj)->value = (float)program;
-    gtk_signal_emit_by_name (GTK_OBJECT (bank_spin_adj), "value_changed");
-    gtk_signal_emit_by_name (GTK_OBJECT (program_spin_adj), "value_changed");
+    GTK_ADJUSTMENT(ugui->bank_spin_adj)->value = (float)bank;
+    GTK_ADJUSTMENT(ugui->program_spin_adj)->value = (float)program;
+    gtk_signal_emit_by_name (GTK_OBJECT (ugui->bank_spin_adj), "value_changed");
+    gtk_signal_emit_by_name (GTK_OBJECT (ugui->program_spin_adj), "value_changed");
 
-    gtk_signal_handler_unblock_by_func(GTK_OBJECT(bank_spin_adj),
+    gtk_signal_handler_unblock_by_func(GTK_OBJECT(ugui->bank_spin_adj),
                                        GTK_SIGNAL_FUNC(on_program_spin_changed),
                                        (gpointer)0);
-    gtk_signal_handler_unblock_by_func(GTK_OBJECT(program_spin_adj),
+    gtk_signal_handler_unblock_by_func(GTK_OBJECT(ugui->program_spin_adj),
                                        GTK_SIGNAL_FUNC(on_program_spin_changed),
                                        (gpointer)1);
 }
 
 void
-update_port_widget(int port, float value)
+update_port_widget(ugui_t *ugui, int port, float value)
 {
+    port_data_t *port_data = ugui->port_data;
     GtkAdjustment *adj;
     GtkWidget *widget;
     float bounded_value, fval;
     int ival;
-    float plb = port_data[port].LowerBound,
-          pub = port_data[port].UpperBound;
+    float plb, pub;
 
-    if (port < 0 || port > plugin_descriptor->LADSPA_Plugin->PortCount - 1 ||
+    if (port < 0 || port > ugui->descriptor->LADSPA_Plugin->PortCount - 1 ||
         port_data[port].type == PORT_AUDIO_OUTPUT ||
         port_data[port].type == PORT_AUDIO_INPUT) {
         return;
     }
 
+    port_data[port].value = value;
+    port_data[port].have_value = 1;
+    if (!port_data[port].widget)  /* not on the current page */
+        return;
+
+    plb = port_data[port].LowerBound;
+    pub = port_data[port].UpperBound;
     bounded_value = value;
     if (port_data[port].bounded) {
         if (bounded_value < plb)
@@ -491,7 +675,7 @@ update_port_widget(int port, float value)
 
       case PORT_CONTROL_INPUT_TOGGLED:
         ival = (value > 0.0001f ? 1 : 0);
-        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %d\n", plugin_descriptor->LADSPA_Plugin->PortNames[port], value, ival); */
+        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %d\n", ugui->descriptor->LADSPA_Plugin->PortNames[port], value, ival); */
         widget = port_data[port].widget;
         gtk_signal_handler_block_by_func(GTK_OBJECT(widget),
                                          GTK_SIGNAL_FUNC(on_port_button_toggled),
@@ -504,7 +688,7 @@ update_port_widget(int port, float value)
 
       case PORT_CONTROL_INPUT_INTEGER:
         ival = lrintf(bounded_value);
-        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %d\n", plugin_descriptor->LADSPA_Plugin->PortNames[port], value, ival); */
+        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %d\n", ugui->descriptor->LADSPA_Plugin->PortNames[port], value, ival); */
         adj = GTK_ADJUSTMENT(port_data[port].adjustment);
         adj->value = (float)ival;
         gtk_signal_handler_block_by_func(GTK_OBJECT(adj),
@@ -520,7 +704,7 @@ update_port_widget(int port, float value)
         fval = logf(plb);
         fval = (logf(bounded_value) - fval) / (logf(pub) - fval);
         fval = plb + fval * (pub - plb);
-        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %f\n", plugin_descriptor->LADSPA_Plugin->PortNames[port], value, fval); */
+        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %f\n", ugui->descriptor->LADSPA_Plugin->PortNames[port], value, fval); */
         adj = GTK_ADJUSTMENT(port_data[port].adjustment);
         adj->value = fval;
         gtk_signal_handler_block_by_func(GTK_OBJECT(adj),
@@ -533,7 +717,7 @@ update_port_widget(int port, float value)
         break;
 
       case PORT_CONTROL_INPUT_LINEAR:
-        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %f\n", plugin_descriptor->LADSPA_Plugin->PortNames[port], value, bounded_value); */
+        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f => %f\n", ugui->descriptor->LADSPA_Plugin->PortNames[port], value, bounded_value); */
         adj = GTK_ADJUSTMENT(port_data[port].adjustment);
         adj->value = bounded_value;
         gtk_signal_handler_block_by_func(GTK_OBJECT(adj),
@@ -546,7 +730,7 @@ update_port_widget(int port, float value)
         break;
 
       case PORT_CONTROL_OUTPUT:
-        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f\n", plugin_descriptor->LADSPA_Plugin->PortNames[port], value); */
+        /* GDB_MESSAGE(GDB_GUI, " update_port_widget: change of '%s' to %f\n", ugui->descriptor->LADSPA_Plugin->PortNames[port], value); */
         {
             char buf[16];
             snprintf(buf, 16, "%.6g", value);
@@ -560,14 +744,15 @@ update_port_widget(int port, float value)
 }
 
 void
-update_for_sample_rate(void)
+update_for_sample_rate(ugui_t *ugui)
 {
-    unsigned long portcount = plugin_descriptor->LADSPA_Plugin->PortCount;
+    port_data_t *port_data = ugui->port_data;
+    unsigned long portcount = ugui->descriptor->LADSPA_Plugin->PortCount;
     int port;
     LADSPA_PortRangeHintDescriptor prh;
     LADSPA_Data plb, pub;
 
-    GDB_MESSAGE(GDB_GUI, " update_for_sample_rate: new rate %ld\n", sample_rate);
+    GDB_MESSAGE(GDB_GUI, " update_for_sample_rate: new rate %ld\n", ugui->sample_rate);
 
     for (port = 0; port < portcount; port++) {
         if (!(port_data[port].by_sample_rate &&
@@ -576,30 +761,33 @@ update_for_sample_rate(void)
                port_data[port].type == PORT_CONTROL_INPUT_LINEAR)))
             continue;
 
-        prh = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].HintDescriptor;
+        prh = ugui->descriptor->LADSPA_Plugin->PortRangeHints[port].HintDescriptor;
 
         if (LADSPA_IS_HINT_BOUNDED_BELOW(prh) &&
             LADSPA_IS_HINT_BOUNDED_ABOVE(prh)) {
-            plb = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
-            pub = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
+            plb = ugui->descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
+            pub = ugui->descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
         } else if (LADSPA_IS_HINT_BOUNDED_BELOW(prh)) {
-            plb = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
+            plb = ugui->descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
             if (plb < 1.0f)
                 pub = 1.0f;
             else
                 pub = plb + 1.0f;
         } else { /* LADSPA_IS_HINT_BOUNDED_ABOVE(prh) */
-            pub = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
+            pub = ugui->descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
             if (pub > 0.0f)
                 plb = 0.0f;
             else
                 plb = pub - 1.0f;
         }
-        plb *= sample_rate;
-        pub *= sample_rate;
+        plb *= ugui->sample_rate;
+        pub *= ugui->sample_rate;
         port_data[port].LowerBound = plb;
         port_data[port].UpperBound = pub;
 
+        if (!port_data[port].widget)  /* not on the current page */
+            continue;
+
         /* block signals */
         if (port_data[port].type == PORT_CONTROL_INPUT_INTEGER)
             g_signal_handlers_block_by_func(G_OBJECT(port_data[port].adjustment),
@@ -646,11 +834,328 @@ update_for_sample_rate(void)
 
 /* ==== GTK+ widget creation ==== */
 
+/* Work out each port's type and bounds.  This is the model the port
+ * widgets are built from, and which '/control' updates go to whether or
+ * not the port currently has a widget. */
 void
-create_main_window (const char *tag, const char *soname, const char *label)
+init_port_data(ugui_t *ugui)
 {
-    GtkWidget *vbox4;
+    port_data_t *port_data = ugui->port_data;
+    const LADSPA_Descriptor *ldesc = ugui->descriptor->LADSPA_Plugin;
+    unsigned long portcount = ldesc->PortCount;
+    int port;
+    LADSPA_PortDescriptor pod;
+    LADSPA_PortRangeHintDescriptor prh;
+    LADSPA_Data plb, pub;
+
+    for (port = 0; port < portcount; port++) {
+
+        pod = ldesc->PortDescriptors[port];
+        prh = ldesc->PortRangeHints[port].HintDescriptor;
+        port_data[port].bounded = 0;
+        port_data[port].by_sample_rate = 0;
+        if (LADSPA_IS_HINT_BOUNDED_BELOW(prh) &&
+            LADSPA_IS_HINT_BOUNDED_ABOVE(prh)) {
+            plb = ldesc->PortRangeHints[port].LowerBound;
+            pub = ldesc->PortRangeHints[port].UpperBound;
+            port_data[port].bounded = 1;
+            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
+                port_data[port].by_sample_rate = 1;
+        } else if (LADSPA_IS_HINT_BOUNDED_BELOW(prh)) {
+            plb = ldesc->PortRangeHints[port].LowerBound;
+            pub = plb + 1.0f;
+            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
+                port_data[port].by_sample_rate = 1;
+        } else if (LADSPA_IS_HINT_BOUNDED_ABOVE(prh)) {
+            pub = ldesc->PortRangeHints[port].UpperBound;
+            plb = pub - 1.0f;
+            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
+                port_data[port].by_sample_rate = 1;
+        } else {
+            plb = 0.0f; pub = 1.0f;
+        }
+        port_data[port].LowerBound = plb;
+        port_data[port].UpperBound = pub;
+
+        if (LADSPA_IS_PORT_AUDIO(pod)) {
+            if (LADSPA_IS_PORT_INPUT(pod))
+                port_data[port].type = PORT_AUDIO_INPUT;
+            else
+                port_data[port].type = PORT_AUDIO_OUTPUT;
+        } else if (!LADSPA_IS_PORT_CONTROL(pod) ||
+                   !LADSPA_IS_PORT_INPUT(pod)) {  /* assume control output */
+            port_data[port].type = PORT_CONTROL_OUTPUT;
+        /* from here on should be control inputs */
+        } else if (LADSPA_IS_HINT_TOGGLED(prh)) {
+            port_data[port].type = PORT_CONTROL_INPUT_TOGGLED;
+        } else if (LADSPA_IS_HINT_INTEGER(prh)) {
+            /* -FIX- would be nice to implement LADSPA_HINT_SWITCHED */
+            port_data[port].type = PORT_CONTROL_INPUT_INTEGER;
+        } else if (LADSPA_IS_HINT_LOGARITHMIC(prh) && plb > 0.0f && pub > plb) {
+            port_data[port].type = PORT_CONTROL_INPUT_LOGARITHMIC;
+        } else {
+            port_data[port].type = PORT_CONTROL_INPUT_LINEAR;
+        }
+    }
+}
+
+/* Build the widgets for one port, at (x, y) in the page's table, and
+ * set them from the model. */
+void
+create_port_widget(ugui_t *ugui, int port, GtkWidget *table, int x, int y)
+{
+    port_data_t *port_data = ugui->port_data;
     char buf[256], *tmp;
+    int i, j;
+    GtkWidget *port_frame;
+    GtkWidget *port_table;
+    GtkWidget *port_label;
+    LADSPA_Data plb = port_data[port].LowerBound,
+                pub = port_data[port].UpperBound;
+    int rate_unknown = (port_data[port].by_sample_rate && !ugui->sample_rate);
+    GtkObject *adjustment;
+    GtkWidget *widget;
+
+    port_frame = gtk_frame_new (NULL);
+    gtk_widget_show (port_frame);
+    gtk_table_attach (GTK_TABLE (table), port_frame, x, x + 1, y, y + 1,
+                      (GtkAttachOptions) (GTK_FILL),
+                      (GtkAttachOptions) (GTK_FILL), 0, 0);
+
+    port_table = gtk_table_new (3, 3, FALSE);
+    gtk_widget_show (port_table);
+    gtk_container_set_border_width (GTK_CONTAINER (port_table), 4);
+    gtk_table_set_row_spacings (GTK_TABLE (port_table), 0);
+    gtk_table_set_col_spacings (GTK_TABLE (port_table), 0);
+    gtk_container_add (GTK_CONTAINER (port_frame), port_table);
+
+    tmp = (char *)ugui->descriptor->LADSPA_Plugin->PortNames[port];
+    if (strlen(tmp) <= 21) {
+        strcpy(buf, tmp);
+    } else {
+        for (i = 0, j = 0; i <= strlen(tmp) && j < 255; i++, j++) {
+            buf[j] = tmp[i];
+            if (tmp[i] == 0)
+                break;
+            if (i % 20 == 19)
+                buf[++j] = '\n';
+        }
+    }
+    port_label = gtk_label_new (buf);
+    gtk_widget_show (port_label);
+    gtk_misc_set_alignment (GTK_MISC (port_label), 0, 0.5);
+    gtk_misc_set_padding (GTK_MISC (port_label), 2, 2);
+    gtk_label_set_line_wrap (GTK_LABEL (port_label), TRUE);
+    gtk_table_attach (GTK_TABLE (port_table), port_label, 0, 3, 0, 1,
+                              (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
+                              (GtkAttachOptions) (0), 2, 2);
+
+    switch (port_data[port].type) {
+
+      case PORT_AUDIO_INPUT:
+      case PORT_AUDIO_OUTPUT:
+        if (port_data[port].type == PORT_AUDIO_INPUT)
+            widget = gtk_label_new ("(audio input)");
+        else
+            widget = gtk_label_new ("(audio output)");
+        port_data[port].widget = widget;
+        gtk_widget_show (widget);
+        gtk_misc_set_alignment (GTK_MISC (widget), 0.5, 0.5);
+        gtk_misc_set_padding (GTK_MISC (widget), 2, 2);
+        gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
+                                  (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
+                                  (GtkAttachOptions) (GTK_EXPAND | GTK_FILL), 5, 5);
+        break;
+
+      case PORT_CONTROL_OUTPUT:
+        widget = gtk_label_new ("?");
+        port_data[port].widget = widget;
+        gtk_widget_show (widget);
+        gtk_misc_set_alignment (GTK_MISC (widget), 0.5, 0.5);
+        gtk_misc_set_padding (GTK_MISC (widget), 2, 2);
+        gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
+                          (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
+                          (GtkAttachOptions) (GTK_EXPAND | GTK_FILL), 5, 5);
+        break;
+
+      case PORT_CONTROL_INPUT_TOGGLED:
+        widget = gtk_check_button_new ();
+        g_object_set_data (G_OBJECT (widget), "ugui", ugui);
+        port_data[port].widget = widget;
+        gtk_widget_show (widget);
+        gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
+                                  (GtkAttachOptions) (0),
+                                  (GtkAttachOptions) (0), 5, 5);
+        gtk_signal_connect (GTK_OBJECT (widget), "toggled",
+                    GTK_SIGNAL_FUNC (on_port_button_toggled),
+                    (gpointer)(intptr_t)port);
+        break;
+
+      case PORT_CONTROL_INPUT_INTEGER:
+        adjustment = gtk_adjustment_new (plb, plb, pub, 1, 1, 0);
+        g_object_set_data (G_OBJECT (adjustment), "ugui", ugui);
+        port_data[port].adjustment = adjustment;
+        widget = gtk_spin_button_new (GTK_ADJUSTMENT (adjustment), 1, 0);
+        port_data[port].widget = widget;
+        if (rate_unknown)
+            gtk_widget_set_sensitive (widget, FALSE);
+        gtk_widget_show (widget);
+        gtk_spin_button_set_numeric (GTK_SPIN_BUTTON (widget), TRUE);
+        gtk_spin_button_set_update_policy (GTK_SPIN_BUTTON (widget), GTK_UPDATE_IF_VALID);
+        gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (widget), TRUE);
+        gtk_spin_button_set_wrap (GTK_SPIN_BUTTON (widget), TRUE);
+        gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
+                                  (GtkAttachOptions) (0),
+                                  (GtkAttachOptions) (0), 5, 5);
+        gtk_signal_connect (GTK_OBJECT (adjustment), "value_changed",
+                            GTK_SIGNAL_FUNC (on_port_spin_changed),
+                            (gpointer)(intptr_t)port);
+        break;
+
+      default: /* continuous control input */
+        adjustment = gtk_adjustment_new (plb, plb, pub, (pub - plb) / 1000.0f, 1, 0);
+        g_object_set_data (G_OBJECT (adjustment), "ugui", ugui);
+        port_data[port].adjustment = adjustment;
+
+        widget = gtk_knob_new (GTK_ADJUSTMENT (adjustment));
+        port_data[port].widget = widget;
+        if (rate_unknown)
+            gtk_widget_set_sensitive (widget, FALSE);
+        gtk_widget_show (widget);
+        gtk_table_attach (GTK_TABLE (port_table), widget, 1, 2, 1, 2,
+                                  (GtkAttachOptions) (0),
+                                  (GtkAttachOptions) (0), 0, 0);
+        gtk_signal_connect (GTK_OBJECT (adjustment), "value_changed",
+                            GTK_SIGNAL_FUNC (on_port_knob_changed),
+                            (gpointer)(intptr_t)port);
+
+        if (port_data[port].bounded) {
+            GtkWidget *lb_label, *ub_label;
+
+            if (rate_unknown) {
+                sprintf(buf, "?");
+            } else {
+                sprintf(buf, "%.5g", plb);
+            }
+            lb_label = gtk_label_new (buf);
+            port_data[port].lower_label = lb_label;
+            gtk_widget_show (lb_label);
+            gtk_misc_set_alignment (GTK_MISC (lb_label), 1, 0.5);
+            gtk_misc_set_padding (GTK_MISC (lb_label), 1, 0);
+            gtk_table_attach (GTK_TABLE (port_table), lb_label, 0, 1, 2, 3,
+                              (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
+                              (GtkAttachOptions) (0), 0, 0);
+            if (rate_unknown) {
+                sprintf(buf, "?");
+            } else {
+                sprintf(buf, "%.5g", pub);
+            }
+            ub_label = gtk_label_new (buf);
+            port_data[port].upper_label = ub_label;
+            gtk_widget_show (ub_label);
+            gtk_misc_set_alignment (GTK_MISC (ub_label), 0, 0.5);
+            gtk_misc_set_padding (GTK_MISC (ub_label), 1, 0);
+            gtk_table_attach (GTK_TABLE (port_table), ub_label, 2, 3, 2, 3,
+                              (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
+                              (GtkAttachOptions) (0), 0, 0);
+        }
+        break;
+    }
+
+    if (port_data[port].have_value)
+        update_port_widget(ugui, port, port_data[port].value);
+}
+
+/* Find the ports whose names contain the filter text, ignoring case. */
+void
+port_view_filter(ugui_t *ugui)
+{
+    const LADSPA_Descriptor *ldesc = ugui->descriptor->LADSPA_Plugin;
+    const char *filter = "";
+    char *folded_filter, *folded_name;
+    int port;
+
+    if (!ugui->port_view)
+        ugui->port_view = (int *)malloc(ldesc->PortCount * sizeof(int));
+    if (ugui->port_filter_entry)
+        filter = gtk_entry_get_text(GTK_ENTRY(ugui->port_filter_entry));
+    folded_filter = g_utf8_casefold(filter, -1);
+
+    ugui->port_view_count = 0;
+    for (port = 0; port < ldesc->PortCount; port++) {
+        if (*folded_filter) {
+            folded_name = g_utf8_casefold(ldesc->PortNames[port], -1);
+            if (!strstr(folded_name, folded_filter)) {
+                g_free(folded_name);
+                continue;
+            }
+            g_free(folded_name);
+        }
+        ugui->port_view[ugui->port_view_count++] = port;
+    }
+    g_free(folded_filter);
+}
+
+/* Replace the port table with one holding the widgets for the current
+ * page of the port view.  The old page's widgets are destroyed, and the
+ * model forgets them, so updates for those ports just land in the
+ * model until the ports come into view again. */
+void
+port_view_build_page(ugui_t *ugui)
+{
+    port_data_t *port_data = ugui->port_data;
+    unsigned long portcount = ugui->descriptor->LADSPA_Plugin->PortCount;
+    int first = ugui->port_page * PORTS_PER_PAGE;
+    int count = ugui->port_view_count - first;
+    int i, port;
+    char buf[64];
+
+    if (ugui->port_table) {
+        for (port = 0; port < portcount; port++) {
+            port_data[port].adjustment = NULL;
+            port_data[port].widget = NULL;
+            port_data[port].lower_label = NULL;
+            port_data[port].upper_label = NULL;
+        }
+        gtk_widget_destroy(ugui->port_table);
+    }
+
+    if (count > PORTS_PER_PAGE)
+        count = PORTS_PER_PAGE;
+    else if (count < 0)
+        count = 0;
+
+    ugui->port_table = gtk_table_new (count > 5 ? (count + 4) / 5 : 1, 5, FALSE);
+    gtk_widget_show (ugui->port_table);
+    gtk_container_set_border_width (GTK_CONTAINER (ugui->port_table), 4);
+    gtk_table_set_col_spacings (GTK_TABLE (ugui->port_table), 2);
+    gtk_container_add (GTK_CONTAINER (ugui->port_container), ugui->port_table);
+
+    for (i = 0; i < count; i++)
+        create_port_widget(ugui, ugui->port_view[first + i], ugui->port_table,
+                           i % 5, i / 5);
+
+    if (GTK_IS_VIEWPORT(ugui->port_container))
+        gtk_adjustment_set_value(gtk_viewport_get_vadjustment(GTK_VIEWPORT(ugui->port_container)), 0.0);
+
+    if (ugui->port_page_label) {
+        if (count)
+            snprintf(buf, 64, "ports %d-%d of %d", first + 1, first + count,
+                     ugui->port_view_count);
+        else
+            snprintf(buf, 64, "no matching ports");
+        gtk_label_set_text(GTK_LABEL(ugui->port_page_label), buf);
+        gtk_widget_set_sensitive(ugui->port_prev_button, ugui->port_page > 0);
+        gtk_widget_set_sensitive(ugui->port_next_button,
+                                 first + count < ugui->port_view_count);
+    }
+}
+
+void
+create_main_window (ugui_t *ugui, const char *tag, const char *soname, const char *label)
+{
+    GtkWidget *vbox4;
+    char buf[256];
     GtkWidget *main_label;
     GtkWidget *separator;
     GtkWidget *program_hbox;
@@ -658,11 +1163,10 @@ create_main_window (const char *tag, const char *soname, const char *label)
     GtkWidget *bank_spin;
     GtkWidget *program_label;
     GtkWidget *program_spin;
-    unsigned long portcount = plugin_descriptor->LADSPA_Plugin->PortCount;
-    int port, x, y;
-    GtkWidget *table2;
+    unsigned long portcount = ugui->descriptor->LADSPA_Plugin->PortCount;
+    GtkWidget *port_view_hbox;
+    GtkWidget *filter_label;
     GtkWidget *scrolledwindow1;
-    GtkWidget *viewport1;
     GtkWidget *test_note_frame;
     GtkWidget *test_note_table;
     GtkWidget *test_note_label_key;
@@ -670,40 +1174,33 @@ create_main_window (const char *tag, const char *soname, const char *label)
     GtkWidget *test_note_key;
     GtkWidget *test_note_velocity;
     GtkWidget *test_note_mode_button;
-    GtkWidget *port_frame;
-    GtkWidget *port_table;
-    GtkWidget *port_label;
-    LADSPA_PortDescriptor pod;
-    LADSPA_PortRangeHintDescriptor prh;
-    LADSPA_Data plb, pub;
-    GtkObject *adjustment;
-    GtkWidget *widget;
 
-    main_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
-    gtk_object_set_data (GTK_OBJECT (main_window), "main_window", main_window);
-    gtk_window_set_title (GTK_WINDOW (main_window), tag);
+    ugui->main_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    gtk_object_set_data (GTK_OBJECT (ugui->main_window), "main_window", ugui->main_window);
+    gtk_window_set_title (GTK_WINDOW (ugui->main_window), tag);
 
     /* connect main window */
-    gtk_signal_connect(GTK_OBJECT(main_window), "destroy",
-                       GTK_SIGNAL_FUNC(gtk_main_quit), NULL);
-    gtk_signal_connect (GTK_OBJECT (main_window), "delete_event",
-                        (GtkSignalFunc)on_delete_event_wrapper,
-                        (gpointer)gtk_main_quit);
+    if (!shared)
+        gtk_signal_connect(GTK_OBJECT(ugui->main_window), "destroy",
+                           GTK_SIGNAL_FUNC(gtk_main_quit), NULL);
+    gtk_signal_connect (GTK_OBJECT (ugui->main_window), "delete_event",
+                        (GtkSignalFunc)on_main_window_delete_event,
+                        (gpointer)ugui);
 
     vbox4 = gtk_vbox_new (FALSE, 0);
     gtk_widget_ref (vbox4);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "vbox4", vbox4,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "vbox4", vbox4,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (vbox4);
-    gtk_container_add (GTK_CONTAINER (main_window), vbox4);
+    gtk_container_add (GTK_CONTAINER (ugui->main_window), vbox4);
 
-    if (plugin_is_DSSI_so)
+    if (ugui->so->is_DSSI_so)
         snprintf(buf, 256, "DSSI plugin %s:%s", soname, label);
     else
         snprintf(buf, 256, "LADSPA plugin %s:%s", soname, label);
     main_label = gtk_label_new (buf);
     gtk_widget_ref (main_label);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "main_label plugin", main_label,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "main_label plugin", main_label,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (main_label);
     gtk_box_pack_start (GTK_BOX (vbox4), main_label, FALSE, FALSE, 2);
@@ -711,10 +1208,10 @@ create_main_window (const char *tag, const char *soname, const char *label)
     gtk_misc_set_padding (GTK_MISC (main_label), 5, 0);
     /* gtk_label_set_line_wrap (GTK_LABEL (main_label), TRUE); */
     
-    snprintf(buf, 256, "Name: %s", plugin_descriptor->LADSPA_Plugin->Name);
+    snprintf(buf, 256, "Name: %s", ugui->descriptor->LADSPA_Plugin->Name);
     main_label = gtk_label_new (buf);
     gtk_widget_ref (main_label);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "main_label Name", main_label,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "main_label Name", main_label,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (main_label);
     gtk_box_pack_start (GTK_BOX (vbox4), main_label, FALSE, FALSE, 2);
@@ -722,10 +1219,10 @@ create_main_window (const char *tag, const char *soname, const char *label)
     gtk_misc_set_padding (GTK_MISC (main_label), 5, 0);
     gtk_label_set_line_wrap (GTK_LABEL (main_label), TRUE);
 
-    snprintf(buf, 256, "Maker: %s", plugin_descriptor->LADSPA_Plugin->Maker);
+    snprintf(buf, 256, "Maker: %s", ugui->descriptor->LADSPA_Plugin->Maker);
     main_label = gtk_label_new (buf);
     gtk_widget_ref (main_label);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "main_label Maker", main_label,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "main_label Maker", main_label,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (main_label);
     gtk_box_pack_start (GTK_BOX (vbox4), main_label, FALSE, FALSE, 2);
@@ -733,10 +1230,10 @@ create_main_window (const char *tag, const char *soname, const char *label)
     gtk_misc_set_padding (GTK_MISC (main_label), 5, 0);
     gtk_label_set_line_wrap (GTK_LABEL (main_label), TRUE);
 
-    snprintf(buf, 256, "Copyright: %s", plugin_descriptor->LADSPA_Plugin->Copyright);
+    snprintf(buf, 256, "Copyright: %s", ugui->descriptor->LADSPA_Plugin->Copyright);
     main_label = gtk_label_new (buf);
     gtk_widget_ref (main_label);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "main_label Copyright", main_label,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "main_label Copyright", main_label,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (main_label);
     gtk_box_pack_start (GTK_BOX (vbox4), main_label, FALSE, FALSE, 2);
@@ -745,34 +1242,35 @@ create_main_window (const char *tag, const char *soname, const char *label)
     gtk_label_set_line_wrap (GTK_LABEL (main_label), TRUE);
 
     /* program widgets */
-    if (plugin_descriptor->select_program) {
+    if (ugui->descriptor->select_program) {
 
         separator = gtk_hseparator_new ();
         gtk_widget_ref (separator);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "separator1", separator,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "separator1", separator,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (separator);
         gtk_box_pack_start (GTK_BOX (vbox4), separator, FALSE, FALSE, 2);
 
         program_hbox = gtk_hbox_new (FALSE, 10);
         gtk_widget_ref (program_hbox);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "program_hbox", program_hbox,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "program_hbox", program_hbox,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (program_hbox);
         gtk_box_pack_start (GTK_BOX (vbox4), program_hbox, FALSE, FALSE, 2);
 
         bank_label = gtk_label_new ("Bank:");
         gtk_widget_ref (bank_label);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "bank_label", bank_label,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "bank_label", bank_label,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (bank_label);
         gtk_box_pack_start (GTK_BOX (program_hbox), bank_label, FALSE, FALSE, 2);
         gtk_misc_set_alignment (GTK_MISC (bank_label), 0, 0.5);
 
-        bank_spin_adj = gtk_adjustment_new (0, 0, G_MAXLONG, 1, 1, 0);
-        bank_spin = gtk_spin_button_new (GTK_ADJUSTMENT (bank_spin_adj), 1, 0);
+        ugui->bank_spin_adj = gtk_adjustment_new (0, 0, G_MAXLONG, 1, 1, 0);
+        g_object_set_data (G_OBJECT (ugui->bank_spin_adj), "ugui", ugui);
+        bank_spin = gtk_spin_button_new (GTK_ADJUSTMENT (ugui->bank_spin_adj), 1, 0);
         gtk_widget_ref (bank_spin);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "bank_spin", bank_spin,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "bank_spin", bank_spin,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (bank_spin);
         gtk_box_pack_start (GTK_BOX (program_hbox), bank_spin, FALSE, FALSE, 0);
@@ -780,22 +1278,23 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_spin_button_set_update_policy (GTK_SPIN_BUTTON (bank_spin), GTK_UPDATE_IF_VALID);
         gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (bank_spin), TRUE);
         gtk_spin_button_set_wrap (GTK_SPIN_BUTTON (bank_spin), TRUE);
-        gtk_signal_connect (GTK_OBJECT (bank_spin_adj), "value_changed",
+        gtk_signal_connect (GTK_OBJECT (ugui->bank_spin_adj), "value_changed",
                             GTK_SIGNAL_FUNC (on_program_spin_changed),
                             (gpointer)0);
 
         program_label = gtk_label_new ("Program:");
         gtk_widget_ref (program_label);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "program_label", program_label,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "program_label", program_label,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (program_label);
         gtk_box_pack_start (GTK_BOX (program_hbox), program_label, FALSE, FALSE, 2);
         gtk_misc_set_alignment (GTK_MISC (program_label), 0, 0.5);
 
-        program_spin_adj = gtk_adjustment_new (0, 0, G_MAXLONG, 1, 1, 0);
-        program_spin = gtk_spin_button_new (GTK_ADJUSTMENT (program_spin_adj), 1, 0);
+        ugui->program_spin_adj = gtk_adjustment_new (0, 0, G_MAXLONG, 1, 1, 0);
+        g_object_set_data (G_OBJECT (ugui->program_spin_adj), "ugui", ugui);
+        program_spin = gtk_spin_button_new (GTK_ADJUSTMENT (ugui->program_spin_adj), 1, 0);
         gtk_widget_ref (program_spin);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "program_spin", program_spin,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "program_spin", program_spin,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (program_spin);
         gtk_box_pack_start (GTK_BOX (program_hbox), program_spin, FALSE, FALSE, 0);
@@ -803,33 +1302,87 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_spin_button_set_update_policy (GTK_SPIN_BUTTON (program_spin), GTK_UPDATE_IF_VALID);
         gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (program_spin), TRUE);
         gtk_spin_button_set_wrap (GTK_SPIN_BUTTON (program_spin), TRUE);
-        gtk_signal_connect (GTK_OBJECT (program_spin_adj), "value_changed",
+        gtk_signal_connect (GTK_OBJECT (ugui->program_spin_adj), "value_changed",
                             GTK_SIGNAL_FUNC (on_program_spin_changed),
                             (gpointer)1);
     }
 
-    /* port widget table and scrolledwindow */
+    /* port widget view: filter and page controls, and the scrolledwindow */
     separator = gtk_hseparator_new ();
     gtk_widget_ref (separator);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "separator2", separator,
+    gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "separator2", separator,
                               (GtkDestroyNotify) gtk_widget_unref);
     gtk_widget_show (separator);
     gtk_box_pack_start (GTK_BOX (vbox4), separator, FALSE, FALSE, 2);
 
-    table2 = gtk_table_new (5, (portcount + 4) / 5, FALSE);
-    gtk_widget_ref (table2);
-    gtk_object_set_data_full (GTK_OBJECT (main_window), "table2", table2,
-                              (GtkDestroyNotify) gtk_widget_unref);
-    gtk_widget_show (table2);
-    gtk_container_set_border_width (GTK_CONTAINER (table2), 4);
-    gtk_table_set_col_spacings (GTK_TABLE (table2), 2);
+    if (portcount > PORTS_PER_PAGE) {
+        port_view_hbox = gtk_hbox_new (FALSE, 5);
+        gtk_widget_ref (port_view_hbox);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_view_hbox", port_view_hbox,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (port_view_hbox);
+        gtk_container_set_border_width (GTK_CONTAINER (port_view_hbox), 2);
+        gtk_box_pack_start (GTK_BOX (vbox4), port_view_hbox, FALSE, FALSE, 2);
+
+        filter_label = gtk_label_new ("Filter:");
+        gtk_widget_ref (filter_label);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "filter_label", filter_label,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (filter_label);
+        gtk_box_pack_start (GTK_BOX (port_view_hbox), filter_label, FALSE, FALSE, 2);
+
+        ugui->port_filter_entry = gtk_entry_new ();
+        g_object_set_data (G_OBJECT (ugui->port_filter_entry), "ugui", ugui);
+        gtk_widget_ref (ugui->port_filter_entry);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_filter_entry", ugui->port_filter_entry,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (ugui->port_filter_entry);
+        gtk_box_pack_start (GTK_BOX (port_view_hbox), ugui->port_filter_entry, TRUE, TRUE, 0);
+        gtk_signal_connect (GTK_OBJECT (ugui->port_filter_entry), "changed",
+                            GTK_SIGNAL_FUNC (on_port_filter_changed),
+                            NULL);
+
+        ugui->port_next_button = gtk_button_new_with_label (">");
+        g_object_set_data (G_OBJECT (ugui->port_next_button), "ugui", ugui);
+        gtk_widget_ref (ugui->port_next_button);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_next_button", ugui->port_next_button,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (ugui->port_next_button);
+        gtk_box_pack_end (GTK_BOX (port_view_hbox), ugui->port_next_button, FALSE, FALSE, 0);
+        gtk_signal_connect (GTK_OBJECT (ugui->port_next_button), "clicked",
+                            GTK_SIGNAL_FUNC (on_port_page_clicked),
+                            (gpointer)1);
+
+        ugui->port_page_label = gtk_label_new ("");
+        gtk_widget_ref (ugui->port_page_label);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_page_label", ugui->port_page_label,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (ugui->port_page_label);
+        gtk_box_pack_end (GTK_BOX (port_view_hbox), ugui->port_page_label, FALSE, FALSE, 2);
+
+        ugui->port_prev_button = gtk_button_new_with_label ("<");
+        g_object_set_data (G_OBJECT (ugui->port_prev_button), "ugui", ugui);
+        gtk_widget_ref (ugui->port_prev_button);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_prev_button", ugui->port_prev_button,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (ugui->port_prev_button);
+        gtk_box_pack_end (GTK_BOX (port_view_hbox), ugui->port_prev_button, FALSE, FALSE, 0);
+        gtk_signal_connect (GTK_OBJECT (ugui->port_prev_button), "clicked",
+                            GTK_SIGNAL_FUNC (on_port_page_clicked),
+                            (gpointer)-1);
+    }
 
     if (portcount < 21) {
-        gtk_box_pack_start (GTK_BOX (vbox4), table2, TRUE, TRUE, 0);
+        ugui->port_container = gtk_vbox_new (FALSE, 0);
+        gtk_widget_ref (ugui->port_container);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "port_container", ugui->port_container,
+                                  (GtkDestroyNotify) gtk_widget_unref);
+        gtk_widget_show (ugui->port_container);
+        gtk_box_pack_start (GTK_BOX (vbox4), ugui->port_container, TRUE, TRUE, 0);
     } else {
         scrolledwindow1 = gtk_scrolled_window_new (NULL, NULL);
         gtk_widget_ref (scrolledwindow1);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "scrolledwindow1", scrolledwindow1,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "scrolledwindow1", scrolledwindow1,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (scrolledwindow1);
         gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolledwindow1), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
@@ -838,32 +1391,30 @@ create_main_window (const char *tag, const char *soname, const char *label)
 
         gtk_widget_set_size_request(GTK_WIDGET(scrolledwindow1), -1, 300);
 
-        viewport1 = gtk_viewport_new (NULL, NULL);
-        gtk_widget_ref (viewport1);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "viewport1", viewport1,
+        ugui->port_container = gtk_viewport_new (NULL, NULL);
+        gtk_widget_ref (ugui->port_container);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "viewport1", ugui->port_container,
                                   (GtkDestroyNotify) gtk_widget_unref);
-        gtk_widget_show (viewport1);
-        gtk_container_add (GTK_CONTAINER (scrolledwindow1), viewport1);
-
-        gtk_container_add (GTK_CONTAINER (viewport1), table2);
+        gtk_widget_show (ugui->port_container);
+        gtk_container_add (GTK_CONTAINER (scrolledwindow1), ugui->port_container);
     }
 
     /* test note widgets */
-    if (plugin_descriptor->run_synth ||
-        plugin_descriptor->run_synth_adding ||
-        plugin_descriptor->run_multiple_synths ||
-        plugin_descriptor->run_multiple_synths_adding) {
+    if (ugui->descriptor->run_synth ||
+        ugui->descriptor->run_synth_adding ||
+        ugui->descriptor->run_multiple_synths ||
+        ugui->descriptor->run_multiple_synths_adding) {
 
         separator = gtk_hseparator_new ();
         gtk_widget_ref (separator);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "separator3", separator,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "separator3", separator,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (separator);
         gtk_box_pack_start (GTK_BOX (vbox4), separator, FALSE, FALSE, 2);
 
         test_note_frame = gtk_frame_new ("Test Note");
         gtk_widget_ref (test_note_frame);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_frame", test_note_frame,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_frame", test_note_frame,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (test_note_frame);
         gtk_container_set_border_width (GTK_CONTAINER (test_note_frame), 5);
@@ -877,7 +1428,7 @@ create_main_window (const char *tag, const char *soname, const char *label)
 
         test_note_label_key = gtk_label_new ("key");
         gtk_widget_ref (test_note_label_key);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_label_key", test_note_label_key,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_label_key", test_note_label_key,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (test_note_label_key);
         gtk_table_attach (GTK_TABLE (test_note_table), test_note_label_key, 0, 1, 0, 1,
@@ -887,7 +1438,7 @@ create_main_window (const char *tag, const char *soname, const char *label)
 
         test_note_label_velocity = gtk_label_new ("velocity");
         gtk_widget_ref (test_note_label_velocity);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_label_velocity", test_note_label_velocity,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_label_velocity", test_note_label_velocity,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (test_note_label_velocity);
         gtk_table_attach (GTK_TABLE (test_note_table), test_note_label_velocity, 0, 1, 1, 2,
@@ -896,6 +1447,7 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_misc_set_alignment (GTK_MISC (test_note_label_velocity), 0, 0.5);
 
         test_note_mode_button = gtk_check_button_new ();
+        g_object_set_data (G_OBJECT (test_note_mode_button), "ugui", ugui);
         gtk_widget_show (test_note_mode_button);
         gtk_table_attach (GTK_TABLE (test_note_table), test_note_mode_button, 2, 3, 0, 2,
                           (GtkAttachOptions) (0),
@@ -904,33 +1456,35 @@ create_main_window (const char *tag, const char *soname, const char *label)
                             GTK_SIGNAL_FUNC (on_test_note_mode_toggled),
                             NULL);
 
-        test_note_button = gtk_button_new_with_label ("Send Test Note");
-        gtk_widget_ref (test_note_button);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_button", test_note_button,
+        ugui->test_note_button = gtk_button_new_with_label ("Send Test Note");
+        g_object_set_data (G_OBJECT (ugui->test_note_button), "ugui", ugui);
+        gtk_widget_ref (ugui->test_note_button);
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_button", ugui->test_note_button,
                                   (GtkDestroyNotify) gtk_widget_unref);
-        gtk_widget_show (test_note_button);
-        gtk_table_attach (GTK_TABLE (test_note_table), test_note_button, 3, 4, 0, 2,
+        gtk_widget_show (ugui->test_note_button);
+        gtk_table_attach (GTK_TABLE (test_note_table), ugui->test_note_button, 3, 4, 0, 2,
                           (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
                           (GtkAttachOptions) (0), 4, 0);
-        gtk_signal_connect (GTK_OBJECT (test_note_button), "pressed",
+        gtk_signal_connect (GTK_OBJECT (ugui->test_note_button), "pressed",
                             GTK_SIGNAL_FUNC (on_test_note_button_press),
                             (gpointer)1);
-        gtk_signal_connect (GTK_OBJECT (test_note_button), "released",
+        gtk_signal_connect (GTK_OBJECT (ugui->test_note_button), "released",
                             GTK_SIGNAL_FUNC (on_test_note_button_press),
                             (gpointer)0);
 
-        test_note_toggle = gtk_toggle_button_new_with_label ("Toggle Test Note");
-        /* gtk_widget_show (test_note_toggle);  -- initially hidden */
-        gtk_table_attach (GTK_TABLE (test_note_table), test_note_toggle, 3, 4, 0, 2,
+        ugui->test_note_toggle = gtk_toggle_button_new_with_label ("Toggle Test Note");
+        g_object_set_data (G_OBJECT (ugui->test_note_toggle), "ugui", ugui);
+        /* gtk_widget_show (ugui->test_note_toggle);  -- initially hidden */
+        gtk_table_attach (GTK_TABLE (test_note_table), ugui->test_note_toggle, 3, 4, 0, 2,
                           (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
                           (GtkAttachOptions) (0), 4, 0);
-        gtk_signal_connect (GTK_OBJECT (test_note_toggle), "toggled",
+        gtk_signal_connect (GTK_OBJECT (ugui->test_note_toggle), "toggled",
                             GTK_SIGNAL_FUNC (on_test_note_toggle_toggled),
                             NULL);
 
         test_note_key = gtk_hscale_new (GTK_ADJUSTMENT (gtk_adjustment_new (60, 12, 120, 1, 12, 12)));
         gtk_widget_ref (test_note_key);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_key", test_note_key,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_key", test_note_key,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (test_note_key);
         gtk_table_attach (GTK_TABLE (test_note_table), test_note_key, 1, 2, 0, 1,
@@ -939,13 +1493,14 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_scale_set_value_pos (GTK_SCALE (test_note_key), GTK_POS_RIGHT);
         gtk_scale_set_digits (GTK_SCALE (test_note_key), 0);
         gtk_range_set_update_policy (GTK_RANGE (test_note_key), GTK_UPDATE_DELAYED);
+        g_object_set_data (G_OBJECT (gtk_range_get_adjustment (GTK_RANGE (test_note_key))), "ugui", ugui);
         gtk_signal_connect (GTK_OBJECT (gtk_range_get_adjustment (GTK_RANGE (test_note_key))),
                             "value_changed", GTK_SIGNAL_FUNC(on_test_note_slider_change),
                             (gpointer)0);
 
         test_note_velocity = gtk_hscale_new (GTK_ADJUSTMENT (gtk_adjustment_new (96, 1, 137, 1, 10, 10)));
         gtk_widget_ref (test_note_velocity);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "test_note_velocity", test_note_velocity,
+        gtk_object_set_data_full (GTK_OBJECT (ugui->main_window), "test_note_velocity", test_note_velocity,
                                   (GtkDestroyNotify) gtk_widget_unref);
         gtk_widget_show (test_note_velocity);
         gtk_table_attach (GTK_TABLE (test_note_table), test_note_velocity, 1, 2, 1, 2,
@@ -954,6 +1509,7 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_scale_set_value_pos (GTK_SCALE (test_note_velocity), GTK_POS_RIGHT);
         gtk_scale_set_digits (GTK_SCALE (test_note_velocity), 0);
         gtk_range_set_update_policy (GTK_RANGE (test_note_velocity), GTK_UPDATE_DELAYED);
+        g_object_set_data (G_OBJECT (gtk_range_get_adjustment (GTK_RANGE (test_note_velocity))), "ugui", ugui);
         gtk_signal_connect (GTK_OBJECT (gtk_range_get_adjustment (GTK_RANGE (test_note_velocity))),
                             "value_changed", GTK_SIGNAL_FUNC(on_test_note_slider_change),
                             (gpointer)1);
@@ -961,233 +1517,16 @@ create_main_window (const char *tag, const char *soname, const char *label)
         gtk_box_pack_start (GTK_BOX (vbox4), test_note_frame, FALSE, FALSE, 0);
     }
 
-    /* port widgets */
-    port_data = (port_data_t *)calloc(portcount, sizeof(port_data_t));
-
-    for (port = 0; port < portcount; port++) {
-        port_frame = gtk_frame_new (NULL);
-        gtk_widget_ref (port_frame);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "port_frame", port_frame,
-                                  (GtkDestroyNotify) gtk_widget_unref);
-        gtk_widget_show (port_frame);
-        x = port % 5;
-        y = port / 5;
-        gtk_table_attach (GTK_TABLE (table2), port_frame, x, x + 1, y, y + 1,
-                          (GtkAttachOptions) (GTK_FILL),
-                          (GtkAttachOptions) (GTK_FILL), 0, 0);
-
-        port_table = gtk_table_new (3, 3, FALSE);
-        gtk_widget_ref (port_table);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "port_table", port_table,
-                                  (GtkDestroyNotify) gtk_widget_unref);
-        gtk_widget_show (port_table);
-        gtk_container_set_border_width (GTK_CONTAINER (port_table), 4);
-        gtk_table_set_row_spacings (GTK_TABLE (port_table), 0);
-        gtk_table_set_col_spacings (GTK_TABLE (port_table), 0);
-        gtk_container_add (GTK_CONTAINER (port_frame), port_table);
-
-        tmp = (char *)plugin_descriptor->LADSPA_Plugin->PortNames[port];
-        if (strlen(tmp) <= 21) {
-            strcpy(buf, tmp);
-        } else {
-            for (x = 0, y = 0; x <= strlen(tmp) && y < 255; x++, y++) {
-                buf[y] = tmp[x];
-                if (tmp[x] == 0)
-                    break;
-                if (x % 20 == 19)
-                    buf[++y] = '\n';
-            }
-        }
-        port_label = gtk_label_new (buf);
-        gtk_widget_ref (port_label);
-        gtk_object_set_data_full (GTK_OBJECT (main_window), "port_label", port_label,
-                                  (GtkDestroyNotify) gtk_widget_unref);
-        gtk_widget_show (port_label);
-        gtk_misc_set_alignment (GTK_MISC (port_label), 0, 0.5);
-        gtk_misc_set_padding (GTK_MISC (port_label), 2, 2);
-        gtk_label_set_line_wrap (GTK_LABEL (port_label), TRUE);
-        gtk_table_attach (GTK_TABLE (port_table), port_label, 0, 3, 0, 1,
-                                  (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
-                                  (GtkAttachOptions) (0), 2, 2);
-
-        pod = plugin_descriptor->LADSPA_Plugin->PortDescriptors[port];
-        prh = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].HintDescriptor;
-        port_data[port].bounded = 0;
-        port_data[port].by_sample_rate = 0;
-        if (LADSPA_IS_HINT_BOUNDED_BELOW(prh) &&
-            LADSPA_IS_HINT_BOUNDED_ABOVE(prh)) {
-            plb = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
-            pub = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
-            port_data[port].bounded = 1;
-            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
-                port_data[port].by_sample_rate = 1;
-        } else if (LADSPA_IS_HINT_BOUNDED_BELOW(prh)) {
-            plb = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].LowerBound;
-            pub = plb + 1.0f;
-            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
-                port_data[port].by_sample_rate = 1;
-        } else if (LADSPA_IS_HINT_BOUNDED_ABOVE(prh)) {
-            pub = plugin_descriptor->LADSPA_Plugin->PortRangeHints[port].UpperBound;
-            plb = pub - 1.0f;
-            if (LADSPA_IS_HINT_SAMPLE_RATE(prh))
-                port_data[port].by_sample_rate = 1;
-        } else {
-            plb = 0.0f; pub = 1.0f;
-        }
-        port_data[port].LowerBound = plb;
-        port_data[port].UpperBound = pub;
-
-        if (LADSPA_IS_PORT_AUDIO(pod)) {
-
-            if (LADSPA_IS_PORT_INPUT(pod)) {
-                port_data[port].type = PORT_AUDIO_INPUT;
-
-                widget = gtk_label_new ("(audio input)");
-            } else {
-                port_data[port].type = PORT_AUDIO_OUTPUT;
-
-                widget = gtk_label_new ("(audio output)");
-            }
-            port_data[port].widget = widget;
-            gtk_widget_ref (widget);
-            gtk_object_set_data_full (GTK_OBJECT (main_window), "audio label", widget,
-                                      (GtkDestroyNotify) gtk_widget_unref);
-            gtk_widget_show (widget);
-            gtk_misc_set_alignment (GTK_MISC (widget), 0.5, 0.5);
-            gtk_misc_set_padding (GTK_MISC (widget), 2, 2);
-            gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
-                                      (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
-                                      (GtkAttachOptions) (GTK_EXPAND | GTK_FILL), 5, 5);
-
-        } else if (!LADSPA_IS_PORT_CONTROL(pod) ||
-                   !LADSPA_IS_PORT_INPUT(pod)) {  /* assume control output */
-
-            port_data[port].type = PORT_CONTROL_OUTPUT;
-
-            widget = gtk_label_new ("?");
-            port_data[port].widget = widget;
-            gtk_widget_ref (widget);
-            gtk_object_set_data_full (GTK_OBJECT (main_window), "ctlout label", widget,
-                                      (GtkDestroyNotify) gtk_widget_unref);
-            gtk_widget_show (widget);
-            gtk_misc_set_alignment (GTK_MISC (widget), 0.5, 0.5);
-            gtk_misc_set_padding (GTK_MISC (widget), 2, 2);
-            gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
-                              (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
-                              (GtkAttachOptions) (GTK_EXPAND | GTK_FILL), 5, 5);
-
-        /* from here on should be control inputs */
-
-        } else if (LADSPA_IS_HINT_TOGGLED(prh)) {
-
-            port_data[port].type = PORT_CONTROL_INPUT_TOGGLED;
-
-            widget = gtk_check_button_new ();
-            port_data[port].widget = widget;
-            gtk_widget_ref (widget);
-            gtk_object_set_data_full (GTK_OBJECT (main_window), "port toggle", widget,
-                                      (GtkDestroyNotify) gtk_widget_unref);
-            gtk_widget_show (widget);
-            gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
-                                      (GtkAttachOptions) (0),
-                                      (GtkAttachOptions) (0), 5, 5);
-            gtk_signal_connect (GTK_OBJECT (widget), "toggled",
-                        GTK_SIGNAL_FUNC (on_port_button_toggled),
-                        (gpointer)(intptr_t)port);
-
-        } else if (LADSPA_IS_HINT_INTEGER(prh)) {
-            /* -FIX- would be nice to implement LADSPA_HINT_SWITCHED */
-
-            port_data[port].type = PORT_CONTROL_INPUT_INTEGER;
-
-            adjustment = gtk_adjustment_new (plb, plb, pub, 1, 1, 0);
-            port_data[port].adjustment = adjustment;
-            widget = gtk_spin_button_new (GTK_ADJUSTMENT (adjustment), 1, 0);
-            port_data[port].widget = widget;
-            gtk_widget_ref (widget);
-            gtk_object_set_data_full (GTK_OBJECT (main_window), "port spin", widget,
-                                      (GtkDestroyNotify) gtk_widget_unref);
-            if (port_data[port].by_sample_rate)
-                gtk_widget_set_sensitive (widget, FALSE);
-            gtk_widget_show (widget);
-            gtk_spin_button_set_numeric (GTK_SPIN_BUTTON (widget), TRUE);
-            gtk_spin_button_set_update_policy (GTK_SPIN_BUTTON (widget), GTK_UPDATE_IF_VALID);
-            gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (widget), TRUE);
-            gtk_spin_button_set_wrap (GTK_SPIN_BUTTON (widget), TRUE);
-            gtk_table_attach (GTK_TABLE (port_table), widget, 0, 3, 1, 3,
-                                      (GtkAttachOptions) (0),
-                                      (GtkAttachOptions) (0), 5, 5);
-            gtk_signal_connect (GTK_OBJECT (adjustment), "value_changed",
-                                GTK_SIGNAL_FUNC (on_port_spin_changed),
-                                (gpointer)(intptr_t)port);
-
-        } else { /* continuous control input */
-
-            if (LADSPA_IS_HINT_LOGARITHMIC(prh) && plb > 0.0f && pub > plb)
-                port_data[port].type = PORT_CONTROL_INPUT_LOGARITHMIC;
-            else
-                port_data[port].type = PORT_CONTROL_INPUT_LINEAR;
-
-            adjustment = gtk_adjustment_new (plb, plb, pub, (pub - plb) / 1000.0f, 1, 0);
-            port_data[port].adjustment = adjustment;
-
-            widget = gtk_knob_new (GTK_ADJUSTMENT (adjustment));
-            port_data[port].widget = widget;
-            gtk_widget_ref (widget);
-            gtk_object_set_data_full (GTK_OBJECT (main_window), "port knob", widget,
-                                      (GtkDestroyNotify) gtk_widget_unref);
-            if (port_data[port].by_sample_rate)
-                gtk_widget_set_sensitive (widget, FALSE);
-            gtk_widget_show (widget);
-            gtk_table_attach (GTK_TABLE (port_table), widget, 1, 2, 1, 2,
-                                      (GtkAttachOptions) (0),
-                                      (GtkAttachOptions) (0), 0, 0);
-            gtk_signal_connect (GTK_OBJECT (adjustment), "value_changed",
-                                GTK_SIGNAL_FUNC (on_port_knob_changed),
-                                (gpointer)(intptr_t)port);
-
-            if (port_data[port].bounded) {
-                GtkWidget *lb_label, *ub_label;
-
-                if (port_data[port].by_sample_rate) {
-                    sprintf(buf, "?");
-                } else {
-                    sprintf(buf, "%.5g", plb);
-                }
-                lb_label = gtk_label_new (buf);
-                port_data[port].lower_label = lb_label;
-                gtk_widget_ref (lb_label);
-                gtk_object_set_data_full (GTK_OBJECT (main_window), "port lb_label", lb_label,
-                                          (GtkDestroyNotify) gtk_widget_unref);
-                gtk_widget_show (lb_label);
-                gtk_misc_set_alignment (GTK_MISC (lb_label), 1, 0.5);
-                gtk_misc_set_padding (GTK_MISC (lb_label), 1, 0);
-                gtk_table_attach (GTK_TABLE (port_table), lb_label, 0, 1, 2, 3,
-                                  (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
-                                  (GtkAttachOptions) (0), 0, 0);
-                if (port_data[port].by_sample_rate) {
-                    sprintf(buf, "?");
-                } else {
-                    sprintf(buf, "%.5g", pub);
-                }
-                ub_label = gtk_label_new (buf);
-                port_data[port].upper_label = ub_label;
-                gtk_widget_ref (ub_label);
-                gtk_object_set_data_full (GTK_OBJECT (main_window), "port ub_label", ub_label,
-                                          (GtkDestroyNotify) gtk_widget_unref);
-                gtk_widget_show (ub_label);
-                gtk_misc_set_alignment (GTK_MISC (ub_label), 0, 0.5);
-                gtk_misc_set_padding (GTK_MISC (ub_label), 1, 0);
-                gtk_table_attach (GTK_TABLE (port_table), ub_label, 2, 3, 2, 3,
-                                  (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
-                                  (GtkAttachOptions) (0), 0, 0);
-            }
-        }
-    }
+    /* port widgets, for the first page of ports */
+    ugui->port_data = (port_data_t *)calloc(portcount, sizeof(port_data_t));
+    ugui->dirty_ports = (int *)malloc(portcount * sizeof(int));
+    init_port_data(ugui);
+    port_view_filter(ugui);
+    port_view_build_page(ugui);
 }
 
 void
-create_windows(const char *instance_tag, const char *soname, const char *label)
+create_windows(ugui_t *ugui, const char *instance_tag, const char *soname, const char *label)
 {
     char tag[60];
 
@@ -1202,21 +1541,22 @@ create_windows(const char *instance_tag, const char *soname, const char *label)
         }
     }
 
-    create_main_window(tag, soname, label);
+    create_main_window(ugui, tag, soname, label);
 }
 
 /* ==== DSSI/LADSPA plugin handling ==== */
 
-int
-load_so(char *ui_path, char *soname, char *label)
+/* Load a plugin library, or find it already loaded for another window. */
+plugin_so_t *
+load_so(const char *ui_path, const char *soname, const char *label)
 {
+    plugin_so_t *so;
+    char *plugin_path;
     const char *message;
     int i;
 
-    plugin_dlh = NULL;
-
     if (g_path_is_absolute(soname)) {
-        plugin_path = soname;
+        plugin_path = g_strdup(soname);
     } else {  /* build .so path from ui path */
         char *uidir = g_path_get_dirname(ui_path);
         char *sodir = g_path_get_dirname(uidir);
@@ -1225,67 +1565,281 @@ load_so(char *ui_path, char *soname, char *label)
         g_free(uidir);
     }
 
-    if ((plugin_dlh = dlopen(plugin_path, RTLD_LAZY)) == NULL) {
+    for (so = plugin_sos; so; so = so->next) {
+        if (!strcmp(so->path, plugin_path) && !strcmp(so->label, label)) {
+            so->references++;
+            g_free(plugin_path);
+            return so;
+        }
+    }
+
+    so = (plugin_so_t *)calloc(1, sizeof(plugin_so_t));
+    so->path = plugin_path;
+    so->label = strdup(label);
+
+    if ((so->dlh = dlopen(plugin_path, RTLD_LAZY)) == NULL) {
         message = dlerror();
         if (message) {
             GDB_MESSAGE(GDB_PLUGIN, ": dlopen of '%s' failed: %s\n", soname, message);
         } else {
             GDB_MESSAGE(GDB_PLUGIN, ": dlopen of '%s' failed\n", soname);
         }
-        return 0;
+        goto fail;
     }
 
     GDB_MESSAGE(GDB_PLUGIN, ": '%s' found at '%s'\n", soname, plugin_path);
 
-    plugin_descfn = (DSSI_Descriptor_Function)dlsym(plugin_dlh,
-                                                    "dssi_descriptor");
-    if (plugin_descfn) {
-        plugin_is_DSSI_so = 1;
-    } else {
-        plugin_descfn = (DSSI_Descriptor_Function)dlsym(plugin_dlh,
-                                                        "ladspa_descriptor");
-        if (!plugin_descfn) {
-            GDB_MESSAGE(GDB_PLUGIN, ": %s is not a DSSI or LADSPA plugin library\n", soname);
-            return 0;
+    {
+        DSSI_Descriptor_Function descfn;
+
+        descfn = (DSSI_Descriptor_Function)dlsym(so->dlh, "dssi_descriptor");
+        if (descfn) {
+            so->is_DSSI_so = 1;
+        } else {
+            descfn = (DSSI_Descriptor_Function)dlsym(so->dlh, "ladspa_descriptor");
+            if (!descfn) {
+                GDB_MESSAGE(GDB_PLUGIN, ": %s is not a DSSI or LADSPA plugin library\n", soname);
+                goto fail;
+            }
+            so->is_DSSI_so = 0;
         }
-        plugin_is_DSSI_so = 0;
-    }
 
-    /* get the plugin descriptor */
-    i = 0;
-    if (plugin_is_DSSI_so) {
-        const DSSI_Descriptor *desc;
+        /* get the plugin descriptor */
+        i = 0;
+        if (so->is_DSSI_so) {
+            const DSSI_Descriptor *desc;
 
-        while ((desc = plugin_descfn(i++))) {
-            if (!strcmp(desc->LADSPA_Plugin->Label, label)) {
-                plugin_descriptor = desc;
-                break;
+            while ((desc = descfn(i++))) {
+                if (!strcmp(desc->LADSPA_Plugin->Label, label)) {
+                    so->descriptor = desc;
+                    break;
+                }
             }
-        }
-    } else { /* LADSPA plugin; create and use a dummy DSSI descriptor */
-        LADSPA_Descriptor *desc;
+        } else { /* LADSPA plugin; create and use a dummy DSSI descriptor */
+            LADSPA_Descriptor *desc;
+            DSSI_Descriptor *dummy;
 
-        plugin_descriptor = (const DSSI_Descriptor *)calloc(1, sizeof(DSSI_Descriptor));
-        ((DSSI_Descriptor *)plugin_descriptor)->DSSI_API_Version = 1;
+            dummy = (DSSI_Descriptor *)calloc(1, sizeof(DSSI_Descriptor));
+            dummy->DSSI_API_Version = 1;
 
-        while ((desc = (LADSPA_Descriptor *)plugin_descfn(i++))) {
-            if (!strcmp(desc->Label, label)) {
-                ((DSSI_Descriptor *)plugin_descriptor)->LADSPA_Plugin = desc;
-                break;
+            while ((desc = (LADSPA_Descriptor *)descfn(i++))) {
+                if (!strcmp(desc->Label, label)) {
+                    dummy->LADSPA_Plugin = desc;
+                    break;
+                }
             }
-        }
-        if (!plugin_descriptor->LADSPA_Plugin) {
-            free((void *)plugin_descriptor);
-            plugin_descriptor = NULL;
+            if (dummy->LADSPA_Plugin)
+                so->descriptor = dummy;
+            else
+                free(dummy);
         }
     }
-    if (!plugin_descriptor) {
+    if (!so->descriptor) {
         GDB_MESSAGE(GDB_PLUGIN, ": plugin label '%s' not found in library '%s'\n",
                     label, soname);
-        return 0;
+        goto fail;
     }
 
-    return 1;
+    so->references = 1;
+    so->next = plugin_sos;
+    plugin_sos = so;
+    return so;
+
+  fail:
+    if (so->dlh)
+        dlclose(so->dlh);
+    g_free(so->path);
+    free(so->label);
+    free(so);
+    return NULL;
+}
+
+void
+unload_so(plugin_so_t *so)
+{
+    plugin_so_t **prev;
+
+    if (--so->references > 0)
+        return;
+
+    for (prev = &plugin_sos; *prev != so; prev = &(*prev)->next);
+    *prev = so->next;
+
+    dlclose(so->dlh);
+    if (!so->is_DSSI_so)
+        free((void *)so->descriptor);
+    g_free(so->path);
+    free(so->label);
+    free(so);
+}
+
+/* ==== instance windows ==== */
+
+char *ui_path;  /* argv[0] */
+
+/* Create the window for a plugin instance, given the host's OSC URL for
+ * the instance, and start talking to the host about it. */
+ugui_t *
+ugui_new(const char *host_url, const char *soname, const char *label,
+         const char *instance_tag)
+{
+    ugui_t *ugui;
+    plugin_so_t *so;
+    char *path;
+
+    if (!(so = load_so(ui_path, soname, label))) {
+        fprintf(stderr, "ghostess uniGUI: can't load plugin %s:%s for UI %s\n", soname, label, ui_path);
+        return NULL;
+    }
+    /* GDB_MESSAGE(GDB_PLUGIN, ": plugin has %lu ports\n", so->descriptor->LADSPA_Plugin->PortCount); */
+
+    ugui = (ugui_t *)calloc(1, sizeof(ugui_t));
+    ugui->so = so;
+    ugui->descriptor = so->descriptor;
+    ugui->test_note_noteon_key = 60;
+    ugui->test_note_noteoff_key = -1;
+    ugui->test_note_velocity = 96;
+
+    path = lo_url_get_path(host_url);
+    ugui->osc_path = path;
+    ugui->osc_configure_path = osc_build_path(path, "/configure");
+    ugui->osc_control_path   = osc_build_path(path, "/control");
+    ugui->osc_exiting_path   = osc_build_path(path, "/exiting");
+    ugui->osc_hide_path      = osc_build_path(path, "/hide");
+    ugui->osc_midi_path      = osc_build_path(path, "/midi");
+    ugui->osc_program_path   = osc_build_path(path, "/program");
+    ugui->osc_quit_path      = osc_build_path(path, "/quit");
+    ugui->osc_rate_path      = osc_build_path(path, "/sample-rate");
+    ugui->osc_show_path      = osc_build_path(path, "/show");
+    ugui->osc_update_path    = osc_build_path(path, "/update");
+
+    /* the catch-all debug handler must stay last */
+    lo_server_del_method(osc_server, NULL, NULL);
+    lo_server_add_method(osc_server, ugui->osc_configure_path, "ss", osc_configure_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_control_path, "if", osc_control_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_hide_path, "", osc_hide_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_program_path, "ii", osc_program_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_quit_path, "", osc_quit_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_rate_path, "i", osc_rate_handler, ugui);
+    lo_server_add_method(osc_server, ugui->osc_show_path, "", osc_show_handler, ugui);
+    lo_server_add_method(osc_server, NULL, NULL, osc_debug_handler, NULL);
+
+    if (osc_proto == LO_UNIX) /* no trailing slash after the socket path */
+        ugui->osc_self_url = osc_build_path(osc_server_url, path);
+    else
+        ugui->osc_self_url = osc_build_path(osc_server_url, (strlen(path) > 1 ? path + 1 : path));
+    GDB_MESSAGE(GDB_OSC, ": listening for %s at %s\n", path, ugui->osc_self_url);
+
+    /* set up GTK+ */
+    create_windows(ugui, instance_tag, soname, label);
+
+    ugui->next = uguis;
+    uguis = ugui;
+
+    /* schedule our initial update request */
+    schedule_update_request(ugui);
+
+    return ugui;
+}
+
+void
+ugui_free(ugui_t *ugui)
+{
+    ugui_t **prev;
+
+    for (prev = &uguis; *prev != ugui; prev = &(*prev)->next);
+    *prev = ugui->next;
+
+    /* release test note, if playing */
+    release_test_note(ugui);
+
+    if (ugui->update_request_timeout_active)
+        gtk_timeout_remove(ugui->update_request_timeout_tag);
+    if (ugui->control_flush_timeout_active)
+        gtk_timeout_remove(ugui->control_flush_timeout_tag);
+
+    /* say bye-bye */
+    if (!ugui->host_requested_quit && !host_requested_quit) {
+        lo_send(osc_host_address, ugui->osc_exiting_path, "");
+    }
+
+    lo_server_del_method(osc_server, ugui->osc_configure_path, "ss");
+    lo_server_del_method(osc_server, ugui->osc_control_path, "if");
+    lo_server_del_method(osc_server, ugui->osc_hide_path, "");
+    lo_server_del_method(osc_server, ugui->osc_program_path, "ii");
+    lo_server_del_method(osc_server, ugui->osc_quit_path, "");
+    lo_server_del_method(osc_server, ugui->osc_rate_path, "i");
+    lo_server_del_method(osc_server, ugui->osc_show_path, "");
+
+    if (shared)
+        gtk_widget_destroy(ugui->main_window);
+
+    free(ugui->osc_path);
+    free(ugui->osc_configure_path);
+    free(ugui->osc_control_path);
+    free(ugui->osc_exiting_path);
+    free(ugui->osc_hide_path);
+    free(ugui->osc_midi_path);
+    free(ugui->osc_program_path);
+    free(ugui->osc_quit_path);
+    free(ugui->osc_rate_path);
+    free(ugui->osc_show_path);
+    free(ugui->osc_update_path);
+    free(ugui->osc_self_url);
+    free(ugui->port_data);
+    free(ugui->port_view);
+    free(ugui->dirty_ports);
+
+    unload_so(ugui->so);
+    free(ugui);
+}
+
+static gboolean
+ugui_close_idle_callback(gpointer data)
+{
+    ugui_free((ugui_t *)data);
+
+    return FALSE;
+}
+
+/* Close an instance's window, at the user's or host's request.  On its
+ * own, the GUI exits; shared, it carries on with its other windows (or
+ * none), ready for the next '/ghostess/gui/open'.  This may be called
+ * from an OSC handler, which mustn't delete its own method, so the
+ * window is freed when idle. */
+void
+ugui_close(ugui_t *ugui)
+{
+    if (!shared) {
+        gtk_main_quit();
+    } else if (!ugui->closing) {
+        ugui->closing = 1;
+        gtk_widget_hide(ugui->main_window);
+        g_idle_add(ugui_close_idle_callback, ugui);
+    }
+}
+
+/* '/ghostess/gui/open <osc url> <plugin dllname> <plugin label> <user-friendly id>' */
+int
+osc_open_handler(const char *path, const char *types, lo_arg **argv,
+                 int argc, lo_message msg, void *user_data)
+{
+    GDB_MESSAGE(GDB_OSC, " osc_open_handler: opening window for %s\n", &argv[0]->s);
+
+    ugui_new(&argv[0]->s, &argv[1]->s, &argv[2]->s, &argv[3]->s);
+
+    return 0;
+}
+
+/* '/ghostess/gui/quit': the host is done with us */
+int
+osc_shared_quit_handler(const char *path, const char *types, lo_arg **argv,
+                        int argc, lo_message msg, void *user_data)
+{
+    host_requested_quit = 1;
+    gtk_main_quit();
+
+    return 0;
 }
 
 /* ==== main ==== */
@@ -1293,9 +1847,9 @@ load_so(char *ui_path, char *soname, char *label)
 int
 main(int argc, char *argv[])
 {
-    char *host, *port, *path, *tmp_url;
-    lo_server osc_server;
+    char *host, *port;
     gint osc_server_socket_tag;
+    gint osc_forward_pipe_tag = 0;
 
     DSSP_DEBUG_INIT("ghostess uniGUI");
 
@@ -1308,52 +1862,71 @@ main(int argc, char *argv[])
     
     gtk_init(&argc, &argv);
 
-    if (argc != 5) {
-        fprintf(stderr, "usage: %s <osc url> <plugin dllname> <plugin label> <user-friendly id>\n", argv[0]);
-        exit(1);
+    ui_path = argv[0];
+    if (argc > 1 && !strcmp(argv[1], "-shared")) {
+        shared = 1;
+        argc--;
+        argv++;
     }
-
-    /* load and analyze plugin */
-    if (!load_so(argv[0], argv[2], argv[3])) {
-        fprintf(stderr, "ghostess uniGUI fatal: can't load plugin %s:%s for UI %s\n", argv[2], argv[3], argv[0]);
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s [-shared] <osc url> <plugin dllname> <plugin label> <user-friendly id>\n", ui_path);
         exit(1);
     }
-    /* GDB_MESSAGE(GDB_PLUGIN, ": plugin has %lu ports\n", plugin_descriptor->LADSPA_Plugin->PortCount); */
 
     /* set up OSC support */
     osc_host_url = argv[1];
     host = lo_url_get_hostname(osc_host_url);
     port = lo_url_get_port(osc_host_url);
-    path = lo_url_get_path(osc_host_url);
-    osc_host_address = lo_address_new(host, port);
-    osc_configure_path = osc_build_path(path, "/configure");
-    osc_control_path   = osc_build_path(path, "/control");
-    osc_exiting_path   = osc_build_path(path, "/exiting");
-    osc_hide_path      = osc_build_path(path, "/hide");
-    osc_midi_path      = osc_build_path(path, "/midi");
-    osc_program_path   = osc_build_path(path, "/program");
-    osc_quit_path      = osc_build_path(path, "/quit");
-    osc_rate_path      = osc_build_path(path, "/sample-rate");
-    osc_show_path      = osc_build_path(path, "/show");
-    osc_update_path    = osc_build_path(path, "/update");
-
-    osc_server = lo_server_new(NULL, osc_error);
-    lo_server_add_method(osc_server, osc_configure_path, "ss", osc_configure_handler, NULL);
-    lo_server_add_method(osc_server, osc_control_path, "if", osc_control_handler, NULL);
-    lo_server_add_method(osc_server, osc_hide_path, "", osc_action_handler, "hide");
-    lo_server_add_method(osc_server, osc_program_path, "ii", osc_program_handler, NULL);
-    lo_server_add_method(osc_server, osc_quit_path, "", osc_action_handler, "quit");
-    lo_server_add_method(osc_server, osc_rate_path, "i", osc_action_handler, "sample-rate");
-    lo_server_add_method(osc_server, osc_show_path, "", osc_action_handler, "show");
-    lo_server_add_method(osc_server, NULL, NULL, osc_debug_handler, NULL);
+    /* If ghostess gave us a local (UNIX socket or TCP) URL, talk to it that
+     * way, but still take our OSC path from the standard UDP URL. */
+    osc_host_local_url = getenv("GHOSTESS_OSC_LOCAL_URL");
+    if (osc_host_local_url) {
+        osc_proto = lo_url_get_protocol_id(osc_host_local_url);
+        if (osc_proto != LO_UNIX && osc_proto != LO_TCP)
+            osc_host_local_url = NULL;
+    }
+    if (osc_host_local_url) {
+        GDB_MESSAGE(GDB_OSC, ": using local host URL %s\n", osc_host_local_url);
+        osc_host_address = lo_address_new_from_url(osc_host_local_url);
+    } else {
+        osc_proto = LO_UDP;
+        osc_host_address = lo_address_new(host, port);
+    }
 
-    tmp_url = lo_server_get_url(osc_server);
-    osc_self_url = osc_build_path(tmp_url, (strlen(path) > 1 ? path + 1 : path));
-    free(tmp_url);
-    GDB_MESSAGE(GDB_OSC, ": listening at %s\n", osc_self_url);
+    if (osc_proto == LO_UNIX) {
+        osc_self_socket = (char *)malloc(strlen(osc_host_local_url) + 16);
+        sprintf(osc_self_socket, "%s-gui%d", osc_host_local_url + 11, getpid()); /* skip "osc.unix://" */
+        osc_server = lo_server_new_with_proto(osc_self_socket, LO_UNIX, osc_error);
+    } else if (osc_proto == LO_TCP) {
+        osc_server = lo_server_new_with_proto(NULL, LO_UDP, osc_error);
+        if (pipe(osc_forward_pipe) ||
+            !(osc_tcp_thread = lo_server_thread_new_with_proto(NULL, LO_TCP, osc_error))) {
+            fprintf(stderr, "ghostess uniGUI fatal: could not create OSC TCP server\n");
+            exit(1);
+        }
+        lo_server_thread_add_method(osc_tcp_thread, NULL, NULL, osc_forward_handler, NULL);
+    } else {
+        osc_server = lo_server_new_with_proto(NULL, osc_proto, osc_error);
+    }
+    if (!osc_server) {
+        fprintf(stderr, "ghostess uniGUI fatal: could not create OSC server\n");
+        exit(1);
+    }
+    if (osc_tcp_thread)
+        osc_server_url = lo_server_thread_get_url(osc_tcp_thread);
+    else
+        osc_server_url = lo_server_get_url(osc_server);
+    if (shared) {
+        lo_server_add_method(osc_server, "/ghostess/gui/open", "ssss", osc_open_handler, NULL);
+        lo_server_add_method(osc_server, "/ghostess/gui/quit", "", osc_shared_quit_handler, NULL);
+    }
+    lo_server_add_method(osc_server, NULL, NULL, osc_debug_handler, NULL);
 
-    /* set up GTK+ */
-    create_windows(argv[4], argv[2], argv[3]);
+    /* load the plugin and create the first (or only) window */
+    if (!ugui_new(argv[1], argv[2], argv[3], argv[4])) {
+        fprintf(stderr, "ghostess uniGUI fatal: can't load plugin %s:%s for UI %s\n", argv[2], argv[3], ui_path);
+        exit(1);
+    }
 
     /* add OSC server socket to GTK+'s watched I/O */
     if (lo_server_get_socket_fd(osc_server) < 0) {
@@ -1364,9 +1937,17 @@ main(int argc, char *argv[])
                                           GDK_INPUT_READ,
                                           osc_data_on_socket_callback,
                                           osc_server);
+    if (osc_tcp_thread) {
+        osc_forward_pipe_tag = gdk_input_add(osc_forward_pipe[0],
+                                             GDK_INPUT_READ,
+                                             osc_data_on_pipe_callback,
+                                             NULL);
+        lo_server_thread_start(osc_tcp_thread);
+    }
 
-    /* schedule our initial update request */
-    schedule_update_request();
+    /* tell the host where to send '/ghostess/gui/open' */
+    if (shared)
+        lo_send(osc_host_address, "/ghostess/gui/hello", "s", osc_server_url);
 
     /* let GTK+ take it from here */
     gtk_main();
@@ -1374,42 +1955,31 @@ main(int argc, char *argv[])
     /* clean up and exit */
     GDB_MESSAGE(GDB_MAIN, ": yep, we got to the cleanup!\n");
 
-    /* release test note, if playing */
-    release_test_note();
+    while (uguis)
+        ugui_free(uguis);
+    if (shared && !host_requested_quit)
+        lo_send(osc_host_address, "/ghostess/gui/bye", "");
 
     /* GTK+ cleanup */
-    gtk_timeout_remove(update_request_timeout_tag);
     gdk_input_remove(osc_server_socket_tag);
-
-    /* say bye-bye */
-    if (!host_requested_quit) {
-        lo_send(osc_host_address, osc_exiting_path, "");
-    }
+    if (osc_forward_pipe_tag)
+        gdk_input_remove(osc_forward_pipe_tag);
 
     /* clean up OSC support */
+    if (osc_tcp_thread) {
+        lo_server_thread_stop(osc_tcp_thread);
+        lo_server_thread_free(osc_tcp_thread);
+        close(osc_forward_pipe[0]);
+        close(osc_forward_pipe[1]);
+    }
     lo_server_free(osc_server);
+    if (osc_self_socket) {
+        unlink(osc_self_socket);
+        free(osc_self_socket);
+    }
+    free(osc_server_url);
     free(host);
     free(port);
-    free(path);
-    free(osc_configure_path);
-    free(osc_control_path);
-    free(osc_exiting_path);
-    free(osc_hide_path);
-    free(osc_midi_path);
-    free(osc_program_path);
-    free(osc_quit_path);
-    free(osc_rate_path);
-    free(osc_show_path);
-    free(osc_update_path);
-    free(osc_self_url);
-
-    /* clean up plugin */
-    dlclose(plugin_dlh);
-    free(plugin_path);
-    if (!plugin_is_DSSI_so) {
-        free((void *)plugin_descriptor);
-    }
-    free(port_data);
 
     return 0;
 }
@@ -71,11 +71,89 @@ struct _port_data_t {
     int         by_sample_rate;
     LADSPA_Data LowerBound;
     LADSPA_Data UpperBound;
-    GtkObject  *adjustment;
+    LADSPA_Data value;       /* last value sent or received, kept even */
+    int         have_value;  /*   while the port has no widget          */
+    int         dirty;       /* value awaits the next control flush */
+    GtkObject  *adjustment;  /* adjustment and widgets are NULL unless */
+                             /*   the port is on the current page      */
     GtkWidget  *widget;
     GtkWidget  *lower_label;
     GtkWidget  *upper_label;
 };
 
+typedef struct _plugin_so_t plugin_so_t;
+
+/* a plugin library and label loaded for one or more windows */
+struct _plugin_so_t {
+    plugin_so_t   *next;
+    char          *path;
+    char          *label;
+    int            references;
+    void          *dlh;
+    int            is_DSSI_so;
+    const DSSI_Descriptor *
+                   descriptor;
+};
+
+typedef struct _ugui_t ugui_t;
+
+/* the window, and the OSC conversation with the host, for one plugin
+ * instance -- with '-shared', one process may have many of these */
+struct _ugui_t {
+    ugui_t        *next;
+    plugin_so_t   *so;
+    const DSSI_Descriptor *
+                   descriptor;     /* so->descriptor */
+
+    char          *osc_path;       /* the instance's path on the host, e.g. '/dssi/foo' */
+    char          *osc_self_url;
+    char          *osc_configure_path;
+    char          *osc_control_path;
+    char          *osc_exiting_path;
+    char          *osc_hide_path;
+    char          *osc_midi_path;
+    char          *osc_program_path;
+    char          *osc_quit_path;
+    char          *osc_rate_path;
+    char          *osc_show_path;
+    char          *osc_update_path;
+
+    gint           update_request_timeout_tag;
+    int            update_request_timeout_active;
+    int            update_request_awaiting_program_change;
+
+    gint           control_flush_timeout_tag;
+    int            control_flush_timeout_active;
+    int           *dirty_ports;    /* ports with 'dirty' set, in arrival order */
+    int            dirty_port_count;
+
+    GtkWidget     *main_window;
+    GtkObject     *bank_spin_adj;
+    GtkObject     *program_spin_adj;
+    GtkWidget     *test_note_button;
+    GtkWidget     *test_note_toggle;
+
+    unsigned char  test_note_noteon_key;
+    int            test_note_noteoff_key;
+    unsigned char  test_note_velocity;
+
+    int            host_requested_quit;
+    int            closing;
+    unsigned long  sample_rate;
+
+    port_data_t   *port_data;
+
+    /* the port view: only the ports on the current page have widgets */
+    GtkWidget     *port_container;
+    GtkWidget     *port_table;
+    GtkWidget     *port_filter_entry;
+    GtkWidget     *port_page_label;
+    GtkWidget     *port_prev_button;
+    GtkWidget     *port_next_button;
+    int           *port_view;      /* ports whose names match the filter */
+    int            port_view_count;
+    int            port_page;
+};
+
 #endif /* _UNIVERSAL_GUI_H */
 
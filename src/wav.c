@@ -0,0 +1,137 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "wav.h"
+
+#define WAVE_FORMAT_IEEE_FLOAT  3
+#define WAV_HEADER_SIZE         58   /* RIFF, fmt (18 bytes), fact, data headers */
+#define WAV_WRITE_FRAMES        1024 /* interleave this many frames at a time */
+
+struct _wav_writer_t {
+    FILE          *fp;
+    int            channels;
+    unsigned long  sample_rate;
+    unsigned long  frames;
+    unsigned char *buffer;           /* interleaved, little-endian */
+};
+
+static void
+put_le(unsigned char *p, unsigned long value, int bytes)
+{
+    while (bytes--) {
+        *p++ = value & 0xff;
+        value >>= 8;
+    }
+}
+
+static int
+write_header(wav_writer_t *w)
+{
+    unsigned char h[WAV_HEADER_SIZE];
+    unsigned long data_bytes = w->frames * w->channels * 4;
+
+    memcpy(h, "RIFF", 4);
+    put_le(h + 4, WAV_HEADER_SIZE - 8 + data_bytes, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 18, 4);
+    put_le(h + 20, WAVE_FORMAT_IEEE_FLOAT, 2);
+    put_le(h + 22, w->channels, 2);
+    put_le(h + 24, w->sample_rate, 4);
+    put_le(h + 28, w->sample_rate * w->channels * 4, 4);
+    put_le(h + 32, w->channels * 4, 2);
+    put_le(h + 34, 32, 2);
+    put_le(h + 36, 0, 2);
+    memcpy(h + 38, "fact", 4);
+    put_le(h + 42, 4, 4);
+    put_le(h + 46, w->frames, 4);
+    memcpy(h + 50, "data", 4);
+    put_le(h + 54, data_bytes, 4);
+
+    return (fwrite(h, 1, WAV_HEADER_SIZE, w->fp) == WAV_HEADER_SIZE);
+}
+
+wav_writer_t *
+wav_writer_open(const char *filename, int channels, unsigned long sample_rate)
+{
+    wav_writer_t *w = (wav_writer_t *)calloc(1, sizeof(wav_writer_t));
+
+    if (!w)
+        return NULL;
+    w->channels = channels;
+    w->sample_rate = sample_rate;
+    w->buffer = (unsigned char *)malloc(WAV_WRITE_FRAMES * channels * 4);
+    if (!w->buffer || (w->fp = fopen(filename, "wb")) == NULL ||
+        !write_header(w)) {
+        if (w->fp) fclose(w->fp);
+        free(w->buffer);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int
+wav_writer_write(wav_writer_t *w, float **buffers, unsigned long nframes)
+{
+    unsigned long done, n, i;
+    unsigned char *p;
+    union { float f; uint32_t u; } sample;
+    int c;
+
+    for (done = 0; done < nframes; done += n) {
+        n = nframes - done;
+        if (n > WAV_WRITE_FRAMES)
+            n = WAV_WRITE_FRAMES;
+        p = w->buffer;
+        for (i = 0; i < n; i++) {
+            for (c = 0; c < w->channels; c++) {
+                sample.f = buffers[c][done + i];
+                put_le(p, sample.u, 4);
+                p += 4;
+            }
+        }
+        if (fwrite(w->buffer, 4 * w->channels, n, w->fp) != n)
+            return 0;
+        w->frames += n;
+    }
+    return 1;
+}
+
+int
+wav_writer_close(wav_writer_t *w)
+{
+    int rc;
+
+    rc = (fseek(w->fp, 0, SEEK_SET) == 0 && write_header(w));
+    if (fclose(w->fp))
+        rc = 0;
+    free(w->buffer);
+    free(w);
+    return rc;
+}
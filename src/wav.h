@@ -0,0 +1,40 @@
+/* ghostess - A GUI host for DSSI plugins.
+ *
+ * Copyright (C) 2021 Sean Bolton and others.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _WAV_H
+#define _WAV_H
+
+/* Streaming writer for 32-bit floating point WAV files.  The header is
+ * written with zero lengths on open, and fixed up on close. */
+
+typedef struct _wav_writer_t wav_writer_t;
+
+wav_writer_t *wav_writer_open(const char *filename, int channels,
+                              unsigned long sample_rate);
+
+/* Write 'nframes' frames from 'channels' separate buffers, interleaving
+ * them.  Returns 0 on error. */
+int           wav_writer_write(wav_writer_t *writer, float **buffers,
+                               unsigned long nframes);
+
+/* Fix up the header and close the file.  Returns 0 on error. */
+int           wav_writer_close(wav_writer_t *writer);
+
+#endif /* _WAV_H */